@@ -55,6 +55,7 @@
 #include "SNAPRegistryIO.h"
 #include "HistoryManager.h"
 #include "UIReporterDelegates.h"
+#include "GuidedNativeImageIO.h"
 #include <itksys/Directory.hxx>
 #include <itksys/SystemTools.hxx>
 #include "itkVoxBoCUBImageIOFactory.h"
@@ -178,6 +179,12 @@ SystemInterface
 
   // Set the preferences file
   m_UserPreferenceFile = appdir + "/UserPreferences.xml";
+
+  // Keep the DICOM directory indices with the application data. If the
+  // directory cannot be created, DICOM directories are parsed without an index
+  std::string dicomdir = appdir + "/DicomIndex";
+  if(itksys::SystemTools::MakeDirectory(dicomdir.c_str()))
+    GuidedNativeImageIO::SetDICOMIndexDirectory(dicomdir);
 }
 
 SystemInterface
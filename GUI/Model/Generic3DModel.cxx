@@ -42,6 +42,11 @@ Generic3DModel::Generic3DModel()
 
   // Reset clear time
   m_ClearTime = 0;
+
+  // No mesh update is running
+  m_MeshUpdating = false;
+  m_MeshUpdateSourceTime = 0;
+  m_RenderedMeshTime = 0;
 }
 
 #include "itkImage.h"
@@ -217,28 +222,44 @@ void Generic3DModel::OnImageGeometryUpdate()
 
 #include "itkMutexLockHolder.h"
 
-void Generic3DModel::UpdateSegmentationMesh(itk::Command *callback)
+// Sets a flag while in scope, and clears it however the scope is left
+class Generic3DModelFlagHolder
+{
+public:
+  Generic3DModelFlagHolder(bool &flag) : m_Flag(flag) { m_Flag = true; }
+  ~Generic3DModelFlagHolder() { m_Flag = false; }
+private:
+  bool &m_Flag;
+};
+
+void Generic3DModel::PrepareSegmentationMeshUpdate(bool continuous)
+{
+  // Prevent concurrent access to this method and mesh update
+  itk::MutexLockHolder<itk::SimpleFastMutexLock> mholder(m_MutexLock);
+
+  // Remember which version of the image the meshes are generated from
+  m_MeshUpdateSourceTime = m_Driver->GetMeshManager()->GetSourceTime();
+  m_Driver->GetMeshManager()->PrepareUpdate(!continuous);
+}
+
+void Generic3DModel::UpdateSegmentationMesh(itk::Command *callback, bool prepared)
 {
   // Prevent concurrent access to this method
   itk::MutexLockHolder<itk::SimpleFastMutexLock> mholder(m_MutexLock);
 
+  // The flag is cleared whether the update succeeds or fails
+  Generic3DModelFlagHolder updating(m_MeshUpdating);
+
   try
   {
     // Generate all the mesh objects
-    m_MeshUpdating = true;
-    m_Driver->GetMeshManager()->UpdateVTKMeshes(callback);
-    m_MeshUpdating = false;
-
+    m_Driver->GetMeshManager()->UpdateVTKMeshes(callback, prepared);
     InvokeEvent(ModelUpdateEvent());
   }
   catch(std::bad_alloc &)
   {
     throw IRISException("Out of memory during mesh computation");
   }
-  catch(IRISException & IRISexc)
-  {
-    throw IRISexc;
-  }
 }
 
 bool Generic3DModel::IsMeshUpdating()
@@ -246,6 +267,31 @@ bool Generic3DModel::IsMeshUpdating()
   return m_MeshUpdating;
 }
 
+bool Generic3DModel::IsMeshUpdateStale()
+{
+  return m_MeshUpdating
+      && m_Driver->GetMeshManager()->GetSourceTime() > m_MeshUpdateSourceTime;
+}
+
+void Generic3DModel::AbortMeshUpdate()
+{
+  m_Driver->GetMeshManager()->AbortUpdate();
+}
+
+bool Generic3DModel::UpdateRenderedMeshes()
+{
+  // Meshes are only published one by one for the segmentation. The level set
+  // mesh is shown when its update is finished
+  itk::ModifiedTimeType t = m_Driver->GetMeshManager()->GetMeshCollectionTime();
+  if(t == m_RenderedMeshTime
+     || (m_MeshUpdating && m_Driver->IsSnakeModeLevelSetActive()))
+    return false;
+
+  m_RenderedMeshTime = t;
+  m_Renderer->UpdateSegmentationMeshAssembly();
+  return true;
+}
+
 bool Generic3DModel::AcceptAction()
 {
   ToolbarMode3DType mode = m_ParentUI->GetGlobalState()->GetToolbarMode3D();
@@ -59,15 +59,34 @@ public:
   bool CheckState(UIState state);
 
   // A flag indicating that the mesh should be continually updated
-  // TODO: replace this with an update in a background thread
   irisSimplePropertyAccessMacro(ContinuousUpdate, bool)
 
-  // Tell the model to update the segmentation mesh
-  void UpdateSegmentationMesh(itk::Command *callback);
+  // Capture the state of the segmentation that the mesh update depends on.
+  // This is called from the GUI thread before the update is started in
+  // another thread. The meshes computed by continuous updates are not
+  // stored in the mesh cache
+  void PrepareSegmentationMeshUpdate(bool continuous = false);
+
+  // Tell the model to update the segmentation mesh. If prepared is true, the
+  // state captured by PrepareSegmentationMeshUpdate() is used, and this can
+  // be called from another thread
+  void UpdateSegmentationMesh(itk::Command *callback, bool prepared = false);
 
   // Reentrant function to check if mesh is being constructed in another thread
   bool IsMeshUpdating();
 
+  // Check if the segmentation has changed since the mesh update running in
+  // another thread started, so that its result will already be out of date
+  bool IsMeshUpdateStale();
+
+  // Ask the mesh update running in another thread to stop early
+  void AbortMeshUpdate();
+
+  // Pass the meshes completed since the last call to the renderer. Returns
+  // true if there were any. This is called from the GUI thread while the
+  // meshes are updated in the background
+  bool UpdateRenderedMeshes();
+
   // Accept the current drawing operation
   bool AcceptAction();
 
@@ -162,6 +181,12 @@ protected:
   // Is the mesh updating
   bool m_MeshUpdating;
 
+  // MTime of the source image when the running mesh update started
+  itk::ModifiedTimeType m_MeshUpdateSourceTime;
+
+  // Time of the mesh collection last passed to the renderer
+  itk::ModifiedTimeType m_RenderedMeshTime;
+
   // Time of the last mesh clear operation
   unsigned long m_ClearTime;
 
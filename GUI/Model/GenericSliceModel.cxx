@@ -1039,3 +1039,15 @@ ImageWrapperBase *GenericSliceModel::GetLayerForNthTile(int row, int col)
 
   return NULL;
 }
+
+void GenericSliceModel::PrefetchDisplaySlices()
+{
+  if(!m_SliceInitialized)
+    return;
+
+  for(LayerIterator it(this->GetImageData()); !it.IsAtEnd(); ++it)
+    {
+    if(it.GetLayer() && it.GetLayer()->IsInitialized())
+      it.GetLayer()->PrefetchDisplaySlices(m_Id);
+    }
+}
@@ -382,6 +382,13 @@ public:
   unsigned int MergeSliceSegmentation(
         itk::Image<unsigned char, 2> *drawing);
 
+  /**
+    Compute the display slices adjacent to the current slice for all layers,
+    in the direction in which the user has been scrolling, so that they can
+    be shown without delay. This should be called when the GUI is idle.
+   */
+  void PrefetchDisplaySlices();
+
 
 protected:
 
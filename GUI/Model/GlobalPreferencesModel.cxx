@@ -4,6 +4,7 @@
 #include "GlobalUIModel.h"
 #include "GlobalState.h"
 #include "DefaultBehaviorSettings.h"
+#include "GuidedNativeImageIO.h"
 
 GlobalPreferencesModel::GlobalPreferencesModel()
 {
@@ -160,6 +161,9 @@ void GlobalPreferencesModel::ApplyPreferences()
 
   // Default behaviors
   gs->GetDefaultBehaviorSettings()->DeepCopy(m_DefaultBehaviorSettings);
+  GuidedNativeImageIO::SetUseMemoryMapping(m_DefaultBehaviorSettings->GetMemoryMapImageFiles());
+  GuidedNativeImageIO::SetDICOMReadThreads(m_DefaultBehaviorSettings->GetDICOMReadThreads());
+  GuidedNativeImageIO::SetGzipThreads(m_DefaultBehaviorSettings->GetGzipThreads());
 
   // Global display prefs
   m_ParentModel->SetGlobalDisplaySettings(m_GlobalDisplaySettings);
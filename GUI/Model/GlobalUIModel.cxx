@@ -71,6 +71,7 @@
 #include "RegistrationModel.h"
 #include "InteractiveRegistrationModel.h"
 #include "DistributedSegmentationModel.h"
+#include "DisplaySliceCacheFilter.h"
 
 #include <itksys/SystemTools.hxx>
 
@@ -462,6 +463,12 @@ void GlobalUIModel::SetGlobalDisplaySettings(
   // Update the global display settings
   m_GlobalDisplaySettings->DeepCopy(settings);
 
+  // Update the limits on display slice caching
+  DisplaySliceCacheFilter::SetGlobalMaximumCacheSize(
+        ((size_t) settings->GetSliceCacheSizeInMB()) << 20);
+  DisplaySliceCacheFilter::SetGlobalPrefetchCount(
+        (unsigned int) settings->GetSlicePrefetchCount());
+
   // Update the RAI codes in all slice views
   m_Driver->SetDisplayGeometry(IRISDisplayGeometry(raiNew[0], raiNew[1], raiNew[2]));
 
@@ -539,6 +546,9 @@ void GlobalUIModel::LoadUserPreferences()
   m_SynchronizationModel->SetSyncPan(dbs->GetSyncPan());
   m_Model3D->SetContinuousUpdate(dbs->GetContinuousMeshUpdate());
   m_Driver->GetGlobalState()->SetSliceViewLayerLayout(dbs->GetOverlayLayout());
+  GuidedNativeImageIO::SetUseMemoryMapping(dbs->GetMemoryMapImageFiles());
+  GuidedNativeImageIO::SetDICOMReadThreads(dbs->GetDICOMReadThreads());
+  GuidedNativeImageIO::SetGzipThreads(dbs->GetGzipThreads());
 
   // Read the Polygon properties
   m_PolygonSettingsModel->LoadFromRegistry(
@@ -36,6 +36,39 @@ private:
   TLabel m_Label;
 };
 
+/** Paint rule that replaces the segmentation by the interpolation */
+class InterpolateAllRule
+{
+public:
+  InterpolateAllRule(const SegmentationUpdateIterator *it) : m_Iterator(it) {}
+
+  LabelType operator() (LabelType lOld, LabelType lInterp) const
+  { return m_Iterator->RulePaintLabel(lOld, lInterp); }
+
+protected:
+  const SegmentationUpdateIterator *m_Iterator;
+};
+
+/** Paint rule that paints the interpolation of a single label */
+class InterpolateOneRule
+{
+public:
+  InterpolateOneRule(const SegmentationUpdateIterator *it,
+                     LabelType l_interp, LabelType l_replace)
+    : m_Iterator(it), m_Interp(l_interp), m_Replace(l_replace) {}
+
+  LabelType operator() (LabelType lOld, LabelType lInterp) const
+  {
+    return lInterp == m_Interp
+        ? m_Iterator->RulePaintLabelWithExtraProtection(lOld, m_Interp, m_Replace)
+        : lOld;
+  }
+
+protected:
+  const SegmentationUpdateIterator *m_Iterator;
+  LabelType m_Interp, m_Replace;
+};
+
 void InterpolateLabelModel::Interpolate()
 {
   // Get the segmentation wrapper
@@ -91,24 +124,20 @@ void InterpolateLabelModel::Interpolate()
   SegmentationUpdateIterator it_trg(liw->GetImage(), liw->GetImage()->GetBufferedRegion(),
                                     this->GetDrawingLabel(), this->GetDrawOverFilter());
 
-  itk::ImageRegionConstIterator<GenericImageData::LabelImageType>
-      it_src(mci->GetOutput(), mci->GetOutput()->GetBufferedRegion());
-
   // The way we paint back into the segmentation depends on whether all labels
-  // or a specific label are being interpolated
+  // or a specific label are being interpolated. The interpolation result is
+  // an RLE image, so this is done one run at a time.
+  GenericImageData::LabelImageType *src = mci->GetOutput();
   if(interp_all)
     {
     // Just replace the segmentation by the interpolation, respecting draw-over
-    for(; !it_trg.IsAtEnd(); ++it_trg, ++it_src)
-      it_trg.PaintLabel(it_src.Get());
+    InterpolateAllRule rule(&it_trg);
+    it_trg.PaintRunsWithSource(src, src->GetBufferedRegion(), rule);
     }
   else
     {
-    LabelType l_interp = this->GetInterpolateLabel();
-    LabelType l_replace = this->GetDrawingLabel();
-    for(; !it_trg.IsAtEnd(); ++it_trg, ++it_src)
-      if(it_src.Get() == l_interp)
-        it_trg.PaintLabelWithExtraProtection(l_interp, l_replace);
+    InterpolateOneRule rule(&it_trg, this->GetInterpolateLabel(), this->GetDrawingLabel());
+    it_trg.PaintRunsWithSource(src, src->GetBufferedRegion(), rule);
     }
 
   // Finish the segmentation editing and create an undo point
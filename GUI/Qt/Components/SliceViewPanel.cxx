@@ -36,6 +36,7 @@
 
 #include <QStackedLayout>
 #include <QMenu>
+#include <QTimer>
 
 SliceViewPanel::SliceViewPanel(QWidget *parent) :
     SNAPComponent(parent),
@@ -47,6 +48,13 @@ SliceViewPanel::SliceViewPanel(QWidget *parent) :
   m_GlobalUI = NULL;
   m_SliceModel = NULL;
 
+  // Slices are prefetched when the event loop becomes idle after the
+  // cursor has moved
+  m_PrefetchTimer = new QTimer(this);
+  m_PrefetchTimer->setSingleShot(true);
+  m_PrefetchTimer->setInterval(0);
+  connect(m_PrefetchTimer, SIGNAL(timeout()), this, SLOT(onPrefetchTimeout()));
+
   // Create my own renderers
   m_SnakeModeRenderer = SnakeModeRenderer::New();
   m_DecorationRenderer = SliceWindowDecorationRenderer::New();
@@ -301,6 +309,16 @@ void SliceViewPanel::onModelUpdate(const EventBucket &eb)
     UpdateExpandViewButton();
     }
   ui->sliceView->update();
+
+  // Once the new slice has been painted, compute the slices that follow it
+  if(eb.HasEvent(CursorUpdateEvent()))
+    m_PrefetchTimer->start();
+}
+
+void SliceViewPanel::onPrefetchTimeout()
+{
+  if(m_SliceModel)
+    m_SliceModel->PrefetchDisplaySlices();
 }
 
 void SliceViewPanel::on_inSlicePosition_valueChanged(int value)
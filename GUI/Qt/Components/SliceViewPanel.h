@@ -12,6 +12,7 @@ class SliceWindowDecorationRenderer;
 class GenericSliceModel;
 class QCursor;
 class QToolButton;
+class QTimer;
 
 namespace Ui {
     class SliceViewPanel;
@@ -77,6 +78,8 @@ private slots:
 
   void on_actionAnnotationPrevious_triggered();
 
+  void onPrefetchTimeout();
+
 private:
   Ui::SliceViewPanel *ui;
 
@@ -106,6 +109,9 @@ private:
   // Index of the panel
   unsigned int m_Index;
 
+  // Timer used to prefetch display slices once pending events are processed
+  QTimer *m_PrefetchTimer;
+
   void SetActiveMode(QWidget *mode, bool clearChildren = true);
 
   /**
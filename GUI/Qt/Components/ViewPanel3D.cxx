@@ -78,19 +78,10 @@ void ViewPanel3D::onModelUpdate(const EventBucket &bucket)
 
 void ViewPanel3D::on_btnUpdateMesh_clicked()
 {
-  try
-    {
-    // Tell the model to update itself
-    m_Model->UpdateSegmentationMesh(m_Model->GetParentUI()->GetProgressCommand());
-    // m_Model->UpdateSegmentationMesh(m_RenderProgressCommand);
-    }
-  catch(IRISException & IRISexc)
-    {
-    QMessageBox::warning(this, "Problem generating mesh", IRISexc.what());
-    }
-
-  // TODO: Delete this later - should be automatic!
-  ui->view3d->repaint();
+  // The meshes are built in the background, as with continuous update, and
+  // the timer shows them as they are completed
+  if(!m_RenderFuture.isRunning())
+    this->StartMeshUpdate(false);
 }
 
 void ViewPanel3D::Initialize(GlobalUIModel *globalUI)
@@ -142,13 +133,41 @@ void ViewPanel3D::UpdateExpandViewButton()
     }
 }
 
+void ViewPanel3D::StartMeshUpdate(bool continuous)
+{
+  // Make sure the model actually requires updating
+  if(!m_Model || !m_Model->CheckState(Generic3DModel::UIF_MESH_DIRTY))
+    return;
+
+  // The segmentation can be edited while the meshes are computed, so the
+  // state that the update depends on is captured here, in the GUI thread
+  m_Model->PrepareSegmentationMeshUpdate(continuous);
+
+  // Launch the worker thread
+  m_RenderProgressValue = 0;
+  m_RenderElapsedTicks = 0;
+  m_RenderFuture = QtConcurrent::run(this, &ViewPanel3D::UpdateMeshesInBackground);
+}
+
 // This method is run in a concurrent thread
 void ViewPanel3D::UpdateMeshesInBackground()
 {
-  // Make sure the model actually requires updating
-  if(m_Model && m_Model->CheckState(Generic3DModel::UIF_MESH_DIRTY))
+  try
+    {
+    m_Model->UpdateSegmentationMesh(m_RenderProgressCommand, true);
+    }
+  catch(std::exception &exc)
+    {
+    // The error is reported by the timer, in the GUI thread
+    m_RenderProgressMutex.lock();
+    m_RenderError = exc.what();
+    m_RenderProgressMutex.unlock();
+    }
+  catch(...)
     {
-    m_Model->UpdateSegmentationMesh(m_RenderProgressCommand);
+    m_RenderProgressMutex.lock();
+    m_RenderError = "Unknown error during mesh computation";
+    m_RenderProgressMutex.unlock();
     }
 }
 
@@ -198,14 +217,27 @@ void ViewPanel3D::onTimer()
 {
   if(!m_RenderFuture.isRunning())
     {
+    // If the last update failed, report it and stop updating continuously,
+    // since the next update would likely fail as well
+    m_RenderProgressMutex.lock();
+    QString error = m_RenderError;
+    m_RenderError.clear();
+    m_RenderProgressMutex.unlock();
+
+    if(!error.isEmpty())
+      {
+      ui->progressBar->setVisible(false);
+      ui->actionContinuous_Update->setChecked(false);
+      ui->btnUpdateMesh->setVisible(true);
+      QMessageBox::warning(this, "Problem generating mesh", error);
+      return;
+      }
+
     // Does work need to be done?
     if(m_Model && ui->actionContinuous_Update->isChecked()
        && m_Model->CheckState(Generic3DModel::UIF_MESH_DIRTY))
       {
-      // Launch the worker thread
-      m_RenderProgressValue = 0;
-      m_RenderElapsedTicks = 0;
-      m_RenderFuture = QtConcurrent::run(this, &ViewPanel3D::UpdateMeshesInBackground);
+      this->StartMeshUpdate(true);
       }
     else
       {
@@ -214,6 +246,11 @@ void ViewPanel3D::onTimer()
     }
   else
     {
+    // If the segmentation was edited after the update started, the update
+    // is stale. It is stopped, and a new one is started on a later tick
+    if(ui->actionContinuous_Update->isChecked() && m_Model->IsMeshUpdateStale())
+      m_Model->AbortMeshUpdate();
+
     // We only want to show progress after some minimum timeout (1 sec)
     if((++m_RenderElapsedTicks) > 10)
       {
@@ -224,6 +261,11 @@ void ViewPanel3D::onTimer()
       m_RenderProgressMutex.unlock();
       }
     }
+
+  // Show the meshes completed in the background so far. Until a mesh is
+  // replaced, its old version is shown
+  if(m_Model && m_Model->UpdateRenderedMeshes())
+    ui->view3d->repaint();
 }
 
 void ViewPanel3D::on_actionReset_Viewpoint_triggered()
@@ -94,11 +94,16 @@ private:
   // Elapsed time since begin of render operation
   int m_RenderElapsedTicks;
 
+  // Error message from the last background update, guarded by the mutex
+  QString m_RenderError;
+
   typedef itk::MemberCommand<ViewPanel3D> CommandType;
   SmartPtr<CommandType> m_RenderProgressCommand;
 
   void UpdateExpandViewButton();
 
+  void StartMeshUpdate(bool continuous);
+
   void UpdateMeshesInBackground();
 
   void UpdateActionButtons();
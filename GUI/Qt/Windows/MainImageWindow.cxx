@@ -89,6 +89,12 @@
 #include <QShortcut>
 
 #include <QTextStream>
+#include <QtConcurrent>
+#include <QFutureWatcher>
+#include <QStatusBar>
+#include <QProgressBar>
+#include <QFileInfo>
+#include <itkCommand.h>
 
 QString read_tooltip_qt(const QString &filename)
 {
@@ -315,6 +321,14 @@ MainImageWindow::MainImageWindow(QWidget *parent) :
   m_ProgressReporterDelegate->SetProgressDialog(m_Progress);
   m_Progress->reset();
 
+  // The status bar lists the images that are loading in the background,
+  // and is only shown while there are any
+  m_BackgroundLoadProgress = new QProgressBar(this);
+  m_BackgroundLoadProgress->setRange(0, 100);
+  m_BackgroundLoadProgress->setMaximumWidth(200);
+  this->statusBar()->addPermanentWidget(m_BackgroundLoadProgress);
+  this->statusBar()->hide();
+
   // Set title
   this->setWindowTitle("ITK-SNAP");
 
@@ -437,6 +451,11 @@ MainImageWindow::MainImageWindow(QWidget *parent) :
 
 MainImageWindow::~MainImageWindow()
 {
+  // Background reads must not outlive the objects they read into
+  std::map<QObject *, SmartPtr<PendingImageLoad> >::iterator it;
+  for(it = m_BackgroundImageLoads.begin(); it != m_BackgroundImageLoads.end(); ++it)
+    static_cast<QFutureWatcher<void> *>(it->first)->waitForFinished();
+
   delete m_ProgressReporterDelegate;
   delete ui;
 }
@@ -1356,15 +1375,100 @@ void MainImageWindow::LoadRecentOverlayActionTriggered()
   QAction *action = qobject_cast<QAction *>(sender());
   QString file = action->text();
 
-  // Try loading the image
+  // Read the header of the image. The voxel data are read in the background
+  // and the overlay is added when they become available
+  SmartPtr<PendingImageLoad> load;
   try
     {
-    // Change cursor for this operation
     QtCursorOverride c(Qt::WaitCursor);
     IRISWarningList warnings;
     SmartPtr<LoadOverlayImageDelegate> del = LoadOverlayImageDelegate::New();
     del->Initialize(m_Model->GetDriver());
-    m_Model->GetDriver()->LoadImageViaDelegate(file.toUtf8().constData(), del, warnings);
+    load = m_Model->GetDriver()->BeginLoadImageViaDelegate(
+          file.toUtf8().constData(), del, warnings);
+    }
+  catch(exception &exc)
+    {
+    ReportNonLethalException(this, exc, "Image IO Error",
+                             QString("Failed to load overlay image %1").arg(file));
+    return;
+    }
+
+  // Show that something is happening, without blocking the user
+  if(m_BackgroundImageLoads.empty())
+    QApplication::setOverrideCursor(Qt::BusyCursor);
+
+  // The progress is reported on the reading thread
+  typedef itk::SimpleMemberCommand<MainImageWindow> ProgressCommand;
+  SmartPtr<ProgressCommand> cmd = ProgressCommand::New();
+  cmd->SetCallbackFunction(this, &MainImageWindow::OnBackgroundImageLoadProgressEvent);
+  load->AddObserver(itk::ProgressEvent(), cmd);
+
+  QFutureWatcher<void> *watcher = new QFutureWatcher<void>(this);
+  connect(watcher, SIGNAL(finished()), this, SLOT(onBackgroundImageLoadFinished()));
+  m_BackgroundImageLoads[watcher] = load;
+  this->onBackgroundImageLoadProgress();
+  watcher->setFuture(QtConcurrent::run(load.GetPointer(), &PendingImageLoad::ReadImageData));
+}
+
+void MainImageWindow::OnBackgroundImageLoadProgressEvent()
+{
+  // Pass the event on to the GUI thread
+  QMetaObject::invokeMethod(this, "onBackgroundImageLoadProgress", Qt::QueuedConnection);
+}
+
+void MainImageWindow::onBackgroundImageLoadProgress()
+{
+  if(m_BackgroundImageLoads.empty())
+    {
+    this->statusBar()->clearMessage();
+    this->statusBar()->hide();
+    return;
+    }
+
+  // Show the names of the loading images and their average progress
+  QStringList names;
+  double progress = 0.0;
+  std::map<QObject *, SmartPtr<PendingImageLoad> >::iterator it;
+  for(it = m_BackgroundImageLoads.begin(); it != m_BackgroundImageLoads.end(); ++it)
+    {
+    names << QFileInfo(from_utf8(it->second->GetFileName())).fileName();
+    progress += it->second->GetProgress();
+    }
+
+  this->statusBar()->showMessage(QString("Loading %1").arg(names.join(", ")));
+  m_BackgroundLoadProgress->setValue(
+        (int) (100 * progress / m_BackgroundImageLoads.size()));
+  this->statusBar()->show();
+}
+
+void MainImageWindow::onBackgroundImageLoadFinished()
+{
+  QObject *watcher = this->sender();
+  std::map<QObject *, SmartPtr<PendingImageLoad> >::iterator it =
+      m_BackgroundImageLoads.find(watcher);
+  if(it == m_BackgroundImageLoads.end())
+    return;
+
+  SmartPtr<PendingImageLoad> load = it->second;
+  m_BackgroundImageLoads.erase(it);
+  watcher->deleteLater();
+
+  if(m_BackgroundImageLoads.empty())
+    QApplication::restoreOverrideCursor();
+  this->onBackgroundImageLoadProgress();
+
+  // The main image may have been closed while the overlay was being read
+  IRISApplication *driver = m_Model->GetDriver();
+  if(!driver->IsMainImageLoaded() || driver->IsSnakeModeActive())
+    return;
+
+  QString file = from_utf8(load->GetFileName());
+  try
+    {
+    QtCursorOverride c(Qt::WaitCursor);
+    IRISWarningList warnings;
+    driver->FinishLoadImageViaDelegate(load, warnings);
     }
   catch(exception &exc)
     {
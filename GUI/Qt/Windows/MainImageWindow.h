@@ -30,6 +30,7 @@
 #include <QMainWindow>
 #include "GlobalState.h"
 #include "SNAPCommon.h"
+#include <map>
 
 class GenericSliceView;
 class SliceViewPanel;
@@ -56,8 +57,10 @@ class InterpolateLabelsDialog;
 class ImageIOWizard;
 class ImageIOWizardModel;
 class DistributedSegmentationDialog;
+class PendingImageLoad;
 
 class QTimer;
+class QProgressBar;
 
 class SplashPanel;
 
@@ -158,6 +161,10 @@ private slots:
 
   void onActiveChanged();
 
+  void onBackgroundImageLoadFinished();
+
+  void onBackgroundImageLoadProgress();
+
   void on_actionQuit_triggered();
 
   void on_actionLoad_from_Image_triggered();
@@ -363,6 +370,9 @@ private:
   // Common method for loading recent segmentations (either open or add)
   void LoadRecentSegmentation(QString file, bool additive);
 
+  // Observer of the progress of background loads, called on the reading thread
+  void OnBackgroundImageLoadProgressEvent();
+
   // For convenience, an array of the four panels (3 slice/1 3D)
   QWidget *m_ViewPanels[4];
 
@@ -416,6 +426,13 @@ private:
 
   // A timer used to animate components
   QTimer *m_AnimateTimer;
+
+  // Images whose voxel data are being read in the background, keyed by the
+  // watcher of the reading task
+  std::map<QObject *, SmartPtr<PendingImageLoad> > m_BackgroundImageLoads;
+
+  // Progress of the background loads, shown in the status bar
+  QProgressBar *m_BackgroundLoadProgress;
 };
 
 
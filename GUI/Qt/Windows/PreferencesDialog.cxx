@@ -13,6 +13,7 @@
 #include "QtComboBoxCoupling.h"
 #include "QtAbstractButtonCoupling.h"
 #include "QtLabelCoupling.h"
+#include "QtLineEditCoupling.h"
 #include "QtWidgetActivator.h"
 #include "GlobalUIModel.h"
 #include "ColorMapModel.h"
@@ -103,6 +104,8 @@ void PreferencesDialog::SetModel(GlobalPreferencesModel *model)
   makeCoupling(ui->chkSyncPan, dbs->GetSyncPanModel());
   makeCoupling(ui->chkCheckForUpdates, m_Model->GetCheckForUpdateModel());
   makeCoupling(ui->chkAutoContrast, dbs->GetAutoContrastModel());
+  makeCoupling(ui->inMeshCacheDirectory, dbs->GetMeshCacheDirectoryModel());
+  makeCoupling(ui->inMeshCacheSize, dbs->GetMeshCacheSizeInMBModel());
 
   // Hook up the display layout properties
   GlobalDisplaySettings *gds = m_Model->GetGlobalDisplaySettings();
@@ -127,6 +130,8 @@ void PreferencesDialog::SetModel(GlobalPreferencesModel *model)
   makeCoupling(ui->chkShowThumbnail, gds->GetFlagDisplayZoomThumbnailModel());
   makeCoupling(ui->inThumbnailFraction, gds->GetZoomThumbnailSizeInPercentModel());
   makeCoupling(ui->inThumbnailMaxSize, gds->GetZoomThumbnailMaximumSizeModel());
+  makeCoupling(ui->inSliceCacheSize, gds->GetSliceCacheSizeInMBModel());
+  makeCoupling(ui->inSlicePrefetchCount, gds->GetSlicePrefetchCountModel());
 
   // Couple the interpolation mode (the domain is not provided by the model)
   makeCoupling(ui->inInterpolationMode, gds->GetGreyInterpolationModeModel());
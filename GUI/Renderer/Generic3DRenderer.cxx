@@ -235,12 +235,14 @@ void Generic3DRenderer::SetModel(Generic3DModel *model)
 
 void Generic3DRenderer::UpdateSegmentationMeshAssembly()
 {
-  if(m_Model->IsMeshUpdating())
-    return;
-
   // Get the app driver
   IRISApplication *driver = m_Model->GetParentUI()->GetDriver();
 
+  // The segmentation meshes can be shown while they are updated, because
+  // each is replaced only when complete, but the level set mesh cannot
+  if(m_Model->IsMeshUpdating() && driver->IsSnakeModeLevelSetActive())
+    return;
+
   // Get the mesh from the parent object
   MeshManager *mesh = driver->GetMeshManager();
   MeshManager::MeshCollection meshes = mesh->GetMeshes();
@@ -372,6 +372,12 @@ GlobalDisplaySettings::GlobalDisplaySettings()
 
   m_LayerLayoutModel =
       NewSimpleEnumProperty("LayerLayout", LAYOUT_STACKED, emap_layer_layout);
+
+  m_SliceCacheSizeInMBModel =
+      NewRangedProperty("SliceCacheSizeInMB", 64, 0, 4096, 16);
+
+  m_SlicePrefetchCountModel =
+      NewRangedProperty("SlicePrefetchCount", 4, 0, 32, 1);
 }
 
 void GlobalDisplaySettings
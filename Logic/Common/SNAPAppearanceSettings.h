@@ -114,6 +114,12 @@ public:
   irisSimplePropertyAccessMacro(SliceLayout, UISliceLayout)
   irisSimplePropertyAccessMacro(LayerLayout, LayerLayout)
 
+  /** Memory (in megabytes) each image layer may use to cache display slices */
+  irisRangedPropertyAccessMacro(SliceCacheSizeInMB, int)
+
+  /** Number of slices computed ahead of the scrolling direction */
+  irisRangedPropertyAccessMacro(SlicePrefetchCount, int)
+
   /**
    * This method uses SliceLayout, FlagLayoutPatientAnteriorShownLeft and
    * FlagLayoutPatientRightShownLeft to generate RAI codes for the three
@@ -129,6 +135,8 @@ protected:
   SmartPtr<ConcreteSimpleBooleanProperty> m_FlagDisplayZoomThumbnailModel;
   SmartPtr<ConcreteRangedDoubleProperty> m_ZoomThumbnailSizeInPercentModel;
   SmartPtr<ConcreteRangedIntProperty> m_ZoomThumbnailMaximumSizeModel;
+  SmartPtr<ConcreteRangedIntProperty> m_SliceCacheSizeInMBModel;
+  SmartPtr<ConcreteRangedIntProperty> m_SlicePrefetchCountModel;
   SmartPtr<ConcreteSimpleBooleanProperty> m_FlagLayoutPatientAnteriorShownLeftModel;
   SmartPtr<ConcreteSimpleBooleanProperty> m_FlagLayoutPatientRightShownLeftModel;
 
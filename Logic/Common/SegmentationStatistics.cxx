@@ -36,6 +36,7 @@
 #include "GenericImageData.h"
 #include "IRISApplication.h"
 #include "ImageCollectionToImageFilter.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
 
 #include <iostream>
 #include <iomanip>
@@ -92,35 +93,52 @@ SegmentationStatistics
   // Clear and initialize the statistics table
   m_Stats.clear();
 
-  // Start the label image iteration
-  LabelImageWrapper::ConstIterator itLabel = seg->GetImageConstIterator();
-  itk::ImageRegion<3> region = itLabel.GetRegion();
+  // Walk the run-length segments of the label image in buffer order. This
+  // does work per run rather than per voxel
+  typedef LabelImageWrapper::ImageType LabelImageType;
+  typedef itk::ImageRegionConstIteratorWithIndex<LabelImageType::BufferType> LineIterator;
+  const LabelImageType *imgLabel = seg->GetImage();
+  itk::ImageRegion<3> region = imgLabel->GetBufferedRegion();
 
   // Cache the entry to avoid many calls to std::map
   LabelType runLabel = 0;
   Entry *cachedEntry = &m_Stats[runLabel];
   cachedEntry->resize(ngray);
-  itk::Index<3> runStart = itLabel.GetIndex();
+  itk::Index<3> runStart = region.GetIndex();
   long runLength = 0;
 
-  // Aggregate the statistical data
-  for( ; !itLabel.IsAtEnd(); ++itLabel, ++runLength)
+  // Aggregate the statistical data. Runs continue across line boundaries
+  LineIterator itLine(imgLabel->GetBuffer(), imgLabel->GetBuffer()->GetBufferedRegion());
+  for(; !itLine.IsAtEnd(); ++itLine)
     {
-    // Get the label and the corresponding entry (use cache to reduce time wasted in std::map)
-    LabelType label = itLabel.Value();
-    if(label != runLabel)
+    // The line buffer is indexed by the absolute (y,z) of the line
+    const LabelImageType::RLLine &line = itLine.Value();
+    itk::Index<3> idx;
+    idx[0] = region.GetIndex(0);
+    idx[1] = itLine.GetIndex()[0];
+    idx[2] = itLine.GetIndex()[1];
+
+    for(size_t k = 0; k < line.size(); k++)
       {
-      // Record the statistics from the last run
-      this->RecordRunLength(ngray, layers, region, runStart, runLength, cachedEntry);
+      // Get the label and the corresponding entry (use cache to reduce time wasted in std::map)
+      LabelType label = line[k].second;
+      if(label != runLabel)
+        {
+        // Record the statistics from the last run
+        this->RecordRunLength(ngray, layers, region, runStart, runLength, cachedEntry);
+
+        // Change the cached entry
+        runLabel = label;
+        cachedEntry = &m_Stats[runLabel];
+        if(cachedEntry->count == 0)
+          cachedEntry->resize(ngray);
 
-      // Change the cached entry
-      runLabel = label;
-      cachedEntry = &m_Stats[runLabel];
-      if(cachedEntry->count == 0)
-        cachedEntry->resize(ngray);
+        runStart = idx;
+        runLength = 0;
+        }
 
-      runStart = itLabel.GetIndex();
-      runLength = 0;
+      runLength += line[k].first;
+      idx[0] += line[k].first;
       }
     }
 
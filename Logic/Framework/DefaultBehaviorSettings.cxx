@@ -33,4 +33,17 @@ DefaultBehaviorSettings::DefaultBehaviorSettings()
   // Paintbrush defaults
   m_PaintbrushDefaultInitialSizeModel = NewRangedProperty("PaintbrushDefaultInitialSize", 8, 1, 10000, 1);
   m_PaintbrushDefaultMaximumSizeModel = NewRangedProperty("PaintbrushDefaultMaximumSize", 40, 10, 10000, 1);
+
+  // Mesh cache (disabled by default)
+  m_MeshCacheDirectoryModel = NewSimpleProperty("MeshCacheDirectory", std::string());
+  m_MeshCacheSizeInMBModel = NewRangedProperty("MeshCacheSizeInMB", 512, 16, 65536, 16);
+
+  // Memory mapping of image files (opt-in)
+  m_MemoryMapImageFilesModel = NewSimpleProperty("MemoryMapImageFiles", false);
+
+  // Threads for reading DICOM series (0 uses the ITK default)
+  m_DICOMReadThreadsModel = NewRangedProperty("DICOMReadThreads", 0, 0, 256, 1);
+
+  // Threads for gzip compression of NIfTI files (0 uses the ITK default)
+  m_GzipThreadsModel = NewRangedProperty("GzipThreads", 0, 0, 256, 1);
 }
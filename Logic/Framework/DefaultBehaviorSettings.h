@@ -43,6 +43,25 @@ public:
   irisRangedPropertyAccessMacro(PaintbrushDefaultInitialSize, int)
   irisRangedPropertyAccessMacro(PaintbrushDefaultMaximumSize, int)
 
+  // Directory where segmentation meshes are cached between sessions. The
+  // meshes are not cached if this is empty
+  irisSimplePropertyAccessMacro(MeshCacheDirectory, std::string)
+
+  // Size (in megabytes) above which the least recently used meshes are
+  // removed from the mesh cache
+  irisRangedPropertyAccessMacro(MeshCacheSizeInMB, int)
+
+  // Whether uncompressed image files are mapped into memory instead of read
+  irisSimplePropertyAccessMacro(MemoryMapImageFiles, bool)
+
+  // Number of threads used to read the slices of a DICOM series, 0 for the
+  // ITK default
+  irisRangedPropertyAccessMacro(DICOMReadThreads, int)
+
+  // Number of threads used to compress and decompress gzipped NIfTI files,
+  // 0 for the ITK default and 1 to leave the compression to ITK
+  irisRangedPropertyAccessMacro(GzipThreads, int)
+
 protected:
 
   // Default behaviors
@@ -67,6 +86,15 @@ protected:
   SmartPtr<ConcreteRangedIntProperty> m_PaintbrushDefaultInitialSizeModel;
   SmartPtr<ConcreteRangedIntProperty> m_PaintbrushDefaultMaximumSizeModel;
 
+  // Mesh cache
+  SmartPtr<ConcreteSimpleStringProperty> m_MeshCacheDirectoryModel;
+  SmartPtr<ConcreteRangedIntProperty> m_MeshCacheSizeInMBModel;
+
+  // Image IO
+  SmartPtr<ConcreteSimpleBooleanProperty> m_MemoryMapImageFilesModel;
+  SmartPtr<ConcreteRangedIntProperty> m_DICOMReadThreadsModel;
+  SmartPtr<ConcreteRangedIntProperty> m_GzipThreadsModel;
+
   // Constructor
   DefaultBehaviorSettings();
 };
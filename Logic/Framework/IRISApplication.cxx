@@ -431,10 +431,14 @@ void IRISApplication::SetColorLabelsInSegmentationAsValid(LabelImageWrapper *seg
 }
 
 
-LabelImageWrapper *IRISApplication::UpdateSNAPSegmentationImage(GuidedNativeImageIO *io)
+IRISApplication::LabelImageType::Pointer
+IRISApplication
+::CreateLabelImageFromNativeIO(GuidedNativeImageIO *io)
 {
-  // This has to happen in 'pure' SNAP mode
-  assert(IsSnakeModeActive());
+  // Segmentations in the RLE format are used without expanding them
+  LabelImageType::Pointer imgLabel = io->GetNativeRLEImage();
+  if(imgLabel)
+    return imgLabel;
 
   typedef itk::Image<LabelType, 3> UncompressedImageType;
 
@@ -448,8 +452,17 @@ LabelImageWrapper *IRISApplication::UpdateSNAPSegmentationImage(GuidedNativeImag
   inConv->SetInput(imgUncompressed);
   inConv->SetRegionOfInterest(imgUncompressed->GetLargestPossibleRegion());
   inConv->Update();
-  LabelImageType::Pointer imgLabel = inConv->GetOutput();
-  imgUncompressed = NULL; //deallocate intermediate image to save memory
+  imgLabel = inConv->GetOutput();
+  return imgLabel;
+}
+
+LabelImageWrapper *IRISApplication::UpdateSNAPSegmentationImage(GuidedNativeImageIO *io)
+{
+  // This has to happen in 'pure' SNAP mode
+  assert(IsSnakeModeActive());
+
+  // Convert the native image to a run-length encoded label image
+  LabelImageType::Pointer imgLabel = this->CreateLabelImageFromNativeIO(io);
 
   // The header of the label image is made to match that of the grey image
   imgLabel->SetOrigin(m_CurrentImageData->GetMain()->GetImageBase()->GetOrigin());
@@ -482,20 +495,8 @@ IRISApplication
   // This has to happen in 'pure' IRIS mode
   assert(!IsSnakeModeActive());
 
-  typedef itk::Image<LabelType, 3> UncompressedImageType;
-
-  // Cast the native to label type
-  CastNativeImage<UncompressedImageType> caster;
-  UncompressedImageType::Pointer imgUncompressed = caster(io);
-
-  //use specialized RoI filter to convert to RLEImage
-  typedef itk::RegionOfInterestImageFilter<UncompressedImageType, LabelImageType> inConverterType;
-  inConverterType::Pointer inConv = inConverterType::New();
-  inConv->SetInput(imgUncompressed);
-  inConv->SetRegionOfInterest(imgUncompressed->GetLargestPossibleRegion());
-  inConv->Update();
-  LabelImageType::Pointer imgLabel = inConv->GetOutput();
-  imgUncompressed = NULL; //deallocate intermediate image to save memory
+  // Convert the native image to a run-length encoded label image
+  LabelImageType::Pointer imgLabel = this->CreateLabelImageFromNativeIO(io);
 
   // Disconnect from the pipeline right away
   imgLabel->DisconnectPipeline();
@@ -666,6 +667,30 @@ IRISApplication
   return itVol.GetNumberOfChangedVoxels();
 }
 
+/**
+ * Paint rule used to copy the result of snake segmentation into the
+ * segmentation image: voxels inside the snake are painted with the active
+ * label, and voxels outside are cleared if they have the active label
+ */
+class SnakeToSegmentationRule
+{
+public:
+  SnakeToSegmentationRule(const SegmentationUpdateIterator *it, bool invert)
+    : m_Iterator(it), m_Invert(invert) {}
+
+  LabelType operator() (LabelType lOld, float voxSNAP) const
+  {
+    if((!m_Invert && voxSNAP <= 0) || (m_Invert && voxSNAP >= 0))
+      return m_Iterator->RulePaintAsForeground(lOld);
+    else
+      return m_Iterator->RulePaintAsBackground(lOld);
+  }
+
+protected:
+  const SegmentationUpdateIterator *m_Iterator;
+  bool m_Invert;
+};
+
 void 
 IRISApplication
 ::UpdateIRISWithSnapImageData(CommandType *progressCommand)
@@ -758,32 +783,14 @@ IRISApplication
     source = fltSample->GetOutput();
     }  
 
-  // Creat the source iterator
-  typedef itk::ImageRegionConstIterator<SourceImageType> SourceIteratorType;
-  SourceIteratorType itSource(source,source->GetLargestPossibleRegion());
-
   // Create the smart target iterator
   SegmentationUpdateIterator itTarget(
         target, roi.GetROI(),
         m_GlobalState->GetDrawingColorLabel(), m_GlobalState->GetDrawOverFilter());
 
-  // Inversion state
-  bool invert = m_GlobalState->GetPolygonInvert();
-
-  // Go through both iterators, copy the new over the old
-  while(!itSource.IsAtEnd())
-    {
-    // Get the level set value
-    float voxSNAP = itSource.Value();
-    if((!invert && voxSNAP <= 0) || (invert && voxSNAP >= 0))
-      itTarget.PaintAsForeground();
-    else
-      itTarget.PaintAsBackground();
-
-    // Iterate
-    ++itSource;
-    ++itTarget;
-    }
+  // Copy the new over the old, one run of the segmentation at a time
+  SnakeToSegmentationRule rule(&itTarget, m_GlobalState->GetPolygonInvert());
+  itTarget.PaintRunsWithSource(source.GetPointer(), source->GetLargestPossibleRegion(), rule);
 
   // Finalize the segmentation
   itTarget.Finalize();
@@ -1172,30 +1179,19 @@ IRISApplication
   // Get the label image
   LabelImageWrapper::ImageType *imgLabel = this->GetSelectedSegmentationLayer()->GetImage();
 
-  // Get the number of voxels
-  size_t nvoxels = 0;
-
-  // Update the segmentation
-  typedef itk::ImageRegionIterator<
-    LabelImageWrapper::ImageType> IteratorType;
-  for(IteratorType it(imgLabel, imgLabel->GetBufferedRegion());  
-    !it.IsAtEnd(); ++it)
-    {
-    if(it.Get() == drawover)
-      {
-      it.Set(drawing);
-      ++nvoxels;
-      }
-    }
+  // Update the segmentation one run at a time. This is not an undoable
+  // operation, so the delta is discarded.
+  SegmentationUpdateIterator it(
+        imgLabel, imgLabel->GetBufferedRegion(),
+        drawing, DrawOverFilter(PAINT_OVER_ALL, 0));
+  it.ReplaceLabelInRuns(drawover, drawing);
 
   // Register that the image has been updated
-  imgLabel->Modified();
+  it.Finalize();
 
-  return nvoxels;
+  return it.GetNumberOfChangedVoxels();
 }
 
-// TODO: This information should be cached at the segmentation layer level
-// by keeping track of label counts after every update operation.
 size_t
 IRISApplication
 ::GetNumberOfVoxelsWithLabel(LabelType label)
@@ -1203,20 +1199,13 @@ IRISApplication
   // Number of voxels matching current label
   size_t nvoxels = 0;
 
-  // We must iterate over all the label images
+  // We must iterate over all the label images. Each keeps a table of label
+  // counts that is updated as the segmentation is edited.
   for(LayerIterator it = this->GetCurrentImageData()->GetLayers(LABEL_ROLE);
       !it.IsAtEnd(); ++it)
     {
     LabelImageWrapper *wrapper = dynamic_cast<LabelImageWrapper *>(it.GetLayer());
-    LabelImageType *seg = wrapper->GetImage();
-
-    // Get the number of voxels
-    for(LabelImageWrapper::ConstIterator it(seg, seg->GetBufferedRegion());
-        !it.IsAtEnd(); ++it)
-      {
-      if(it.Get() == label)
-        ++nvoxels;
-      }
+    nvoxels += wrapper->GetNumberOfVoxelsWithLabel(label);
     }
 
   return nvoxels;
@@ -1807,42 +1796,90 @@ IRISApplication
                        IRISWarningList &wl,
                        Registry *ioHints)
 {
-  Registry regAssoc;
+  // Load and validate the header of the image
+  SmartPtr<PendingImageLoad> load =
+      this->BeginLoadImageViaDelegate(fname, del, wl, ioHints);
+
+  // Unload the current image data before reading, to conserve memory
+  load->UnloadCurrentImage();
+
+  // Read the image body
+  load->ReadImageData();
+
+  // Validate the image and put it in the right place
+  return this->FinishLoadImageViaDelegate(load, wl);
+}
+
+SmartPtr<PendingImageLoad>
+IRISApplication
+::BeginLoadImageViaDelegate(const char *fname,
+                            AbstractLoadImageDelegate *del,
+                            IRISWarningList &wl,
+                            Registry *ioHints)
+{
+  SmartPtr<PendingImageLoad> load = PendingImageLoad::New();
+  load->m_FileName = fname;
+  load->m_Delegate = del;
 
   // When hints are not provided, we load them using the association system
-  if(!ioHints)
+  if(ioHints)
+    {
+    load->m_IOHints = *ioHints;
+    }
+  else
     {
     // Load the settings associated with this file
+    Registry regAssoc;
     m_SystemInterface->FindRegistryAssociatedWithFile(fname, regAssoc);
 
     // Get the folder dealing with grey image properties
-    ioHints = &regAssoc.Folder("Files.Grey");
+    load->m_IOHints = regAssoc.Folder("Files.Grey");
     }
 
   // Create a native image IO object
-  SmartPtr<GuidedNativeImageIO> io = GuidedNativeImageIO::New();
+  load->m_IO = GuidedNativeImageIO::New();
 
-  // Load the header of the image
-  io->ReadNativeImageHeader(fname, *ioHints);
+  // Load the header of the image. Reading the header may update the hints,
+  // and these updates are passed back to the caller as before
+  load->m_IO->ReadNativeImageHeader(fname, load->m_IOHints);
+  if(ioHints)
+    *ioHints = load->m_IOHints;
 
   // Validate the header
-  del->ValidateHeader(io, wl);
+  del->ValidateHeader(load->m_IO, wl);
 
-  // Unload the current image data
-  del->UnloadCurrentImage();
+  return load;
+}
 
-  // Read the image body
-  io->ReadNativeImageData();
+ImageWrapperBase *
+IRISApplication
+::FinishLoadImageViaDelegate(PendingImageLoad *load, IRISWarningList &wl)
+{
+  // Report the error encountered while reading the image body
+  if(load->GetState() == PendingImageLoad::DATA_FAILED)
+    throw IRISException("%s", load->GetErrorMessage().c_str());
+
+  assert(load->GetState() == PendingImageLoad::DATA_LOADED);
+
+  // The application may have changed while the data were read, e.g., the
+  // main image may have been replaced, so the header is validated again
+  // against the current state. Its warnings were reported when the load began
+  AbstractLoadImageDelegate *del = load->GetDelegate();
+  IRISWarningList header_warnings;
+  del->ValidateHeader(load->GetIO(), header_warnings);
+
+  // Unload the current image data, unless this has been done already
+  load->UnloadCurrentImage();
 
   // Validate the image data
-  del->ValidateImage(io, wl);
+  del->ValidateImage(load->GetIO(), wl);
 
   // Put the image in the right place
-  ImageWrapperBase *layer = del->UpdateApplicationWithImage(io);
+  ImageWrapperBase *layer = del->UpdateApplicationWithImage(load->GetIO());
 
   // Store the IO hints inside of the image - in case it ever gets added
   // to a project
-  layer->SetIOHints(*ioHints);
+  layer->SetIOHints(load->GetIOHints());
 
   return layer;
 }
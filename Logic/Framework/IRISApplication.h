@@ -65,6 +65,7 @@ class ImageWrapperBase;
 class MeshManager;
 class AbstractLoadImageDelegate;
 class AbstractSaveImageDelegate;
+class PendingImageLoad;
 class IRISWarningList;
 class GaussianMixtureModel;
 struct IRISDisplayGeometry;
@@ -216,6 +217,29 @@ public:
                                          IRISWarningList &wl,
                                          Registry *ioHints = NULL);
 
+  /**
+   * Begin loading an image using a delegate, reading only the header. This
+   * is the first stage of LoadImageViaDelegate, for callers that want the
+   * geometry of the image immediately and the voxel data to be read in the
+   * background. The returned object reads the voxel data when its method
+   * ReadImageData() is called (possibly on a worker thread), after which the
+   * load is completed by FinishLoadImageViaDelegate().
+   */
+  SmartPtr<PendingImageLoad> BeginLoadImageViaDelegate(
+      const char *fname, AbstractLoadImageDelegate *del,
+      IRISWarningList &wl, Registry *ioHints = NULL);
+
+  /**
+   * Complete a load started with BeginLoadImageViaDelegate once the voxel
+   * data have been read. The header is validated again, since the application
+   * may have changed while the data were read. The current image in the
+   * delegate's role is unloaded, unless this was done before the data were
+   * read, and the new layer is returned. If reading the data failed, the
+   * error is thrown here.
+   */
+  ImageWrapperBase* FinishLoadImageViaDelegate(PendingImageLoad *load,
+                                               IRISWarningList &wl);
+
   /**
    * List available additional DICOM series that can be loaded given the currently
    * loaded DICOM images. This creates a listing of 'sibling' DICOM series Ids,
@@ -765,6 +789,9 @@ protected:
   // Go overall all labels in the segmentation wrapper and mark them as valid in the color table
   void SetColorLabelsInSegmentationAsValid(LabelImageWrapper *seg);
 
+  // Get the segmentation read by an IO object as a run-length encoded image
+  LabelImageType::Pointer CreateLabelImageFromNativeIO(GuidedNativeImageIO *io);
+
   // ----------------------- Project support ------------------------------
 
   // Cached state of the project at the time of last open/save. Used to check
@@ -4,6 +4,7 @@
 #include "GenericImageData.h"
 #include "HistoryManager.h"
 #include "IRISImageData.h"
+#include "itkMutexLockHolder.h"
 
 
 /* =============================
@@ -230,6 +231,93 @@ LoadSegmentationImageDelegate
 }
 
 
+/* =============================
+   Pending Image Load
+   ============================= */
+
+PendingImageLoad::PendingImageLoad()
+{
+  m_State = HEADER_LOADED;
+  m_Progress = 0.0;
+  m_CurrentImageUnloaded = false;
+}
+
+PendingImageLoad::LoadState PendingImageLoad::GetState() const
+{
+  itk::MutexLockHolder<itk::SimpleFastMutexLock> holder(m_StateLock);
+  return m_State;
+}
+
+std::string PendingImageLoad::GetErrorMessage() const
+{
+  itk::MutexLockHolder<itk::SimpleFastMutexLock> holder(m_StateLock);
+  return m_ErrorMessage;
+}
+
+void PendingImageLoad::SetState(LoadState state, const std::string &message)
+{
+  itk::MutexLockHolder<itk::SimpleFastMutexLock> holder(m_StateLock);
+  m_State = state;
+  m_ErrorMessage = message;
+}
+
+double PendingImageLoad::GetProgress() const
+{
+  itk::MutexLockHolder<itk::SimpleFastMutexLock> holder(m_StateLock);
+  switch(m_State)
+    {
+    case HEADER_LOADED: return 0.0;
+    case DATA_LOADING: return m_Progress;
+    default: return 1.0;
+    }
+}
+
+void PendingImageLoad::OnReadProgress()
+{
+  // The IO object is only accessed by the reading thread until it is done
+  double progress = m_IO->GetReadProgress();
+    {
+    itk::MutexLockHolder<itk::SimpleFastMutexLock> holder(m_StateLock);
+    m_Progress = progress;
+    }
+  this->InvokeEvent(itk::ProgressEvent());
+}
+
+void PendingImageLoad::ReadImageData()
+{
+  assert(this->GetState() == HEADER_LOADED);
+
+  // Forward the progress of the IO object
+  typedef itk::SimpleMemberCommand<PendingImageLoad> CommandType;
+  CommandType::Pointer cmd = CommandType::New();
+  cmd->SetCallbackFunction(this, &PendingImageLoad::OnReadProgress);
+
+  this->SetState(DATA_LOADING);
+  try
+    {
+    m_IO->ReadNativeImageData(cmd);
+    this->SetState(DATA_LOADED);
+    }
+  catch(std::exception &exc)
+    {
+    this->SetState(DATA_FAILED, exc.what());
+    }
+  catch(...)
+    {
+    this->SetState(DATA_FAILED, "Unknown error reading image data");
+    }
+}
+
+void PendingImageLoad::UnloadCurrentImage()
+{
+  if(!m_CurrentImageUnloaded)
+    {
+    m_Delegate->UnloadCurrentImage();
+    m_CurrentImageUnloaded = true;
+    }
+}
+
+
 void
 DefaultSaveImageDelegate::Initialize(
     IRISApplication *driver,
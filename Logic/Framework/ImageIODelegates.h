@@ -5,6 +5,7 @@
 #include "IRISException.h"
 #include "IRISApplication.h"
 #include "IRISException.h"
+#include "itkSimpleFastMutexLock.h"
 #include <vector>
 
 class IRISApplication;
@@ -142,6 +143,84 @@ protected:
 };
 
 
+/**
+  An image load that is split into stages, so that the voxel data can be read
+  on a worker thread while the application remains responsive. The header is
+  read and validated by IRISApplication::BeginLoadImageViaDelegate(), after
+  which the dimensions and geometry of the image are available from the IO
+  object. The voxel data are then read by ReadImageData(), which does not
+  touch the application state and may be called from any thread. Finally,
+  IRISApplication::FinishLoadImageViaDelegate() creates the layer from the
+  data; this must happen on the main thread.
+
+  While the data are read, the object invokes itk::ProgressEvent on the
+  reading thread, and GetState() reports that the image is still loading.
+  Observers that update a GUI must pass the event on to the GUI thread. The
+  state, the progress and the error message are guarded by a lock, so they
+  can be queried from any thread.
+  */
+class PendingImageLoad : public itk::Object
+{
+public:
+
+  irisITKObjectMacro(PendingImageLoad, itk::Object)
+
+  enum LoadState {
+    HEADER_LOADED = 0, DATA_LOADING, DATA_LOADED, DATA_FAILED
+  };
+
+  irisGetMacro(FileName, const std::string &)
+  irisGetMacro(IO, GuidedNativeImageIO *)
+  irisGetMacro(Delegate, AbstractLoadImageDelegate *)
+
+  /** Current stage of the load */
+  LoadState GetState() const;
+
+  /** Error message from ReadImageData() when the state is DATA_FAILED */
+  std::string GetErrorMessage() const;
+
+  /** Fraction of the voxel data that has been read */
+  double GetProgress() const;
+
+  /** The IO hints used to read the image */
+  Registry &GetIOHints() { return m_IOHints; }
+
+  /**
+   * Read the voxel data. Errors are not thrown, but recorded in the state of
+   * the object, so that this method can be run on a worker thread.
+   */
+  void ReadImageData();
+
+  /** Unload the current image of the delegate's role, only once */
+  void UnloadCurrentImage();
+
+protected:
+  PendingImageLoad();
+  virtual ~PendingImageLoad() {}
+
+  void OnReadProgress();
+
+  // Change the state, and the error message if the state is DATA_FAILED
+  void SetState(LoadState state, const std::string &message = std::string());
+
+  std::string m_FileName;
+  SmartPtr<GuidedNativeImageIO> m_IO;
+  SmartPtr<AbstractLoadImageDelegate> m_Delegate;
+  Registry m_IOHints;
+  LoadState m_State;
+  std::string m_ErrorMessage;
+  bool m_CurrentImageUnloaded;
+
+  // Fraction of the data read, copied from the IO object on the reading thread
+  double m_Progress;
+
+  // Guards the state, the progress and the error message
+  mutable itk::SimpleFastMutexLock m_StateLock;
+
+  friend class IRISApplication;
+};
+
+
 class AbstractSaveImageDelegate : public itk::Object
 {
 public:
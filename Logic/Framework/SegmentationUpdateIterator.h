@@ -46,8 +46,95 @@
 #include "SNAPCommon.h"
 #include "ImageWrapperTraits.h"
 #include "UndoDataManager.h"
+#include <algorithm>
+#include <vector>
 
 
+/**
+ * Reads a scanline of a source image as runs of equal values. This is used
+ * by SegmentationUpdateIterator::PaintRunsWithSource(). The generic version
+ * works with images that have a pixel buffer, and finds the runs by
+ * comparing neighboring voxels.
+ */
+template <class TImage>
+class SegmentationSourceRunReader
+{
+public:
+  typedef typename TImage::PixelType PixelType;
+
+  SegmentationSourceRunReader(const TImage *image)
+    : m_Image(image), m_Ptr(NULL), m_RunEnd(NULL), m_LineEnd(NULL) {}
+
+  void StartLine(const itk::Index<3> &index, long length)
+  {
+    m_Ptr = m_Image->GetBufferPointer() + m_Image->ComputeOffset(index);
+    m_RunEnd = m_Ptr;
+    m_LineEnd = m_Ptr + length;
+  }
+
+  const PixelType &GetValue() const
+  { return *m_Ptr; }
+
+  long GetRemaining()
+  {
+    if(m_RunEnd <= m_Ptr)
+      {
+      m_RunEnd = m_Ptr + 1;
+      while(m_RunEnd < m_LineEnd && *m_RunEnd == *m_Ptr)
+        ++m_RunEnd;
+      }
+    return m_RunEnd - m_Ptr;
+  }
+
+  void Advance(long n)
+  { m_Ptr += n; }
+
+protected:
+  const TImage *m_Image;
+  const PixelType *m_Ptr, *m_RunEnd, *m_LineEnd;
+};
+
+/** For RLE images, the runs are the segments of the run-length lines */
+template <class TPixel, class CounterType>
+class SegmentationSourceRunReader< RLEImage<TPixel, 3, CounterType> >
+{
+public:
+  typedef RLEImage<TPixel, 3, CounterType> ImageType;
+  typedef TPixel PixelType;
+
+  SegmentationSourceRunReader(const ImageType *image)
+    : m_Image(image), m_Line(NULL), m_Segment(0), m_X(0), m_SegmentEnd(0), m_LineEnd(0) {}
+
+  void StartLine(const itk::Index<3> &index, long length)
+  {
+    // The line buffer is indexed by the absolute (y,z) of the line
+    typename ImageType::RegionType br = m_Image->GetBufferedRegion();
+    typename ImageType::BufferType::IndexType bi = ImageType::truncateIndex(index);
+    m_Line = &m_Image->GetBuffer()->GetPixel(bi);
+    m_X = index[0] - br.GetIndex(0);
+    m_LineEnd = m_X + length;
+    m_Segment = m_Image->FindSegment(bi, m_X, m_SegmentEnd);
+  }
+
+  const PixelType &GetValue() const
+  { return (*m_Line)[m_Segment].second; }
+
+  long GetRemaining()
+  { return std::min(m_SegmentEnd, m_LineEnd) - m_X; }
+
+  void Advance(long n)
+  {
+    m_X += n;
+    while(m_X >= m_SegmentEnd && m_X < m_LineEnd)
+      m_SegmentEnd += (*m_Line)[++m_Segment].first;
+  }
+
+protected:
+  const ImageType *m_Image;
+  const typename ImageType::RLLine *m_Line;
+  itk::IndexValueType m_Segment, m_X, m_SegmentEnd, m_LineEnd;
+};
+
 /**
  * \class SegmentationUpdate
  * \brief This class handles updates to the segmentation image at a high level.
@@ -73,15 +160,24 @@ public:
     : m_Region(region),
       m_ActiveLabel(active_label),
       m_DrawOver(draw_over),
+      m_Image(labelImage),
       m_Iterator(labelImage, region),
       m_ChangedVoxels(0)
   {
     // Create the delta
     m_Delta = new UndoDelta();
     m_Delta->SetRegion(region);
+    m_Delta->SetImageMTime(labelImage->GetMTime());
 
     // Set the voxel delta to zero
     m_VoxelDelta = 0;
+
+    // Set up the buffer for the current scanline
+    m_LineBuffer.resize(region.GetSize(0));
+    m_LineIndex = region.GetIndex();
+    m_LinePos = 0;
+    m_LineFirstChange = -1;
+    m_LineLastChange = -1;
   }
 
   ~SegmentationUpdateIterator()
@@ -92,13 +188,27 @@ public:
 
   void operator ++()
   {
-    // Encode the current voxel delta
-    m_Delta->Encode(m_VoxelDelta);
+    // Buffer the current voxel delta, keeping track of the changed stretch
+    m_LineBuffer[m_LinePos] = m_VoxelDelta;
+    if(m_VoxelDelta != 0)
+      {
+      if(m_LineFirstChange < 0)
+        m_LineFirstChange = m_LinePos;
+      m_LineLastChange = m_LinePos;
+      }
     m_VoxelDelta = 0;
 
-    // Keep track of changed voxels
-    if(m_VoxelDelta != 0)
-      m_ChangedVoxels++;
+    // At the end of the scanline, encode the changes
+    if(++m_LinePos == (long) m_LineBuffer.size())
+      {
+      this->FlushLine();
+      m_LinePos = 0;
+      if(++m_LineIndex[1] >= m_Region.GetUpperIndex()[1] + 1)
+        {
+        m_LineIndex[1] = m_Region.GetIndex(1);
+        ++m_LineIndex[2];
+        }
+      }
 
     // Update the internal iterator
     ++m_Iterator;
@@ -114,19 +224,7 @@ public:
    */
   virtual void PaintLabel(LabelType new_label)
   {
-    LabelType lOld = m_Iterator.Get();
-
-    if(m_DrawOver.CoverageMode == PAINT_OVER_ALL ||
-       (m_DrawOver.CoverageMode == PAINT_OVER_ONE && lOld == m_DrawOver.DrawOverLabel) ||
-       (m_DrawOver.CoverageMode == PAINT_OVER_VISIBLE && lOld != 0))
-      {
-      if(lOld != new_label)
-        {
-        m_VoxelDelta += new_label - lOld;
-        m_Iterator.Set(new_label);
-        m_ChangedVoxels++;
-        }
-      }
+    this->SetLabel(this->RulePaintLabel(m_Iterator.Get(), new_label));
   }
 
 
@@ -143,21 +241,7 @@ public:
    */
   void PaintAsForegroundPreserveClear()
   {
-    LabelType lOld = m_Iterator.Get();
-    if(lOld == 0)
-      return;
-
-    if(m_DrawOver.CoverageMode == PAINT_OVER_ALL ||
-       (m_DrawOver.CoverageMode == PAINT_OVER_ONE && lOld == m_DrawOver.DrawOverLabel) ||
-       (m_DrawOver.CoverageMode == PAINT_OVER_VISIBLE && lOld != 0))
-      {
-      if(lOld != m_ActiveLabel)
-        {
-        m_VoxelDelta += m_ActiveLabel - lOld;
-        m_Iterator.Set(m_ActiveLabel);
-        m_ChangedVoxels++;
-        }
-      }
+    this->SetLabel(this->RulePaintAsForegroundPreserveClear(m_Iterator.Get()));
   }
 
 
@@ -167,14 +251,7 @@ public:
    */
   void PaintAsBackground()
   {
-    LabelType lOld = m_Iterator.Get();
-
-    if(m_ActiveLabel != 0 && lOld == m_ActiveLabel)
-      {
-      m_VoxelDelta += 0 - lOld;
-      m_Iterator.Set(0);
-      m_ChangedVoxels++;
-      }
+    this->SetLabel(this->RulePaintAsBackground(m_Iterator.Get()));
   }
 
   /**
@@ -183,14 +260,7 @@ public:
    */
   void ReplaceLabel(LabelType target_label, LabelType new_label)
   {
-    LabelType lOld = m_Iterator.Get();
-
-    if(lOld == target_label)
-      {
-      m_VoxelDelta += new_label - lOld;
-      m_Iterator.Set(new_label);
-      m_ChangedVoxels++;
-      }
+    this->SetLabel(this->RuleReplaceLabel(m_Iterator.Get(), target_label, new_label));
   }
 
   /**
@@ -202,21 +272,99 @@ public:
    */
   void PaintLabelWithExtraProtection(LabelType protect_label, LabelType new_label)
   {
-    LabelType lOld = m_Iterator.Get();
-  
-    // Test for protection or empty operation
-    if(lOld == protect_label || lOld == new_label)
-      return;
-
-    // Apply the draw over test
-    if(m_DrawOver.CoverageMode == PAINT_OVER_ALL ||
-       (m_DrawOver.CoverageMode == PAINT_OVER_ONE && lOld == m_DrawOver.DrawOverLabel) ||
-       (m_DrawOver.CoverageMode == PAINT_OVER_VISIBLE && lOld != 0))
-      {
-      m_VoxelDelta += new_label - lOld;
-      m_Iterator.Set(new_label);
-      m_ChangedVoxels++;
-      }
+    this->SetLabel(this->RulePaintLabelWithExtraProtection(
+                     m_Iterator.Get(), protect_label, new_label));
+  }
+
+  /**
+   * The paint rules behind the methods above. Each maps the label currently
+   * at a voxel to the label it should have after the update.
+   */
+  bool CanDrawOver(LabelType lOld) const
+  {
+    return m_DrawOver.CoverageMode == PAINT_OVER_ALL ||
+        (m_DrawOver.CoverageMode == PAINT_OVER_ONE && lOld == m_DrawOver.DrawOverLabel) ||
+        (m_DrawOver.CoverageMode == PAINT_OVER_VISIBLE && lOld != 0);
+  }
+
+  LabelType RulePaintLabel(LabelType lOld, LabelType new_label) const
+  {
+    return this->CanDrawOver(lOld) ? new_label : lOld;
+  }
+
+  LabelType RulePaintAsForeground(LabelType lOld) const
+  {
+    return this->RulePaintLabel(lOld, m_ActiveLabel);
+  }
+
+  LabelType RulePaintAsForegroundPreserveClear(LabelType lOld) const
+  {
+    return lOld == 0 ? lOld : this->RulePaintLabel(lOld, m_ActiveLabel);
+  }
+
+  LabelType RulePaintAsBackground(LabelType lOld) const
+  {
+    return (m_ActiveLabel != 0 && lOld == m_ActiveLabel) ? 0 : lOld;
+  }
+
+  LabelType RuleReplaceLabel(LabelType lOld, LabelType target_label, LabelType new_label) const
+  {
+    return lOld == target_label ? new_label : lOld;
+  }
+
+  LabelType RulePaintLabelWithExtraProtection(
+      LabelType lOld, LabelType protect_label, LabelType new_label) const
+  {
+    return lOld == protect_label ? lOld : this->RulePaintLabel(lOld, new_label);
+  }
+
+  /**
+   * Run-level updates. These apply a paint rule to the whole region in one
+   * call, in place of iterating with operator++. The label image is processed
+   * one RL segment at a time: the rule is evaluated once per segment, and
+   * scanlines where the rule changes nothing are left untouched. Call
+   * Finalize() afterwards as usual.
+   */
+  void PaintRunsAsForeground()
+  {
+    this->PaintRuns(ForegroundRule(this));
+  }
+
+  void PaintRunsAsBackground()
+  {
+    this->PaintRuns(BackgroundRule(this));
+  }
+
+  void ReplaceLabelInRuns(LabelType target_label, LabelType new_label)
+  {
+    this->PaintRuns(ReplaceRule(target_label, new_label));
+  }
+
+  /** Apply a rule mapping the old label to the new label */
+  template <class TRule>
+  void PaintRuns(const TRule &rule)
+  {
+    NullSourceReader reader;
+    this->PaintRunsInternal(reader, LabelOnlyRule<TRule>(rule));
+  }
+
+  /**
+   * Apply a rule that maps the old label and the value of a source image to
+   * the new label. The source region must have the same size as the region
+   * of the iterator. Runs of equal values in the source are handled at once
+   * (for RLE sources these are simply the RL segments).
+   */
+  template <class TSourceImage, class TRule>
+  void PaintRunsWithSource(const TSourceImage *source,
+                           const RegionType &sourceRegion,
+                           const TRule &rule)
+  {
+    SegmentationSourceRunReader<TSourceImage> reader(source);
+    IndexType offset;
+    for(unsigned int d = 0; d < 3; d++)
+      offset[d] = sourceRegion.GetIndex(d) - m_Region.GetIndex(d);
+    OffsetSourceReader<SegmentationSourceRunReader<TSourceImage> > oreader(reader, offset);
+    this->PaintRunsInternal(oreader, rule);
   }
 
 
@@ -231,6 +379,7 @@ public:
    */
   void Finalize()
   {
+    this->FlushLine();
     m_Delta->FinishEncoding();
     if(m_ChangedVoxels > 0)
       m_Iterator.GetImage()->Modified();
@@ -258,6 +407,195 @@ public:
 
 protected:
 
+  // Assign a label to the current voxel, keeping track of the change
+  void SetLabel(LabelType lNew)
+  {
+    LabelType lOld = m_Iterator.Get();
+    if(lOld != lNew)
+      {
+      m_VoxelDelta += lNew - lOld;
+      m_Iterator.Set(lNew);
+      m_ChangedVoxels++;
+      }
+  }
+
+  // Rules for the run-level paint methods
+  struct ForegroundRule
+  {
+    const SegmentationUpdateIterator *m_Parent;
+    ForegroundRule(const SegmentationUpdateIterator *p) : m_Parent(p) {}
+    LabelType operator() (LabelType lOld) const
+    { return m_Parent->RulePaintAsForeground(lOld); }
+  };
+
+  struct BackgroundRule
+  {
+    const SegmentationUpdateIterator *m_Parent;
+    BackgroundRule(const SegmentationUpdateIterator *p) : m_Parent(p) {}
+    LabelType operator() (LabelType lOld) const
+    { return m_Parent->RulePaintAsBackground(lOld); }
+  };
+
+  struct ReplaceRule
+  {
+    LabelType m_Target, m_New;
+    ReplaceRule(LabelType target, LabelType lnew) : m_Target(target), m_New(lnew) {}
+    LabelType operator() (LabelType lOld) const
+    { return lOld == m_Target ? m_New : lOld; }
+  };
+
+  // Adapts a label-only rule to the two-argument form
+  template <class TRule>
+  struct LabelOnlyRule
+  {
+    const TRule &m_Rule;
+    LabelOnlyRule(const TRule &rule) : m_Rule(rule) {}
+    LabelType operator() (LabelType lOld, int) const
+    { return m_Rule(lOld); }
+  };
+
+  // Source reader used when there is no source image
+  struct NullSourceReader
+  {
+    void StartLine(const IndexType &, long) {}
+    int GetValue() const { return 0; }
+    long GetRemaining() const { return itk::NumericTraits<long>::max(); }
+    void Advance(long) {}
+  };
+
+  // Maps indices in the iterator's region to the source region
+  template <class TReader>
+  struct OffsetSourceReader
+  {
+    TReader &m_Reader;
+    IndexType m_Offset;
+    OffsetSourceReader(TReader &reader, const IndexType &offset)
+      : m_Reader(reader), m_Offset(offset) {}
+    void StartLine(const IndexType &index, long length)
+    {
+      IndexType src_index;
+      for(unsigned int d = 0; d < 3; d++)
+        src_index[d] = index[d] + m_Offset[d];
+      m_Reader.StartLine(src_index, length);
+    }
+    typename TReader::PixelType GetValue() const { return m_Reader.GetValue(); }
+    long GetRemaining() { return m_Reader.GetRemaining(); }
+    void Advance(long n) { m_Reader.Advance(n); }
+  };
+
+  // A stretch of changed voxels within a scanline
+  struct RunChange
+  {
+    long Start, Length;
+    LabelType Delta;
+  };
+
+  // Apply a rule to the region, scanline by scanline. Each scanline is
+  // rebuilt from its segments, and only replaces the original if the rule
+  // changed any of the voxels.
+  template <class TReader, class TRule>
+  void PaintRunsInternal(TReader &reader, const TRule &rule)
+  {
+    typedef LabelImageType::RLLine RLLine;
+    typedef LabelImageType::BufferType::IndexType BufferIndexType;
+
+    // Run-level updates replace the per-voxel iteration
+    assert(m_LinePos == 0 && m_LineFirstChange < 0);
+
+    RegionType br = m_Image->GetBufferedRegion();
+    long x0 = m_Region.GetIndex(0) - br.GetIndex(0);
+    long x1 = x0 + (long) m_Region.GetSize(0);
+
+    RLLine newLine;
+    std::vector<RunChange> changes;
+
+    IndexType idx = m_Region.GetIndex();
+    for(idx[2] = m_Region.GetIndex(2); idx[2] <= m_Region.GetUpperIndex()[2]; ++idx[2])
+      {
+      for(idx[1] = m_Region.GetIndex(1); idx[1] <= m_Region.GetUpperIndex()[1]; ++idx[1])
+        {
+        BufferIndexType bi = LabelImageType::truncateIndex(idx);
+        RLLine &line = m_Image->GetBuffer()->GetPixel(bi);
+
+        reader.StartLine(idx, x1 - x0);
+        newLine.clear();
+        changes.clear();
+
+        long x = 0;
+        for(size_t s = 0; s < line.size(); s++)
+          {
+          long sStart = x, sEnd = x + line[s].first;
+          LabelType lOld = line[s].second;
+          x = sEnd;
+
+          // Part of the segment before the region
+          if(sStart < x0)
+            LabelImageType::AppendRun(newLine, std::min(sEnd, x0) - sStart, lOld);
+
+          // Part of the segment inside the region
+          for(long a = std::max(sStart, x0), b = std::min(sEnd, x1); a < b; )
+            {
+            long n = std::min(b - a, reader.GetRemaining());
+            LabelType lNew = rule(lOld, reader.GetValue());
+            if(lNew != lOld)
+              {
+              RunChange rc = { a, n, (LabelType)(lNew - lOld) };
+              if(changes.size() && changes.back().Start + changes.back().Length == a
+                 && changes.back().Delta == rc.Delta)
+                changes.back().Length += n;
+              else
+                changes.push_back(rc);
+              m_ChangedVoxels += n;
+              }
+            LabelImageType::AppendRun(newLine, n, lNew);
+            reader.Advance(n);
+            a += n;
+            }
+
+          // Part of the segment after the region
+          if(sEnd > x1)
+            LabelImageType::AppendRun(newLine, sEnd - std::max(sStart, x1), lOld);
+          }
+
+        if(changes.size())
+          {
+          line.swap(newLine);
+
+          // Record the changed stretch in the undo delta
+          IndexType start = idx;
+          start[0] = changes.front().Start + br.GetIndex(0);
+          m_Delta->BeginLine(start);
+          long pos = changes.front().Start;
+          for(size_t k = 0; k < changes.size(); k++)
+            {
+            m_Delta->Encode(0, changes[k].Start - pos);
+            m_Delta->Encode(changes[k].Delta, changes[k].Length);
+            pos = changes[k].Start + changes[k].Length;
+            }
+          }
+        }
+      }
+
+    // The iteration is complete
+    m_Iterator.GoToEnd();
+  }
+
+  // Add the changed stretch of the current scanline to the delta. Only
+  // scanlines with changes are stored, so sparse edits to large regions
+  // produce small deltas that are also fast to undo.
+  void FlushLine()
+  {
+    if(m_LineFirstChange >= 0)
+      {
+      IndexType start = m_LineIndex;
+      start[0] += m_LineFirstChange;
+      m_Delta->BeginLine(start);
+      for(long i = m_LineFirstChange; i <= m_LineLastChange; i++)
+        m_Delta->Encode(m_LineBuffer[i]);
+      m_LineFirstChange = m_LineLastChange = -1;
+      }
+  }
+
   // Name of the segmentation update (for undo tracking)
   std::string m_Title;
 
@@ -273,12 +611,20 @@ protected:
   // RLE encoding of the segmentation update - for storing undo/redo points
   UndoDelta *m_Delta;
 
+  // The label image
+  LabelImageType *m_Image;
+
   // Iterator used internally
   LabelIteratorType m_Iterator;
 
   // Delta at the current location
   LabelType m_VoxelDelta;
 
+  // Deltas along the current scanline and the range where they are non-zero
+  std::vector<LabelType> m_LineBuffer;
+  IndexType m_LineIndex;
+  long m_LinePos, m_LineFirstChange, m_LineLastChange;
+
   // Number of voxels actually modified
   unsigned long m_ChangedVoxels;
 };
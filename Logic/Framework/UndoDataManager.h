@@ -37,6 +37,7 @@
 
 #include <vector>
 #include <list>
+#include <cstdio>
 
 #include <RLEImage.h>
 
@@ -44,49 +45,194 @@
  * The Delta class represents a difference between two images used in
  * the Undo system. It only supports linear traversal of images and
  * stores differences in an RLE (run length encoding) format.
+ *
+ * The runs are packed into a byte buffer, each run being a varint-coded
+ * length followed by the raw bytes of the value. When encoding is finished
+ * the buffer is deflated with zlib if that makes it smaller. The runs are
+ * read back sequentially using RLEIterator. The encoded buffer can also be
+ * moved out to a file (see Spill/Restore), which the UndoDataManager uses
+ * to keep old commits without holding them in memory.
+ *
+ * By default the values cover the whole region in raster order. A delta
+ * can instead be made sparse by calling BeginLine() before encoding the
+ * values of each changed stretch of a scanline. Only these stretches are
+ * stored, and the region is shrunk to their bounding box when encoding is
+ * finished. The stretches can be read back using LineIterator.
  */
 template <typename TPixel>
 class UndoDelta
 {
 public:
   typedef itk::ImageRegion<3> RegionType;
+  typedef itk::Index<3> IndexType;
 
   UndoDelta();
 
   void SetRegion(const RegionType &region)
   { this->m_Region = region; }
 
+  /**
+   * Start a new stretch of a sparse delta. The values passed to Encode()
+   * until the next call are applied along the x axis starting at index
+   * start. Lines must be started in raster order within the region.
+   */
+  void BeginLine(const IndexType &start);
+
+  /** Whether the delta only stores selected stretches of scanlines */
+  bool IsSparse() const
+  { return m_Sparse; }
+
+  /** Number of stretches in a sparse delta */
+  size_t GetNumberOfLines() const
+  { return m_NumberOfLines; }
+
   const RegionType &GetRegion()
   { return m_Region; }
 
   void Encode(const TPixel &value);
 
-  void FinishEncoding();
-
-  size_t GetNumberOfRLEs()
-  { return m_Array.size(); }
+  /** Encode a run of identical values */
+  void Encode(const TPixel &value, size_t count);
 
-  TPixel GetRLEValue(size_t i)
-  { return m_Array[i].second; }
+  void FinishEncoding();
 
-  size_t GetRLELength(size_t i)
-  { return m_Array[i].first; }
+  size_t GetNumberOfRLEs() const
+  { return m_NumberOfRLEs; }
 
   unsigned long GetUniqueID() const
   { return m_UniqueID; }
 
+  /** MTime of the image before the changes in this delta, or 0 if unknown */
+  void SetImageMTime(itk::ModifiedTimeType mtime)
+  { m_ImageMTime = mtime; }
+
+  itk::ModifiedTimeType GetImageMTime() const
+  { return m_ImageMTime; }
+
+  /** Size of the encoded data, whether it is held in memory or on disk */
+  size_t GetEncodedSize() const
+  { return m_EncodedSize + m_LineDataSize; }
+
+  /** Number of bytes of encoded data currently held in memory */
+  size_t GetMemorySize() const
+  { return m_Data.capacity() + m_LineData.capacity(); }
+
+  /** Whether the encoded data lives in a spill file */
+  bool IsSpilled() const
+  { return m_SpillOffset >= 0; }
+
+  /** Append the encoded data to the end of a file and release it from memory */
+  bool Spill(FILE *file);
+
+  /** Read the data of a spilled delta back into memory */
+  bool Restore(FILE *file);
+
+  /** Release the memory held by a spilled delta after Restore */
+  void ReleaseRestored();
+
+  /** 64-bit position in a spill file, which may grow past 2GB */
+  typedef long long SpillOffsetType;
+
+  /**
+   * Append the data of a spilled delta to another file, returning its
+   * position in that file, or -1 on failure. The delta still refers to its
+   * data in the original file until SetSpillOffset() is called.
+   */
+  SpillOffsetType CopySpill(FILE *source, FILE *target);
+
+  /** Refer to the data of a spilled delta at a new position */
+  void SetSpillOffset(SpillOffsetType offset)
+  { m_SpillOffset = offset; }
+
   UndoDelta & operator = (const UndoDelta &other);
 
+  /** Sequential access to the runs stored in a finished delta */
+  class RLEIterator
+  {
+  public:
+    RLEIterator(const UndoDelta<TPixel> *delta);
+
+    bool IsAtEnd() const
+    { return m_Index >= m_Count; }
+
+    size_t GetLength() const
+    { return m_Length; }
+
+    const TPixel &GetValue() const
+    { return m_Value; }
+
+    RLEIterator &operator ++ ()
+    { ++m_Index; this->ReadRLE(); return *this; }
+
+  private:
+    void ReadRLE();
+
+    std::vector<unsigned char> m_Inflated;
+    const unsigned char *m_Ptr;
+    size_t m_Index, m_Count, m_Length;
+    TPixel m_Value;
+  };
+
+  /** Sequential access to the stretches of a finished sparse delta */
+  class LineIterator
+  {
+  public:
+    LineIterator(const UndoDelta<TPixel> *delta);
+
+    bool IsAtEnd() const
+    { return m_Index >= m_Count; }
+
+    /** Index of the first voxel in the stretch */
+    const IndexType &GetIndex() const
+    { return m_Start; }
+
+    /** Number of voxels in the stretch along the x axis */
+    size_t GetLength() const
+    { return m_Length; }
+
+    LineIterator &operator ++ ()
+    { ++m_Index; this->ReadLine(); return *this; }
+
+  private:
+    void ReadLine();
+
+    const unsigned char *m_Ptr;
+    IndexType m_Origin, m_Start;
+    size_t m_Index, m_Count, m_Length;
+  };
+
 protected:
-  typedef std::pair<size_t, TPixel> RLEPair;
-  typedef std::vector<RLEPair> RLEArray;
-  RLEArray m_Array;
+  void AppendRLE(size_t length, const TPixel &value);
+  void CloseLine();
+
+  static void AppendVarint(std::vector<unsigned char> &buffer, size_t value);
+  static size_t ReadVarint(const unsigned char * &ptr);
+
+  // Encoded runs (possibly deflated)
+  std::vector<unsigned char> m_Data;
+  size_t m_NumberOfRLEs, m_EncodedSize, m_InflatedSize;
+  bool m_Deflated, m_Finished;
+
+  // Varint-coded stretches of a sparse delta, relative to m_LineOrigin
+  std::vector<unsigned char> m_LineData;
+  size_t m_NumberOfLines, m_LineDataSize, m_NumberOfValues, m_LineValueStart;
+  IndexType m_LineOrigin, m_LineStart, m_LastLineStart;
+  IndexType m_LineMin, m_LineMax;
+  bool m_Sparse, m_LineOpen;
+
+  // Position of the data in the spill file, or -1 if the data is in memory
+  SpillOffsetType m_SpillOffset;
+
+  // State of the run being encoded
   size_t m_CurrentLength;
   TPixel m_LastValue;
 
   // The delta is associated with an image region
   RegionType m_Region;
 
+  // Image state the delta applies to
+  itk::ModifiedTimeType m_ImageMTime;
+
   // Each delta is assigned a unique ID at creation
   unsigned long m_UniqueID;
   static unsigned long m_UniqueIDCounter;
@@ -123,13 +269,43 @@ public:
     Commit(const DList &list, const char *name);
     void DeleteDeltas();
     size_t GetNumberOfRLEs() const;
+    size_t GetEncodedSize() const;
     const DList &GetDeltas() const { return m_Deltas; }
+
+    /** Move the data of all deltas to a spill file */
+    bool Spill(FILE *file);
+    bool IsSpilled() const { return m_Spilled; }
+
+    /** Load/release the data of a spilled commit */
+    bool Restore(FILE *file);
+    void ReleaseRestored();
+
+    /** Copy the data of a spilled commit to another file, appending the new
+     * positions of the deltas to the list */
+    bool CopySpill(FILE *source, FILE *target,
+                   std::vector<typename Delta::SpillOffsetType> &offsets);
+
+    /** Refer to the copies made by CopySpill, starting at position k in the
+     * list, which is advanced past the deltas of this commit */
+    void SetSpillOffsets(
+        const std::vector<typename Delta::SpillOffsetType> &offsets, size_t &k);
+
   protected:
     DList m_Deltas;
     std::string m_Name;
+    bool m_Spilled;
   };
 
-  UndoDataManager(size_t nMinCommits, size_t nMaxTotalSize);
+  /**
+   * Create the manager. At least nMinCommits commits are kept in memory,
+   * and older commits are evicted once the encoded deltas take up more than
+   * nMaxTotalSize bytes. If nMaxSpillSize is non-zero, evicted commits are
+   * written to a temporary file rather than discarded, until that file holds
+   * nMaxSpillSize bytes of live data.
+   */
+  UndoDataManager(size_t nMinCommits, size_t nMaxTotalSize, size_t nMaxSpillSize = 0);
+
+  virtual ~UndoDataManager();
 
   /** Add a delta to the staging list. The staging list must be committed */
   void AddDeltaToStaging(Delta *delta);
@@ -149,6 +325,19 @@ public:
   size_t GetNumberOfCommits()
     { return m_CommitList.size(); }
 
+  /** Number of commits whose data is in the spill file */
+  size_t GetNumberOfSpilledCommits()
+    { return m_NumberOfSpilledCommits; }
+
+  /** Bytes of encoded delta data held in memory / in the spill file */
+  size_t GetTotalSize() const { return m_TotalSize; }
+  size_t GetSpilledSize() const { return m_SpilledSize; }
+
+protected:
+
+  // Create the temporary file that commits are spilled to
+  virtual FILE *CreateSpillFile();
+
 private:
 
   // Current staging list - where deltas are added
@@ -159,10 +348,33 @@ private:
   typedef typename CList::iterator CIterator;
   typedef typename CList::const_iterator CConstIterator;
 
-  // A list of commits
+  // Move a commit out of memory, spilling it if possible. If it cannot be
+  // spilled, it is dropped along with all the older commits
+  void EvictCommit(CIterator it);
+
+  // Load the data of a commit about to be undone/redone
+  void PrepareCommit(CIterator it);
+
+  // Close the spill file
+  void ResetSpillFile();
+
+  // After spilled commits are dropped, close the spill file if it holds no
+  // more commits, or compact it if most of it is taken by dropped commits
+  void ShrinkSpillFile();
+
+  // Copy the data of the spilled commits to a new spill file
+  void CompactSpillFile();
+
+  // A list of commits. Spilled commits always form a prefix of this list
   CList m_CommitList;
   CIterator m_Position;
   size_t m_TotalSize, m_MinCommits, m_MaxTotalSize;
+
+  // Spill tier. The file holds m_SpilledSize bytes of live data, out of
+  // m_SpillFileSize bytes written to it
+  FILE *m_SpillFile;
+  size_t m_SpilledSize, m_MaxSpillSize, m_NumberOfSpilledCommits;
+  unsigned long long m_SpillFileSize;
 };
 
 #endif // __UndoDataManager_h_
@@ -33,6 +33,11 @@
 
 =========================================================================*/
 
+#include "itk_zlib.h"
+#include <cstring>
+#include <iterator>
+#include <algorithm>
+
 template<typename TPixel> unsigned long UndoDelta<TPixel>::m_UniqueIDCounter = 0;
 
 template<typename TPixel>
@@ -40,14 +45,74 @@ UndoDelta<TPixel>
 ::UndoDelta()
 {
   m_CurrentLength = 0;
+  m_NumberOfRLEs = 0;
+  m_EncodedSize = 0;
+  m_InflatedSize = 0;
+  m_Deflated = false;
+  m_Finished = false;
+  m_SpillOffset = -1;
+  m_NumberOfLines = 0;
+  m_LineDataSize = 0;
+  m_NumberOfValues = 0;
+  m_LineValueStart = 0;
+  m_Sparse = false;
+  m_LineOpen = false;
+  m_ImageMTime = 0;
   m_UniqueID = m_UniqueIDCounter++;
 }
 
+template<typename TPixel>
+void
+UndoDelta<TPixel>
+::AppendVarint(std::vector<unsigned char> &buffer, size_t value)
+{
+  // Seven bits at a time, with the high bit flagging continuation
+  while(value >= 0x80)
+    {
+    buffer.push_back((unsigned char)(value | 0x80));
+    value >>= 7;
+    }
+  buffer.push_back((unsigned char) value);
+}
+
+template<typename TPixel>
+size_t
+UndoDelta<TPixel>
+::ReadVarint(const unsigned char * &ptr)
+{
+  size_t value = 0;
+  for(unsigned int shift = 0; ; shift += 7)
+    {
+    unsigned char b = *ptr++;
+    value |= ((size_t)(b & 0x7f)) << shift;
+    if(!(b & 0x80))
+      break;
+    }
+  return value;
+}
+
+template<typename TPixel>
+void
+UndoDelta<TPixel>
+::AppendRLE(size_t length, const TPixel &value)
+{
+  // The length is stored as a varint
+  AppendVarint(m_Data, length);
+
+  // The value is stored as raw bytes
+  const unsigned char *pv = reinterpret_cast<const unsigned char *>(&value);
+  m_Data.insert(m_Data.end(), pv, pv + sizeof(TPixel));
+  m_NumberOfRLEs++;
+}
+
 template<typename TPixel>
 void
 UndoDelta<TPixel>
 ::Encode(const TPixel &value)
 {
+  assert(!m_Finished);
+  m_NumberOfValues++;
+
   if(m_CurrentLength == 0)
     {
     m_LastValue = value;
@@ -59,19 +124,270 @@ UndoDelta<TPixel>
     }
   else
     {
-    m_Array.push_back(std::make_pair(m_CurrentLength, m_LastValue));
+    this->AppendRLE(m_CurrentLength, m_LastValue);
     m_CurrentLength = 1;
     m_LastValue = value;
     }
 }
 
+template<typename TPixel>
+void
+UndoDelta<TPixel>
+::Encode(const TPixel &value, size_t count)
+{
+  assert(!m_Finished);
+  if(count == 0)
+    return;
+
+  m_NumberOfValues += count;
+
+  if(m_CurrentLength == 0)
+    {
+    m_LastValue = value;
+    m_CurrentLength = count;
+    }
+  else if(value == m_LastValue)
+    {
+    m_CurrentLength += count;
+    }
+  else
+    {
+    this->AppendRLE(m_CurrentLength, m_LastValue);
+    m_CurrentLength = count;
+    m_LastValue = value;
+    }
+}
+
 template<typename TPixel>
 void
 UndoDelta<TPixel>
 ::FinishEncoding()
 {
+  if(m_Finished)
+    return;
+
+  if(m_LineOpen)
+    this->CloseLine();
+
   if(m_CurrentLength > 0)
-    m_Array.push_back(std::make_pair(m_CurrentLength, m_LastValue));
+    this->AppendRLE(m_CurrentLength, m_LastValue);
+  m_CurrentLength = 0;
+  m_Finished = true;
+
+  // Deflate the runs. A fast compression level is used since this happens
+  // at the end of every paint operation, and the result is only kept if it
+  // actually saves space. Tiny deltas are not worth the zlib overhead.
+  if(m_Data.size() > 64)
+    {
+    uLongf zsize = compressBound(m_Data.size());
+    std::vector<unsigned char> zdata(zsize);
+    if(compress2(&zdata[0], &zsize, &m_Data[0], m_Data.size(), 1) == Z_OK
+       && zsize < m_Data.size())
+      {
+      zdata.resize(zsize);
+      m_InflatedSize = m_Data.size();
+      m_Deflated = true;
+      m_Data.swap(zdata);
+      }
+    }
+
+  // Trim the buffer to its exact size
+  std::vector<unsigned char>(m_Data).swap(m_Data);
+  m_EncodedSize = m_Data.size();
+
+  // A sparse delta only needs to cover the stretches it stores
+  if(m_Sparse)
+    {
+    std::vector<unsigned char>(m_LineData).swap(m_LineData);
+    m_LineDataSize = m_LineData.size();
+
+    RegionType bbox;
+    bbox.SetIndex(m_LineOrigin);
+    if(m_NumberOfLines > 0)
+      {
+      bbox.SetIndex(m_LineMin);
+      for(unsigned int d = 0; d < 3; d++)
+        bbox.SetSize(d, m_LineMax[d] - m_LineMin[d] + 1);
+      }
+    m_Region = bbox;
+    }
+}
+
+template<typename TPixel>
+void
+UndoDelta<TPixel>
+::BeginLine(const IndexType &start)
+{
+  assert(!m_Finished);
+
+  if(m_LineOpen)
+    this->CloseLine();
+
+  if(!m_Sparse)
+    {
+    // Values can't be mixed between dense and sparse encoding
+    assert(m_NumberOfValues == 0);
+    m_Sparse = true;
+    m_LineOrigin = m_Region.GetIndex();
+    m_LastLineStart = m_LineOrigin;
+    }
+
+  m_LineStart = start;
+  m_LineValueStart = m_NumberOfValues;
+  m_LineOpen = true;
+}
+
+template<typename TPixel>
+void
+UndoDelta<TPixel>
+::CloseLine()
+{
+  m_LineOpen = false;
+  size_t length = m_NumberOfValues - m_LineValueStart;
+  if(length == 0)
+    return;
+
+  // Lines come in raster order, so z and y are coded as increments from
+  // the previous line, and x relative to the origin of the region
+  assert(m_LineStart[2] >= m_LastLineStart[2]);
+  size_t dz = m_LineStart[2] - m_LastLineStart[2];
+  size_t dy = dz > 0
+      ? m_LineStart[1] - m_LineOrigin[1]
+      : m_LineStart[1] - m_LastLineStart[1];
+  assert(m_LineStart[0] >= m_LineOrigin[0]);
+
+  AppendVarint(m_LineData, dz);
+  AppendVarint(m_LineData, dy);
+  AppendVarint(m_LineData, m_LineStart[0] - m_LineOrigin[0]);
+  AppendVarint(m_LineData, length);
+
+  // Update the bounding box of the stretches
+  IndexType end = m_LineStart;
+  end[0] += length - 1;
+  if(m_NumberOfLines == 0)
+    {
+    m_LineMin = m_LineStart;
+    m_LineMax = end;
+    }
+  else
+    {
+    for(unsigned int d = 0; d < 3; d++)
+      {
+      m_LineMin[d] = std::min(m_LineMin[d], m_LineStart[d]);
+      m_LineMax[d] = std::max(m_LineMax[d], end[d]);
+      }
+    }
+
+  m_LastLineStart = m_LineStart;
+  m_NumberOfLines++;
+}
+
+// Seek and tell with 64-bit positions, since the spill file may grow past
+// 2GB, which a long does not hold on all platforms
+inline int UndoSpillSeek(FILE *file, long long offset, int origin)
+{
+#ifdef _WIN32
+  return _fseeki64(file, offset, origin);
+#else
+  return fseeko(file, (off_t) offset, origin);
+#endif
+}
+
+inline long long UndoSpillTell(FILE *file)
+{
+#ifdef _WIN32
+  return _ftelli64(file);
+#else
+  return (long long) ftello(file);
+#endif
+}
+
+template<typename TPixel>
+bool
+UndoDelta<TPixel>
+::Spill(FILE *file)
+{
+  assert(m_Finished);
+  if(this->IsSpilled())
+    return true;
+
+  if(UndoSpillSeek(file, 0, SEEK_END) != 0)
+    return false;
+
+  SpillOffsetType offset = UndoSpillTell(file);
+  if(offset < 0)
+    return false;
+
+  if(m_EncodedSize > 0 && fwrite(&m_Data[0], 1, m_EncodedSize, file) != m_EncodedSize)
+    return false;
+  if(m_LineDataSize > 0 && fwrite(&m_LineData[0], 1, m_LineDataSize, file) != m_LineDataSize)
+    return false;
+
+  m_SpillOffset = offset;
+  std::vector<unsigned char>().swap(m_Data);
+  std::vector<unsigned char>().swap(m_LineData);
+  return true;
+}
+
+template<typename TPixel>
+bool
+UndoDelta<TPixel>
+::Restore(FILE *file)
+{
+  if(!this->IsSpilled()
+     || (m_Data.size() == m_EncodedSize && m_LineData.size() == m_LineDataSize))
+    return true;
+
+  std::vector<unsigned char> data(m_EncodedSize), line_data(m_LineDataSize);
+  if(UndoSpillSeek(file, m_SpillOffset, SEEK_SET) != 0)
+    return false;
+  if(m_EncodedSize > 0 && fread(&data[0], 1, m_EncodedSize, file) != m_EncodedSize)
+    return false;
+  if(m_LineDataSize > 0 && fread(&line_data[0], 1, m_LineDataSize, file) != m_LineDataSize)
+    return false;
+
+  m_Data.swap(data);
+  m_LineData.swap(line_data);
+  return true;
+}
+
+template<typename TPixel>
+void
+UndoDelta<TPixel>
+::ReleaseRestored()
+{
+  if(this->IsSpilled())
+    {
+    std::vector<unsigned char>().swap(m_Data);
+    std::vector<unsigned char>().swap(m_LineData);
+    }
+}
+
+template<typename TPixel>
+typename UndoDelta<TPixel>::SpillOffsetType
+UndoDelta<TPixel>
+::CopySpill(FILE *source, FILE *target)
+{
+  assert(this->IsSpilled());
+
+  // The encoded runs and the line data are stored back to back
+  size_t size = m_EncodedSize + m_LineDataSize;
+  std::vector<unsigned char> buffer(size);
+  if(size > 0)
+    {
+    if(UndoSpillSeek(source, m_SpillOffset, SEEK_SET) != 0
+       || fread(&buffer[0], 1, size, source) != size)
+      return -1;
+    }
+
+  if(UndoSpillSeek(target, 0, SEEK_END) != 0)
+    return -1;
+
+  SpillOffsetType offset = UndoSpillTell(target);
+  if(offset < 0 || (size > 0 && fwrite(&buffer[0], 1, size, target) != size))
+    return -1;
+
+  return offset;
 }
 
 template<typename TPixel>
@@ -79,24 +395,224 @@ UndoDelta<TPixel> &
 UndoDelta<TPixel>
 ::operator = (const UndoDelta<TPixel> &other)
 {
-  m_Array = other.m_Array;
+  // Spilled data belongs to the file of the source manager, so only the
+  // in-memory state is copied
+  assert(!other.IsSpilled());
+  m_Data = other.m_Data;
+  m_NumberOfRLEs = other.m_NumberOfRLEs;
+  m_EncodedSize = other.m_EncodedSize;
+  m_InflatedSize = other.m_InflatedSize;
+  m_Deflated = other.m_Deflated;
+  m_Finished = other.m_Finished;
+  m_SpillOffset = -1;
+  m_LineData = other.m_LineData;
+  m_NumberOfLines = other.m_NumberOfLines;
+  m_LineDataSize = other.m_LineDataSize;
+  m_NumberOfValues = other.m_NumberOfValues;
+  m_LineValueStart = other.m_LineValueStart;
+  m_LineOrigin = other.m_LineOrigin;
+  m_LineStart = other.m_LineStart;
+  m_LastLineStart = other.m_LastLineStart;
+  m_LineMin = other.m_LineMin;
+  m_LineMax = other.m_LineMax;
+  m_Sparse = other.m_Sparse;
+  m_LineOpen = other.m_LineOpen;
   m_CurrentLength = other.m_CurrentLength;
   m_LastValue = other.m_LastValue;
   m_Region = other.m_Region;
+  m_ImageMTime = other.m_ImageMTime;
   return *this;
 }
 
+template<typename TPixel>
+UndoDelta<TPixel>::RLEIterator
+::RLEIterator(const UndoDelta<TPixel> *delta)
+{
+  // The data of a spilled delta must be restored before reading it
+  assert(delta->m_Finished);
+  assert(delta->m_Data.size() == delta->m_EncodedSize);
+
+  m_Index = 0;
+  m_Count = delta->m_NumberOfRLEs;
+  m_Length = 0;
+  m_Ptr = NULL;
+
+  if(m_Count == 0)
+    return;
+
+  if(delta->m_Deflated)
+    {
+    m_Inflated.resize(delta->m_InflatedSize);
+    uLongf size = delta->m_InflatedSize;
+    if(uncompress(&m_Inflated[0], &size, &delta->m_Data[0], delta->m_EncodedSize) != Z_OK
+       || size != delta->m_InflatedSize)
+      {
+      // This should never happen, but don't read garbage if it does
+      m_Count = 0;
+      return;
+      }
+    m_Ptr = &m_Inflated[0];
+    }
+  else
+    {
+    m_Ptr = &delta->m_Data[0];
+    }
+
+  this->ReadRLE();
+}
+
+template<typename TPixel>
+void
+UndoDelta<TPixel>::RLEIterator
+::ReadRLE()
+{
+  if(m_Index >= m_Count)
+    return;
+
+  // Decode the varint length
+  m_Length = UndoDelta<TPixel>::ReadVarint(m_Ptr);
+
+  // Read the value
+  memcpy(&m_Value, m_Ptr, sizeof(TPixel));
+  m_Ptr += sizeof(TPixel);
+}
+
+template<typename TPixel>
+UndoDelta<TPixel>::LineIterator
+::LineIterator(const UndoDelta<TPixel> *delta)
+{
+  assert(delta->m_Finished);
+  assert(delta->m_LineData.size() == delta->m_LineDataSize);
+
+  m_Index = 0;
+  m_Count = delta->m_NumberOfLines;
+  m_Length = 0;
+  m_Origin = delta->m_LineOrigin;
+  m_Start = m_Origin;
+  m_Ptr = m_Count > 0 ? &delta->m_LineData[0] : NULL;
+
+  this->ReadLine();
+}
+
+template<typename TPixel>
+void
+UndoDelta<TPixel>::LineIterator
+::ReadLine()
+{
+  if(m_Index >= m_Count)
+    return;
+
+  size_t dz = UndoDelta<TPixel>::ReadVarint(m_Ptr);
+  size_t dy = UndoDelta<TPixel>::ReadVarint(m_Ptr);
+  size_t dx = UndoDelta<TPixel>::ReadVarint(m_Ptr);
+  m_Length = UndoDelta<TPixel>::ReadVarint(m_Ptr);
+
+  if(dz > 0)
+    {
+    m_Start[2] += dz;
+    m_Start[1] = m_Origin[1] + dy;
+    }
+  else
+    {
+    m_Start[1] += dy;
+    }
+  m_Start[0] = m_Origin[0] + dx;
+}
+
+
 
 template<typename TPixel>
 UndoDataManager<TPixel>
-::UndoDataManager(size_t nMinCommits, size_t nMaxTotalSize)
+::UndoDataManager(size_t nMinCommits, size_t nMaxTotalSize, size_t nMaxSpillSize)
 {
   this->m_MinCommits = nMinCommits;
   this->m_MaxTotalSize = nMaxTotalSize;
+  this->m_MaxSpillSize = nMaxSpillSize;
   this->m_TotalSize = 0;
+  this->m_SpilledSize = 0;
+  this->m_NumberOfSpilledCommits = 0;
+  this->m_SpillFile = NULL;
+  this->m_SpillFileSize = 0;
   m_Position = m_CommitList.begin();
 }
 
+template<typename TPixel>
+UndoDataManager<TPixel>
+::~UndoDataManager()
+{
+  this->Clear();
+}
+
+template<typename TPixel>
+FILE *
+UndoDataManager<TPixel>
+::CreateSpillFile()
+{
+  return tmpfile();
+}
+
+template<typename TPixel>
+void
+UndoDataManager<TPixel>
+::ResetSpillFile()
+{
+  if(m_SpillFile)
+    {
+    fclose(m_SpillFile);
+    m_SpillFile = NULL;
+    }
+  m_SpilledSize = 0;
+  m_SpillFileSize = 0;
+}
+
+template<typename TPixel>
+void
+UndoDataManager<TPixel>
+::ShrinkSpillFile()
+{
+  if(m_NumberOfSpilledCommits == 0)
+    this->ResetSpillFile();
+
+  // Dropped commits leave holes in the file, which would otherwise grow
+  // without bound over a long session. Once the holes take up more than
+  // half of the file, the live data are copied to a new file
+  else if(m_SpillFileSize > 2 * (unsigned long long) m_SpilledSize)
+    this->CompactSpillFile();
+}
+
+template<typename TPixel>
+void
+UndoDataManager<TPixel>
+::CompactSpillFile()
+{
+  FILE *file = this->CreateSpillFile();
+  if(!file)
+    return;
+
+  // Copy all the spilled commits first, so that if this fails, the commits
+  // still refer to the old file, which remains valid
+  std::vector<typename Delta::SpillOffsetType> offsets;
+  CIterator it = m_CommitList.begin();
+  for(size_t i = 0; i < m_NumberOfSpilledCommits; ++i, ++it)
+    {
+    if(!it->CopySpill(m_SpillFile, file, offsets))
+      {
+      fclose(file);
+      return;
+      }
+    }
+
+  // Switch the commits to the new file
+  size_t k = 0;
+  it = m_CommitList.begin();
+  for(size_t i = 0; i < m_NumberOfSpilledCommits; ++i, ++it)
+    it->SetSpillOffsets(offsets, k);
+
+  fclose(m_SpillFile);
+  m_SpillFile = file;
+  m_SpillFileSize = m_SpilledSize;
+}
+
 template<typename TPixel>
 void
 UndoDataManager<TPixel>
@@ -111,6 +627,8 @@ UndoDataManager<TPixel>
     m_Position = m_CommitList.erase(m_Position);
     }
   m_TotalSize = 0;
+  m_NumberOfSpilledCommits = 0;
+  this->ResetSpillFile();
 
   // Clear the staging list
   m_StagingList.clear();
@@ -125,6 +643,79 @@ UndoDataManager<TPixel>
   m_StagingList.push_back(delta);
 }
 
+template<typename TPixel>
+void
+UndoDataManager<TPixel>
+::EvictCommit(CIterator it)
+{
+  // Only the oldest in-memory commit may be evicted, so that the spilled
+  // commits remain a prefix of the list
+  size_t size = it->GetEncodedSize();
+  m_TotalSize -= size;
+
+  if(m_MaxSpillSize > 0 && !m_SpillFile)
+    m_SpillFile = this->CreateSpillFile();
+
+  if(m_MaxSpillSize > 0 && m_SpillFile && it->Spill(m_SpillFile))
+    {
+    m_SpilledSize += size;
+    m_SpillFileSize += size;
+    m_NumberOfSpilledCommits++;
+    }
+  else
+    {
+    // No spill tier, or writing failed: the commit is lost. The spilled
+    // commits are older, and undoing them would skip over this one, so
+    // they are dropped as well. The commit may have been partly written
+    // to the spill file, which is then started over
+    CIterator itEnd = it;
+    ++itEnd;
+    while(m_CommitList.begin() != itEnd)
+      {
+      CIterator itHead = m_CommitList.begin();
+      if(m_Position == itHead)
+        m_Position = itEnd;
+      itHead->DeleteDeltas();
+      m_CommitList.erase(itHead);
+      }
+    m_NumberOfSpilledCommits = 0;
+    this->ResetSpillFile();
+    return;
+    }
+
+  // Drop the oldest spilled commits if the spill file holds too much
+  while(m_NumberOfSpilledCommits > 0 && m_SpilledSize > m_MaxSpillSize)
+    {
+    CIterator itHead = m_CommitList.begin();
+    if(m_Position == itHead)
+      ++m_Position;
+    m_SpilledSize -= itHead->GetEncodedSize();
+    m_NumberOfSpilledCommits--;
+    itHead->DeleteDeltas();
+    m_CommitList.erase(itHead);
+    }
+
+  this->ShrinkSpillFile();
+}
+
+template<typename TPixel>
+void
+UndoDataManager<TPixel>
+::PrepareCommit(CIterator it)
+{
+  // Free the memory used by any previously restored commits
+  CIterator itSpilled = m_CommitList.begin();
+  for(size_t i = 0; i < m_NumberOfSpilledCommits; ++i, ++itSpilled)
+    if(itSpilled != it)
+      itSpilled->ReleaseRestored();
+
+  if(it->IsSpilled())
+    {
+    if(!m_SpillFile || !it->Restore(m_SpillFile))
+      itkGenericExceptionMacro(<< "Failed to read undo data from the spill file");
+    }
+}
+
 template<typename TPixel>
 int
 UndoDataManager<TPixel>
@@ -135,11 +726,21 @@ UndoDataManager<TPixel>
   // to the end. So that's the loop that we do
   while(m_Position != m_CommitList.end())
     {
-    m_TotalSize -= m_Position->GetNumberOfRLEs();
+    if(m_Position->IsSpilled())
+      {
+      m_SpilledSize -= m_Position->GetEncodedSize();
+      m_NumberOfSpilledCommits--;
+      }
+    else
+      {
+      m_TotalSize -= m_Position->GetEncodedSize();
+      }
     m_Position->DeleteDeltas();
     m_Position = m_CommitList.erase(m_Position);
     }
 
+  this->ShrinkSpillFile();
+
   // Create a commit that we will be adding
   Commit new_commit(m_StagingList, text);
 
@@ -156,20 +757,22 @@ UndoDataManager<TPixel>
     return 0;
     }
 
-  // Check whether we need to prune from the back to keep total size under control
-  CIterator itHead = m_CommitList.begin();
-  while(m_CommitList.size() > m_MinCommits && m_TotalSize + n_new_rles > m_MaxTotalSize)
+  // Check whether we need to evict old commits to keep the memory use under
+  // control. Spilled commits don't count towards the memory budget.
+  size_t new_size = new_commit.GetEncodedSize();
+  while(m_CommitList.size() - m_NumberOfSpilledCommits > m_MinCommits
+        && m_TotalSize + new_size > m_MaxTotalSize)
     {
-    m_TotalSize -= itHead->GetNumberOfRLEs();
-    itHead->DeleteDeltas();
-    itHead = m_CommitList.erase(itHead);
+    CIterator itOldest = m_CommitList.begin();
+    std::advance(itOldest, m_NumberOfSpilledCommits);
+    this->EvictCommit(itOldest);
     }
 
   // Now we have a well pruned list of deltas, and we can append
   // the current delta to it;
   m_CommitList.push_back(new_commit);
   m_Position = m_CommitList.end();
-  m_TotalSize += n_new_rles;
+  m_TotalSize += new_size;
 
   // Return the number of RLEs
   return n_new_rles;
@@ -191,8 +794,13 @@ UndoDataManager<TPixel>
   // Can't be at the beginning
   assert(IsUndoPossible());
 
+  // Make sure the data is in memory before moving the position
+  CIterator itPrev = m_Position;
+  --itPrev;
+  this->PrepareCommit(itPrev);
+
   // Move the position one delta to the beginning
-  m_Position--;
+  m_Position = itPrev;
 
   // Return the current delta
   return *m_Position;
@@ -214,6 +822,9 @@ UndoDataManager<TPixel>
   // Can't be at the beginning
   assert(IsRedoPossible());
 
+  // Make sure the data is in memory
+  this->PrepareCommit(m_Position);
+
   // Return the delta at the current position
   const Commit &commit = *m_Position;
 
@@ -231,6 +842,7 @@ UndoDataManager<TPixel>::Commit::Commit(const DList &list, const char *name)
 {
   m_Deltas = list;
   m_Name = name;
+  m_Spilled = false;
 }
 
 template<typename TPixel>
@@ -263,3 +875,82 @@ UndoDataManager<TPixel>::Commit::GetNumberOfRLEs() const
     }
   return n;
 }
+
+template<typename TPixel>
+size_t
+UndoDataManager<TPixel>::Commit::GetEncodedSize() const
+{
+  size_t n = 0;
+  for(DConstIterator dit = m_Deltas.begin(); dit != m_Deltas.end(); ++dit)
+    {
+    if(*dit)
+      n += (*dit)->GetEncodedSize();
+    }
+  return n;
+}
+
+template<typename TPixel>
+bool
+UndoDataManager<TPixel>::Commit::Spill(FILE *file)
+{
+  for(DIterator dit = m_Deltas.begin(); dit != m_Deltas.end(); ++dit)
+    {
+    if(*dit && !(*dit)->Spill(file))
+      return false;
+    }
+  m_Spilled = true;
+  return true;
+}
+
+template<typename TPixel>
+bool
+UndoDataManager<TPixel>::Commit::Restore(FILE *file)
+{
+  for(DIterator dit = m_Deltas.begin(); dit != m_Deltas.end(); ++dit)
+    {
+    if(*dit && !(*dit)->Restore(file))
+      return false;
+    }
+  return true;
+}
+
+template<typename TPixel>
+void
+UndoDataManager<TPixel>::Commit::ReleaseRestored()
+{
+  for(DIterator dit = m_Deltas.begin(); dit != m_Deltas.end(); ++dit)
+    {
+    if(*dit)
+      (*dit)->ReleaseRestored();
+    }
+}
+
+template<typename TPixel>
+bool
+UndoDataManager<TPixel>::Commit::CopySpill(
+    FILE *source, FILE *target, std::vector<typename Delta::SpillOffsetType> &offsets)
+{
+  for(DIterator dit = m_Deltas.begin(); dit != m_Deltas.end(); ++dit)
+    {
+    if(*dit && (*dit)->IsSpilled())
+      {
+      typename Delta::SpillOffsetType offset = (*dit)->CopySpill(source, target);
+      if(offset < 0)
+        return false;
+      offsets.push_back(offset);
+      }
+    }
+  return true;
+}
+
+template<typename TPixel>
+void
+UndoDataManager<TPixel>::Commit::SetSpillOffsets(
+    const std::vector<typename Delta::SpillOffsetType> &offsets, size_t &k)
+{
+  for(DIterator dit = m_Deltas.begin(); dit != m_Deltas.end(); ++dit)
+    {
+    if(*dit && (*dit)->IsSpilled())
+      (*dit)->SetSpillOffset(offsets[k++]);
+    }
+}
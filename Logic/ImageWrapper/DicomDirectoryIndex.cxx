@@ -0,0 +1,196 @@
+#include "DicomDirectoryIndex.h"
+#include "itksys/MD5.h"
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+
+static const char *DICOM_INDEX_MAGIC = "ITK-SNAP DICOM Index";
+static const int DICOM_INDEX_VERSION = 1;
+
+DicomDirectoryIndex::DicomDirectoryIndex(const std::string &directory,
+                                         unsigned int n_values)
+  : m_Directory(directory), m_NumberOfValues(n_values), m_Modified(false)
+{
+}
+
+std::string
+DicomDirectoryIndex::GetIndexFileName(const std::string &store_dir,
+                                      const std::string &directory)
+{
+  // The index file is named by the MD5 of the directory path
+  char hex_code[33];
+  hex_code[32] = 0;
+  itksysMD5 *md5 = itksysMD5_New();
+  itksysMD5_Initialize(md5);
+  itksysMD5_Append(md5, (unsigned char *) directory.c_str(), directory.size());
+  itksysMD5_FinalizeHex(md5, hex_code);
+  itksysMD5_Delete(md5);
+
+  return store_dir + "/dicom_" + hex_code + ".txt";
+}
+
+std::string DicomDirectoryIndex::Escape(const std::string &text)
+{
+  std::string out;
+  out.reserve(text.size());
+  for(size_t i = 0; i < text.size(); i++)
+    {
+    switch(text[i])
+      {
+      case '\\': out += "\\\\"; break;
+      case '\t': out += "\\t"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      default: out += text[i];
+      }
+    }
+  return out;
+}
+
+std::string DicomDirectoryIndex::Unescape(const std::string &text)
+{
+  std::string out;
+  out.reserve(text.size());
+  for(size_t i = 0; i < text.size(); i++)
+    {
+    if(text[i] == '\\' && i + 1 < text.size())
+      {
+      char c = text[++i];
+      out += (c == 't') ? '\t' : (c == 'n') ? '\n' : (c == 'r') ? '\r' : c;
+      }
+    else
+      out += text[i];
+    }
+  return out;
+}
+
+// Split a line on tabs
+static void SplitIndexLine(const std::string &line, std::vector<std::string> &fields)
+{
+  fields.clear();
+  size_t pos = 0;
+  while(true)
+    {
+    size_t next = line.find('\t', pos);
+    fields.push_back(line.substr(pos, next == std::string::npos ? next : next - pos));
+    if(next == std::string::npos)
+      break;
+    pos = next + 1;
+    }
+}
+
+bool DicomDirectoryIndex::Load(const std::string &index_file)
+{
+  m_Entries.clear();
+  m_Modified = false;
+
+  std::ifstream ifs(index_file.c_str());
+  if(!ifs.good())
+    return false;
+
+  // Check the header
+  std::string line;
+  std::vector<std::string> fields;
+  if(!std::getline(ifs, line))
+    return false;
+
+  SplitIndexLine(line, fields);
+  if(fields.size() != 4
+     || fields[0] != DICOM_INDEX_MAGIC
+     || atoi(fields[1].c_str()) != DICOM_INDEX_VERSION
+     || atoi(fields[2].c_str()) != (int) m_NumberOfValues
+     || Unescape(fields[3]) != m_Directory)
+    return false;
+
+  // Read the entries. Lines that are malformed are skipped, so that the
+  // corresponding files are parsed again
+  while(std::getline(ifs, line))
+    {
+    SplitIndexLine(line, fields);
+    if(fields.size() != 4 + m_NumberOfValues)
+      continue;
+
+    Entry entry;
+    entry.Size = strtoul(fields[1].c_str(), NULL, 10);
+    entry.ModifiedTime = strtol(fields[2].c_str(), NULL, 10);
+    entry.IsDicom = (fields[3] == "1");
+    for(unsigned int i = 0; i < m_NumberOfValues; i++)
+      entry.Values.push_back(Unescape(fields[4 + i]));
+
+    m_Entries[Unescape(fields[0])] = entry;
+    }
+
+  return true;
+}
+
+void DicomDirectoryIndex::Save(const std::string &index_file) const
+{
+  // Write to a temporary file first, so that a partially written index is
+  // never read
+  std::string tmp_file = index_file + ".tmp";
+  {
+  std::ofstream ofs(tmp_file.c_str());
+  if(!ofs.good())
+    return;
+
+  ofs << DICOM_INDEX_MAGIC << "\t" << DICOM_INDEX_VERSION << "\t"
+      << m_NumberOfValues << "\t" << Escape(m_Directory) << "\n";
+
+  for(EntryMap::const_iterator it = m_Entries.begin(); it != m_Entries.end(); ++it)
+    {
+    const Entry &e = it->second;
+    ofs << Escape(it->first) << "\t" << e.Size << "\t" << e.ModifiedTime
+        << "\t" << (e.IsDicom ? 1 : 0);
+    for(unsigned int i = 0; i < m_NumberOfValues; i++)
+      ofs << "\t" << (i < e.Values.size() ? Escape(e.Values[i]) : std::string());
+    ofs << "\n";
+    }
+
+  if(!ofs.good())
+    {
+    ofs.close();
+    remove(tmp_file.c_str());
+    return;
+    }
+  }
+
+  remove(index_file.c_str());
+  rename(tmp_file.c_str(), index_file.c_str());
+}
+
+const DicomDirectoryIndex::Entry *
+DicomDirectoryIndex::Find(const std::string &file,
+                          unsigned long size, long mtime) const
+{
+  EntryMap::const_iterator it = m_Entries.find(file);
+  if(it == m_Entries.end()
+     || it->second.Size != size || it->second.ModifiedTime != mtime)
+    return NULL;
+
+  return &it->second;
+}
+
+void DicomDirectoryIndex::Update(const std::string &file, const Entry &entry)
+{
+  m_Entries[file] = entry;
+  m_Modified = true;
+}
+
+void DicomDirectoryIndex::Prune(const std::vector<std::string> &files)
+{
+  std::set<std::string> keep(files.begin(), files.end());
+  EntryMap::iterator it = m_Entries.begin();
+  while(it != m_Entries.end())
+    {
+    if(keep.count(it->first))
+      {
+      ++it;
+      }
+    else
+      {
+      m_Entries.erase(it++);
+      m_Modified = true;
+      }
+    }
+}
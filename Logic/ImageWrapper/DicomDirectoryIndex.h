@@ -0,0 +1,81 @@
+#ifndef DICOMDIRECTORYINDEX_H
+#define DICOMDIRECTORYINDEX_H
+
+#include <string>
+#include <vector>
+#include <map>
+
+/**
+ * A persistent index of the DICOM header values extracted from the files in a
+ * directory. Parsing the headers of every file in a large directory is slow,
+ * so GuidedNativeImageIO::ParseDicomDirectory keeps the values it extracts in
+ * an index file. When the directory is parsed again, the files whose size and
+ * modification time have not changed are taken from the index, and only new
+ * or changed files are read.
+ *
+ * Each entry stores a fixed number of string values (one per DICOM tag that
+ * the parser needs), or marks the file as not readable as DICOM, so that such
+ * files are not reread either.
+ *
+ * The index is stored as a text file, with one tab-separated line per file.
+ * The file begins with a header that records the format version, the number
+ * of values per entry and the directory, and the index is ignored if any of
+ * these do not match.
+ */
+class DicomDirectoryIndex
+{
+public:
+
+  struct Entry
+  {
+    unsigned long Size;
+    long ModifiedTime;
+    bool IsDicom;
+    std::vector<std::string> Values;
+  };
+
+  DicomDirectoryIndex(const std::string &directory, unsigned int n_values);
+
+  /** Get the name of the index file for a directory within the index store */
+  static std::string GetIndexFileName(const std::string &store_dir,
+                                      const std::string &directory);
+
+  /** Read the index from file. Returns false if it is missing or invalid */
+  bool Load(const std::string &index_file);
+
+  /** Write the index to file. Failures are silently ignored */
+  void Save(const std::string &index_file) const;
+
+  /**
+   * Find the entry for a file. Returns NULL unless the size and modification
+   * time of the file match those in the index.
+   */
+  const Entry *Find(const std::string &file,
+                    unsigned long size, long mtime) const;
+
+  /** Add or replace the entry for a file */
+  void Update(const std::string &file, const Entry &entry);
+
+  /** Remove the entries for all files that are not in the given list */
+  void Prune(const std::vector<std::string> &files);
+
+  /** Whether the index has changed since it was loaded */
+  bool IsModified() const { return m_Modified; }
+
+  /** Number of files in the index */
+  size_t GetNumberOfEntries() const { return m_Entries.size(); }
+
+protected:
+
+  typedef std::map<std::string, Entry> EntryMap;
+  EntryMap m_Entries;
+
+  std::string m_Directory;
+  unsigned int m_NumberOfValues;
+  bool m_Modified;
+
+  static std::string Escape(const std::string &text);
+  static std::string Unescape(const std::string &text);
+};
+
+#endif // DICOMDIRECTORYINDEX_H
@@ -0,0 +1,264 @@
+#include "DisplaySliceCacheFilter.h"
+#include <algorithm>
+
+size_t DisplaySliceCacheFilter::m_GlobalMaximumCacheSize = 64 << 20;
+unsigned int DisplaySliceCacheFilter::m_GlobalPrefetchCount = 4;
+
+DisplaySliceCacheFilter::DisplaySliceCacheFilter()
+{
+  m_CacheKeyTime = 0;
+  m_SliceSource = NULL;
+  m_SliceIndex = 0;
+  m_LastSliceIndex = 0;
+  m_LastSliceIndexValid = false;
+  m_ScrollDirection = 0;
+  m_CachingEnabled = false;
+  m_CacheSize = 0;
+}
+
+void DisplaySliceCacheFilter::SetGlobalMaximumCacheSize(size_t bytes)
+{
+  m_GlobalMaximumCacheSize = bytes;
+}
+
+size_t DisplaySliceCacheFilter::GetGlobalMaximumCacheSize()
+{
+  return m_GlobalMaximumCacheSize;
+}
+
+void DisplaySliceCacheFilter::SetGlobalPrefetchCount(unsigned int count)
+{
+  m_GlobalPrefetchCount = count;
+}
+
+size_t DisplaySliceCacheFilter::GetMaximumCacheSizePerFilter()
+{
+  // Each image wrapper has a cache filter for each of the three display
+  // directions, and the global limit applies to the wrapper as a whole
+  return m_GlobalMaximumCacheSize / 3;
+}
+
+unsigned int DisplaySliceCacheFilter::GetGlobalPrefetchCount()
+{
+  return m_GlobalPrefetchCount;
+}
+
+void DisplaySliceCacheFilter::SetSliceSource(itk::ProcessObject *source)
+{
+  if(m_SliceSource != source)
+    {
+    m_SliceSource = source;
+    this->InvalidateCache();
+    this->Modified();
+    }
+}
+
+void DisplaySliceCacheFilter::SetCachingEnabled(bool flag)
+{
+  if(m_CachingEnabled != flag)
+    {
+    m_CachingEnabled = flag;
+    this->InvalidateCache();
+    this->Modified();
+    }
+}
+
+void DisplaySliceCacheFilter::InvalidateCache()
+{
+  m_Cache.clear();
+  m_RecentlyUsed.clear();
+  m_CacheSize = 0;
+  m_ScrollDirection = 0;
+  m_LastSliceIndexValid = false;
+}
+
+void DisplaySliceCacheFilter
+::AccumulateKeyTime(const itk::DataObject *data,
+                    std::set<const itk::Object *> &visited,
+                    itk::ModifiedTimeType &time)
+{
+  if(!data || !visited.insert(data).second)
+    return;
+
+  // Objects without a source (images, curves, color maps) contribute
+  // their own modification time
+  itk::ProcessObject *source = data->GetSource();
+  if(!source)
+    {
+    time = std::max(time, data->GetMTime());
+    return;
+    }
+
+  if(!visited.insert(source).second)
+    return;
+
+  // Filters contribute their modification time, except the slicer, whose
+  // MTime changes with every change of slice index
+  if(source != m_SliceSource)
+    time = std::max(time, source->GetMTime());
+
+  itk::ProcessObject::DataObjectPointerArray inputs = source->GetInputs();
+  for(size_t i = 0; i < inputs.size(); i++)
+    this->AccumulateKeyTime(inputs[i], visited, time);
+}
+
+itk::ModifiedTimeType DisplaySliceCacheFilter::ComputeKeyTime()
+{
+  std::set<const itk::Object *> visited;
+  itk::ModifiedTimeType time = 0;
+  this->AccumulateKeyTime(this->GetInput(), visited, time);
+  return time;
+}
+
+void DisplaySliceCacheFilter::ValidateCache()
+{
+  itk::ModifiedTimeType time = this->ComputeKeyTime();
+  if(time != m_CacheKeyTime)
+    {
+    m_Cache.clear();
+    m_RecentlyUsed.clear();
+    m_CacheSize = 0;
+    m_CacheKeyTime = time;
+    }
+}
+
+void DisplaySliceCacheFilter::RemoveEntry(CacheMap::iterator it)
+{
+  m_CacheSize -= it->second.Slice->GetPixelContainer()->Size() * sizeof(PixelType);
+  m_RecentlyUsed.erase(it->second.Position);
+  m_Cache.erase(it);
+}
+
+DisplaySliceCacheFilter::ImageType *
+DisplaySliceCacheFilter::InsertSlice(int index, const ImageType *input)
+{
+  // Slices that do not fit into the cache at all are not stored
+  size_t budget = GetMaximumCacheSizePerFilter();
+  size_t bytes = input->GetBufferedRegion().GetNumberOfPixels() * sizeof(PixelType);
+  if(bytes == 0 || bytes > budget)
+    return NULL;
+
+  // Replace an existing entry for this index
+  CacheMap::iterator itOld = m_Cache.find(index);
+  if(itOld != m_Cache.end())
+    this->RemoveEntry(itOld);
+
+  // Make room by removing the least recently used slices. The slice that is
+  // currently displayed is never removed to make room for a prefetched one
+  std::list<int>::iterator itLRU = m_RecentlyUsed.end();
+  while(m_CacheSize + bytes > budget
+        && itLRU != m_RecentlyUsed.begin())
+    {
+    --itLRU;
+    if(*itLRU != m_SliceIndex)
+      {
+      CacheMap::iterator itDrop = m_Cache.find(*itLRU);
+      ++itLRU;
+      this->RemoveEntry(itDrop);
+      }
+    }
+
+  if(m_CacheSize + bytes > budget)
+    return NULL;
+
+  // Copy the slice, since the upstream filters reuse their buffers
+  SmartPtr<ImageType> slice = ImageType::New();
+  slice->CopyInformation(input);
+  slice->SetRegions(input->GetBufferedRegion());
+  slice->Allocate();
+  std::copy(input->GetBufferPointer(),
+            input->GetBufferPointer() + input->GetBufferedRegion().GetNumberOfPixels(),
+            slice->GetBufferPointer());
+
+  Entry &entry = m_Cache[index];
+  entry.Slice = slice;
+  m_RecentlyUsed.push_front(index);
+  entry.Position = m_RecentlyUsed.begin();
+  m_CacheSize += bytes;
+
+  return slice;
+}
+
+bool DisplaySliceCacheFilter::ServeFromCache()
+{
+  this->ValidateCache();
+
+  CacheMap::iterator it = m_Cache.find(m_SliceIndex);
+  if(it == m_Cache.end())
+    return false;
+
+  // The cached slice must have the geometry the pipeline expects
+  ImageType *output = this->GetOutput();
+  ImageType *slice = it->second.Slice;
+  if(slice->GetBufferedRegion() != output->GetLargestPossibleRegion())
+    {
+    this->RemoveEntry(it);
+    return false;
+    }
+
+  // Mark as most recently used
+  m_RecentlyUsed.splice(m_RecentlyUsed.begin(), m_RecentlyUsed, it->second.Position);
+
+  // Present the cached buffer as the output
+  output->SetBufferedRegion(slice->GetBufferedRegion());
+  output->SetPixelContainer(slice->GetPixelContainer());
+  output->DataHasBeenGenerated();
+  return true;
+}
+
+void DisplaySliceCacheFilter::UpdateOutputData(itk::DataObject *output)
+{
+  // Keep track of the direction in which the user is scrolling
+  if(m_LastSliceIndexValid && m_SliceIndex != m_LastSliceIndex)
+    m_ScrollDirection = (m_SliceIndex > m_LastSliceIndex) ? 1 : -1;
+  m_LastSliceIndex = m_SliceIndex;
+  m_LastSliceIndexValid = true;
+
+  // Bypass the upstream pipeline if we have the slice
+  if(m_CachingEnabled && this->ServeFromCache())
+    return;
+
+  Superclass::UpdateOutputData(output);
+}
+
+void DisplaySliceCacheFilter::GenerateData()
+{
+  ImageType *input = const_cast<ImageType *>(this->GetInput());
+  ImageType *output = this->GetOutput();
+
+  // Try to store the input in the cache
+  ImageType *slice = NULL;
+  if(m_CachingEnabled)
+    {
+    this->ValidateCache();
+    slice = this->InsertSlice(m_SliceIndex, input);
+    }
+
+  // Pass the cached copy or the input container to the output
+  if(!slice)
+    slice = input;
+
+  output->SetBufferedRegion(slice->GetBufferedRegion());
+  output->SetPixelContainer(slice->GetPixelContainer());
+}
+
+bool DisplaySliceCacheFilter::IsSliceCached(int index)
+{
+  if(!m_CachingEnabled)
+    return false;
+
+  this->ValidateCache();
+  return m_Cache.find(index) != m_Cache.end();
+}
+
+void DisplaySliceCacheFilter::CacheInputSlice(int index)
+{
+  if(!m_CachingEnabled || !this->GetInput())
+    return;
+
+  ImageType *input = const_cast<ImageType *>(this->GetInput());
+  input->Update();
+
+  this->ValidateCache();
+  this->InsertSlice(index, input);
+}
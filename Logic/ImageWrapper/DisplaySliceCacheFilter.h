@@ -0,0 +1,157 @@
+#ifndef DISPLAYSLICECACHEFILTER_H
+#define DISPLAYSLICECACHEFILTER_H
+
+#include "itkImageToImageFilter.h"
+#include "itkRGBAPixel.h"
+#include "itkImage.h"
+#include "SNAPCommon.h"
+#include <list>
+#include <map>
+#include <set>
+
+/**
+ * This filter sits at the end of the display pipeline of an image wrapper
+ * and keeps a least recently used cache of the RGBA slices that pass through
+ * it. Slices are keyed on their index along the slicing axis. The cache is
+ * flushed whenever something other than the slice index changes upstream,
+ * i.e., when the modification time of any filter or source object feeding
+ * the display slice (image, transforms, intensity curve, color map, label
+ * table, etc.) changes. The slicing filter itself is excluded from this check
+ * because its modification time changes with the slice index.
+ *
+ * When the requested slice is in the cache, the filter presents the cached
+ * buffer as its output without updating the upstream pipeline. The output
+ * object never changes, so the filter can be inserted in front of renderers
+ * and other pipelines that hold on to the display slice.
+ *
+ * When caching is disabled (oblique slicing, preview pipelines, or wrappers
+ * whose display slice is composed from other wrappers), the filter simply
+ * passes its input through.
+ *
+ * The memory available to each image layer and the number of slices that
+ * should be prefetched in the direction of scrolling are global settings.
+ * The layer's memory limit is split evenly between its three filters, one
+ * per display direction.
+ */
+class DisplaySliceCacheFilter
+    : public itk::ImageToImageFilter<
+        itk::Image<itk::RGBAPixel<unsigned char>, 2>,
+        itk::Image<itk::RGBAPixel<unsigned char>, 2> >
+{
+public:
+
+  typedef itk::RGBAPixel<unsigned char>                             PixelType;
+  typedef itk::Image<PixelType, 2>                                  ImageType;
+
+  typedef DisplaySliceCacheFilter                                        Self;
+  typedef itk::ImageToImageFilter<ImageType, ImageType>            Superclass;
+  typedef SmartPtr<Self>                                              Pointer;
+  typedef SmartPtr<const Self>                                   ConstPointer;
+
+  itkNewMacro(Self)
+  itkTypeMacro(DisplaySliceCacheFilter, ImageToImageFilter)
+
+  /** Index of the requested slice along the slicing axis */
+  itkSetMacro(SliceIndex, int)
+  itkGetMacro(SliceIndex, int)
+
+  /**
+   * The filter that extracts the slice from the volume. Its own modification
+   * time is ignored when checking whether the cache is current, but its
+   * inputs are not.
+   */
+  void SetSliceSource(itk::ProcessObject *source);
+
+  /** Whether the cache is used. When off, the input is passed through */
+  void SetCachingEnabled(bool flag);
+  itkGetMacro(CachingEnabled, bool)
+
+  /** Discard all cached slices */
+  void InvalidateCache();
+
+  /** Check if the slice with given index is in the cache and current */
+  bool IsSliceCached(int index);
+
+  /**
+   * Update the input and store it in the cache under the given slice index.
+   * This is used to prefetch slices: the caller must point the slicing filter
+   * at that slice before calling this method.
+   */
+  void CacheInputSlice(int index);
+
+  /** Direction (-1, 0 or 1) in which the requested slice last moved */
+  itkGetMacro(ScrollDirection, int)
+
+  /** Number of slices currently in the cache */
+  unsigned int GetNumberOfCachedSlices() const
+    { return (unsigned int) m_Cache.size(); }
+
+  /** Number of bytes used by the cached slices */
+  itkGetConstMacro(CacheSize, size_t)
+
+  /**
+   * Maximum number of bytes each image layer may use for cached slices. This
+   * is shared by the layer's three filters, one per display direction.
+   */
+  static void SetGlobalMaximumCacheSize(size_t bytes);
+  static size_t GetGlobalMaximumCacheSize();
+
+  /** Maximum number of bytes a single filter may use for cached slices */
+  static size_t GetMaximumCacheSizePerFilter();
+
+  /** Number of slices to prefetch in the direction of scrolling */
+  static void SetGlobalPrefetchCount(unsigned int count);
+  static unsigned int GetGlobalPrefetchCount();
+
+protected:
+
+  DisplaySliceCacheFilter();
+  virtual ~DisplaySliceCacheFilter() {}
+
+  /** Serves the slice from the cache, bypassing upstream, when possible */
+  virtual void UpdateOutputData(itk::DataObject *output) ITK_OVERRIDE;
+
+  /** Copies the input into the cache and presents it as output */
+  virtual void GenerateData() ITK_OVERRIDE;
+
+  // A cached slice and its position in the recently used list
+  struct Entry
+  {
+    SmartPtr<ImageType> Slice;
+    std::list<int>::iterator Position;
+  };
+
+  typedef std::map<int, Entry> CacheMap;
+
+  // Cached slices, keyed on slice index
+  CacheMap m_Cache;
+
+  // Slice indices, most recently used first
+  std::list<int> m_RecentlyUsed;
+
+  // Modification time of the upstream pipeline for which the cache is valid
+  itk::ModifiedTimeType m_CacheKeyTime;
+
+  // The slicer, whose own MTime is not part of the key
+  itk::ProcessObject *m_SliceSource;
+
+  int m_SliceIndex, m_LastSliceIndex, m_ScrollDirection;
+  bool m_LastSliceIndexValid;
+  bool m_CachingEnabled;
+  size_t m_CacheSize;
+
+  static size_t m_GlobalMaximumCacheSize;
+  static unsigned int m_GlobalPrefetchCount;
+
+  itk::ModifiedTimeType ComputeKeyTime();
+  void AccumulateKeyTime(const itk::DataObject *data,
+                         std::set<const itk::Object *> &visited,
+                         itk::ModifiedTimeType &time);
+
+  void ValidateCache();
+  bool ServeFromCache();
+  ImageType *InsertSlice(int index, const ImageType *slice);
+  void RemoveEntry(CacheMap::iterator it);
+};
+
+#endif // DISPLAYSLICECACHEFILTER_H
@@ -37,6 +37,10 @@
 #include "SNAPCommon.h"
 #include "SNAPRegistryIO.h"
 #include "ImageCoordinateGeometry.h"
+#include "DicomDirectoryIndex.h"
+#include "MappedFileImageContainer.h"
+#include "ParallelGzipIO.h"
+#include "RLESegmentationImageIO.h"
 
 #include "itkImage.h"
 #include "itkImageIOBase.h"
@@ -68,6 +72,9 @@
 #include "ExtendedGDCMSerieHelper.h"
 #include "itkComposeImageFilter.h"
 #include "itkStreamingImageFilter.h"
+#include "itkMultiThreader.h"
+#include "itkByteSwapper.h"
+#include <fstream>
 
 #include <itk_zlib.h>
 
@@ -75,6 +82,10 @@
 using namespace std;
 
 bool GuidedNativeImageIO::m_StaticDataInitialized = false;
+int GuidedNativeImageIO::m_DICOMReadThreads = 0;
+std::string GuidedNativeImageIO::m_DICOMIndexDirectory;
+bool GuidedNativeImageIO::m_UseMemoryMapping = false;
+int GuidedNativeImageIO::m_GzipThreads = 0;
 
 RegistryEnumMap<GuidedNativeImageIO::FileFormat> GuidedNativeImageIO::m_EnumFileFormat;
 RegistryEnumMap<GuidedNativeImageIO::RawPixelType> GuidedNativeImageIO::m_EnumRawPixelType;
@@ -95,154 +106,113 @@ GuidedNativeImageIO
   {"Siemens Vision", "ima",          false, false, true,  true},
   {"VoxBo CUB", "cub,cub.gz",        true,  false, true,  true},
   {"VTK Image", "vtk",               true,  false, true,  true},
+  {"ITK-SNAP RLE Segmentation", "rle", true, true, false, true},
   {"Generic ITK Image", "",          true,  true,  true,  true},
   {"INVALID FORMAT", "",             false, false, false, false}};
 
 
 /*************************************************************************/
-/* THE FOLLOWING CODE IS TAKEN FROM FFTW */
-
-/* In-place transpose routine from TOMS, which follows the cycles of
-   the permutation so that it writes to each location only once.
-   Because of cache-line and other issues, however, this routine is
-   typically much slower than transpose-gcd or transpose-cut, even
-   though the latter do some extra writes.  On the other hand, if the
-   vector length is large then the TOMS routine is best.
-
-   The TOMS routine also has the advantage of requiring less buffer
-   space for the case of gcd(nx,ny) small.  However, in this case it
-   has been superseded by the combination of the generalized
-   transpose-cut method with the transpose-gcd method, which can
-   always transpose with buffers a small fraction of the array size
-   regardless of gcd(nx,ny). */
+/* CACHE-BLOCKED PARALLEL TRANSPOSE                                      */
 
 /*
- * TOMS Transpose.  Algorithm 513 (Revised version of algorithm 380).
- *
- * These routines do in-place transposes of arrays.
- *
- * [ Cate, E.G. and Twigg, D.W., ACM Transactions on Mathematical Software,
- *   vol. 3, no. 1, 104-110 (1977) ]
- *
- * C version by Steven G. Johnson (February 1997).
+ * Out-of-place transpose of an nrows x ncols matrix of ntuple-tuples stored in
+ * row-major order. This is used to convert 4D images, in which the last
+ * dimension varies slowest, into the interleaved VectorImage layout. The
+ * columns of the source matrix (rows of the output) are divided among the
+ * threads, and each thread copies square tiles of the matrix, so that both
+ * the reads and the writes stay within a small number of cache lines.
  */
-
-/*
- * "a" is a 1D array of length ny*nx*N which constains the nx x ny
- * matrix of N-tuples to be transposed.  "a" is stored in row-major
- * order (last index varies fastest).  move is a 1D array of length
- * move_size used to store information to speed up the process.  The
- * value move_size=(ny+nx)/2 is recommended.  buf should be an array
- * of length 2*N.
- *
- */
-
-template <typename INT>
-INT gcd(INT a, INT b)
+template <typename R>
+struct BlockedTransposeData
 {
-  INT r;
-  do {
-    r = a % b;
-    a = b;
-    b = r;
-    } while (r != 0);
-
-  return a;
-}
+  const R *src;
+  R *dst;
+  long nrows, ncols, ntuple;
+};
 
-template <typename R, typename INT>
-void transpose_toms513(R *a, INT nx, INT ny, char *move, INT move_size, R *buf)
+template <typename R>
+ITK_THREAD_RETURN_TYPE transpose_blocked_callback(void *arg)
 {
-  INT i, im, mn;
-  R *b, *c, *d;
-  INT ncount;
-  INT k;
-
-  /* check arguments and initialize: */
-  assert(ny > 0 && nx > 0 && move_size > 0);
-
-  b = buf;
-
-  /* Cate & Twigg have a special case for nx == ny, but we don't
-  bother, since we already have special code for this case elsewhere. */
-
-  c = buf + 1;
-  ncount = 2;		/* always at least 2 fixed points */
-  k = (mn = ny * nx) - 1;
-
-  for (i = 0; i < move_size; ++i)
-    move[i] = 0;
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfo;
+  ThreadInfo *info = static_cast<ThreadInfo *>(arg);
+  const BlockedTransposeData<R> *td =
+      static_cast<const BlockedTransposeData<R> *>(info->UserData);
 
-  if (ny >= 3 && nx >= 3)
-    ncount += gcd(ny - 1, nx - 1) - 1;	/* # fixed points */
+  // The range of source columns handled by this thread
+  long nthreads = info->NumberOfThreads, tid = info->ThreadID;
+  long c_begin = (td->ncols * tid) / nthreads;
+  long c_end = (td->ncols * (tid + 1)) / nthreads;
 
-  i = 1;
-  im = ny;
+  // Tile size, in tuples
+  const long tile = 64;
 
-  while (1) {
-    INT i1, i2, i1c, i2c;
-    INT kmi;
-
-    /** Rearrange the elements of a loop
-        and its companion loop: **/
-
-    i1 = i;
-    kmi = k - i;
-    i1c = kmi;
-    b[0] = a[i1];
-    c[0] = a[i1c];
-
-    while (1) {
-      i2 = ny * i1 - k * (i1 / nx);
-      i2c = k - i2;
-      if (i1 < move_size)
-        move[i1] = 1;
-      if (i1c < move_size)
-        move[i1c] = 1;
-      ncount += 2;
-      if (i2 == i)
-        break;
-      if (i2 == kmi) {
-        d = b;
-        b = c;
-        c = d;
-        break;
+  for(long c0 = c_begin; c0 < c_end; c0 += tile)
+    {
+    long c1 = std::min(c0 + tile, c_end);
+    for(long r0 = 0; r0 < td->nrows; r0 += tile)
+      {
+      long r1 = std::min(r0 + tile, td->nrows);
+      for(long c = c0; c < c1; c++)
+        {
+        R *dst = td->dst + (c * td->nrows + r0) * td->ntuple;
+        const R *src = td->src + (r0 * td->ncols + c) * td->ntuple;
+        for(long r = r0; r < r1; r++, src += td->ncols * td->ntuple)
+          for(long k = 0; k < td->ntuple; k++)
+            *dst++ = src[k];
         }
-      a[i1] = a[i2];
-      a[i1c] = a[i2c];
-      i1 = i2;
-      i1c = i2c;
       }
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
 
-    a[i1] = b[0];
-    a[i1c] = c[0];
+template <typename R>
+void transpose_blocked(const R *src, R *dst, long nrows, long ncols, long ntuple)
+{
+  BlockedTransposeData<R> td;
+  td.src = src;
+  td.dst = dst;
+  td.nrows = nrows;
+  td.ncols = ncols;
+  td.ntuple = ntuple;
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetNumberOfThreads(
+        std::max(1, (int) std::min(ncols, (long) threader->GetNumberOfThreads())));
+  threader->SetSingleMethod(&transpose_blocked_callback<R>, &td);
+  threader->SingleMethodExecute();
+}
+
+/**
+ * Expansion of the lines of an RLE image into an uncompressed buffer. The
+ * lines are independent and are stored in the same order as the voxels, so
+ * each thread expands a contiguous range of lines.
+ */
+struct RLEExpandData
+{
+  const RLEImage<LabelType>::RLLine *lines;
+  LabelType *dst;
+  long nlines, nx;
+};
 
-    if (ncount >= mn)
-      break;	/* we've moved all elements */
+ITK_THREAD_RETURN_TYPE rle_expand_callback(void *arg)
+{
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfo;
+  ThreadInfo *info = static_cast<ThreadInfo *>(arg);
+  const RLEExpandData *td = static_cast<const RLEExpandData *>(info->UserData);
 
-    /** Search for loops to rearrange: **/
+  long nthreads = info->NumberOfThreads, tid = info->ThreadID;
+  long l_begin = (td->nlines * tid) / nthreads;
+  long l_end = (td->nlines * (tid + 1)) / nthreads;
 
-    while (1) {
-      INT max = k - i;
-      ++i;
-//      assert(i <= max);
-      im += ny;
-      if (im > k)
-        im -= k;
-      i2 = im;
-      if (i == i2)
-        continue;
-      if (i >= move_size) {
-        while (i2 > i && i2 < max) {
-          i1 = i2;
-          i2 = ny * i1 - k * (i1 / nx);
-          }
-        if (i2 == i)
-          break;
-        } else if (!move[i])
-        break;
-      }
+  for(long i = l_begin; i < l_end; i++)
+    {
+    LabelType *p = td->dst + i * td->nx;
+    for(size_t s = 0; s < td->lines[i].size(); s++)
+      p = std::fill_n(p, td->lines[i][s].first, td->lines[i][s].second);
     }
+
+  return ITK_THREAD_RETURN_VALUE;
 }
 
 
@@ -297,6 +267,14 @@ GuidedNativeImageIO
   m_NativeFileName = "";
   m_NativeByteOrder = itk::ImageIOBase::OrderNotApplicable;
   m_NativeSizeInBytes = 0;
+  m_ReadProgressCommand = NULL;
+  m_ReadProgress = 0.0;
+}
+
+GuidedNativeImageIO::~GuidedNativeImageIO()
+{
+  DeallocateNativeImage();
+  AbortWrite();
 }
 
 GuidedNativeImageIO::FileFormat 
@@ -378,9 +356,27 @@ void
 GuidedNativeImageIO
 ::CreateImageIO(const char *fname, Registry &folder, bool flag_read)
 {
+  // Images mapped from a file that is about to be overwritten must be copied
+  // into memory first
+  if(!flag_read)
+    MappedFileBuffer::DetachAll(fname);
+
   // Get the format specified in the folder
   m_FileFormat = GetFileFormat(folder);
 
+  // Gzipped NIfTI files are written uncompressed by ITK and then compressed
+  // in parallel by FinishWrite()
+  AbortWrite();
+  m_WriteFileName = fname;
+  m_CompressedFileName.clear();
+  std::string sfname = fname;
+  if(!flag_read && m_GzipThreads != 1 && m_FileFormat == FORMAT_NIFTI
+     && sfname.size() > 3 && sfname.compare(sfname.size() - 3, 3, ".gz") == 0)
+    {
+    m_CompressedFileName = sfname;
+    m_WriteFileName = sfname + ".tmp.nii";
+    }
+
   // Choose the approach based on the file format
   switch(m_FileFormat)
     {
@@ -394,6 +390,7 @@ GuidedNativeImageIO
     case FORMAT_SIEMENS:    m_IOBase = itk::SiemensVisionImageIO::New(); break;
     case FORMAT_VTK:        m_IOBase = itk::VTKImageIO::New();           break;
     case FORMAT_VOXBO_CUB:  m_IOBase = itk::VoxBoCUBImageIO::New();      break;
+    case FORMAT_SNAP_RLE:   m_IOBase = RLESegmentationImageIO::New();    break;
     case FORMAT_DICOM_DIR:
     case FORMAT_DICOM_FILE: m_IOBase = itk::GDCMImageIO::New();          break;
     case FORMAT_RAW:
@@ -425,6 +422,14 @@ GuidedNativeImageIO
       break;
     default:
       {
+      // The RLE segmentation format is not known to ITK's factory
+      if(GetFileFormatDescriptor(FORMAT_SNAP_RLE).TestFilename(fname))
+        {
+        m_FileFormat = FORMAT_SNAP_RLE;
+        m_IOBase = RLESegmentationImageIO::New();
+        break;
+        }
+
       // No IO base was specified in the registry folder. We will use ITK's factory
       // system to find an IO object that can open the file
       m_IOBase = itk::ImageIOFactory::CreateImageIO(fname, 
@@ -564,15 +569,67 @@ GuidedNativeImageIO
 
 void
 GuidedNativeImageIO
-::ReadNativeImageData()
+::ReadNativeImageData(itk::Command *progressCommand)
 {
-  // Based on the component type, read image in native mode
-  DispatchBase *dispatch = this->CreateDispatch(m_IOBase->GetComponentType());
-  dispatch->ReadNative(this, m_NativeFileName.c_str(), m_Hints);
-  delete dispatch;
+  m_ReadProgressCommand = progressCommand;
+  this->UpdateReadProgress(0.0);
+
+  // Label images in the RLE segmentation format are read without expanding
+  // them; other images are read in their native type
+  RLESegmentationImageIO *rle_io =
+      dynamic_cast<RLESegmentationImageIO *>(m_IOBase.GetPointer());
+  if(rle_io && m_IOBase->GetComponentType() == itk::ImageIOBase::USHORT
+     && m_NativeComponents == 1)
+    {
+    try
+      {
+      m_NativeImage = rle_io->ReadRLEImage();
+      }
+    catch(...)
+      {
+      m_ReadProgressCommand = NULL;
+      throw;
+      }
+    }
+  else
+    {
+    DispatchBase *dispatch = this->CreateDispatch(m_IOBase->GetComponentType());
+    try
+      {
+      dispatch->ReadNative(this, m_NativeFileName.c_str(), m_Hints);
+      }
+    catch(...)
+      {
+      delete dispatch;
+      m_ReadProgressCommand = NULL;
+      throw;
+      }
+    delete dispatch;
+    }
 
   // Get rid of the IOBase, it may store useless data (in case of NIFTI)
   m_IOBase = NULL;
+
+  this->UpdateReadProgress(1.0);
+  m_ReadProgressCommand = NULL;
+}
+
+void
+GuidedNativeImageIO
+::UpdateReadProgress(double progress)
+{
+  m_ReadProgress = progress;
+  if(m_ReadProgressCommand)
+    m_ReadProgressCommand->Execute(this, itk::ProgressEvent());
+}
+
+void
+GuidedNativeImageIO
+::OnReaderProgress(itk::Object *caller, const itk::EventObject &event)
+{
+  itk::ProcessObject *po = dynamic_cast<itk::ProcessObject *>(caller);
+  if(po)
+    this->UpdateReadProgress(po->GetProgress());
 }
 
 void
@@ -584,6 +641,457 @@ GuidedNativeImageIO
 }
 
 
+void
+GuidedNativeImageIO
+::ExpandNativeRLEImage()
+{
+  RLEImageType *rle = this->GetNativeRLEImage();
+  if(!rle)
+    return;
+
+  // The native image is a single-component vector image
+  typedef itk::VectorImage<LabelType, 3> NativeImageType;
+  NativeImageType::Pointer image = NativeImageType::New();
+  image->CopyInformation(rle);
+  image->SetRegions(rle->GetBufferedRegion());
+  image->SetVectorLength(1);
+  image->Allocate();
+
+  // Expand the lines in parallel
+  RLEExpandData td;
+  td.lines = rle->GetBuffer()->GetBufferPointer();
+  td.dst = image->GetBufferPointer();
+  td.nlines = rle->GetBuffer()->GetBufferedRegion().GetNumberOfPixels();
+  td.nx = rle->GetBufferedRegion().GetSize(0);
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetNumberOfThreads(
+        std::max(1, (int) std::min(td.nlines, (long) threader->GetNumberOfThreads())));
+  threader->SetSingleMethod(&rle_expand_callback, &td);
+  threader->SingleMethodExecute();
+
+  image->SetMetaDataDictionary(rle->GetMetaDataDictionary());
+  m_NativeImage = image;
+}
+
+void GuidedNativeImageIO::SetDICOMReadThreads(int n)
+{
+  m_DICOMReadThreads = n;
+}
+
+int GuidedNativeImageIO::GetDICOMReadThreads()
+{
+  return m_DICOMReadThreads;
+}
+
+void GuidedNativeImageIO::SetDICOMIndexDirectory(const std::string &dir)
+{
+  m_DICOMIndexDirectory = dir;
+}
+
+std::string GuidedNativeImageIO::GetDICOMIndexDirectory()
+{
+  return m_DICOMIndexDirectory;
+}
+
+void GuidedNativeImageIO::SetUseMemoryMapping(bool flag)
+{
+  m_UseMemoryMapping = flag;
+}
+
+bool GuidedNativeImageIO::GetUseMemoryMapping()
+{
+  return m_UseMemoryMapping;
+}
+
+/**
+ * Check that the voxels of a single-file NIfTI-1 image with the given header
+ * are stored as they are laid out in memory: native byte order, no intensity
+ * scaling (which the reader would apply) and a single component (vector
+ * components are stored as separate volumes). Returns the offset of the
+ * voxels in the file.
+ */
+static bool find_nifti_voxel_data(const char *hdr, size_t element_size,
+                                  size_t ncomp, size_t &offset)
+{
+  int sizeof_hdr;
+  memcpy(&sizeof_hdr, hdr, 4);
+  if(sizeof_hdr != 348 || strncmp(hdr + 344, "n+1", 4))
+    return false;
+
+  short bitpix;
+  float vox_offset, scl_slope, scl_inter;
+  memcpy(&bitpix, hdr + 72, 2);
+  memcpy(&vox_offset, hdr + 108, 4);
+  memcpy(&scl_slope, hdr + 112, 4);
+  memcpy(&scl_inter, hdr + 116, 4);
+
+  if(bitpix != (short) (8 * element_size)
+     || (scl_slope != 0.0f && (scl_slope != 1.0f || scl_inter != 0.0f))
+     || ncomp != 1 || vox_offset < 348.0f)
+    return false;
+
+  offset = (size_t) vox_offset;
+  return true;
+}
+
+void GuidedNativeImageIO::FinishWrite()
+{
+  if(m_CompressedFileName.empty())
+    return;
+
+  std::string target = m_CompressedFileName;
+
+  // The temporary file is removed by AbortWrite() whether or not the
+  // compression succeeds, and so is an incomplete compressed file
+  bool ok = false;
+  try
+    {
+    ok = ParallelGzipIO::CompressFile(
+          m_WriteFileName, target, Z_DEFAULT_COMPRESSION, m_GzipThreads);
+    }
+  catch(...)
+    {
+    AbortWrite();
+    itksys::SystemTools::RemoveFile(target.c_str());
+    throw;
+    }
+
+  AbortWrite();
+  m_WriteFileName = target;
+
+  if(!ok)
+    {
+    itksys::SystemTools::RemoveFile(target.c_str());
+    throw IRISException("Error: Failed to write image. "
+                        "Unable to write compressed data to file %s", target.c_str());
+    }
+}
+
+void GuidedNativeImageIO::AbortWrite()
+{
+  if(m_CompressedFileName.empty())
+    return;
+
+  itksys::SystemTools::RemoveFile(m_WriteFileName.c_str());
+  m_WriteFileName = m_CompressedFileName;
+  m_CompressedFileName.clear();
+}
+
+bool
+GuidedNativeImageIO
+::ReadBlockCompressedVoxelData(size_t element_size, size_t n_bytes, void *buffer)
+{
+  if(m_GzipThreads == 1 || m_FileFormat != FORMAT_NIFTI
+     || !ParallelGzipIO::IsBlockCompressed(m_NativeFileName))
+    return false;
+
+  // The header is read through zlib, which handles the gzip members
+  char hdr[348];
+  gzFile gz = gzopen(m_NativeFileName.c_str(), "rb");
+  bool havehdr = (gz != NULL) && gzread(gz, hdr, 348) == 348;
+  if(gz)
+    gzclose(gz);
+
+  size_t offset;
+  if(!havehdr || !find_nifti_voxel_data(hdr, element_size,
+                                        m_IOBase->GetNumberOfComponents(), offset))
+    return false;
+
+  return ParallelGzipIO::DecompressRange(
+        m_NativeFileName, offset, n_bytes, buffer, m_GzipThreads);
+}
+
+void GuidedNativeImageIO::SetGzipThreads(int n)
+{
+  m_GzipThreads = n;
+}
+
+int GuidedNativeImageIO::GetGzipThreads()
+{
+  return m_GzipThreads;
+}
+
+bool
+GuidedNativeImageIO
+::FindMappableVoxelData(size_t element_size, size_t n_bytes,
+                        std::string &data_file, size_t &offset)
+{
+  bool big_endian = itk::ByteSwapper<int>::SystemIsBigEndian();
+
+  if(m_FileFormat == FORMAT_NIFTI)
+    {
+    // Read the NIfTI-1 header directly. A compressed file will fail the
+    // checks below, since its first bytes are the gzip header
+    char hdr[348];
+    std::ifstream ifs(m_NativeFileName.c_str(), std::ios::binary);
+    if(!ifs.read(hdr, 348))
+      return false;
+
+    if(!find_nifti_voxel_data(hdr, element_size, m_IOBase->GetNumberOfComponents(), offset))
+      return false;
+
+    data_file = m_NativeFileName;
+    }
+
+  else if(m_FileFormat == FORMAT_MHA)
+    {
+    // Parse the MetaImage header, which ends with the ElementDataFile entry
+    std::ifstream ifs(m_NativeFileName.c_str(), std::ios::binary);
+    std::string line, edf;
+    bool msb = false;
+    long header_size = 0;
+    while(std::getline(ifs, line))
+      {
+      size_t eq = line.find('=');
+      if(eq == std::string::npos)
+        continue;
+
+      std::string key = itksys::SystemTools::TrimWhitespace(line.substr(0, eq));
+      std::string value = itksys::SystemTools::TrimWhitespace(line.substr(eq + 1));
+
+      if(key == "CompressedData" && itksys::SystemTools::LowerCase(value) == "true")
+        return false;
+      else if(key == "BinaryData" && itksys::SystemTools::LowerCase(value) == "false")
+        return false;
+      else if(key == "ElementByteOrderMSB" || key == "BinaryDataByteOrderMSB")
+        msb = (itksys::SystemTools::LowerCase(value) == "true");
+      else if(key == "HeaderSize")
+        header_size = atol(value.c_str());
+      else if(key == "ElementDataFile")
+        {
+        edf = value;
+        break;
+        }
+      }
+
+    // Lists of slice files are not supported
+    if(edf.empty() || edf == "LIST" || edf.find(' ') != std::string::npos
+       || msb != big_endian)
+      return false;
+
+    if(edf == "LOCAL")
+      {
+      // The voxels follow the header, unless they are at the end of the file
+      if(header_size > 0)
+        return false;
+      data_file = m_NativeFileName;
+      offset = (size_t) ifs.tellg();
+      }
+    else
+      {
+      data_file = itksys::SystemTools::CollapseFullPath(
+            edf.c_str(),
+            itksys::SystemTools::GetFilenamePath(m_NativeFileName).c_str());
+      offset = header_size > 0 ? header_size : 0;
+      }
+
+    if(header_size == -1)
+      {
+      unsigned long length = itksys::SystemTools::FileLength(data_file.c_str());
+      if(length < n_bytes)
+        return false;
+      offset = length - n_bytes;
+      }
+    }
+
+  else if(m_FileFormat == FORMAT_RAW)
+    {
+    bool file_big_endian = (m_IOBase->GetByteOrder() == itk::ImageIOBase::BigEndian);
+    if(file_big_endian != big_endian)
+      return false;
+
+    data_file = m_NativeFileName;
+    offset = (size_t) m_Hints["Raw.HeaderSize"][0];
+    }
+
+  else
+    {
+    return false;
+    }
+
+  // The voxels must be aligned in memory
+  return offset % element_size == 0;
+}
+
+/*
+ * Shared state for the threads that decode a DICOM series. Slices are
+ * assigned to threads in an interleaved fashion. Each thread has its own IO
+ * object and reports failure in its own flag.
+ */
+template <typename TScalar>
+struct DICOMSliceReadData
+{
+  const std::vector<std::string> *files;
+  int images_per_ipp, n_slices;
+  size_t nx, ny;
+  itk::ImageIOBase::IOComponentType component_type;
+  TScalar *buffer;
+  std::vector<itk::ImageIOBase::Pointer> io;
+
+  // One flag per thread; not a vector<bool>, whose elements share bytes
+  std::vector<char> failed;
+
+  // Progress is reported by the first thread, which runs on the calling thread
+  GuidedNativeImageIO *self;
+  void (GuidedNativeImageIO::*progress)(double);
+};
+
+template <typename TScalar>
+ITK_THREAD_RETURN_TYPE dicom_slice_read_callback(void *arg)
+{
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfo;
+  ThreadInfo *info = static_cast<ThreadInfo *>(arg);
+  DICOMSliceReadData<TScalar> *td = static_cast<DICOMSliceReadData<TScalar> *>(info->UserData);
+
+  int nthreads = info->NumberOfThreads, tid = info->ThreadID;
+  itk::ImageIOBase *io = td->io[tid];
+  size_t n_pix = td->nx * td->ny;
+  int P = td->images_per_ipp;
+
+  // Buffer for slices that have to be interleaved with other slices
+  std::vector<TScalar> slice_buffer(P > 1 ? n_pix : 0);
+
+  try
+    {
+    int n_files = td->n_slices * P;
+    for(int f = tid; f < n_files && !td->failed[tid]; f += nthreads)
+      {
+      io->SetFileName((*td->files)[f]);
+      io->ReadImageInformation();
+
+      // The slice must match the first slice in the series
+      size_t nd = io->GetNumberOfDimensions();
+      if(nd < 2 || nd > 3
+         || io->GetDimensions(0) != td->nx || io->GetDimensions(1) != td->ny
+         || (nd == 3 && io->GetDimensions(2) != 1)
+         || io->GetNumberOfComponents() != 1
+         || io->GetComponentType() != td->component_type)
+        {
+        td->failed[tid] = 1;
+        break;
+        }
+
+      itk::ImageIORegion ioRegion(nd);
+      for(size_t d = 0; d < nd; d++)
+        {
+        ioRegion.SetIndex(d, 0);
+        ioRegion.SetSize(d, io->GetDimensions(d));
+        }
+      io->SetIORegion(ioRegion);
+
+      // Position of the slice in the volume
+      int s = f / P, c = f % P;
+      if(P == 1)
+        {
+        io->Read(td->buffer + s * n_pix);
+        }
+      else
+        {
+        io->Read(&slice_buffer[0]);
+        TScalar *trg = td->buffer + s * n_pix * P + c;
+        for(size_t j = 0; j < n_pix; j++, trg += P)
+          *trg = slice_buffer[j];
+        }
+
+      // The files are interleaved between the threads, so the progress of
+      // the first thread is representative of the overall progress
+      if(tid == 0)
+        ((td->self)->*(td->progress))((f + 1.0) / n_files);
+      }
+    }
+  catch(...)
+    {
+    td->failed[tid] = 1;
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template<class TScalar>
+bool
+GuidedNativeImageIO
+::DoReadDICOMSeriesParallel()
+{
+  typedef itk::VectorImage<TScalar, 3> NativeImageType;
+  typedef itk::Image<TScalar, 3> GreyImageType;
+  typedef itk::ImageSeriesReader<GreyImageType> ReaderType;
+
+  int P = m_DICOMImagesPerIPP;
+  int n_slices = m_DICOMFiles.size() / P;
+  if(n_slices * P != (int) m_DICOMFiles.size())
+    return false;
+
+  // Determine the number of threads
+  int n_threads = m_DICOMReadThreads > 0
+      ? m_DICOMReadThreads : itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+  n_threads = std::min(n_threads, (int) m_DICOMFiles.size());
+  if(n_threads <= 1)
+    return false;
+
+  // The metadata comes from the first image in the series, which is the one
+  // whose header is currently loaded
+  itk::MetaDataDictionary mdd = m_IOBase->GetMetaDataDictionary();
+  itk::ImageIOBase::IOComponentType ctype = m_IOBase->GetComponentType();
+  if(m_IOBase->GetNumberOfComponents() != 1)
+    return false;
+
+  // Let the series reader work out the geometry of the volume, using the
+  // files of the first component. This only reads the headers
+  std::vector<std::string> geomFiles;
+  for(int s = 0; s < n_slices; s++)
+    geomFiles.push_back(m_DICOMFiles[s * P]);
+
+  // The series reader points its IO object at each file whose header it
+  // reads, so it is given its own. m_IOBase keeps the header of the first
+  // image, which the serial read relies on if this read fails
+  typename ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileNames(geomFiles);
+  reader->SetImageIO(itk::GDCMImageIO::New());
+  reader->UpdateOutputInformation();
+
+  GreyImageType *geom = reader->GetOutput();
+  typename GreyImageType::RegionType region = geom->GetLargestPossibleRegion();
+  if((int) region.GetSize()[2] != n_slices)
+    return false;
+
+  // Allocate the native image
+  typename NativeImageType::Pointer image = NativeImageType::New();
+  image->CopyInformation(geom);
+  image->SetRegions(region);
+  image->SetVectorLength(P);
+  image->Allocate();
+
+  // Set up the threads, each with its own IO object
+  DICOMSliceReadData<TScalar> td;
+  td.files = &m_DICOMFiles;
+  td.images_per_ipp = P;
+  td.n_slices = n_slices;
+  td.nx = region.GetSize()[0];
+  td.ny = region.GetSize()[1];
+  td.component_type = ctype;
+  td.buffer = image->GetBufferPointer();
+  td.failed.resize(n_threads, 0);
+  td.self = this;
+  td.progress = &GuidedNativeImageIO::UpdateReadProgress;
+  for(int t = 0; t < n_threads; t++)
+    td.io.push_back(itk::GDCMImageIO::New().GetPointer());
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetNumberOfThreads(n_threads);
+  threader->SetSingleMethod(&dicom_slice_read_callback<TScalar>, &td);
+  threader->SingleMethodExecute();
+
+  // If any slice could not be read, the series will be read serially
+  for(int t = 0; t < n_threads; t++)
+    if(td.failed[t])
+      return false;
+
+  image->SetMetaDataDictionary(mdd);
+  m_NativeImage = image;
+  return true;
+}
+
 template<class TScalar>
 void
 GuidedNativeImageIO
@@ -601,13 +1109,25 @@ GuidedNativeImageIO
     // Create an image series reader 
     typedef itk::ImageSeriesReader<GreyImageType> ReaderType;
 
-    if(this->m_DICOMImagesPerIPP == 1)
+    // Forward the progress of the series readers
+    typedef itk::MemberCommand<GuidedNativeImageIO> ProgressCommand;
+    typename ProgressCommand::Pointer progress_cmd = ProgressCommand::New();
+    progress_cmd->SetCallbackFunction(this, &GuidedNativeImageIO::OnReaderProgress);
+
+    // First try decoding the slices concurrently. If the slices are not
+    // consistent, they are read one after another by the series reader
+    if(this->DoReadDICOMSeriesParallel<TScalar>())
+      {
+      m_NativeComponents = m_DICOMImagesPerIPP;
+      }
+    else if(this->m_DICOMImagesPerIPP == 1)
       {
       // When there is a single volume
       typename ReaderType::Pointer reader = ReaderType::New();
 
       // Set the filenames and read
       reader->SetFileNames(m_DICOMFiles);
+      reader->AddObserver(itk::ProgressEvent(), progress_cmd);
 
       // Set the IO
       // typename GDCMImageIO::Pointer dicomio = GDCMImageIO::New();
@@ -673,6 +1193,7 @@ GuidedNativeImageIO
         }
 
       // Do the big update
+      composer->AddObserver(itk::ProgressEvent(), progress_cmd);
       composer->Update();
 
       // Set up the streamer
@@ -736,7 +1257,28 @@ GuidedNativeImageIO
     region.SetSize(dim);
     image->SetRegions(region);
     image->SetVectorLength(ncomp);
-    image->Allocate();
+
+    // If the voxels are stored on disk as they are laid out in memory, map the
+    // file instead of reading it
+    size_t n_elements = region.GetNumberOfPixels() * ncomp;
+    std::string data_file;
+    size_t data_offset;
+    bool mapped = false;
+    if(m_UseMemoryMapping && nd_actual <= 3
+       && this->FindMappableVoxelData(sizeof(TScalar), n_elements * sizeof(TScalar),
+                                      data_file, data_offset))
+      {
+      typedef MappedFileImageContainer<TScalar> MappedContainer;
+      typename MappedContainer::Pointer mpc = MappedContainer::New();
+      if(mpc->MapElements(data_file, data_offset, n_elements))
+        {
+        image->SetPixelContainer(mpc);
+        mapped = true;
+        }
+      }
+
+    if(!mapped)
+      image->Allocate();
 
     // Set the IO region
     if(nd_actual <= 3)
@@ -761,34 +1303,48 @@ GuidedNativeImageIO
       m_IOBase->SetIORegion(ioRegion);
       }
 
-    // Read the image into the buffer
-    m_IOBase->Read(image->GetBufferPointer());
-    m_NativeImage = image;
-
-    // If the image is 4-dimensional or more, we must perform an in-place transpose
-    // of the image. The fourth dimension is the one that varies fastest, and in our
-    // representation, the image is represented as a VectorImage, where the components
-    // of each voxel are the thing that moves fastest. The problem can be represented as
-    // a transpose of a N x M array, where N = dimX*dimY*dimZ and M = dimW
-    if(nd_actual > 3)
+    // Read the image into the buffer. If the image is 4-dimensional or more,
+    // the data must be transposed. The fourth dimension is the one that varies
+    // slowest in the file, whereas in our representation, the image is a
+    // VectorImage, where the components of each voxel are the thing that moves
+    // fastest. The problem can be represented as a transpose of an M x N array
+    // of tuples, where N = dimX*dimY*dimZ, M = dimW*..., and the tuple length
+    // is the number of components per voxel in the file.
+    if(mapped)
+      {
+      // Nothing to read, the pages are loaded on first access
+      }
+    else if(nd_actual <= 3)
+      {
+      // Files that we compressed in blocks are decompressed in parallel
+      if(!this->ReadBlockCompressedVoxelData(sizeof(TScalar), n_elements * sizeof(TScalar),
+                                             image->GetBufferPointer()))
+        m_IOBase->Read(image->GetBufferPointer());
+      }
+    else
       {
       long N = dim[0] * dim[1] * dim[2];
-      long M = ncomp;
-      long move_size = (2 * M) * sizeof(TScalar);
-      char *move = new char[move_size];
-      TScalar buffer[2];
-
-      // TODO: this is a pretty slow routine. It would be nice to find somehting a little
-      // faster than this. But at least we can read 4D data now
-      itk::TimeProbe probe;
-      probe.Start();
-      transpose_toms513(image->GetBufferPointer(), M, N, move, move_size, buffer);
-      probe.Stop();
-
-      std::cout << "Transpose of " << N << " by " << M << " matrix computed in " << probe.GetTotal() << " sec." << std::endl;
-      delete[] move;
+      long C = m_IOBase->GetNumberOfComponents();
+      long M = ncomp / C;
+
+      // Read into a temporary buffer and transpose into the image
+      TScalar *raw = new TScalar[N * ncomp];
+      try
+        {
+        m_IOBase->Read(raw);
+        }
+      catch(...)
+        {
+        delete[] raw;
+        throw;
+        }
+
+      transpose_blocked(raw, image->GetBufferPointer(), M, N, C);
+      delete[] raw;
       }
 
+    m_NativeImage = image;
+
     
     /*
     typedef ImageFileReader<NativeImageType> ReaderType;
@@ -831,6 +1387,8 @@ void
 GuidedNativeImageIO
 ::SaveNativeImage(const char *FileName, Registry &folder)
 {
+  this->ExpandNativeRLEImage();
+
   // Cast image from native format to TPixel
   DispatchBase *dispatch = this->CreateDispatch(this->GetComponentTypeInNativeImage());
   dispatch->SaveNative(this, FileName, folder);
@@ -867,11 +1425,23 @@ GuidedNativeImageIO
   typedef itk::ImageFileWriter<TImageType> WriterType;
   typename WriterType::Pointer writer = WriterType::New();
   
-  writer->SetFileName(FileName);
+  writer->SetFileName(m_WriteFileName);
   if(m_IOBase)
     writer->SetImageIO(m_IOBase);
   writer->SetInput(image);
-  writer->Update();
+
+  // Do not leave the temporary file of a compressed write behind
+  try
+    {
+    writer->Update();
+    }
+  catch(...)
+    {
+    this->AbortWrite();
+    throw;
+    }
+
+  this->FinishWrite();
 }
 
 
@@ -882,6 +1452,7 @@ GuidedNativeImageIO
   std::string md5;
 
   // Cast image from native format to TPixel
+  this->ExpandNativeRLEImage();
   DispatchBase *dispatch = this->CreateDispatch(this->GetComponentTypeInNativeImage());
   md5 = dispatch->GetNativeMD5Hash(this);
   delete dispatch;
@@ -903,13 +1474,19 @@ GuidedNativeImageIO
     reinterpret_cast<InputImageType *>(native);
   assert(input);
 
+  const unsigned char *data = (const unsigned char *) input->GetBufferPointer();
+  size_t n_bytes = input->GetPixelContainer()->Size() * sizeof(TNative);
+
   char hex_code[33];
   hex_code[32] = 0;
   itksysMD5 *md5 = itksysMD5_New();
   itksysMD5_Initialize(md5);
-  itksysMD5_Append(md5, 
-    (unsigned char *) input->GetBufferPointer(), 
-    input->GetPixelContainer()->Size() * sizeof(TNative));
+
+  // The MD5 API takes an int length, so large buffers are appended in parts
+  const size_t max_append = 1 << 30;
+  for(size_t pos = 0; pos < n_bytes; pos += max_append)
+    itksysMD5_Append(md5, data + pos, (int) std::min(max_append, n_bytes - pos));
+
   itksysMD5_FinalizeHex(md5, hex_code);
   itksysMD5_Delete(md5);
 
@@ -929,6 +1506,7 @@ RescaleNativeImageToIntegralType<TOutputImage>::operator()(
     GuidedNativeImageIO *nativeIO)
 {
   // Get the native image pointer
+  nativeIO->ExpandNativeRLEImage();
   itk::ImageBase<3> *native = nativeIO->GetNativeImage();
 
   // Cast image from native format to TPixel
@@ -953,6 +1531,208 @@ RescaleNativeImageToIntegralType<TOutputImage>::operator()(
   return m_Output;
 }
 
+/*
+ * Multi-threaded helpers for scanning and casting the native image buffer.
+ * The buffer is split into contiguous chunks, one per thread. Small buffers
+ * are processed by a single thread to avoid the cost of starting threads.
+ */
+inline int GetNativeBufferThreadCount(itk::MultiThreader *threader, size_t n)
+{
+  const size_t min_chunk = 1 << 16;
+  size_t nt = std::min((size_t) threader->GetNumberOfThreads(), n / min_chunk);
+  return (int) std::max(nt, (size_t) 1);
+}
+
+template <typename TNative>
+struct NativeRangeScanPartial
+{
+  TNative min, max;
+  bool isint, valid;
+};
+
+template <typename TNative>
+struct NativeRangeScanData
+{
+  const TNative *buffer;
+  size_t n;
+  double omin, omax;
+  bool test_integer;
+  std::vector<NativeRangeScanPartial<TNative> > partials;
+};
+
+/*
+ * Computes the minimum and maximum of a chunk of the buffer. Optionally also
+ * tests whether all values in the chunk are integers that can be represented
+ * in TOutput (using the same rounding test as the cast), so that the range
+ * and the integrality of the data are established in a single pass.
+ */
+template <typename TNative, typename TOutput>
+ITK_THREAD_RETURN_TYPE native_range_scan_callback(void *arg)
+{
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfo;
+  ThreadInfo *info = static_cast<ThreadInfo *>(arg);
+  NativeRangeScanData<TNative> *td =
+      static_cast<NativeRangeScanData<TNative> *>(info->UserData);
+
+  size_t nthreads = info->NumberOfThreads, tid = info->ThreadID;
+  size_t i0 = (td->n * tid) / nthreads, i1 = (td->n * (tid + 1)) / nthreads;
+
+  NativeRangeScanPartial<TNative> &part = td->partials[tid];
+  part.valid = (i0 < i1);
+  if(!part.valid)
+    return ITK_THREAD_RETURN_VALUE;
+
+  const TNative *buffer = td->buffer;
+  TNative vmin = buffer[i0], vmax = buffer[i0];
+  bool isint = td->test_integer;
+  for(size_t i = i0; i < i1; i++)
+    {
+    TNative val = buffer[i];
+    if(val < vmin) vmin = val;
+    if(val > vmax) vmax = val;
+
+    if(isint)
+      {
+      // Values outside of the output range can not be cast, and the scan
+      // stops testing once a non-integer value is found
+      if(!(val >= td->omin && val <= td->omax))
+        isint = false;
+      else if(val != static_cast<TNative>(static_cast<TOutput>(val + 0.5)))
+        isint = false;
+      }
+    }
+
+  part.min = vmin;
+  part.max = vmax;
+  part.isint = isint;
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <typename TNative, typename TOutput>
+void scan_native_range(const TNative *buffer, size_t n, bool test_integer,
+                       TNative &vmin, TNative &vmax, bool &isint)
+{
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetNumberOfThreads(GetNativeBufferThreadCount(threader, n));
+
+  NativeRangeScanData<TNative> td;
+  td.buffer = buffer;
+  td.n = n;
+  td.omin = static_cast<double>(itk::NumericTraits<TOutput>::min());
+  td.omax = static_cast<double>(itk::NumericTraits<TOutput>::max());
+  td.test_integer = test_integer;
+  td.partials.resize(threader->GetNumberOfThreads());
+
+  threader->SetSingleMethod(&native_range_scan_callback<TNative, TOutput>, &td);
+  threader->SingleMethodExecute();
+
+  // Combine the partial results in the order of the chunks
+  vmin = vmax = buffer[0];
+  isint = test_integer;
+  for(size_t t = 0; t < td.partials.size(); t++)
+    {
+    const NativeRangeScanPartial<TNative> &part = td.partials[t];
+    if(part.valid)
+      {
+      if(part.min < vmin) vmin = part.min;
+      if(part.max > vmax) vmax = part.max;
+      isint = isint && part.isint;
+      }
+    }
+}
+
+template <typename TNative, typename TOutput, typename TFunctor>
+struct NativeCastData
+{
+  TNative *src;
+  TOutput *trg;
+  size_t n;
+  TFunctor *functor;
+};
+
+template <typename TNative, typename TOutput, typename TFunctor>
+ITK_THREAD_RETURN_TYPE native_cast_callback(void *arg)
+{
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfo;
+  ThreadInfo *info = static_cast<ThreadInfo *>(arg);
+  NativeCastData<TNative, TOutput, TFunctor> *td =
+      static_cast<NativeCastData<TNative, TOutput, TFunctor> *>(info->UserData);
+
+  size_t nthreads = info->NumberOfThreads, tid = info->ThreadID;
+  size_t i0 = (td->n * tid) / nthreads, i1 = (td->n * (tid + 1)) / nthreads;
+
+  // Copy the functor so that threads do not share state
+  TFunctor functor = *td->functor;
+  for(size_t i = i0; i < i1; i++)
+    functor(td->src + i, td->trg + i);
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <typename TNative, typename TOutput, typename TFunctor>
+void cast_native_chunk(itk::MultiThreader *threader,
+                       TNative *src, TOutput *trg, size_t n, TFunctor &functor)
+{
+  NativeCastData<TNative, TOutput, TFunctor> td;
+  td.src = src;
+  td.trg = trg;
+  td.n = n;
+  td.functor = &functor;
+
+  threader->SetNumberOfThreads(GetNativeBufferThreadCount(threader, n));
+  threader->SetSingleMethod(&native_cast_callback<TNative, TOutput, TFunctor>, &td);
+  threader->SingleMethodExecute();
+}
+
+/*
+ * Applies the functor to the n values of a buffer, writing the output in
+ * place, i.e., the input and output pointers refer to the same memory. When
+ * the input and output types have the same size, each value is replaced by
+ * its cast and the whole buffer is processed in parallel. Otherwise, the
+ * buffer is processed in waves: each wave is cast in parallel into a small
+ * temporary buffer, which is then copied into place. The waves proceed in
+ * ascending order if the output is smaller than the input, and in descending
+ * order otherwise, so that no input value is overwritten before it is read.
+ */
+template <typename TNative, typename TOutput, typename TFunctor>
+void cast_native_buffer_in_place(TNative *ib, TOutput *ob, size_t n, TFunctor &functor)
+{
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  int max_threads = threader->GetNumberOfThreads();
+
+  if(sizeof(TNative) == sizeof(TOutput))
+    {
+    cast_native_chunk(threader.GetPointer(), ib, ob, n, functor);
+    return;
+    }
+
+  const size_t wave = 1 << 22;
+  std::vector<TOutput> temp(std::min(wave, n));
+
+  if(sizeof(TOutput) < sizeof(TNative))
+    {
+    for(size_t s = 0; s < n; s += wave)
+      {
+      size_t w = std::min(wave, n - s);
+      threader->SetNumberOfThreads(max_threads);
+      cast_native_chunk(threader.GetPointer(), ib + s, &temp[0], w, functor);
+      std::copy(temp.begin(), temp.begin() + w, ob + s);
+      }
+    }
+  else
+    {
+    for(size_t e = n; e > 0; )
+      {
+      size_t w = std::min(wave, e), s = e - w;
+      threader->SetNumberOfThreads(max_threads);
+      cast_native_chunk(threader.GetPointer(), ib + s, &temp[0], w, functor);
+      std::copy(temp.begin(), temp.begin() + w, ob + s);
+      e = s;
+      }
+    }
+}
+
+
 template<typename TPixel, typename TNative>
 class RescaleScalarNativeImageToScalarFunctor
 {
@@ -1065,19 +1845,17 @@ RescaleNativeImageToIntegralType<TOutputImage>
     OutputComponentType omin = itk::NumericTraits<OutputComponentType>::min();
 
     // Scan over all the image components. Avoid using iterators here because of
-    // unnecessary overhead for vector images.
+    // unnecessary overhead for vector images. For floating point input, the
+    // same pass tests whether the input image is actually an integer image
+    // cast to floating point. In that case, there is no need for conversion
     TNative *ib_begin = input->GetBufferPointer();
-    TNative *ib_end = ib_begin + input->GetPixelContainer()->Size();
-
-    TNative imin_nat = *ib_begin, imax_nat = *ib_begin;
+    size_t ib_size = input->GetPixelContainer()->Size();
 
-    // Iterate over all the components in the input image
-    for(TNative *buffer = ib_begin + 1; buffer < ib_end; ++buffer)
-      {
-      TNative val = *buffer;
-      if(val < imin_nat) imin_nat = val;
-      if(val > imax_nat) imax_nat = val;
-      }
+    TNative imin_nat, imax_nat;
+    bool allint;
+    scan_native_range<TNative, OutputComponentType>(
+          ib_begin, ib_size, !itk::NumericTraits<TNative>::is_integer && ncomp == 1,
+          imin_nat, imax_nat, allint);
 
     // Cast the values to double
     double imin = static_cast<double>(imin_nat), imax = static_cast<double>(imax_nat);
@@ -1086,22 +1864,7 @@ RescaleNativeImageToIntegralType<TOutputImage>
     // For float and double, we map the input range into the output range
     if(!itk::NumericTraits<TNative>::is_integer)
       {
-      // Test whether the input image is actually an integer image cast to
-      // floating point. In that case, there is no need for conversion
-      bool isint = false;
-      if(1.0 * omin <= imin && 1.0 * omax >= imax && ncomp == 1)
-        {
-        isint = true;
-
-        // Another pass through the image? Why is this necessary?
-        for(TNative *buffer = ib_begin; buffer < ib_end; ++buffer)
-          {
-          TNative vin = *buffer;
-          TNative vcmp = static_cast<TNative>(static_cast<OutputComponentType>(vin + 0.5));
-          if(vin != vcmp)
-            { isint = false; break; }
-          }
-        }
+      bool isint = allint && 1.0 * omin <= imin && 1.0 * omax >= imax && ncomp == 1;
 
       // If underlying data is really integer, no scale or shift is necessary
       // except that to round (so floating values like 0.9999999 get mapped to
@@ -1173,6 +1936,7 @@ CastNativeImage<TOutputImage,TCastFunctor>
 ::operator()(GuidedNativeImageIO *nativeIO)
 {
   // Get the native image pointer
+  nativeIO->ExpandNativeRLEImage();
   itk::ImageBase<3> *native = nativeIO->GetNativeImage();
 
   // Cast image from native format to TPixel
@@ -1261,6 +2025,11 @@ CastNativeImage<TOutputImage,TCastFunctor>
   // Bytes needed to store the data in target format
   size_t nbTarget = input->GetPixelContainer()->Size() * szTarget;
 
+  // A buffer mapped from a file cannot be converted in place
+  MappedFileBuffer *mapped = dynamic_cast<MappedFileBuffer *>(ipc);
+  if(mapped)
+    mapped->Detach();
+
   // This memory is no longer owned by the input
   ipc->SetContainerManageMemory(false);
 
@@ -1284,22 +2053,10 @@ CastNativeImage<TOutputImage,TCastFunctor>
   // same than the target image, we want to proceed in ascending order, since each
   // input element will be replaced by one or more output elements. But if the
   // native image is smaller, we want to proceed from the end of the memory
-  // block in a descending order, so that the native data is not overridden
+  // block in a descending order, so that the native data is not overridden.
+  // The work is split among threads, see cast_native_buffer_in_place.
   unsigned long nval =  nvoxels * ncomp;
-  if(szTarget > szNative)
-    {
-    TNative *pn = ib + nval - 1;
-    OutputComponentType *pt = ob + nval - 1;
-    for(; pt >= ob; pt--, pn--)
-      m_Functor(pn, pt);
-    }
-  else
-    {
-    TNative *pn = ib;
-    OutputComponentType *pt = ob;
-    for(; pt < ob + nval; pt++, pn++)
-      m_Functor(pn, pt);
-    }
+  cast_native_buffer_in_place(ib, ob, nval, m_Functor);
 
   // If needed, squeeze the memory
   if(nbTarget < nbNative)
@@ -1408,6 +2165,20 @@ GuidedNativeImageIO
   tags_refine.push_back(m_tagRows);
   tags_refine.push_back(m_tagCols);
 
+  // The values extracted from each file: the series UID, the refine tags in
+  // the order above, and the series description
+  enum DicomValueIndex {
+    DICOM_VALUE_SERIES_UID = 0,
+    DICOM_VALUE_SERIES_NUMBER,
+    DICOM_VALUE_SEQUENCE_NAME,
+    DICOM_VALUE_SLICE_THICKNESS,
+    DICOM_VALUE_ROWS,
+    DICOM_VALUE_COLS,
+    DICOM_VALUE_DESC,
+    DICOM_VALUE_COUNT
+  };
+  assert(tags_refine.size() == DICOM_VALUE_DESC - DICOM_VALUE_SERIES_NUMBER);
+
   // List of tags that we want to parse - everything else may be ignored
   std::set<gdcm::Tag> tags_all;
   tags_all.insert(tags_refine.begin(), tags_refine.end());
@@ -1418,6 +2189,15 @@ GuidedNativeImageIO
   m_LastDicomParseResult.Reset();
   m_LastDicomParseResult.Directory = dir;
 
+  // Load the index of previously parsed files in this directory
+  DicomDirectoryIndex index(dir, DICOM_VALUE_COUNT);
+  std::string index_file;
+  if(m_DICOMIndexDirectory.size())
+    {
+    index_file = DicomDirectoryIndex::GetIndexFileName(m_DICOMIndexDirectory, dir);
+    index.Load(index_file);
+    }
+
   // GDCM directory listing
   gdcm::Directory dirList;
 
@@ -1427,32 +2207,63 @@ GuidedNativeImageIO
   for(gdcm::Directory::FilenamesType::const_iterator it = filenames.begin();
     it != filenames.end(); ++it)
     {
-    // Process each filename in the directory
-    gdcm::Reader reader;
-    reader.SetFileName(it->c_str());
+    // Check if the file is in the index and has not changed since
+    unsigned long size = itksys::SystemTools::FileLength(it->c_str());
+    long mtime = itksys::SystemTools::ModifiedTime(it->c_str());
+    const DicomDirectoryIndex::Entry *cached = index.Find(*it, size, mtime);
 
-    // Try reading this file. Fail quietly.
-    bool read = false;
-    try { read = reader.ReadSelectedTags(tags_all, true); }
-    catch(...) {}
+    DicomDirectoryIndex::Entry entry;
+    if(cached)
+      {
+      entry = *cached;
+      }
+    else
+      {
+      entry.Size = size;
+      entry.ModifiedTime = mtime;
+
+      // Process each filename in the directory
+      gdcm::Reader reader;
+      reader.SetFileName(it->c_str());
+
+      // Try reading this file. Fail quietly.
+      entry.IsDicom = false;
+      try { entry.IsDicom = reader.ReadSelectedTags(tags_all, true); }
+      catch(...) {}
+
+      if(entry.IsDicom)
+        {
+        // Create a string filter to get tags
+        gdcm::StringFilter sf;
+        sf.SetFile(reader.GetFile());
+
+        entry.Values.push_back(sf.ToString(m_tagSeriesInstanceUID));
+        for(int iTag = 0; iTag < tags_refine.size(); iTag++)
+          entry.Values.push_back(sf.ToString(tags_refine[iTag]));
+        entry.Values.push_back(sf.ToString(m_tagDesc));
+        }
+      else
+        {
+        entry.Values.resize(DICOM_VALUE_COUNT);
+        }
+
+      // Remember the file, even if it is not DICOM, so that it is not read again
+      index.Update(*it, entry);
+      }
 
     // If nothing read, keep going
-    if(!read)
+    if(!entry.IsDicom)
       continue;
 
-    // Create a string filter to get tags
-    gdcm::StringFilter sf;
-    sf.SetFile(reader.GetFile());
-
     // Start with the ID being the UID
-    std::string uid = sf.ToString(m_tagSeriesInstanceUID);
+    const std::string &uid = entry.Values[DICOM_VALUE_SERIES_UID];
     std::string full_id = uid;
 
     // Iterate over the tags in the refine list
     for(int iTag = 0; iTag < tags_refine.size(); iTag++)
       {
       // Read the tag value
-      std::string s = sf.ToString(tags_refine[iTag]);
+      const std::string &s = entry.Values[DICOM_VALUE_SERIES_NUMBER + iTag];
 
       // This code is from gdcmSerieHelper
       if( full_id == uid && !s.empty() )
@@ -1489,12 +2300,12 @@ GuidedNativeImageIO
       r["SeriesId"] << full_id;
 
       // Read series description
-      r["SeriesDescription"] << sf.ToString(m_tagDesc);
-      r["SeriesNumber"] << sf.ToString(m_tagSeriesNumber);
+      r["SeriesDescription"] << entry.Values[DICOM_VALUE_DESC];
+      r["SeriesNumber"] << entry.Values[DICOM_VALUE_SERIES_NUMBER];
 
       // Read the dimensions
-      r["Rows"] << std::atoi(sf.ToString(m_tagRows).c_str());
-      r["Columns"] << std::atoi(sf.ToString(m_tagCols).c_str());
+      r["Rows"] << std::atoi(entry.Values[DICOM_VALUE_ROWS].c_str());
+      r["Columns"] << std::atoi(entry.Values[DICOM_VALUE_COLS].c_str());
       r["NumberOfImages"] << 1;
       }
     else
@@ -1516,6 +2327,14 @@ GuidedNativeImageIO
       progressCommand->Execute(this, itk::ProgressEvent());
     }
 
+  // Forget the files that are no longer in the directory and store the index
+  if(index_file.size())
+    {
+    index.Prune(filenames);
+    if(index.IsModified())
+      index.Save(index_file);
+    }
+
   // Complain if no series have been found
   if(m_LastDicomParseResult.SeriesMap.size() == 0)
     throw IRISException(
@@ -1617,6 +2436,7 @@ CastNativeImageToScalar<TPixel>
 ::operator()(GuidedNativeImageIO *nativeIO)
 {
   // Get the native image pointer
+  nativeIO->ExpandNativeRLEImage();
   itk::ImageBase<3> *native = nativeIO->GetNativeImage();
 
   // Allocate the output image
@@ -40,6 +40,7 @@
 #include "itkImage.h"
 #include "itkImageIOBase.h"
 #include "itkVectorImage.h"
+#include "RLEImage.h"
 #include "gdcmTag.h"
 
   
@@ -69,7 +70,7 @@ public:
     FORMAT_DICOM_FILE,      // A single DICOM file
     FORMAT_GE4, FORMAT_GE5, FORMAT_GIPL,
     FORMAT_MHA, FORMAT_NIFTI, FORMAT_NRRD, FORMAT_RAW, FORMAT_SIEMENS,
-    FORMAT_VOXBO_CUB, FORMAT_VTK, FORMAT_GENERIC_ITK, FORMAT_COUNT};
+    FORMAT_VOXBO_CUB, FORMAT_VTK, FORMAT_SNAP_RLE, FORMAT_GENERIC_ITK, FORMAT_COUNT};
 
   enum RawPixelType {
     PIXELTYPE_UCHAR=0, PIXELTYPE_CHAR, PIXELTYPE_USHORT, PIXELTYPE_SHORT, 
@@ -139,7 +140,17 @@ public:
 
   void ReadNativeImageHeader(const char *FileName, Registry &folder);
 
-  void ReadNativeImageData();
+  /**
+   * Read the voxel data after the header has been read. The optional command
+   * is executed with itk::ProgressEvent as the data are read, and the amount
+   * of data read so far is available from GetReadProgress(). The command is
+   * executed on the calling thread. This method does not access any state
+   * outside of this object, so it may be called from a worker thread.
+   */
+  void ReadNativeImageData(itk::Command *progressCommand = NULL);
+
+  /** Fraction of the voxel data read so far by ReadNativeImageData() */
+  irisGetMacro(ReadProgress, double)
 
   /**
    * Get the number of components in the native image read by ReadNativeImage.
@@ -193,6 +204,25 @@ public:
   bool IsNativeImageLoaded() const
     { return m_NativeImage.IsNotNull(); }
 
+  /** Run-length encoded label image type, see GetNativeRLEImage() */
+  typedef RLEImage<LabelType> RLEImageType;
+
+  /**
+   * Segmentations stored in the RLE segmentation format are read directly
+   * into a run-length encoded image, which is returned by this method. In
+   * this case, GetNativeImage() also returns the RLE image, which is only
+   * usable for its header. Returns NULL if the native image is not RLE.
+   */
+  RLEImageType *GetNativeRLEImage() const
+    { return dynamic_cast<RLEImageType *>(m_NativeImage.GetPointer()); }
+
+  /**
+   * Replace a run-length encoded native image by an uncompressed native image.
+   * This is called before the native image is cast to another type, and
+   * does nothing if the native image is not RLE.
+   */
+  void ExpandNativeRLEImage();
+
   /** 
    * Save the native image it its native format (to a different location and
    * filename, presumably). This function is not meant as part of the normal
@@ -282,14 +312,74 @@ public:
    */
   void CreateImageIO(const char *fname, Registry &folder, bool read);
 
+  /**
+   * Get the name of the file that the ITK writer should write to, after
+   * CreateImageIO() has been called for writing. For gzipped NIfTI files
+   * this is an uncompressed temporary file, which FinishWrite() compresses
+   * in parallel into the requested file once the writer is done.
+   */
+  const std::string &GetWriteFileName() const
+    { return m_WriteFileName; }
+
+  /**
+   * Complete the writing of a file, after the ITK writer has written to the
+   * file returned by GetWriteFileName()
+   */
+  void FinishWrite();
+
+  /**
+   * Remove the temporary file of a write that failed before FinishWrite()
+   * was called. This is also done when the object is deleted, so callers
+   * that only keep the object for the duration of the write need not call it.
+   */
+  void AbortWrite();
+
+  /**
+   * Set the number of threads used to compress and decompress gzipped NIfTI
+   * files. The default value of 0 uses as many threads as ITK does by
+   * default, and a value of 1 leaves the compression to ITK. The application
+   * sets it from the GzipThreads preference in DefaultBehaviorSettings.
+   */
+  static void SetGzipThreads(int n);
+  static int GetGzipThreads();
+
+  /**
+   * Set the number of threads used to decode the slices of a DICOM series.
+   * The default value of 0 uses as many threads as ITK does by default, and
+   * a value of 1 reads the slices one after another. The application sets it
+   * from the DICOMReadThreads preference in DefaultBehaviorSettings.
+   */
+  static void SetDICOMReadThreads(int n);
+  static int GetDICOMReadThreads();
+
+  /**
+   * Set the directory where ParseDicomDirectory() keeps an index of the
+   * DICOM header values of the files it has parsed, so that directories that
+   * are parsed again only require new and modified files to be read. An
+   * empty string (the default) disables the index.
+   */
+  static void SetDICOMIndexDirectory(const std::string &dir);
+  static std::string GetDICOMIndexDirectory();
+
+  /**
+   * Whether uncompressed NIfTI, MetaImage and raw files whose voxels are
+   * stored contiguously in the native byte order are mapped into memory
+   * instead of being read. The mapping is copy-on-write, and when no cast is
+   * needed, the image layers use the mapped memory directly. Off by default:
+   * the pages that have not been modified are read from the file on demand,
+   * so a file that is truncated or changed by another program while it is
+   * loaded can crash the application or change the image.
+   */
+  static void SetUseMemoryMapping(bool flag);
+  static bool GetUseMemoryMapping();
+
   // Get the output of the last operation
   // irisGetMacro(IOBase, itk::ImageIOBase *);    
 
 protected:
 
   GuidedNativeImageIO();
-  virtual ~GuidedNativeImageIO()
-    { DeallocateNativeImage(); }
+  virtual ~GuidedNativeImageIO();
 
   /** Templated function to create RAW image IO */
   template <typename TRaw> void CreateRawImageIO(Registry &folder);
@@ -297,6 +387,34 @@ protected:
   /** Templated function that reads a scalar image in its native datatype */
   template <typename TScalar> void DoReadNative(const char *fname, Registry &folder);
 
+  /**
+   * Templated function that decodes the slices of a DICOM series concurrently
+   * into the native image. Returns false, leaving the native image unchanged,
+   * if this is not possible (single thread, or slices with inconsistent
+   * dimensions or pixel types), in which case the series must be read serially.
+   */
+  template <typename TScalar> bool DoReadDICOMSeriesParallel();
+
+  /**
+   * Check whether the voxel data of the file being read can be mapped into
+   * memory as they are stored, and if so, find the file that holds the voxels
+   * and the offset at which they start
+   */
+  bool FindMappableVoxelData(size_t element_size, size_t n_bytes,
+                             std::string &data_file, size_t &offset);
+
+  /**
+   * Read the voxels of a NIfTI file that was compressed by FinishWrite(),
+   * decompressing it in parallel. Returns false if this is not possible.
+   */
+  bool ReadBlockCompressedVoxelData(size_t element_size, size_t n_bytes, void *buffer);
+
+  /** Update the read progress and notify the progress command */
+  void UpdateReadProgress(double progress);
+
+  /** Forwards the progress of ITK readers to UpdateReadProgress() */
+  void OnReaderProgress(itk::Object *caller, const itk::EventObject &event);
+
   /** Templated function that reads a scalar image in its native datatype */
   template <typename TScalar> void DoSaveNative(const char *fname, Registry &folder);
 
@@ -358,6 +476,10 @@ protected:
   // Copy of the registry passed in when reading header
   Registry m_Hints;
 
+  // Progress reporting during ReadNativeImageData()
+  itk::Command *m_ReadProgressCommand;
+  double m_ReadProgress;
+
   // The file format
   FileFormat m_FileFormat;
 
@@ -367,6 +489,21 @@ protected:
   // Number of images per z-position in the DICOM series (e.g., multi-echo data)
   int m_DICOMImagesPerIPP;
 
+  // Number of threads used to decode DICOM slices
+  static int m_DICOMReadThreads;
+
+  // Directory where the DICOM directory indices are stored
+  static std::string m_DICOMIndexDirectory;
+
+  // Whether to map uncompressed images into memory
+  static bool m_UseMemoryMapping;
+
+  // Number of threads used for gzip compression
+  static int m_GzipThreads;
+
+  // The file that the writer writes to, and the file it is compressed into
+  std::string m_WriteFileName, m_CompressedFileName;
+
   /** Registry mappings for these enums */
   static bool m_StaticDataInitialized;
   static RegistryEnumMap<FileFormat> m_EnumFileFormat;
@@ -43,6 +43,7 @@
 
 #include "ImageWrapper.h"
 #include "RLEImageRegionIterator.h"
+#include "RLESegmentationImageIO.h"
 #include "RLERegionOfInterestImageFilter.h"
 #include "itkImageSliceConstIteratorWithIndex.h"
 #include "itkNumericTraits.h"
@@ -164,11 +165,12 @@ public:
 
     typedef itk::ImageFileWriter<TImage> WriterType;
     typename WriterType::Pointer writer = WriterType::New();
-    writer->SetFileName(fname);
+    writer->SetFileName(io->GetWriteFileName());
     if(base)
       writer->SetImageIO(base);
     writer->SetInput(image);
     writer->Update();
+    io->FinishWrite();
   }
 
   template <class TInterpolateFunction>
@@ -373,6 +375,19 @@ public:
 
   static void Write(ImageType *image, const char *fname, Registry &hints)
   {
+    SmartPtr<GuidedNativeImageIO> io = GuidedNativeImageIO::New();
+    io->CreateImageIO(fname, hints, false);
+    itk::ImageIOBase *base = io->GetIOBase();
+
+    // The RLE segmentation format stores the runs without expanding them
+    RLESegmentationImageIO *rle_io = dynamic_cast<RLESegmentationImageIO *>(base);
+    if(rle_io)
+      {
+      rle_io->SetFileName(io->GetWriteFileName());
+      rle_io->WriteRLEImage(image);
+      return;
+      }
+
     //use specialized RoI filter to convert to itk::Image
     typedef itk::RegionOfInterestImageFilter<ImageType, UncompressedType> outConverterType;
     typename outConverterType::Pointer outConv = outConverterType::New();
@@ -381,17 +396,14 @@ public:
     outConv->Update();
     typename UncompressedType::Pointer imgUncompressed = outConv->GetOutput();
 
-    SmartPtr<GuidedNativeImageIO> io = GuidedNativeImageIO::New();
-    io->CreateImageIO(fname, hints, false);
-    itk::ImageIOBase *base = io->GetIOBase();
-
     typedef itk::ImageFileWriter<UncompressedType> WriterType;
     typename WriterType::Pointer writer = WriterType::New();
-    writer->SetFileName(fname);
+    writer->SetFileName(io->GetWriteFileName());
     if (base)
         writer->SetImageIO(base);
     writer->SetInput(imgUncompressed);
     writer->Update();
+    io->FinishWrite();
   }
 
   template <class TInterpolateFunction>
@@ -570,6 +582,19 @@ ImageWrapper<TTraits,TBase>
   m_DisplayMapping = DisplayMapping::New();
   m_DisplayMapping->Initialize(static_cast<typename DisplayMapping::WrapperType *>(this));
 
+  // Create the display slice caches. These stay disabled until an image is
+  // assigned to the wrapper
+  for(int i = 0; i < 3; i++)
+    {
+    m_DisplaySliceCache[i] = DisplaySliceCacheFilter::New();
+    m_DisplaySliceCache[i]->SetSliceSource(m_Slicer[i]);
+    }
+
+  // Cached display slices are discarded when the display mapping changes
+  SmartPtr<itk::SimpleMemberCommand<Self> > cmdMapping = itk::SimpleMemberCommand<Self>::New();
+  cmdMapping->SetCallbackFunction(this, &Self::OnDisplayMappingChange);
+  this->AddObserver(WrapperDisplayMappingChangeEvent(), cmdMapping);
+
   // Set sticky flag
   m_Sticky = TTraits::StickyByDefault;
 
@@ -987,6 +1012,9 @@ ImageWrapper<TTraits,TBase>
   // Update the image in the display mapping
   m_DisplayMapping->UpdateImagePointer(m_Image);
 
+  // Slicing may have switched between orthogonal and oblique
+  this->UpdateDisplaySliceCacheState();
+
   // Update the image coordinate geometry
   if(!isReferenceGeometrySame)
     {
@@ -1097,6 +1125,8 @@ ImageWrapper<TTraits,TBase>
 
       // m_ResampleFilter[i+3]->SetTransform(transform);
       }
+
+    this->UpdateDisplaySliceCacheState();
     }
 }
 
@@ -1129,6 +1159,13 @@ ImageWrapper<TTraits,TBase>
     }
   m_Initialized = false;
 
+  // Release the cached display slices
+  for(int i = 0; i < 3; i++)
+    {
+    m_DisplaySliceCache[i]->SetCachingEnabled(false);
+    m_DisplaySliceCache[i]->InvalidateCache();
+    }
+
   m_Alpha = 0.5;
 }
 
@@ -1216,6 +1253,10 @@ ImageWrapper<TTraits,TBase>
   {
     // Set the slice using that axis
     m_Slicer[i]->SetSliceIndex(to_itkIndex(cursor));
+
+    // The cache is keyed on the position along the slicing axis
+    if(m_ReferenceSpace)
+      m_DisplaySliceCache[i]->SetSliceIndex(cursor[this->GetDisplaySliceImageAxis(i)]);
   }
 }
 
@@ -1266,6 +1307,9 @@ ImageWrapper<TTraits,TBase>
       m_Slicer[iSlice]->SetOrthogonalTransform(
             m_ImageGeometry.GetImageToDisplayTransform(iSlice));
 
+      // Slices cached with the old geometry are no longer valid
+      m_DisplaySliceCache[iSlice]->InvalidateCache();
+
       // TODO: is this necessary and the right place to do ut?
       // Invalidate the requested region in the display slice. This will
       // cause the RR to reset to largest possible region on next Update
@@ -1440,7 +1484,73 @@ template<class TTraits, class TBase>
 typename ImageWrapper<TTraits,TBase>::DisplaySlicePointer
 ImageWrapper<TTraits,TBase>::GetDisplaySlice(unsigned int dim)
 {
-  return m_DisplayMapping->GetDisplaySlice(dim);
+  // The display mapping may replace its output filters, so the input of
+  // the cache is refreshed every time
+  m_DisplaySliceCache[dim]->SetInput(m_DisplayMapping->GetDisplaySlice(dim));
+  return m_DisplaySliceCache[dim]->GetOutput();
+}
+
+template<class TTraits, class TBase>
+void
+ImageWrapper<TTraits,TBase>::PrefetchDisplaySlices(unsigned int dim)
+{
+  DisplaySliceCacheFilter *cache = m_DisplaySliceCache[dim];
+  int dir = cache->GetScrollDirection();
+  int count = (int) DisplaySliceCacheFilter::GetGlobalPrefetchCount();
+  if(!m_Initialized || !cache->GetCachingEnabled() || dir == 0 || count == 0)
+    return;
+
+  // Make sure the cache is connected to the display pipeline
+  this->GetDisplaySlice(dim);
+
+  // Walk along the slicing axis in the direction of scrolling
+  unsigned int axis = this->GetDisplaySliceImageAxis(dim);
+  int size = (int) m_ReferenceSpace->GetLargestPossibleRegion().GetSize()[axis];
+  Vector3ui cursor = m_SliceIndex;
+  bool moved = false;
+  for(int k = 1; k <= count; k++)
+    {
+    int z = (int) m_SliceIndex[axis] + dir * k;
+    if(z < 0 || z >= size)
+      break;
+
+    if(!cache->IsSliceCached(z))
+      {
+      cursor[axis] = (unsigned int) z;
+      m_Slicer[dim]->SetSliceIndex(to_itkIndex(cursor));
+      cache->CacheInputSlice(z);
+      moved = true;
+      }
+    }
+
+  // Point the slicer back at the current slice. The display slice itself
+  // will be served from the cache on the next update
+  if(moved)
+    m_Slicer[dim]->SetSliceIndex(to_itkIndex(m_SliceIndex));
+}
+
+template<class TTraits, class TBase>
+void
+ImageWrapper<TTraits,TBase>::UpdateDisplaySliceCacheState()
+{
+  for(int i = 0; i < 3; i++)
+    {
+    bool enabled = m_Image.IsNotNull()
+        && this->IsDisplaySliceCachingSupported()
+        && m_Slicer[i]->GetUseOrthogonalSlicing()
+        && m_Slicer[i]->GetPreviewImage() == NULL;
+
+    m_DisplaySliceCache[i]->SetCachingEnabled(enabled);
+    m_DisplaySliceCache[i]->InvalidateCache();
+    }
+}
+
+template<class TTraits, class TBase>
+void
+ImageWrapper<TTraits,TBase>::OnDisplayMappingChange()
+{
+  for(int i = 0; i < 3; i++)
+    m_DisplaySliceCache[i]->InvalidateCache();
 }
 
 template<class TTraits, class TBase>
@@ -1551,6 +1661,9 @@ ImageWrapper<TTraits,TBase>
     filter[i]->Modified();
     }
 
+  // Preview slices change without notice, so they are not cached
+  this->UpdateDisplaySliceCacheState();
+
   // This is so that IsDrawable() behaves correctly
   m_ImageAssignTime = m_Image->GetTimeStamp();
 }
@@ -1564,6 +1677,8 @@ ImageWrapper<TTraits,TBase>
     {
     m_Slicer[i]->SetPreviewImage(NULL);
     }
+
+  this->UpdateDisplaySliceCacheState();
 }
 
 template<class TTraits, class TBase>
@@ -42,6 +42,7 @@
 #include <itkVectorImage.h>
 #include <itkRGBAPixel.h>
 #include <DisplayMappingPolicy.h>
+#include "DisplaySliceCacheFilter.h"
 #include <itkSimpleDataObjectDecorator.h>
 
 // Forward declarations to IRIS classes
@@ -452,6 +453,11 @@ public:
    */
   DisplaySlicePointer GetDisplaySlice(unsigned int dim) ITK_OVERRIDE;
 
+  /**
+   * Prefetch display slices ahead of the current slice into the cache
+   */
+  virtual void PrefetchDisplaySlices(unsigned int dim) ITK_OVERRIDE;
+
   /**
     Attach a preview pipeline to the wrapper. This is used with wrappers that
     represent results of image processing operations, such as speed images.
@@ -637,6 +643,9 @@ protected:
   /** The pipeline that handles mapping intensities to the display slices */
   SmartPtr<DisplayMapping> m_DisplayMapping;
 
+  /** Caches of recently displayed slices, at the end of the display pipeline */
+  SmartPtr<DisplaySliceCacheFilter> m_DisplaySliceCache[3];
+
   // Mapping from native to internal format
   NativeIntensityMapping m_NativeMapping;
 
@@ -705,6 +714,18 @@ protected:
   /** Common code for the different constructors */
   void CommonInitialization();
 
+  /**
+   * Whether the display slices of this wrapper may be cached. Wrappers whose
+   * display slices are composed from other wrappers' slices return false.
+   */
+  virtual bool IsDisplaySliceCachingSupported() const { return true; }
+
+  /** Enable or disable the display slice caches based on current slicing */
+  void UpdateDisplaySliceCacheState();
+
+  /** Called when the display mapping changes */
+  void OnDisplayMappingChange();
+
   /** Parent wrapper */
   ImageWrapperBase *m_ParentWrapper;
 
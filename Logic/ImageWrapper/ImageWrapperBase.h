@@ -269,6 +269,13 @@ public:
   /** For each slicer, find out which image dimension does is slice along */
   virtual unsigned int GetDisplaySliceImageAxis(unsigned int slice) = 0;
 
+  /**
+   * Compute and cache the display slices adjacent to the current slice in
+   * the given display direction, in the direction in which the user has
+   * been scrolling. Meant to be called when the GUI is idle.
+   */
+  virtual void PrefetchDisplaySlices(unsigned int dim) = 0;
+
   /** Get the number of voxels */
   virtual size_t GetNumberOfVoxels() const = 0;
 
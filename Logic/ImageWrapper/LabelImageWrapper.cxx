@@ -43,10 +43,17 @@
 #include "LabelImageWrapper.h"
 #include "UndoDataManager.h"
 #include "Rebroadcaster.h"
+#include <algorithm>
 
 LabelImageWrapper::LabelImageWrapper()
 {
-  m_UndoManager = new UndoManagerType(4, 200000);
+  // Keep up to 16MB of compressed undo data in memory, and move older
+  // commits to a temporary file holding up to 512MB
+  m_UndoManager = new UndoManagerType(4, 16 << 20, 512 << 20);
+
+  // The label statistics are computed on demand
+  m_LabelStatisticsValid = false;
+  m_LabelStatisticsMTime = 0;
 }
 
 LabelImageWrapper::~LabelImageWrapper()
@@ -59,6 +66,8 @@ void LabelImageWrapper::UpdateImagePointer(
 {
   Superclass::UpdateImagePointer(image, refSpace, tran);
   m_UndoManager->Clear();
+  m_LabelStatisticsValid = false;
+  m_EditLog.clear();
 
   // Modified event on the image is rebroadcast as the WrapperImageChangeEvent
   Rebroadcaster::Rebroadcast(image, itk::ModifiedEvent(),
@@ -67,6 +76,8 @@ void LabelImageWrapper::UpdateImagePointer(
 
 void LabelImageWrapper::StoreIntermediateUndoDelta(UndoManagerDelta *delta)
 {
+  this->UpdateLabelStatistics(delta, false, delta->GetImageMTime());
+  this->RecordEdit(delta->GetRegion(), delta->GetImageMTime());
   m_UndoManager->AddDeltaToStaging(delta);
 }
 
@@ -74,7 +85,11 @@ void LabelImageWrapper::StoreUndoPoint(const char *text, UndoManagerDelta *delta
 {
   // If there is a delta, add it to staging
   if(delta)
+    {
+    this->UpdateLabelStatistics(delta, false, delta->GetImageMTime());
+    this->RecordEdit(delta->GetRegion(), delta->GetImageMTime());
     m_UndoManager->AddDeltaToStaging(delta);
+    }
 
   // Commit the deltas
   m_UndoManager->CommitStaging(text);
@@ -90,41 +105,106 @@ bool LabelImageWrapper::IsUndoPossible()
   return m_UndoManager->IsUndoPossible();
 }
 
-void LabelImageWrapper::Undo()
+// Apply the next n values from the delta runs at the iterator position
+template <class TIterator, class TRLEIterator>
+static void ApplyDeltaValues(TIterator &lit, TRLEIterator &rit, size_t &nLeftInRun,
+                             size_t n, bool reverse)
 {
-  // Get the commit for the undo
-  const UndoManagerType::Commit &commit = m_UndoManager->GetCommitForUndo();
+  while(n > 0 && !rit.IsAtEnd())
+    {
+    size_t k = std::min(n, nLeftInRun);
+    LabelType d = rit.GetValue();
+    for(size_t j = 0; j < k; j++)
+      {
+      if(d != 0)
+        lit.Set(reverse ? lit.Get() - d : lit.Get() + d);
+      ++lit;
+      }
+
+    n -= k;
+    nLeftInRun -= k;
+    if(nLeftInRun == 0)
+      {
+      ++rit;
+      nLeftInRun = rit.IsAtEnd() ? 0 : rit.GetLength();
+      }
+    }
+}
 
-  // The label image that will undergo undo
+void LabelImageWrapper::ApplyDelta(UndoManagerDelta *delta, bool reverse)
+{
   typedef itk::ImageRegionIterator<ImageType> IteratorType;
   ImageType *imSeg = this->GetImage();
 
-  // Iterate over all the deltas in reverse order
-  UndoManagerType::DList::const_reverse_iterator dit = commit.GetDeltas().rbegin();
-  for(; dit != commit.GetDeltas().rend(); ++dit)
-    {
-    // Apply the changes in the current delta
-    UndoManagerType::Delta *delta = *dit;
+  // Iterate over the rles in the delta
+  UndoManagerDelta::RLEIterator rit(delta);
+  size_t nLeftInRun = rit.IsAtEnd() ? 0 : rit.GetLength();
 
+  if(delta->IsSparse())
+    {
+    // Only visit the stretches of scanlines stored in the delta
+    for(UndoManagerDelta::LineIterator lnit(delta); !lnit.IsAtEnd(); ++lnit)
+      {
+      UndoManagerDelta::RegionType line;
+      line.SetIndex(lnit.GetIndex());
+      line.SetSize(0, lnit.GetLength());
+      line.SetSize(1, 1);
+      line.SetSize(2, 1);
+
+      IteratorType lit(imSeg, line);
+      ApplyDeltaValues(lit, rit, nLeftInRun, lnit.GetLength(), reverse);
+      }
+    }
+  else
+    {
     // Iterator for the relevant region in the label image
     IteratorType lit(imSeg, delta->GetRegion());
+    ApplyDeltaValues(lit, rit, nLeftInRun,
+                     delta->GetRegion().GetNumberOfPixels(), reverse);
+    }
+}
 
-    // Iterate over the rles in the delta
-    for(size_t i = 0; i < delta->GetNumberOfRLEs(); i++)
-      {
-      size_t n = delta->GetRLELength(i);
-      LabelType d = delta->GetRLEValue(i);
-      for(size_t j = 0; j < n; j++)
-        {
-        if(d != 0)
-          lit.Set(lit.Get() - d);
-        ++lit;
-        }
-      }
+// Bounding box of two regions, either of which may be empty
+static LabelImageWrapper::RegionType UnionOfRegions(
+    const LabelImageWrapper::RegionType &a, const LabelImageWrapper::RegionType &b)
+{
+  if(a.GetNumberOfPixels() == 0)
+    return b;
+  if(b.GetNumberOfPixels() == 0)
+    return a;
+
+  LabelImageWrapper::RegionType result;
+  for(int d = 0; d < 3; d++)
+    {
+    long lo = std::min(a.GetIndex(d), b.GetIndex(d));
+    long hi = std::max(a.GetIndex(d) + (long) a.GetSize(d),
+                       b.GetIndex(d) + (long) b.GetSize(d));
+    result.SetIndex(d, lo);
+    result.SetSize(d, hi - lo);
+    }
+  return result;
+}
+
+void LabelImageWrapper::Undo()
+{
+  // Get the commit for the undo
+  const UndoManagerType::Commit &commit = m_UndoManager->GetCommitForUndo();
+  itk::ModifiedTimeType mtime = this->GetImage()->GetMTime();
+  RegionType region;
+
+  // Iterate over all the deltas in reverse order
+  UndoManagerType::DList::const_reverse_iterator dit = commit.GetDeltas().rbegin();
+  for(; dit != commit.GetDeltas().rend(); ++dit)
+    {
+    this->ApplyDelta(*dit, true);
+    this->UpdateLabelStatistics(*dit, true, mtime);
+    region = UnionOfRegions(region, (*dit)->GetRegion());
     }
 
   // Set modified flags
-  imSeg->Modified();
+  this->GetImage()->Modified();
+  this->UpdateLabelStatisticsMTime(mtime);
+  this->RecordEdit(region, mtime);
 }
 
 bool LabelImageWrapper::IsRedoPossible()
@@ -136,37 +216,113 @@ void LabelImageWrapper::Redo()
 {
   // Get the commit for the redo
   const UndoManagerType::Commit &commit = m_UndoManager->GetCommitForRedo();
+  itk::ModifiedTimeType mtime = this->GetImage()->GetMTime();
+  RegionType region;
 
-  // The label image that will undergo redo
-  typedef itk::ImageRegionIterator<ImageType> IteratorType;
-  ImageType *imSeg = this->GetImage();
-
-  // Iterate over all the deltas in reverse order
+  // Iterate over all the deltas in forward order
   UndoManagerType::DList::const_iterator dit = commit.GetDeltas().begin();
   for(; dit != commit.GetDeltas().end(); ++dit)
     {
-    // Apply the changes in the current delta
-    UndoManagerType::Delta *delta = *dit;
+    this->ApplyDelta(*dit, false);
+    this->UpdateLabelStatistics(*dit, false, mtime);
+    region = UnionOfRegions(region, (*dit)->GetRegion());
+    }
 
-    // Iterator for the relevant region in the label image
-    IteratorType lit(imSeg, delta->GetRegion());
+  // Set modified flags
+  this->GetImage()->Modified();
+  this->UpdateLabelStatisticsMTime(mtime);
+  this->RecordEdit(region, mtime);
+}
 
-    // Iterate over the rles in the delta
-    for(size_t i = 0; i < delta->GetNumberOfRLEs(); i++)
-      {
-      size_t n = delta->GetRLELength(i);
-      LabelType d = delta->GetRLEValue(i);
-      for(size_t j = 0; j < n; j++)
-        {
-        if(d != 0)
-          lit.Set(lit.Get() + d);
-        ++lit;
-        }
-      }
+const LabelStatisticsTable &LabelImageWrapper::GetLabelStatistics()
+{
+  ImageType *image = this->GetImage();
+  if(!image)
+    {
+    m_LabelStatistics.Clear();
+    m_LabelStatisticsValid = false;
+    }
+  else if(!m_LabelStatisticsValid || m_LabelStatisticsMTime != image->GetMTime())
+    {
+    // The image was changed by something other than a delta
+    m_LabelStatistics.Compute(image);
+    m_LabelStatisticsMTime = image->GetMTime();
+    m_LabelStatisticsValid = true;
     }
 
-  // Set modified flags
-  imSeg->Modified();
+  return m_LabelStatistics;
+}
+
+unsigned long LabelImageWrapper::GetNumberOfVoxelsWithLabel(LabelType label)
+{
+  return this->GetLabelStatistics().GetCount(label);
+}
+
+void LabelImageWrapper::UpdateLabelStatistics(
+    UndoManagerDelta *delta, bool reverse, itk::ModifiedTimeType mtime)
+{
+  // The delta can only be used if the table describes the image as it was
+  // before the delta was applied. Otherwise, the table will be recomputed
+  // the next time it is requested.
+  if(m_LabelStatisticsValid && mtime != 0 && mtime == m_LabelStatisticsMTime)
+    {
+    if(m_LabelStatistics.Update(this->GetImage(), delta, reverse))
+      m_LabelStatisticsMTime = this->GetImage()->GetMTime();
+    else
+      m_LabelStatisticsValid = false;
+    }
+}
+
+void LabelImageWrapper::UpdateLabelStatisticsMTime(itk::ModifiedTimeType mtime)
+{
+  // After undo/redo, the table is current if it was current before
+  if(m_LabelStatisticsValid && m_LabelStatisticsMTime == mtime)
+    m_LabelStatisticsMTime = this->GetImage()->GetMTime();
+}
+
+void LabelImageWrapper::RecordEdit(const RegionType &region, itk::ModifiedTimeType mtime)
+{
+  // The log must describe an unbroken sequence of changes, so it starts over
+  // if the image was changed by something else since the last edit
+  if(mtime == 0 || (m_EditLog.size() && m_EditLog.back().After != mtime))
+    m_EditLog.clear();
+
+  if(mtime == 0)
+    return;
+
+  EditRecord rec;
+  rec.Before = mtime;
+  rec.After = this->GetImage()->GetMTime();
+  rec.Region = region;
+  m_EditLog.push_back(rec);
+
+  // Only the recent edits are of interest
+  if(m_EditLog.size() > 256)
+    m_EditLog.pop_front();
+}
+
+bool LabelImageWrapper::GetModifiedRegionSince(
+    itk::ModifiedTimeType mtime, RegionType &region) const
+{
+  region = RegionType();
+  ImageType *image = this->GetImage();
+  if(!image || mtime == 0)
+    return false;
+
+  // Walk back through the log from the current state of the image until
+  // reaching the state with the given MTime
+  itk::ModifiedTimeType current = image->GetMTime();
+  for(std::deque<EditRecord>::const_reverse_iterator it = m_EditLog.rbegin();
+      current != mtime; ++it)
+    {
+    if(it == m_EditLog.rend() || it->After != current)
+      return false;
+
+    region = UnionOfRegions(region, it->Region);
+    current = it->Before;
+    }
+
+  return true;
 }
 
 LabelImageWrapper::UndoManagerDelta *
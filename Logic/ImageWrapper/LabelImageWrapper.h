@@ -3,6 +3,8 @@
 
 #include "ImageWrapperTraits.h"
 #include "ScalarImageWrapper.h"
+#include "LabelStatisticsTable.h"
+#include <deque>
 
 template <typename TPixel> class UndoDataManager;
 template <typename TPixel> class UndoDelta;
@@ -30,6 +32,8 @@ public:
   typedef UndoDataManager<PixelType> UndoManagerType;
   typedef UndoDelta<PixelType>       UndoManagerDelta;
 
+  typedef itk::ImageRegion<3>                                       RegionType;
+
   /**
    * We override the SetImage method to reset the undo manager when an image is
    * assigned to the segmentation.
@@ -76,15 +80,62 @@ public:
    * array created in this call. */
   UndoManagerDelta *CompressImage() const;
 
+  /**
+   * Get the voxel count, bounding box and checksum of each label. The table
+   * is updated from the undo deltas as the segmentation is edited, and is
+   * only recomputed from scratch if the image is changed in some other way.
+   */
+  const LabelStatisticsTable &GetLabelStatistics();
+
+  /** Get the number of voxels with a given label */
+  unsigned long GetNumberOfVoxelsWithLabel(LabelType label);
+
+  /**
+   * Get the bounding box of the voxels changed since the image had the given
+   * MTime, from the regions of the undo deltas applied since then. Returns
+   * false if this is not known, i.e., if the image may have been changed in
+   * some other way, in which case the whole image should be assumed changed.
+   */
+  bool GetModifiedRegionSince(itk::ModifiedTimeType mtime, RegionType &region) const;
+
 protected:
 
   LabelImageWrapper();
   ~LabelImageWrapper();
 
+  // Add (or subtract, if reverse is true) the values stored in a delta
+  void ApplyDelta(UndoManagerDelta *delta, bool reverse);
+
+  // Update the label statistics after a delta has been applied to the image,
+  // whose MTime before the change is given
+  void UpdateLabelStatistics(UndoManagerDelta *delta, bool reverse,
+                             itk::ModifiedTimeType mtime);
+  void UpdateLabelStatisticsMTime(itk::ModifiedTimeType mtime);
+
+  // Add the region changed by one or more deltas to the edit log, given the
+  // MTime of the image before the change
+  void RecordEdit(const RegionType &region, itk::ModifiedTimeType mtime);
+
   // Undo data manager, stores 'deltas', i.e., differences between states of the segmentation
   // image. These deltas are compressed, allowing us to store a bunch of
   // undo steps with little cost in performance or memory
   UndoManagerType *m_UndoManager;
+
+  // Per-label statistics and the image MTime they correspond to
+  LabelStatisticsTable m_LabelStatistics;
+  itk::ModifiedTimeType m_LabelStatisticsMTime;
+  bool m_LabelStatisticsValid;
+
+  // A recent change to the image made with undo deltas: the MTime of the
+  // image before and after the change, and the region that was changed
+  struct EditRecord
+  {
+    itk::ModifiedTimeType Before, After;
+    RegionType Region;
+  };
+
+  // Unbroken sequence of the most recent edits
+  std::deque<EditRecord> m_EditLog;
 };
 
 #endif // LABELIMAGEWRAPPER_H
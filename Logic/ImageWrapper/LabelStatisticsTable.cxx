@@ -0,0 +1,206 @@
+/*=========================================================================
+
+  Program:   ITK-SNAP
+  Language:  C++
+
+  This file is part of ITK-SNAP
+
+  ITK-SNAP is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+=========================================================================*/
+#include "LabelStatisticsTable.h"
+#include "UndoDataManager.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include <algorithm>
+
+// Mixing function used to generate pseudo-random values from positions
+static inline unsigned long long splitmix64(unsigned long long x)
+{
+  x += 0x9E3779B97F4A7C15ull;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+const LabelStatisticsTable::Entry *
+LabelStatisticsTable::GetEntry(LabelType label) const
+{
+  EntryMap::const_iterator it = m_Entries.find(label);
+  return (it == m_Entries.end()) ? NULL : &it->second;
+}
+
+unsigned long
+LabelStatisticsTable::GetCount(LabelType label) const
+{
+  const Entry *e = this->GetEntry(label);
+  return e ? e->Count : 0;
+}
+
+unsigned long long
+LabelStatisticsTable::RunHash(const IndexType &start, long x, unsigned long n) const
+{
+  // The hash of voxel (x,y,z) is A(y,z) * r(x) + B(y,z), so the hash of a
+  // run only takes the prefix sums of r(x)
+  unsigned long long key = ((unsigned long long) start[2] << 32) ^ (unsigned long long) start[1];
+  unsigned long long a = splitmix64(key) | 1ull;
+  unsigned long long b = splitmix64(a);
+  return a * (m_PrefixHash[x + n] - m_PrefixHash[x]) + b * n;
+}
+
+void
+LabelStatisticsTable::AddRun(LabelType label, const IndexType &start, long x, unsigned long n)
+{
+  Entry &e = m_Entries[label];
+  IndexType end = start;
+  end[0] += n - 1;
+
+  if(e.Count == 0)
+    {
+    for(int d = 0; d < 3; d++)
+      {
+      e.BoundingBox[0][d] = start[d];
+      e.BoundingBox[1][d] = end[d];
+      }
+    }
+  else
+    {
+    for(int d = 0; d < 3; d++)
+      {
+      e.BoundingBox[0][d] = std::min(e.BoundingBox[0][d], (int) start[d]);
+      e.BoundingBox[1][d] = std::max(e.BoundingBox[1][d], (int) end[d]);
+      }
+    }
+
+  e.Count += n;
+  e.CheckSum += this->RunHash(start, x, n);
+}
+
+bool
+LabelStatisticsTable::RemoveRun(LabelType label, const IndexType &start, long x, unsigned long n)
+{
+  // This only fails if the table does not match the image
+  EntryMap::iterator it = m_Entries.find(label);
+  if(it == m_Entries.end() || it->second.Count < n)
+    return false;
+
+  it->second.Count -= n;
+  it->second.CheckSum -= this->RunHash(start, x, n);
+  if(it->second.Count == 0)
+    m_Entries.erase(it);
+  return true;
+}
+
+void
+LabelStatisticsTable::Compute(const ImageType *image)
+{
+  m_Entries.clear();
+
+  ImageType::RegionType region = image->GetBufferedRegion();
+  long nx = region.GetSize(0);
+
+  // Build the hash table for the lines of this image
+  m_PrefixHash.resize(nx + 1);
+  m_PrefixHash[0] = 0;
+  for(long x = 0; x < nx; x++)
+    m_PrefixHash[x + 1] = m_PrefixHash[x] + splitmix64(x);
+
+  // Walk the runs of each line. The line buffer is indexed by the absolute
+  // (y,z) of the line
+  typedef itk::ImageRegionConstIteratorWithIndex<ImageType::BufferType> LineIterator;
+  LineIterator itLine(image->GetBuffer(), image->GetBuffer()->GetBufferedRegion());
+  IndexType run_start;
+  for(; !itLine.IsAtEnd(); ++itLine)
+    {
+    const ImageType::RLLine &line = itLine.Value();
+    run_start[1] = itLine.GetIndex()[0];
+    run_start[2] = itLine.GetIndex()[1];
+    long t = 0;
+    for(size_t k = 0; k < line.size(); k++)
+      {
+      run_start[0] = region.GetIndex(0) + t;
+      this->AddRun(line[k].second, run_start, t, line[k].first);
+      t += line[k].first;
+      }
+    }
+}
+
+template <class TRLEIterator>
+bool
+LabelStatisticsTable::UpdateStretch(
+    const ImageType *image, const IndexType &start, long length,
+    TRLEIterator &rit, size_t &nLeftInRun, bool reverse)
+{
+  // The line buffer is indexed by the absolute (y,z) of the line
+  ImageType::RegionType br = image->GetBufferedRegion();
+  ImageType::BufferType::IndexType bi = ImageType::truncateIndex(start);
+  const ImageType::RLLine &line = image->GetBuffer()->GetPixel(bi);
+
+  // Walk the segments of the image line and the runs of the delta together
+  long x = start[0] - br.GetIndex(0), xEnd = x + length;
+  ImageType::IndexValueType segEnd;
+  ImageType::IndexValueType s = image->FindSegment(bi, x, segEnd);
+  IndexType pos = start;
+  while(x < xEnd && !rit.IsAtEnd())
+    {
+    long n = std::min(std::min((long) segEnd, xEnd) - x, (long) nLeftInRun);
+    LabelType d = rit.GetValue();
+    if(d != 0)
+      {
+      // The image holds the label after the update
+      LabelType lNew = line[s].second;
+      LabelType lOld = reverse ? lNew + d : lNew - d;
+      if(!this->RemoveRun(lOld, pos, x, n))
+        return false;
+      this->AddRun(lNew, pos, x, n);
+      }
+
+    x += n;
+    pos[0] += n;
+    nLeftInRun -= n;
+    if(nLeftInRun == 0)
+      {
+      ++rit;
+      nLeftInRun = rit.IsAtEnd() ? 0 : rit.GetLength();
+      }
+    if(x == segEnd && x < xEnd)
+      segEnd += line[++s].first;
+    }
+
+  return true;
+}
+
+bool
+LabelStatisticsTable::Update(const ImageType *image, DeltaType *delta, bool reverse)
+{
+  DeltaType::RLEIterator rit(delta);
+  size_t nLeftInRun = rit.IsAtEnd() ? 0 : rit.GetLength();
+
+  if(delta->IsSparse())
+    {
+    for(DeltaType::LineIterator lnit(delta); !lnit.IsAtEnd(); ++lnit)
+      if(!this->UpdateStretch(image, lnit.GetIndex(), lnit.GetLength(), rit, nLeftInRun, reverse))
+        return false;
+    }
+  else
+    {
+    // Dense deltas cover their region in raster order
+    DeltaType::RegionType region = delta->GetRegion();
+    IndexType idx = region.GetIndex();
+    for(idx[2] = region.GetIndex(2); idx[2] <= region.GetUpperIndex()[2]; ++idx[2])
+      for(idx[1] = region.GetIndex(1); idx[1] <= region.GetUpperIndex()[1]; ++idx[1])
+        if(!this->UpdateStretch(image, idx, region.GetSize(0), rit, nLeftInRun, reverse))
+          return false;
+    }
+
+  return true;
+}
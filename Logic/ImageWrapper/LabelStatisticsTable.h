@@ -0,0 +1,116 @@
+/*=========================================================================
+
+  Program:   ITK-SNAP
+  Language:  C++
+
+  This file is part of ITK-SNAP
+
+  ITK-SNAP is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+=========================================================================*/
+#ifndef LABELSTATISTICSTABLE_H
+#define LABELSTATISTICSTABLE_H
+
+#include "SNAPCommon.h"
+#include "IRISVectorTypes.h"
+#include "RLEImage.h"
+#include <map>
+#include <vector>
+
+template <typename TPixel> class UndoDelta;
+
+/**
+ * \class LabelStatisticsTable
+ * \brief Voxel count, bounding box and checksum for each label in a
+ * segmentation image.
+ *
+ * The table can be computed by scanning the image, and then kept up to date
+ * using the undo deltas that describe each edit, so that it does not need
+ * to be recomputed after every change.
+ *
+ * The checksum is a sum of pseudo-random hashes of the voxel positions, so
+ * it can be updated by adding and removing runs of voxels. The bounding box
+ * always contains all voxels of the label, but since it is only grown by
+ * incremental updates, it may not be tight after voxels have been erased.
+ */
+class LabelStatisticsTable
+{
+public:
+  typedef RLEImage<LabelType> ImageType;
+  typedef UndoDelta<LabelType> DeltaType;
+  typedef itk::Index<3> IndexType;
+
+  struct Entry
+  {
+    // Number of voxels with the label
+    unsigned long Count;
+
+    // Corners of the bounding box (inclusive)
+    Vector3i BoundingBox[2];
+
+    // Order-independent checksum of the voxel positions
+    unsigned long long CheckSum;
+
+    Entry() : Count(0), CheckSum(0) {}
+  };
+
+  typedef std::map<LabelType, Entry> EntryMap;
+
+  LabelStatisticsTable() {}
+
+  /** Compute the statistics by scanning the whole image */
+  void Compute(const ImageType *image);
+
+  /**
+   * Update the statistics after the changes stored in a delta have been
+   * applied to the image. If reverse is true, the delta was subtracted from
+   * the image (i.e., undone) rather than added. Returns false if the delta
+   * does not match the table, in which case the table must be recomputed.
+   */
+  bool Update(const ImageType *image, DeltaType *delta, bool reverse);
+
+  /** Clear the table */
+  void Clear()
+  { m_Entries.clear(); }
+
+  /** Get all the labels present in the image */
+  const EntryMap &GetEntries() const
+  { return m_Entries; }
+
+  /** Get the entry for a label, or NULL if the label is not present */
+  const Entry *GetEntry(LabelType label) const;
+
+  /** Get the number of voxels with a label */
+  unsigned long GetCount(LabelType label) const;
+
+protected:
+
+  // Add or remove a run of n voxels along x starting at an index
+  void AddRun(LabelType label, const IndexType &start, long x, unsigned long n);
+  bool RemoveRun(LabelType label, const IndexType &start, long x, unsigned long n);
+
+  // Hash of a run of n voxels, where x is the position in the line
+  unsigned long long RunHash(const IndexType &start, long x, unsigned long n) const;
+
+  // Update the statistics for a stretch of a line covered by a delta
+  template <class TRLEIterator>
+  bool UpdateStretch(const ImageType *image, const IndexType &start, long length,
+                     TRLEIterator &rit, size_t &nLeftInRun, bool reverse);
+
+  EntryMap m_Entries;
+
+  // Prefix sums of pseudo-random values along the x axis
+  std::vector<unsigned long long> m_PrefixHash;
+};
+
+#endif // LABELSTATISTICSTABLE_H
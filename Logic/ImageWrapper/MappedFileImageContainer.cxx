@@ -0,0 +1,198 @@
+#include "MappedFileImageContainer.h"
+#include "itkSimpleFastMutexLock.h"
+#include "itkMutexLockHolder.h"
+#include "itksys/SystemTools.hxx"
+#include <set>
+#include <vector>
+#include <cassert>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// All buffers that are currently mapped. Buffers may be mapped on a worker
+// thread that loads an image in the background, so the list is protected
+static std::set<MappedFileBuffer *> s_MappedBuffers;
+static itk::SimpleFastMutexLock s_MappedBuffersLock;
+
+MappedFileBuffer::MappedFileBuffer()
+{
+  m_Data = NULL;
+  m_Base = NULL;
+  m_Length = 0;
+#ifdef WIN32
+  m_MappingHandle = NULL;
+#endif
+}
+
+MappedFileBuffer::~MappedFileBuffer()
+{
+  this->UnmapFile();
+}
+
+#ifdef WIN32
+
+bool MappedFileBuffer::MapFile(const std::string &fname, size_t offset, size_t n_bytes)
+{
+  assert(!m_Data);
+
+  HANDLE hFile = CreateFileA(fname.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                             OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if(hFile == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER size;
+  if(!GetFileSizeEx(hFile, &size) || (unsigned long long) size.QuadPart < offset + n_bytes)
+    {
+    CloseHandle(hFile);
+    return false;
+    }
+
+  // The mapping handle keeps the file open, so the file handle can be closed
+  HANDLE hMap = CreateFileMappingA(hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+  CloseHandle(hFile);
+  if(!hMap)
+    return false;
+
+  // Views must start at a multiple of the allocation granularity
+  SYSTEM_INFO si;
+  GetSystemInfo(&si);
+  size_t start = offset - offset % si.dwAllocationGranularity;
+  size_t length = n_bytes + (offset - start);
+
+  void *base = MapViewOfFile(hMap, FILE_MAP_COPY,
+                             (DWORD) ((unsigned long long) start >> 32),
+                             (DWORD) (start & 0xffffffff), length);
+  if(!base)
+    {
+    CloseHandle(hMap);
+    return false;
+    }
+
+  m_MappingHandle = hMap;
+  m_Base = base;
+  m_Length = length;
+  m_Data = static_cast<char *>(base) + (offset - start);
+  m_FileName = fname;
+
+  s_MappedBuffersLock.Lock();
+  s_MappedBuffers.insert(this);
+  s_MappedBuffersLock.Unlock();
+  return true;
+}
+
+void MappedFileBuffer::ReleaseMapping()
+{
+  s_MappedBuffers.erase(this);
+
+  UnmapViewOfFile(m_Base);
+  CloseHandle(m_MappingHandle);
+  m_MappingHandle = NULL;
+  m_Base = NULL;
+  m_Data = NULL;
+  m_Length = 0;
+}
+
+#else
+
+bool MappedFileBuffer::MapFile(const std::string &fname, size_t offset, size_t n_bytes)
+{
+  assert(!m_Data);
+
+  int fd = open(fname.c_str(), O_RDONLY);
+  if(fd < 0)
+    return false;
+
+  // Accessing a mapped page past the end of the file is fatal, so the file
+  // must be long enough
+  struct stat st;
+  if(fstat(fd, &st) != 0 || (size_t) st.st_size < offset + n_bytes)
+    {
+    close(fd);
+    return false;
+    }
+
+  // Mappings must start at a page boundary
+  size_t page = (size_t) sysconf(_SC_PAGESIZE);
+  size_t start = offset - offset % page;
+  size_t length = n_bytes + (offset - start);
+
+  // A private writable mapping gives copy-on-write semantics; the mapping
+  // stays valid after the file is closed
+  void *base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, (off_t) start);
+  close(fd);
+  if(base == MAP_FAILED)
+    return false;
+
+  m_Base = base;
+  m_Length = length;
+  m_Data = static_cast<char *>(base) + (offset - start);
+  m_FileName = fname;
+
+  s_MappedBuffersLock.Lock();
+  s_MappedBuffers.insert(this);
+  s_MappedBuffersLock.Unlock();
+  return true;
+}
+
+void MappedFileBuffer::ReleaseMapping()
+{
+  s_MappedBuffers.erase(this);
+
+  munmap(m_Base, m_Length);
+  m_Base = NULL;
+  m_Data = NULL;
+  m_Length = 0;
+}
+
+#endif
+
+void MappedFileBuffer::UnmapFile()
+{
+  // The buffer may have been detached by another thread since the caller
+  // checked IsMapped(), so the check is repeated under the lock
+  itk::MutexLockHolder<itk::SimpleFastMutexLock> holder(s_MappedBuffersLock);
+  if(m_Data)
+    this->ReleaseMapping();
+}
+
+void MappedFileBuffer::Detach()
+{
+  itk::MutexLockHolder<itk::SimpleFastMutexLock> holder(s_MappedBuffersLock);
+  if(m_Data)
+    this->DetachMapping();
+}
+
+// Full path of a file without its last extension
+static std::string GetMappingKey(const std::string &fname)
+{
+  std::string full = itksys::SystemTools::CollapseFullPath(fname.c_str());
+  return itksys::SystemTools::GetFilenamePath(full) + "/"
+      + itksys::SystemTools::GetFilenameWithoutLastExtension(full);
+}
+
+void MappedFileBuffer::DetachAll(const std::string &fname)
+{
+  std::string key = GetMappingKey(fname);
+
+  // The lock is held until all buffers are detached. A buffer that is being
+  // deleted on another thread waits in UnmapFile() and stays valid until then
+  itk::MutexLockHolder<itk::SimpleFastMutexLock> holder(s_MappedBuffersLock);
+
+  // Find the buffers first, since detaching a buffer removes it from the list
+  std::vector<MappedFileBuffer *> matches;
+  for(std::set<MappedFileBuffer *>::iterator it = s_MappedBuffers.begin();
+      it != s_MappedBuffers.end(); ++it)
+    {
+    if(GetMappingKey((*it)->GetMappedFileName()) == key)
+      matches.push_back(*it);
+    }
+
+  for(size_t i = 0; i < matches.size(); i++)
+    matches[i]->DetachMapping();
+}
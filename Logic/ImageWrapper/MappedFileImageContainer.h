@@ -0,0 +1,138 @@
+#ifndef MAPPEDFILEIMAGECONTAINER_H
+#define MAPPEDFILEIMAGECONTAINER_H
+
+#include "itkImportImageContainer.h"
+#include <string>
+#include <algorithm>
+
+/**
+ * A private, copy-on-write mapping of a range of bytes in a file into memory.
+ * Pages of the file are read on demand when the data are first accessed, and
+ * are copied only when they are written to, so the file itself is never
+ * modified.
+ *
+ * Because the pages that have not been written to are shared with the file,
+ * the file must not be overwritten while it is mapped. All mapped buffers are
+ * kept in a global list, and DetachAll() must be called before writing to a
+ * file, so that the buffers mapped from it copy their data into memory.
+ */
+class MappedFileBuffer
+{
+public:
+
+  /** Whether the buffer is currently backed by a file */
+  bool IsMapped() const { return m_Data != NULL; }
+
+  /** The file backing the buffer */
+  const std::string &GetMappedFileName() const { return m_FileName; }
+
+  /** Copy the data into memory and release the mapping */
+  void Detach();
+
+  /**
+   * Detach all buffers mapped from the given file, or from files with the
+   * same name up to the extension (e.g., the .raw file of a .mhd header)
+   */
+  static void DetachAll(const std::string &fname);
+
+protected:
+
+  MappedFileBuffer();
+  virtual ~MappedFileBuffer();
+
+  /**
+   * Map n_bytes of the file starting at the given offset. Returns false if
+   * the file is too short or cannot be mapped.
+   */
+  bool MapFile(const std::string &fname, size_t offset, size_t n_bytes);
+
+  /** Release the mapping */
+  void UnmapFile();
+
+  /**
+   * Copy the data into memory and call ReleaseMapping(). Called with the
+   * global lock held, so that the buffer cannot be unmapped or deleted by
+   * another thread while it is being detached.
+   */
+  virtual void DetachMapping() = 0;
+
+  /** Release the mapping, the global lock must be held by the caller */
+  void ReleaseMapping();
+
+  // Pointer to the mapped data at the requested offset
+  void *m_Data;
+
+private:
+
+  // Start and length of the mapping, which begins at a page boundary
+  void *m_Base;
+  size_t m_Length;
+  std::string m_FileName;
+
+#ifdef WIN32
+  void *m_MappingHandle;
+#endif
+};
+
+/**
+ * An image pixel container whose elements are mapped from a file by
+ * MappedFileBuffer. The mapped memory is released when the container is
+ * deleted, or when it is resized or given another buffer. The container can
+ * be used wherever an itk::ImportImageContainer is expected.
+ */
+template <class TElement>
+class MappedFileImageContainer
+    : public itk::ImportImageContainer<itk::SizeValueType, TElement>,
+      public MappedFileBuffer
+{
+public:
+
+  typedef MappedFileImageContainer Self;
+  typedef itk::ImportImageContainer<itk::SizeValueType, TElement> Superclass;
+  typedef itk::SmartPointer<Self> Pointer;
+  typedef itk::SmartPointer<const Self> ConstPointer;
+
+  itkNewMacro(Self)
+  itkTypeMacro(MappedFileImageContainer, ImportImageContainer)
+
+  /** Map n elements from the file, starting at the given byte offset */
+  bool MapElements(const std::string &fname, size_t offset, itk::SizeValueType n)
+  {
+    if(!this->MapFile(fname, offset, n * sizeof(TElement)))
+      return false;
+
+    // The container does not manage the mapped memory, it is unmapped by us
+    Superclass::SetImportPointer(static_cast<TElement *>(m_Data), n, false);
+    return true;
+  }
+
+protected:
+
+  virtual void DetachMapping() ITK_OVERRIDE
+  {
+    itk::SizeValueType n = this->Size();
+    TElement *buffer = new TElement[n];
+    std::copy(this->GetImportPointer(), this->GetImportPointer() + n, buffer);
+
+    this->ReleaseMapping();
+    Superclass::SetImportPointer(buffer, n, true);
+  }
+
+  MappedFileImageContainer() {}
+
+  virtual ~MappedFileImageContainer()
+  {
+    // The superclass destructor does not call our DeallocateManagedMemory
+    if(this->IsMapped())
+      this->UnmapFile();
+  }
+
+  virtual void DeallocateManagedMemory() ITK_OVERRIDE
+  {
+    if(this->IsMapped() && this->GetImportPointer() == m_Data)
+      this->UnmapFile();
+    Superclass::DeallocateManagedMemory();
+  }
+};
+
+#endif // MAPPEDFILEIMAGECONTAINER_H
@@ -0,0 +1,371 @@
+#include "ParallelGzipIO.h"
+#include "itkMultiThreader.h"
+#include <itk_zlib.h>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+// Size of the gzip member header, including the extra field
+static const size_t MEMBER_HEADER_SIZE = 20;
+
+// Size of the gzip member trailer (CRC32 and uncompressed size)
+static const size_t MEMBER_TRAILER_SIZE = 8;
+
+static void put_uint32(unsigned char *p, unsigned long v)
+{
+  p[0] = v & 0xff; p[1] = (v >> 8) & 0xff; p[2] = (v >> 16) & 0xff; p[3] = (v >> 24) & 0xff;
+}
+
+static unsigned long get_uint32(const unsigned char *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned long) p[3] << 24);
+}
+
+// Seek to a position that may be beyond 2GB
+static int seek_file(FILE *f, size_t pos)
+{
+#ifdef _WIN32
+  return _fseeki64(f, (__int64) pos, SEEK_SET);
+#else
+  return fseeko(f, (off_t) pos, SEEK_SET);
+#endif
+}
+
+static int get_thread_count(int n_threads)
+{
+  return n_threads > 0 ? n_threads : itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+}
+
+// Write the header of a gzip member with our extra field
+static void write_member_header(unsigned char *p, size_t member_size)
+{
+  static const unsigned char fixed[] = {
+    0x1f, 0x8b,       // magic
+    0x08,             // deflate
+    0x04,             // FEXTRA
+    0, 0, 0, 0,       // no modification time
+    0x00,             // extra flags
+    0xff,             // unknown OS
+    8, 0,             // XLEN
+    'I', 'S', 4, 0 }; // subfield ID and length
+  memcpy(p, fixed, 16);
+  put_uint32(p + 16, member_size);
+}
+
+// Read the size of a gzip member from its header, or return 0 if it is not
+// one of our members
+static size_t read_member_header(const unsigned char *p)
+{
+  if(p[0] != 0x1f || p[1] != 0x8b || p[2] != 0x08 || p[3] != 0x04
+     || p[10] != 8 || p[11] != 0 || p[12] != 'I' || p[13] != 'S'
+     || p[14] != 4 || p[15] != 0)
+    return 0;
+
+  size_t size = get_uint32(p + 16);
+  return size >= MEMBER_HEADER_SIZE + MEMBER_TRAILER_SIZE ? size : 0;
+}
+
+/* =============================
+   Compression
+   ============================= */
+
+struct GzipCompressData
+{
+  const unsigned char *input;
+  size_t n_input;
+  int level;
+  std::vector< std::vector<unsigned char> > *output;
+  std::vector<char> failed;
+};
+
+// Compress one block into a complete gzip member
+static bool compress_block(const unsigned char *data, size_t n, int level,
+                           std::vector<unsigned char> &out)
+{
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  if(deflateInit2(&zs, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    return false;
+
+  size_t bound = deflateBound(&zs, n);
+  out.resize(MEMBER_HEADER_SIZE + bound + MEMBER_TRAILER_SIZE);
+
+  zs.next_in = const_cast<Bytef *>(data);
+  zs.avail_in = (uInt) n;
+  zs.next_out = &out[MEMBER_HEADER_SIZE];
+  zs.avail_out = (uInt) bound;
+  int rc = deflate(&zs, Z_FINISH);
+  size_t n_comp = bound - zs.avail_out;
+  deflateEnd(&zs);
+  if(rc != Z_STREAM_END)
+    return false;
+
+  size_t member_size = MEMBER_HEADER_SIZE + n_comp + MEMBER_TRAILER_SIZE;
+  write_member_header(&out[0], member_size);
+
+  unsigned long crc = crc32(crc32(0L, Z_NULL, 0), data, (uInt) n);
+  put_uint32(&out[MEMBER_HEADER_SIZE + n_comp], crc);
+  put_uint32(&out[MEMBER_HEADER_SIZE + n_comp + 4], (unsigned long) n);
+  out.resize(member_size);
+  return true;
+}
+
+static ITK_THREAD_RETURN_TYPE gzip_compress_callback(void *arg)
+{
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfo;
+  ThreadInfo *info = static_cast<ThreadInfo *>(arg);
+  GzipCompressData *td = static_cast<GzipCompressData *>(info->UserData);
+
+  size_t bs = ParallelGzipIO::BlockSize;
+  size_t n_blocks = td->output->size();
+  for(size_t b = info->ThreadID; b < n_blocks; b += info->NumberOfThreads)
+    {
+    size_t start = b * bs;
+    size_t n = std::min(bs, td->n_input - start);
+    if(!compress_block(td->input + start, n, td->level, (*td->output)[b]))
+      td->failed[info->ThreadID] = 1;
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+bool ParallelGzipIO::CompressFile(const std::string &src, const std::string &dst,
+                                  int level, int n_threads)
+{
+  FILE *fin = fopen(src.c_str(), "rb");
+  if(!fin)
+    return false;
+
+  FILE *fout = fopen(dst.c_str(), "wb");
+  if(!fout)
+    {
+    fclose(fin);
+    return false;
+    }
+
+  // Process the file in waves of a few blocks per thread, to limit the
+  // amount of memory used
+  int nt = get_thread_count(n_threads);
+  size_t wave_blocks = 4 * nt;
+  std::vector<unsigned char> input(wave_blocks * BlockSize);
+  std::vector< std::vector<unsigned char> > output;
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetNumberOfThreads(nt);
+
+  bool ok = true, first = true;
+  while(ok)
+    {
+    size_t n_read = fread(&input[0], 1, input.size(), fin);
+    if(n_read == 0 && !first)
+      break;
+
+    // An empty file still gets one (empty) member, to be valid gzip
+    size_t n_blocks = std::max((size_t) 1, (n_read + BlockSize - 1) / BlockSize);
+    output.clear();
+    output.resize(n_blocks);
+
+    GzipCompressData td;
+    td.input = &input[0];
+    td.n_input = n_read;
+    td.level = level;
+    td.output = &output;
+    td.failed.resize(nt, 0);
+
+    threader->SetSingleMethod(gzip_compress_callback, &td);
+    threader->SingleMethodExecute();
+
+    for(int t = 0; t < nt; t++)
+      if(td.failed[t])
+        ok = false;
+
+    for(size_t b = 0; ok && b < n_blocks; b++)
+      if(fwrite(&output[b][0], 1, output[b].size(), fout) != output[b].size())
+        ok = false;
+
+    first = false;
+    if(n_read < input.size())
+      break;
+    }
+
+  if(ferror(fin))
+    ok = false;
+
+  fclose(fin);
+  if(fclose(fout) != 0)
+    ok = false;
+
+  return ok;
+}
+
+/* =============================
+   Decompression
+   ============================= */
+
+bool ParallelGzipIO::IsBlockCompressed(const std::string &fname)
+{
+  FILE *f = fopen(fname.c_str(), "rb");
+  if(!f)
+    return false;
+
+  unsigned char hdr[MEMBER_HEADER_SIZE];
+  bool ok = fread(hdr, 1, MEMBER_HEADER_SIZE, f) == MEMBER_HEADER_SIZE
+      && read_member_header(hdr) > 0;
+  fclose(f);
+  return ok;
+}
+
+// Location of a member in the compressed and uncompressed data
+struct GzipMember
+{
+  size_t offset, size;
+  size_t u_offset, u_size;
+};
+
+struct GzipDecompressData
+{
+  const char *fname;
+  std::vector<GzipMember> members;
+  size_t offset, n_bytes;
+  unsigned char *buffer;
+  std::vector<char> failed;
+};
+
+// Decompress one member and copy the part that falls into the requested range
+static bool decompress_member(FILE *f, const GzipMember &m, GzipDecompressData *td,
+                              std::vector<unsigned char> &comp,
+                              std::vector<unsigned char> &data)
+{
+  comp.resize(m.size);
+  data.resize(m.u_size);
+
+  if(seek_file(f, m.offset) != 0
+     || fread(&comp[0], 1, m.size, f) != m.size)
+    return false;
+
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  if(inflateInit2(&zs, -MAX_WBITS) != Z_OK)
+    return false;
+
+  zs.next_in = &comp[MEMBER_HEADER_SIZE];
+  zs.avail_in = (uInt) (m.size - MEMBER_HEADER_SIZE - MEMBER_TRAILER_SIZE);
+  zs.next_out = data.size() ? &data[0] : NULL;
+  zs.avail_out = (uInt) m.u_size;
+  int rc = inflate(&zs, Z_FINISH);
+  size_t n_out = m.u_size - zs.avail_out;
+  inflateEnd(&zs);
+  if(rc != Z_STREAM_END || n_out != m.u_size)
+    return false;
+
+  unsigned long crc = crc32(crc32(0L, Z_NULL, 0), data.size() ? &data[0] : NULL, (uInt) m.u_size);
+  if(crc != get_uint32(&comp[m.size - MEMBER_TRAILER_SIZE]))
+    return false;
+
+  // Copy the overlap with the requested range
+  size_t lo = std::max(m.u_offset, td->offset);
+  size_t hi = std::min(m.u_offset + m.u_size, td->offset + td->n_bytes);
+  if(lo < hi)
+    memcpy(td->buffer + (lo - td->offset), &data[lo - m.u_offset], hi - lo);
+
+  return true;
+}
+
+static ITK_THREAD_RETURN_TYPE gzip_decompress_callback(void *arg)
+{
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfo;
+  ThreadInfo *info = static_cast<ThreadInfo *>(arg);
+  GzipDecompressData *td = static_cast<GzipDecompressData *>(info->UserData);
+
+  // Each thread reads the file through its own handle
+  FILE *f = fopen(td->fname, "rb");
+  if(!f)
+    {
+    td->failed[info->ThreadID] = 1;
+    return ITK_THREAD_RETURN_VALUE;
+    }
+
+  std::vector<unsigned char> comp, data;
+  for(size_t i = info->ThreadID; i < td->members.size(); i += info->NumberOfThreads)
+    {
+    if(!decompress_member(f, td->members[i], td, comp, data))
+      {
+      td->failed[info->ThreadID] = 1;
+      break;
+      }
+    }
+
+  fclose(f);
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+bool ParallelGzipIO::DecompressRange(const std::string &fname,
+                                     size_t offset, size_t n_bytes, void *buffer,
+                                     int n_threads)
+{
+  FILE *f = fopen(fname.c_str(), "rb");
+  if(!f)
+    return false;
+
+  // Build the list of members that overlap the requested range. This only
+  // reads the header and the trailer of each member
+  GzipDecompressData td;
+  td.fname = fname.c_str();
+  td.offset = offset;
+  td.n_bytes = n_bytes;
+  td.buffer = static_cast<unsigned char *>(buffer);
+
+  size_t pos = 0, u_pos = 0;
+  unsigned char hdr[MEMBER_HEADER_SIZE], trailer[MEMBER_TRAILER_SIZE];
+  bool ok = true;
+  while(u_pos < offset + n_bytes)
+    {
+    size_t size = 0;
+    if(seek_file(f, pos) != 0
+       || fread(hdr, 1, MEMBER_HEADER_SIZE, f) != MEMBER_HEADER_SIZE
+       || (size = read_member_header(hdr)) == 0
+       || seek_file(f, pos + size - MEMBER_TRAILER_SIZE) != 0
+       || fread(trailer, 1, MEMBER_TRAILER_SIZE, f) != MEMBER_TRAILER_SIZE)
+      {
+      ok = false;
+      break;
+      }
+
+    GzipMember m;
+    m.offset = pos;
+    m.size = size;
+    m.u_offset = u_pos;
+    m.u_size = get_uint32(trailer + 4);
+    if(m.u_size > BlockSize)
+      {
+      ok = false;
+      break;
+      }
+
+    if(m.u_offset + m.u_size > offset)
+      td.members.push_back(m);
+
+    pos += size;
+    u_pos += m.u_size;
+    }
+  fclose(f);
+
+  if(!ok)
+    return false;
+
+  // Decompress the members in parallel
+  int nt = std::min(get_thread_count(n_threads), (int) std::max((size_t) 1, td.members.size()));
+  td.failed.resize(nt, 0);
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetNumberOfThreads(nt);
+  threader->SetSingleMethod(gzip_decompress_callback, &td);
+  threader->SingleMethodExecute();
+
+  for(int t = 0; t < nt; t++)
+    if(td.failed[t])
+      return false;
+
+  return true;
+}
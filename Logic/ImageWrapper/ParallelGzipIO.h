@@ -0,0 +1,47 @@
+#ifndef PARALLELGZIPIO_H
+#define PARALLELGZIPIO_H
+
+#include <string>
+#include <cstddef>
+
+/**
+ * Multi-threaded gzip compression and decompression of image files.
+ *
+ * Files are compressed as a sequence of independent gzip members, each
+ * holding one block of the input. Standard tools (gunzip, zlib's gzread)
+ * decompress such files as the concatenation of the members, so the output
+ * stays readable everywhere. Each member carries an extra header field ('I',
+ * 'S') with the compressed size of the member, which allows the members of a
+ * file to be located without decompressing it, and decompressed in parallel.
+ *
+ * Blocks are compressed and decompressed with one thread per block, using
+ * itk::MultiThreader. Only a few blocks per thread are kept in memory at once.
+ */
+class ParallelGzipIO
+{
+public:
+
+  /** Size of the uncompressed blocks */
+  static const size_t BlockSize = 1 << 20;
+
+  /**
+   * Compress the file src into dst. Returns false if either file cannot be
+   * accessed. A value of 0 for n_threads uses the ITK default.
+   */
+  static bool CompressFile(const std::string &src, const std::string &dst,
+                           int level = 6, int n_threads = 0);
+
+  /** Check whether a file was written by CompressFile */
+  static bool IsBlockCompressed(const std::string &fname);
+
+  /**
+   * Decompress n_bytes of the uncompressed contents of a file written by
+   * CompressFile, starting at the given uncompressed offset, into a buffer.
+   * Returns false if the file is not block compressed or is corrupt.
+   */
+  static bool DecompressRange(const std::string &fname,
+                              size_t offset, size_t n_bytes, void *buffer,
+                              int n_threads = 0);
+};
+
+#endif // PARALLELGZIPIO_H
@@ -0,0 +1,695 @@
+#include "RLESegmentationImageIO.h"
+#include "itksys/SystemTools.hxx"
+#include "itkMultiThreader.h"
+#include <itk_zlib.h>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+// Identifier at the start of the file
+static const char RLE_MAGIC[8] = { 'S', 'N', 'A', 'P', 'R', 'L', 'E', 0 };
+
+// Version of the format written
+static const unsigned int RLE_VERSION = 1;
+
+// Size of the fixed part of the header, and of an entry in the chunk table
+static const size_t RLE_HEADER_SIZE = 160;
+static const size_t RLE_CHUNK_ENTRY_SIZE = 24;
+
+static bool is_big_endian()
+{
+  unsigned short one = 1;
+  return *reinterpret_cast<unsigned char *>(&one) == 0;
+}
+
+static void put_uint32(std::vector<char> &out, unsigned long v)
+{
+  for(int i = 0; i < 4; i++)
+    out.push_back((char) ((v >> (8 * i)) & 0xff));
+}
+
+static void put_uint64(std::vector<char> &out, unsigned long long v)
+{
+  for(int i = 0; i < 8; i++)
+    out.push_back((char) ((v >> (8 * i)) & 0xff));
+}
+
+static void put_double(std::vector<char> &out, double d)
+{
+  unsigned long long v;
+  memcpy(&v, &d, 8);
+  put_uint64(out, v);
+}
+
+// Append a value of the given size, stored little-endian
+static void put_value(std::vector<char> &out, const char *value, size_t size)
+{
+  if(is_big_endian())
+    for(size_t i = size; i > 0; i--)
+      out.push_back(value[i - 1]);
+  else
+    out.insert(out.end(), value, value + size);
+}
+
+/**
+ * Sequential reader of the little-endian numbers in a buffer. Reading past
+ * the end of the buffer sets the error flag and returns zeros.
+ */
+class RLEBufferReader
+{
+public:
+  RLEBufferReader(const char *data, size_t size)
+    : m_Data(reinterpret_cast<const unsigned char *>(data)), m_Size(size), m_Pos(0), m_Error(false) {}
+
+  unsigned long long GetUInt(int n_bytes)
+  {
+    if(!this->Check(n_bytes))
+      return 0;
+    unsigned long long v = 0;
+    for(int i = 0; i < n_bytes; i++)
+      v |= ((unsigned long long) m_Data[m_Pos + i]) << (8 * i);
+    m_Pos += n_bytes;
+    return v;
+  }
+
+  unsigned int GetUInt32() { return (unsigned int) this->GetUInt(4); }
+
+  unsigned long long GetUInt64() { return this->GetUInt(8); }
+
+  double GetDouble()
+  {
+    unsigned long long v = this->GetUInt(8);
+    double d;
+    memcpy(&d, &v, 8);
+    return d;
+  }
+
+  // Read a value of the given size into host byte order
+  void GetValue(char *value, size_t size)
+  {
+    if(!this->Check(size))
+      {
+      memset(value, 0, size);
+      return;
+      }
+    if(is_big_endian())
+      for(size_t i = 0; i < size; i++)
+        value[i] = m_Data[m_Pos + size - 1 - i];
+    else
+      memcpy(value, m_Data + m_Pos, size);
+    m_Pos += size;
+  }
+
+  bool GetError() const { return m_Error; }
+
+protected:
+  bool Check(size_t n)
+  {
+    if(m_Error || m_Pos + n > m_Size)
+      m_Error = true;
+    return !m_Error;
+  }
+
+  const unsigned char *m_Data;
+  size_t m_Size, m_Pos;
+  bool m_Error;
+};
+
+// Seek to a position that may be beyond 2GB
+static int seek_file(FILE *f, unsigned long long pos)
+{
+#ifdef _WIN32
+  return _fseeki64(f, (__int64) pos, SEEK_SET);
+#else
+  return fseeko(f, (off_t) pos, SEEK_SET);
+#endif
+}
+
+typedef RLESegmentationImageIO::RLEImageType::RLLine RLLine;
+
+// Write the line count of the runs that follow, which is filled in later
+static size_t begin_line(std::vector<char> &out)
+{
+  size_t pos = out.size();
+  put_uint32(out, 0);
+  return pos;
+}
+
+static void end_line(std::vector<char> &out, size_t pos, unsigned long n_runs)
+{
+  for(int i = 0; i < 4; i++)
+    out[pos + i] = (char) ((n_runs >> (8 * i)) & 0xff);
+}
+
+// Encode lines [l0, l1) of an uncompressed buffer, comparing the bytes of
+// consecutive values
+static void encode_buffer_lines(const char *in, size_t nx, size_t vsize,
+                                size_t l0, size_t l1, std::vector<char> &out)
+{
+  for(size_t line = l0; line < l1; line++)
+    {
+    const char *p = in + line * nx * vsize;
+    size_t pos = begin_line(out);
+    unsigned long n_runs = 0;
+    for(size_t x = 0; x < nx; n_runs++)
+      {
+      size_t x1 = x + 1;
+      while(x1 < nx && memcmp(p + x1 * vsize, p + x * vsize, vsize) == 0)
+        x1++;
+      put_uint32(out, x1 - x);
+      put_value(out, p + x * vsize, vsize);
+      x = x1;
+      }
+    end_line(out, pos, n_runs);
+    }
+}
+
+// Encode lines [l0, l1) of an RLE image. Consecutive segments with the same
+// value, which occur when a run is longer than the counter type allows, are
+// stored as a single run
+static void encode_rle_lines(const RLLine *lines, size_t l0, size_t l1,
+                             std::vector<char> &out)
+{
+  for(size_t i = l0; i < l1; i++)
+    {
+    const RLLine &line = lines[i];
+    size_t pos = begin_line(out);
+    unsigned long n_runs = 0;
+    for(size_t s = 0; s < line.size(); n_runs++)
+      {
+      LabelType value = line[s].second;
+      unsigned long len = 0;
+      for(; s < line.size() && line[s].second == value; s++)
+        len += line[s].first;
+      put_uint32(out, len);
+      put_value(out, reinterpret_cast<const char *>(&value), sizeof(LabelType));
+      }
+    end_line(out, pos, n_runs);
+    }
+}
+
+// Decode lines [l0, l1) into an uncompressed buffer
+static bool decode_buffer_lines(const std::vector<char> &data, char *out,
+                                size_t nx, size_t vsize, size_t l0, size_t l1)
+{
+  std::vector<char> value(vsize);
+  RLEBufferReader rr(data.size() ? &data[0] : NULL, data.size());
+  for(size_t line = l0; line < l1; line++)
+    {
+    char *p = out + line * nx * vsize;
+    size_t x = 0;
+    unsigned int n_runs = rr.GetUInt32();
+    for(unsigned int r = 0; r < n_runs && !rr.GetError(); r++)
+      {
+      size_t len = rr.GetUInt32();
+      rr.GetValue(&value[0], vsize);
+      if(x + len > nx)
+        return false;
+      for(size_t k = 0; k < len; k++, p += vsize)
+        memcpy(p, &value[0], vsize);
+      x += len;
+      }
+
+    if(x != nx || rr.GetError())
+      return false;
+    }
+  return true;
+}
+
+// Decode lines [l0, l1) into the lines of an RLE image
+static bool decode_rle_lines(const std::vector<char> &data, RLLine *lines,
+                             size_t nx, size_t l0, size_t l1)
+{
+  typedef RLESegmentationImageIO::RLEImageType RLEImageType;
+  RLEBufferReader rr(data.size() ? &data[0] : NULL, data.size());
+  for(size_t i = l0; i < l1; i++)
+    {
+    RLLine &line = lines[i];
+    line.clear();
+
+    size_t x = 0;
+    unsigned int n_runs = rr.GetUInt32();
+    for(unsigned int r = 0; r < n_runs && !rr.GetError(); r++)
+      {
+      size_t len = rr.GetUInt32();
+      LabelType value;
+      rr.GetValue(reinterpret_cast<char *>(&value), sizeof(LabelType));
+      if(x + len > nx)
+        return false;
+      RLEImageType::AppendRun(line, len, value);
+      x += len;
+      }
+
+    if(x != nx || rr.GetError())
+      return false;
+    }
+  return true;
+}
+
+static bool compress_chunk(const std::vector<char> &raw, std::vector<char> &out)
+{
+  uLongf csize = compressBound((uLong) raw.size());
+  out.resize(csize);
+  if(compress2((Bytef *) &out[0], &csize,
+               (const Bytef *) (raw.size() ? &raw[0] : NULL),
+               (uLong) raw.size(), Z_DEFAULT_COMPRESSION) != Z_OK)
+    return false;
+  out.resize(csize);
+  return true;
+}
+
+// Read the compressed data of a chunk and decompress it
+static bool read_chunk_data(const std::string &fname,
+                            unsigned long long offset, unsigned long long compressed_size,
+                            unsigned long long size, std::vector<char> &data)
+{
+  std::vector<char> compressed(compressed_size);
+  data.resize(size);
+
+  FILE *f = fopen(fname.c_str(), "rb");
+  if(!f)
+    return false;
+
+  bool ok = seek_file(f, offset) == 0
+      && fread(compressed.size() ? &compressed[0] : NULL, 1, compressed.size(), f) == compressed.size();
+  fclose(f);
+
+  uLongf dsize = (uLongf) size;
+  return ok
+      && uncompress((Bytef *) (data.size() ? &data[0] : NULL), &dsize,
+                    (const Bytef *) (compressed.size() ? &compressed[0] : NULL),
+                    (uLong) compressed.size()) == Z_OK
+      && dsize == size;
+}
+
+/*
+ * Chunks are encoded and decoded on separate threads, since the lines of
+ * different slices are independent. Each thread handles every n-th chunk.
+ * Exactly one of the buffer and RLE line pointers is set.
+ */
+struct RLEChunkCodingData
+{
+  const RLESegmentationImageIO *io;
+  std::string fname;
+  size_t nx, ny, vsize;
+
+  const char *in_buffer;
+  const RLLine *in_lines;
+  char *out_buffer;
+  RLLine *out_lines;
+
+  // Compressed chunks and their uncompressed sizes, when writing
+  std::vector<std::vector<char> > compressed;
+  std::vector<unsigned long long> raw_size;
+
+  // Location of the chunks in the file, and the first chunk to read
+  std::vector<unsigned long long> offset, compressed_size, size;
+  size_t first_chunk;
+
+  std::vector<char> failed;
+};
+
+static ITK_THREAD_RETURN_TYPE rle_chunk_encode_callback(void *arg)
+{
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfo;
+  ThreadInfo *info = static_cast<ThreadInfo *>(arg);
+  RLEChunkCodingData *td = static_cast<RLEChunkCodingData *>(info->UserData);
+
+  std::vector<char> raw;
+  for(size_t c = info->ThreadID; c < td->compressed.size(); c += info->NumberOfThreads)
+    {
+    unsigned int z0, z1;
+    td->io->GetChunkSlices((unsigned int) c, z0, z1);
+
+    raw.clear();
+    if(td->in_lines)
+      encode_rle_lines(td->in_lines, z0 * td->ny, z1 * td->ny, raw);
+    else
+      encode_buffer_lines(td->in_buffer, td->nx, td->vsize, z0 * td->ny, z1 * td->ny, raw);
+
+    td->raw_size[c] = raw.size();
+    if(!compress_chunk(raw, td->compressed[c]))
+      td->failed[c] = 1;
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+static ITK_THREAD_RETURN_TYPE rle_chunk_decode_callback(void *arg)
+{
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfo;
+  ThreadInfo *info = static_cast<ThreadInfo *>(arg);
+  RLEChunkCodingData *td = static_cast<RLEChunkCodingData *>(info->UserData);
+
+  std::vector<char> data;
+  for(size_t c = td->first_chunk + info->ThreadID; c < td->offset.size(); c += info->NumberOfThreads)
+    {
+    unsigned int z0, z1;
+    td->io->GetChunkSlices((unsigned int) c, z0, z1);
+
+    bool ok = read_chunk_data(td->fname, td->offset[c], td->compressed_size[c], td->size[c], data);
+    if(ok && td->out_lines)
+      ok = decode_rle_lines(data, td->out_lines, td->nx, z0 * td->ny, z1 * td->ny);
+    else if(ok)
+      ok = decode_buffer_lines(data, td->out_buffer, td->nx, td->vsize, z0 * td->ny, z1 * td->ny);
+
+    if(!ok)
+      td->failed[c] = 1;
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+static void run_chunk_threads(ITK_THREAD_RETURN_TYPE (*cb)(void *),
+                              RLEChunkCodingData *td, size_t n_chunks)
+{
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetNumberOfThreads(
+        (int) std::max((size_t) 1, std::min((size_t) threader->GetNumberOfThreads(), n_chunks)));
+  threader->SetSingleMethod(cb, td);
+  threader->SingleMethodExecute();
+}
+
+
+RLESegmentationImageIO::RLESegmentationImageIO()
+{
+  this->SetNumberOfDimensions(3);
+  this->SetNumberOfComponents(1);
+  this->SetPixelType(SCALAR);
+  this->SetComponentType(USHORT);
+  this->AddSupportedReadExtension(".rle");
+  this->AddSupportedWriteExtension(".rle");
+  m_SlicesPerChunk = DefaultSlicesPerChunk;
+  m_ChunkSlicesInFile = DefaultSlicesPerChunk;
+}
+
+bool RLESegmentationImageIO::CanReadFile(const char *fname)
+{
+  FILE *f = fopen(fname, "rb");
+  if(!f)
+    return false;
+
+  char magic[8];
+  bool match = fread(magic, 1, 8, f) == 8 && memcmp(magic, RLE_MAGIC, 8) == 0;
+  fclose(f);
+  return match;
+}
+
+bool RLESegmentationImageIO::CanWriteFile(const char *fname)
+{
+  std::string ext = itksys::SystemTools::GetFilenameLastExtension(fname);
+  return itksys::SystemTools::LowerCase(ext) == ".rle";
+}
+
+void RLESegmentationImageIO::ReadImageInformation()
+{
+  FILE *f = fopen(m_FileName.c_str(), "rb");
+  if(!f)
+    itkExceptionMacro(<< "Unable to open file " << m_FileName);
+
+  std::vector<char> header(RLE_HEADER_SIZE);
+  bool ok = fread(&header[0], 1, RLE_HEADER_SIZE, f) == RLE_HEADER_SIZE
+      && memcmp(&header[0], RLE_MAGIC, 8) == 0;
+
+  RLEBufferReader hr(&header[0] + 8, RLE_HEADER_SIZE - 8);
+  unsigned int version = hr.GetUInt32();
+  unsigned int ctype = hr.GetUInt32();
+  unsigned int vsize = hr.GetUInt32();
+  unsigned int chunk_slices = hr.GetUInt32();
+
+  unsigned int dim[3];
+  double origin[3], spacing[3], direction[9];
+  for(int i = 0; i < 3; i++)
+    dim[i] = hr.GetUInt32();
+  for(int i = 0; i < 3; i++)
+    origin[i] = hr.GetDouble();
+  for(int i = 0; i < 3; i++)
+    spacing[i] = hr.GetDouble();
+  for(int i = 0; i < 9; i++)
+    direction[i] = hr.GetDouble();
+  unsigned int n_chunks = hr.GetUInt32();
+
+  // Check that the header is consistent
+  if(ok && version == RLE_VERSION && chunk_slices > 0
+     && dim[0] > 0 && dim[1] > 0 && dim[2] > 0
+     && n_chunks == (dim[2] + chunk_slices - 1) / chunk_slices
+     && ctype >= (unsigned int) UCHAR && ctype <= (unsigned int) DOUBLE)
+    {
+    this->SetComponentType(static_cast<IOComponentType>(ctype));
+    ok = this->GetComponentSize() == vsize;
+    }
+  else
+    {
+    ok = false;
+    }
+
+  // Read the chunk table
+  std::vector<char> table;
+  if(ok)
+    {
+    table.resize(n_chunks * RLE_CHUNK_ENTRY_SIZE);
+    ok = fread(&table[0], 1, table.size(), f) == table.size();
+    }
+  fclose(f);
+
+  if(!ok)
+    itkExceptionMacro(<< "File " << m_FileName << " is not a valid RLE segmentation file");
+
+  RLEBufferReader tr(&table[0], table.size());
+  m_Chunks.resize(n_chunks);
+  for(unsigned int c = 0; c < n_chunks; c++)
+    {
+    m_Chunks[c].offset = tr.GetUInt64();
+    m_Chunks[c].compressed_size = tr.GetUInt64();
+    m_Chunks[c].size = tr.GetUInt64();
+    }
+  m_ChunkSlicesInFile = chunk_slices;
+
+  this->SetNumberOfDimensions(3);
+  this->SetNumberOfComponents(1);
+  this->SetPixelType(SCALAR);
+  for(int i = 0; i < 3; i++)
+    {
+    this->SetDimensions(i, dim[i]);
+    this->SetOrigin(i, origin[i]);
+    this->SetSpacing(i, spacing[i]);
+
+    // The direction of axis i is column i of the matrix
+    std::vector<double> axis(3);
+    for(int j = 0; j < 3; j++)
+      axis[j] = direction[3 * j + i];
+    this->SetDirection(i, axis);
+    }
+}
+
+void RLESegmentationImageIO
+::GetChunkSlices(unsigned int chunk, unsigned int &z0, unsigned int &z1) const
+{
+  z0 = chunk * m_ChunkSlicesInFile;
+  z1 = std::min(z0 + m_ChunkSlicesInFile, (unsigned int) this->GetDimensions(2));
+}
+
+void RLESegmentationImageIO::DecodeChunks(char *buffer, RLEImageType *image,
+                                          unsigned int c0, unsigned int c1)
+{
+  RLEChunkCodingData td;
+  td.io = this;
+  td.fname = m_FileName;
+  td.nx = this->GetDimensions(0);
+  td.ny = this->GetDimensions(1);
+  td.vsize = this->GetComponentSize();
+  td.in_buffer = NULL;
+  td.in_lines = NULL;
+  td.out_buffer = buffer;
+  td.out_lines = image ? image->GetBuffer()->GetBufferPointer() : NULL;
+
+  if(c1 > m_Chunks.size())
+    itkExceptionMacro(<< "Chunk " << c1 - 1 << " is not in file " << m_FileName);
+
+  for(unsigned int c = 0; c < c1; c++)
+    {
+    td.offset.push_back(m_Chunks[c].offset);
+    td.compressed_size.push_back(m_Chunks[c].compressed_size);
+    td.size.push_back(m_Chunks[c].size);
+    }
+  td.first_chunk = c0;
+  td.failed.resize(c1, 0);
+  run_chunk_threads(&rle_chunk_decode_callback, &td, c1 - c0);
+
+  for(unsigned int c = c0; c < c1; c++)
+    if(td.failed[c])
+      itkExceptionMacro(<< "Unable to read chunk " << c << " of file " << m_FileName);
+}
+
+void RLESegmentationImageIO::Read(void *buffer)
+{
+  this->DecodeChunks(static_cast<char *>(buffer), NULL, 0, this->GetNumberOfChunks());
+}
+
+void RLESegmentationImageIO::CheckRLEImage(RLEImageType *image)
+{
+  if(this->GetComponentType() != USHORT
+     || image->GetBufferedRegion() != image->GetLargestPossibleRegion()
+     || image->GetBufferedRegion().GetSize(0) != this->GetDimensions(0)
+     || image->GetBufferedRegion().GetSize(1) != this->GetDimensions(1)
+     || image->GetBufferedRegion().GetSize(2) != this->GetDimensions(2))
+    itkExceptionMacro(<< "Image does not match the contents of file " << m_FileName);
+}
+
+void RLESegmentationImageIO::ReadChunk(unsigned int chunk, RLEImageType *image)
+{
+  this->CheckRLEImage(image);
+  this->DecodeChunks(NULL, image, chunk, chunk + 1);
+
+  // Lines were edited directly, so derived data must be invalidated
+  image->Modified();
+}
+
+RLESegmentationImageIO::RLEImageType::Pointer RLESegmentationImageIO::ReadRLEImage()
+{
+  if(this->GetComponentType() != USHORT)
+    itkExceptionMacro(<< "File " << m_FileName << " does not contain a label image");
+
+  RLEImageType::Pointer image = RLEImageType::New();
+  RLEImageType::RegionType region;
+  RLEImageType::DirectionType direction;
+  for(int i = 0; i < 3; i++)
+    {
+    region.SetSize(i, this->GetDimensions(i));
+    for(int j = 0; j < 3; j++)
+      direction(j, i) = this->GetDirection(i)[j];
+    }
+
+  image->SetRegions(region);
+  image->SetOrigin(&m_Origin[0]);
+  image->SetSpacing(&m_Spacing[0]);
+  image->SetDirection(direction);
+  image->Allocate();
+
+  this->CheckRLEImage(image);
+  this->DecodeChunks(NULL, image, 0, this->GetNumberOfChunks());
+  image->Modified();
+
+  return image;
+}
+
+void RLESegmentationImageIO::Write(const void *buffer)
+{
+  if(this->GetNumberOfComponents() != 1)
+    itkExceptionMacro(<< "Only single-component images can be written to " << m_FileName);
+
+  // Images of lower dimension are stored as a single slice
+  size_t dim[3] = { 1, 1, 1 };
+  double origin[3] = { 0, 0, 0 }, spacing[3] = { 1, 1, 1 };
+  double direction[9] = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
+  unsigned int nd = std::min(this->GetNumberOfDimensions(), 3u);
+  for(unsigned int i = 0; i < nd; i++)
+    {
+    dim[i] = this->GetDimensions(i);
+    origin[i] = this->GetOrigin(i);
+    spacing[i] = this->GetSpacing(i);
+    for(unsigned int j = 0; j < nd; j++)
+      direction[3 * j + i] = this->GetDirection(i)[j];
+    }
+
+  this->EncodeChunks(static_cast<const char *>(buffer), NULL, dim, origin, spacing, direction);
+}
+
+void RLESegmentationImageIO::WriteRLEImage(const RLEImageType *image)
+{
+  if(image->GetBufferedRegion() != image->GetLargestPossibleRegion())
+    itkExceptionMacro(<< "Only complete RLE images can be written to " << m_FileName);
+
+  // The file has no region index, so the origin stored is the position of
+  // the first voxel, as with the ITK image writers
+  RLEImageType::PointType start;
+  image->TransformIndexToPhysicalPoint(image->GetBufferedRegion().GetIndex(), start);
+
+  size_t dim[3];
+  double origin[3], spacing[3], direction[9];
+  for(int i = 0; i < 3; i++)
+    {
+    dim[i] = image->GetBufferedRegion().GetSize(i);
+    origin[i] = start[i];
+    spacing[i] = image->GetSpacing()[i];
+    for(int j = 0; j < 3; j++)
+      direction[3 * i + j] = image->GetDirection()(i, j);
+    }
+
+  this->SetComponentType(USHORT);
+  this->SetNumberOfComponents(1);
+  this->EncodeChunks(NULL, image->GetBuffer()->GetBufferPointer(),
+                     dim, origin, spacing, direction);
+}
+
+void RLESegmentationImageIO
+::EncodeChunks(const char *buffer, const RLLine *lines, const size_t dim[3],
+               const double origin[3], const double spacing[3],
+               const double direction[9])
+{
+  // The chunk layout of the file being written
+  m_ChunkSlicesInFile = m_SlicesPerChunk;
+  size_t n_chunks = (dim[2] + m_SlicesPerChunk - 1) / m_SlicesPerChunk;
+
+  this->SetNumberOfDimensions(3);
+  for(int i = 0; i < 3; i++)
+    this->SetDimensions(i, dim[i]);
+
+  // Encode and compress the chunks in parallel
+  RLEChunkCodingData td;
+  td.io = this;
+  td.nx = dim[0];
+  td.ny = dim[1];
+  td.vsize = this->GetComponentSize();
+  td.in_buffer = buffer;
+  td.in_lines = lines;
+  td.out_buffer = NULL;
+  td.out_lines = NULL;
+  td.first_chunk = 0;
+  td.compressed.resize(n_chunks);
+  td.raw_size.resize(n_chunks, 0);
+  td.failed.resize(n_chunks, 0);
+  run_chunk_threads(&rle_chunk_encode_callback, &td, n_chunks);
+
+  for(size_t c = 0; c < n_chunks; c++)
+    if(td.failed[c])
+      itkExceptionMacro(<< "Unable to compress data for file " << m_FileName);
+
+  // Build the header and the chunk table
+  std::vector<char> header(RLE_MAGIC, RLE_MAGIC + 8);
+  put_uint32(header, RLE_VERSION);
+  put_uint32(header, this->GetComponentType());
+  put_uint32(header, td.vsize);
+  put_uint32(header, m_SlicesPerChunk);
+  for(int i = 0; i < 3; i++)
+    put_uint32(header, dim[i]);
+  for(int i = 0; i < 3; i++)
+    put_double(header, origin[i]);
+  for(int i = 0; i < 3; i++)
+    put_double(header, spacing[i]);
+  for(int i = 0; i < 9; i++)
+    put_double(header, direction[i]);
+  put_uint32(header, n_chunks);
+
+  unsigned long long offset = RLE_HEADER_SIZE + RLE_CHUNK_ENTRY_SIZE * n_chunks;
+  for(size_t c = 0; c < n_chunks; c++)
+    {
+    put_uint64(header, offset);
+    put_uint64(header, td.compressed[c].size());
+    put_uint64(header, td.raw_size[c]);
+    offset += td.compressed[c].size();
+    }
+
+  // Write the file
+  FILE *f = fopen(m_FileName.c_str(), "wb");
+  if(!f)
+    itkExceptionMacro(<< "Unable to open file " << m_FileName << " for writing");
+
+  bool ok = fwrite(&header[0], 1, header.size(), f) == header.size();
+  for(size_t c = 0; ok && c < n_chunks; c++)
+    ok = fwrite(&td.compressed[c][0], 1, td.compressed[c].size(), f) == td.compressed[c].size();
+  ok = (fclose(f) == 0) && ok;
+
+  if(!ok)
+    itkExceptionMacro(<< "Unable to write file " << m_FileName);
+}
@@ -0,0 +1,118 @@
+#ifndef RLESEGMENTATIONIMAGEIO_H
+#define RLESEGMENTATIONIMAGEIO_H
+
+#include "SNAPCommon.h"
+#include "RLEImage.h"
+#include "itkImageIOBase.h"
+#include <vector>
+
+/**
+ * \class RLESegmentationImageIO
+ * \brief Reads and writes segmentations as run-length encoded lines.
+ *
+ * The file stores the runs of each image line, so that segmentations can be
+ * saved and loaded directly from and to an RLEImage, in time proportional to
+ * the number of runs rather than the number of voxels. The lines are grouped
+ * into chunks of consecutive slices along z, and each chunk is compressed
+ * separately with zlib, so that the chunks are encoded and decoded on
+ * separate threads. A table of chunks at the start of the file allows any
+ * chunk to be read without reading the rest of the file.
+ *
+ * The class is also a regular ITK ImageIO, which reads the file into (and
+ * writes it from) an uncompressed buffer, so that the format can be used with
+ * any single-component scalar image.
+ *
+ * File layout (all numbers are little-endian):
+ *
+ *   char[8]    "SNAPRLE" followed by a zero byte
+ *   uint32     format version (1)
+ *   uint32     itk::ImageIOBase::IOComponentType of the values
+ *   uint32     size of a value, in bytes
+ *   uint32     number of slices in a chunk
+ *   uint32[3]  image dimensions
+ *   double[3]  origin
+ *   double[3]  spacing
+ *   double[9]  direction matrix, row by row
+ *   uint32     number of chunks
+ *   uint64[3]  for each chunk: file offset, compressed size, uncompressed size
+ *
+ * The uncompressed contents of a chunk are its lines in y, then z order. Each
+ * line is stored as the number of runs (uint32), followed by the runs, each
+ * given by its length (uint32) and value.
+ */
+class RLESegmentationImageIO : public itk::ImageIOBase
+{
+public:
+  typedef RLESegmentationImageIO Self;
+  typedef itk::ImageIOBase Superclass;
+  typedef itk::SmartPointer<Self> Pointer;
+
+  itkNewMacro(Self)
+  itkTypeMacro(RLESegmentationImageIO, ImageIOBase)
+
+  /** The run-length encoded image type read and written directly */
+  typedef RLEImage<LabelType> RLEImageType;
+
+  /** Default number of slices in a chunk */
+  static const unsigned int DefaultSlicesPerChunk = 8;
+
+  virtual bool CanReadFile(const char *fname) ITK_OVERRIDE;
+  virtual void ReadImageInformation() ITK_OVERRIDE;
+  virtual void Read(void *buffer) ITK_OVERRIDE;
+
+  virtual bool CanWriteFile(const char *fname) ITK_OVERRIDE;
+  virtual void WriteImageInformation() ITK_OVERRIDE {}
+  virtual void Write(const void *buffer) ITK_OVERRIDE;
+
+  /** Number of slices in each chunk written */
+  itkSetMacro(SlicesPerChunk, unsigned int)
+  itkGetMacro(SlicesPerChunk, unsigned int)
+
+  /** Number of chunks in the file, after ReadImageInformation() */
+  unsigned int GetNumberOfChunks() const
+    { return (unsigned int) m_Chunks.size(); }
+
+  /** Range [z0, z1) of slices stored in a chunk */
+  void GetChunkSlices(unsigned int chunk, unsigned int &z0, unsigned int &z1) const;
+
+  /**
+   * Read one chunk of the file into the lines of an RLE image. The image must
+   * have been allocated with the dimensions of the file.
+   */
+  void ReadChunk(unsigned int chunk, RLEImageType *image);
+
+  /** Read the file, whose values must be of LabelType, into an RLE image */
+  RLEImageType::Pointer ReadRLEImage();
+
+  /** Write an RLE image to the file without expanding it */
+  void WriteRLEImage(const RLEImageType *image);
+
+protected:
+  RLESegmentationImageIO();
+  virtual ~RLESegmentationImageIO() {}
+
+  // Location of a chunk in the file
+  struct ChunkInfo
+  {
+    unsigned long long offset, compressed_size, size;
+  };
+
+  // Check that an RLE image can hold the contents of the file
+  void CheckRLEImage(RLEImageType *image);
+
+  // Read chunks [c0, c1) into either an uncompressed buffer or an RLE image,
+  // decoding the chunks in parallel
+  void DecodeChunks(char *buffer, RLEImageType *image, unsigned int c0, unsigned int c1);
+
+  // Encode either an uncompressed buffer or the lines of an RLE image in
+  // parallel, and write the file
+  void EncodeChunks(const char *buffer, const RLEImageType::RLLine *lines,
+                    const size_t dim[3], const double origin[3],
+                    const double spacing[3], const double direction[9]);
+
+  unsigned int m_SlicesPerChunk;
+  unsigned int m_ChunkSlicesInFile;
+  std::vector<ChunkInfo> m_Chunks;
+};
+
+#endif // RLESEGMENTATIONIMAGEIO_H
@@ -513,11 +513,12 @@ ScalarImageWrapper<TTraits, TBase>
 
   typedef itk::ImageFileWriter<FloatImageType> WriterType;
   SmartPtr<WriterType> writer = WriterType::New();
-  writer->SetFileName(fname);
+  writer->SetFileName(io->GetWriteFileName());
   if(base)
     writer->SetImageIO(base);
   writer->SetInput(pipeline->GetOutput());
   writer->Update();
+  io->FinishWrite();
 }
 
 
@@ -434,6 +434,19 @@ VectorImageWrapper<TTraits,TBase>
     }
 }
 
+template <class TTraits, class TBase>
+void
+VectorImageWrapper<TTraits,TBase>
+::PrefetchDisplaySlices(unsigned int dim)
+{
+  // Only the representations that are being displayed have a scroll
+  // direction, so the others return right away
+  for(ScalarRepIterator it = m_ScalarReps.begin(); it != m_ScalarReps.end(); ++it)
+    {
+    it->second->PrefetchDisplaySlices(dim);
+    }
+}
+
 template <class TTraits, class TBase>
 void
 VectorImageWrapper<TTraits,TBase>
@@ -609,11 +622,12 @@ VectorImageWrapper<TTraits, TBase>
   SmartPtr<FloatVectorImageSource> pipeline = this->CreateCastToFloatVectorPipeline();
   typedef itk::ImageFileWriter<FloatVectorImageType> WriterType;
   SmartPtr<WriterType> writer = WriterType::New();
-  writer->SetFileName(fname);
+  writer->SetFileName(io->GetWriteFileName());
   if(base)
     writer->SetImageIO(base);
   writer->SetInput(pipeline->GetOutput());
   writer->Update();
+  io->FinishWrite();
 }
 
 
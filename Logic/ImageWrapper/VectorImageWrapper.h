@@ -218,6 +218,9 @@ public:
 
   virtual void SetSliceIndex(const Vector3ui &cursor) ITK_OVERRIDE;
 
+  /** Prefetch display slices in the scalar representations */
+  virtual void PrefetchDisplaySlices(unsigned int dim) ITK_OVERRIDE;
+
   virtual void SetDisplayGeometry(const IRISDisplayGeometry &dispGeom) ITK_OVERRIDE;
 
   virtual void SetDisplayViewportGeometry(unsigned int index, ImageBaseType *viewport_image);
@@ -277,6 +280,12 @@ protected:
    */
   VectorImageWrapper(const Self &copy) : Superclass(copy) {}
 
+  /**
+   * The display slices are taken from the scalar representations, which
+   * cache their own slices
+   */
+  virtual bool IsDisplaySliceCachingSupported() const ITK_OVERRIDE { return false; }
+
   virtual void UpdateImagePointer(ImageType *image,
                                   ImageBaseType *refSpace = NULL,
                                   ITKTransformType *tran = NULL) ITK_OVERRIDE;
@@ -54,6 +54,7 @@
 #include "SNAPImageData.h"
 #include "AllPurposeProgressAccumulator.h"
 #include "MeshOptions.h"
+#include "DefaultBehaviorSettings.h"
 
 // ITK includes
 #include "itkRegionOfInterestImageFilter.h"
@@ -86,6 +87,8 @@ MeshManager
 ::MeshManager()
 {
   m_Progress = AllPurposeProgressAccumulator::New();
+  m_UpdateRegionKnown = false;
+  m_UpdateImageMTime = 0;
 }
 
 MeshManager
@@ -101,9 +104,67 @@ MeshManager
   m_GlobalState = m_Driver->GetGlobalState();  
 }
 
-void 
+void
+MeshManager
+::PrepareUpdate(bool storeInCache)
+{
+  m_UpdatePipeline = NULL;
+  m_UpdateImage = NULL;
+
+  // The level set mesh pipeline synchronizes with the level set itself
+  if (m_Driver->IsSnakeModeLevelSetActive())
+    return;
+
+  // Get the mesh pipeline associated with the level set image wrapper
+  LabelImageWrapper *wrapper = m_Driver->GetSelectedSegmentationLayer();
+
+  // Make sure we have a workable image from which to extract mesh
+  if(!wrapper || !wrapper->GetImage() || !Is3DProper(wrapper->GetImage()))
+    return;
+
+  // Get the mesh generation pipeline associated with the layer
+  SmartPtr<MultiLabelMeshPipeline> pipeline =
+      static_cast<MultiLabelMeshPipeline *>(wrapper->GetUserData("MeshPipeline"));
+
+  // If the pipeline does not exist, create it
+  if(!pipeline)
+    {
+    pipeline = MultiLabelMeshPipeline::New();
+    wrapper->SetUserData("MeshPipeline", pipeline);
+    }
+
+  // Make sure the pipeline has the right image
+  pipeline->SetImage(wrapper->GetImage());
+
+  // Pass the options to the pipeline
+  pipeline->SetMeshOptions(m_GlobalState->GetMeshOptions());
+  DefaultBehaviorSettings *dbs = m_GlobalState->GetDefaultBehaviorSettings();
+  pipeline->SetMeshCacheDirectory(dbs->GetMeshCacheDirectory());
+  pipeline->SetMeshCacheSizeInMB(dbs->GetMeshCacheSizeInMB());
+  pipeline->SetMeshCacheWriteEnabled(storeInCache);
+
+  // Copy the segmentation image, since the paint tools edit its lines in
+  // place while the meshes are updated in another thread. The copy holds
+  // only the runs of each line, so it is cheap compared to the meshing
+  m_UpdateImage = LabelStatisticsTable::ImageType::New();
+  ConvertRLEImageCounterType(wrapper->GetImage(), m_UpdateImage.GetPointer());
+
+  // Copy the label statistics maintained by the wrapper, which are used to
+  // find out which labels have changed. If the image was only edited with
+  // undo deltas since the last update, the edited region is kept as well,
+  // so that only that part of the image is remeshed. The wrapper keeps
+  // changing both as the segmentation is edited, so they cannot be read
+  // while the meshes are updated in another thread
+  m_UpdateStatistics = wrapper->GetLabelStatistics();
+  m_UpdateRegionKnown = wrapper->GetModifiedRegionSince(
+        pipeline->GetMeshImageMTime(), m_UpdateRegion);
+  m_UpdateImageMTime = wrapper->GetImage()->GetMTime();
+  m_UpdatePipeline = pipeline;
+}
+
+void
 MeshManager
-::UpdateVTKMeshes(itk::Command *command)
+::UpdateVTKMeshes(itk::Command *command, bool prepared)
 {
   // The mesh is constructed differently depending on whether there is an
   // actively evolving level set or not SNAP mode or in IRIS mode
@@ -136,32 +197,21 @@ MeshManager
     }
   else
     {
-    // Get the mesh pipeline associated with the level set image wrapper
-    LabelImageWrapper *wrapper = m_Driver->GetSelectedSegmentationLayer();
-
-    // Make sure we have a workable image from which to extract mesh
-    if(!wrapper || !wrapper->GetImage() || !Is3DProper(wrapper->GetImage()))
-      return;
-
-    // Get the mesh generation pipeline associated with the layer
-    SmartPtr<MultiLabelMeshPipeline> pipeline =
-        static_cast<MultiLabelMeshPipeline *>(wrapper->GetUserData("MeshPipeline"));
-
-    // If the pipeline does not exist, create it
+    // Capture the state of the segmentation, unless this was done already
+    if(!prepared)
+      this->PrepareUpdate();
+
+    // Update the meshes from the captured state
+    SmartPtr<MultiLabelMeshPipeline> pipeline = m_UpdatePipeline;
+    SmartPtr<LabelStatisticsTable::ImageType> image = m_UpdateImage;
+    m_UpdatePipeline = NULL;
+    m_UpdateImage = NULL;
     if(!pipeline)
-      {
-      pipeline = MultiLabelMeshPipeline::New();
-      wrapper->SetUserData("MeshPipeline", pipeline);
-      }
-
-    // Make sure the pipeline has the right image
-    pipeline->SetImage(wrapper->GetImage());
-
-      // Pass the options to the pipeline
-    pipeline->SetMeshOptions(m_GlobalState->GetMeshOptions());
+      return;
 
-    // Update the meshes
-    pipeline->UpdateMeshes(command);
+    pipeline->UpdateMeshes(command, &m_UpdateStatistics,
+                           m_UpdateRegionKnown ? &m_UpdateRegion : NULL,
+                           m_UpdateImageMTime, image);
     }
 
   // Fire a modified event as well
@@ -248,6 +298,14 @@ bool MeshManager::IsMeshDirty()
     // Get the pipelines
     tsImage = wrapper->GetImageBase()->GetMTime();
     tsPipeline = pipeline->GetMTime();
+
+    // If the segmentation has been modified, the label statistics tell us
+    // whether any of the labels actually changed. The image is compared with
+    // the version the meshes were computed from, since it may have been
+    // edited while they were computed in another thread
+    if(tsImage > pipeline->GetMeshImageMTime()
+       && m_Driver->GetGlobalState()->GetMeshOptions()->GetMTime() <= tsPipeline)
+      return pipeline->IsOutOfDate(wrapper->GetLabelStatistics());
     }
 
   // Compare the timestamps
@@ -298,6 +356,48 @@ itk::ModifiedTimeType MeshManager::GetBuildTime() const
     }
 }
 
+itk::ModifiedTimeType MeshManager::GetMeshCollectionTime() const
+{
+  if(!m_Driver->IsMainImageLoaded())
+    return 0;
+
+  // The level set mesh is replaced when its pipeline is updated
+  if(m_Driver->IsSnakeModeLevelSetActive())
+    return this->GetBuildTime();
+
+  LabelImageWrapper *wrapper = m_Driver->GetSelectedSegmentationLayer();
+  SmartPtr<MultiLabelMeshPipeline> pipeline =
+      static_cast<MultiLabelMeshPipeline *>(wrapper->GetUserData("MeshPipeline"));
+
+  return pipeline ? pipeline->GetMeshCollectionMTime() : 0;
+}
+
+itk::ModifiedTimeType MeshManager::GetSourceTime() const
+{
+  if(!m_Driver->IsMainImageLoaded())
+    return 0;
+
+  if(m_Driver->IsSnakeModeLevelSetActive())
+    return m_Driver->GetSNAPImageData()->GetSnake()->GetImageBase()->GetMTime();
+
+  LabelImageWrapper *wrapper = m_Driver->GetSelectedSegmentationLayer();
+  return wrapper ? wrapper->GetImageBase()->GetMTime() : 0;
+}
+
+void MeshManager::AbortUpdate()
+{
+  // Only the segmentation meshes are computed in steps that can be stopped
+  if(!m_Driver->IsMainImageLoaded() || m_Driver->IsSnakeModeLevelSetActive())
+    return;
+
+  LabelImageWrapper *wrapper = m_Driver->GetSelectedSegmentationLayer();
+  SmartPtr<MultiLabelMeshPipeline> pipeline =
+      static_cast<MultiLabelMeshPipeline *>(wrapper->GetUserData("MeshPipeline"));
+
+  if(pipeline)
+    pipeline->AbortUpdate();
+}
+
 
 /*
  *  Apply color label, a shorthand
@@ -48,8 +48,10 @@ class LevelSetMeshPipeline;
 
 #include "SNAPCommon.h"
 #include "AllPurposeProgressAccumulator.h"
+#include "LabelStatisticsTable.h"
 #include <vector>
 #include "itkObject.h"
+#include "itkImageRegion.h"
 #include "vtkSmartPointer.h"
 
 namespace itk {
@@ -76,9 +78,22 @@ public:
   void Initialize(IRISApplication *driver);
 
   /**
-   * Generate VTK meshes from input data.
+   * Capture the state of the segmentation that the mesh update depends on,
+   * i.e., a copy of the segmentation image, its label statistics and the
+   * region edited since the last update, and pass the current mesh options
+   * to the pipeline. This must be called from the thread that edits the
+   * segmentation. If storeInCache is false, the meshes computed by the
+   * update are not added to the mesh cache, e.g., during continuous update.
    */
-  void UpdateVTKMeshes(itk::Command *command);
+  void PrepareUpdate(bool storeInCache = true);
+
+  /**
+   * Generate VTK meshes from input data. If prepared is true, the state
+   * captured by the last call to PrepareUpdate() is used, so this can run in
+   * another thread while the segmentation is being edited. Otherwise, the
+   * state is captured first.
+   */
+  void UpdateVTKMeshes(itk::Command *command, bool prepared = false);
 
   /**
    * Get the mapping of labels to vtk mesh pointers. This method has a
@@ -97,6 +112,25 @@ public:
    */
   itk::ModifiedTimeType GetBuildTime() const;
 
+  /**
+   * Get the timestamp when a mesh in the collection returned by GetMeshes()
+   * was last replaced. The segmentation meshes are replaced one by one as
+   * they are computed by UpdateVTKMeshes(), possibly in another thread.
+   */
+  itk::ModifiedTimeType GetMeshCollectionTime() const;
+
+  /**
+   * Get the MTime of the image from which the meshes are generated, which
+   * can be used to check if the image changed after an update started
+   */
+  itk::ModifiedTimeType GetSourceTime() const;
+
+  /**
+   * Ask UpdateVTKMeshes() running in another thread to stop early. The meshes
+   * that were completed are kept, the others keep their previous versions
+   */
+  void AbortUpdate();
+
 protected:
 
   MeshManager();
@@ -117,6 +151,15 @@ protected:
   // Progress accumulator for multi-object rendering
   itk::SmartPointer<AllPurposeProgressAccumulator> m_Progress;
 
+  // State of the segmentation captured by PrepareUpdate(). The pipeline is
+  // NULL if there are no segmentation meshes to update
+  SmartPtr<MultiLabelMeshPipeline> m_UpdatePipeline;
+  SmartPtr<LabelStatisticsTable::ImageType> m_UpdateImage;
+  LabelStatisticsTable m_UpdateStatistics;
+  itk::ImageRegion<3> m_UpdateRegion;
+  bool m_UpdateRegionKnown;
+  itk::ModifiedTimeType m_UpdateImageMTime;
+
   //Check if apImage is a proper 3D, i.e. the third dimension is
   //different than 1
   bool Is3DProper(const itk::ImageBase<3> * apImage) const;
@@ -37,6 +37,13 @@
 MeshOptions
 ::MeshOptions()
 {
+  // Surface extraction method
+  RegistryEnumMap<MeshingMethodType> remMethod;
+  remMethod.AddPair(MESH_MARCHING_CUBES, "MarchingCubes");
+  remMethod.AddPair(MESH_MULTILABEL_SINGLE_PASS, "MultiLabelSinglePass");
+  m_MeshingMethodModel =
+    NewSimpleEnumProperty("MeshingMethod", MESH_MARCHING_CUBES, remMethod);
+
   // Begin render switches
   m_UseGaussianSmoothingModel = 
     NewSimpleProperty("UseGaussianSmoothing", true);
@@ -48,6 +48,23 @@ public:
 
   irisITKObjectMacro(MeshOptions, AbstractModel)
 
+  /** Methods for extracting the surfaces of a multi-label segmentation */
+  enum MeshingMethodType {
+    // Each label is thresholded, smoothed and contoured with marching cubes.
+    // After an edit, the labels whose voxels changed are meshed again around
+    // the edited region, or within their whole bounding box if decimation
+    // or mesh smoothing is on (this is the default method)
+    MESH_MARCHING_CUBES = 0,
+    // All labels are meshed in one pass over the segmentation, with shared
+    // vertices on the boundaries between labels. After an edit, only the
+    // bricks of the image around the edited region are extracted again. Mesh
+    // smoothing still requires all the meshes to be rebuilt
+    MESH_MULTILABEL_SINGLE_PASS
+  };
+
+  // Surface extraction method
+  irisSimplePropertyAccessMacro(MeshingMethod, MeshingMethodType)
+
   // Gaussian smoothing properties
   irisSimplePropertyAccessMacro(UseGaussianSmoothing,bool)
   irisRangedPropertyAccessMacro(GaussianStandardDeviation,float)
@@ -73,6 +90,9 @@ protected:
   MeshOptions();
 
 private:
+  // Surface extraction method
+  SmartPtr<ConcretePropertyModel<MeshingMethodType> > m_MeshingMethodModel;
+
   // Begin render switches
   SmartPtr<ConcreteSimpleBooleanProperty> m_UseGaussianSmoothingModel;
   SmartPtr<ConcreteSimpleBooleanProperty> m_UseDecimationModel;
@@ -44,9 +44,36 @@
 #include "IRISVectorTypesToITKConversion.h"
 #include "VTKMeshPipeline.h"
 #include "MeshOptions.h"
+#include "MultiLabelSurfaceExtractor.h"
+#include "ImageWrapperBase.h"
+#include "Registry.h"
 
 // ITK includes
 #include "itkBinaryThresholdImageFilter.h"
+#include "itkMutexLockHolder.h"
+#include "itkSimpleFastMutexLock.h"
+#include "itksys/SystemTools.hxx"
+#include "itksys/Directory.hxx"
+
+// VTK includes
+#include <vtkPoints.h>
+#include <vtkPolyDataNormals.h>
+#include <vtkXMLPolyDataReader.h>
+#include <vtkXMLPolyDataWriter.h>
+#include <vtkErrorCode.h>
+#include <vtkAppendPolyData.h>
+#include <vtkCellArray.h>
+#include <vtkCleanPolyData.h>
+#include <vtkIdList.h>
+#include <vtkPointData.h>
+#include <vtkStripper.h>
+#include <vtkTriangleFilter.h>
+#include <vnl/vnl_inverse.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
 
 using namespace std;
 
@@ -72,12 +99,25 @@ MultiLabelMeshPipeline
   // Set the initial mesh options
   m_MeshOptions = MeshOptions::New();
   m_VTKPipeline->SetMeshOptions(m_MeshOptions);
+  this->UpdateMeshOptionsHash();
+
+  // Compute the meshes for different labels in parallel by default
+  m_NumberOfThreads = itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+
+  m_SurfaceExtractor = new MultiLabelSurfaceExtractor();
+  m_MeshImageMTime = 0;
+  m_MeshCacheSizeInMB = 512;
+  m_MeshCacheWriteEnabled = true;
+  m_UpdateWritesCache = false;
+  m_UpdateRegionKnown = false;
+  m_UpdateAborted = false;
 }
 
 MultiLabelMeshPipeline
 ::~MultiLabelMeshPipeline()
 {
   delete m_VTKPipeline;
+  delete m_SurfaceExtractor;
 }
 
 void
@@ -92,9 +132,14 @@ MultiLabelMeshPipeline
 
     // Apply the options to the internal pipeline
     m_VTKPipeline->SetMeshOptions(m_MeshOptions);
+    this->UpdateMeshOptionsHash();
 
-    // Clear the cached stuff
-    m_MeshInfo.clear();
+    // Mark the meshes as out of date, since no label has a voxel count of
+    // zero. They are displayed until they are recomputed with the new options
+    itk::MutexLockHolder<itk::SimpleFastMutexLock> holder(m_MeshInfoLock);
+    for(MeshInfoMap::iterator it = m_MeshInfo.begin(); it != m_MeshInfo.end(); ++it)
+      it->second.Count = 0;
+    m_SurfaceExtractor->Clear();
     }
 }
 
@@ -147,100 +192,57 @@ MultiLabelMeshPipeline
 }
 
 #include "itkImageLinearConstIteratorWithIndex.h"
-#include "itk_zlib.h"
 
-inline unsigned long rotl(unsigned long value, int shift)
+void MultiLabelMeshPipeline::UpdateMeshes(itk::Command *progressCommand,
+                                          const LabelStatisticsTable *stats,
+                                          const itk::ImageRegion<3> *modified,
+                                          itk::ModifiedTimeType imageMTime,
+                                          const InputImageType *snapshot)
 {
-  return (value << shift) | (value >> (32 - shift));
-}
+  typedef itk::MutexLockHolder<itk::SimpleFastMutexLock> LockHolder;
 
-void MultiLabelMeshPipeline::UpdateMeshInfoHelper(
-    MultiLabelMeshPipeline::MeshInfo *current_meshinfo,
-    const itk::Index<3> &run_start,
-    itk::ImageRegionConstIteratorWithIndex<MultiLabelMeshPipeline::InputImageType> &it,
-    unsigned long pos)
-{
-  // The end of the run, i.e., the last voxel that matched the label of run_start
-  itk::Index<3> run_end = run_start; run_end[0] = pos - 1;
+  // All the voxels are read from the snapshot, if there is one
+  m_UpdateImage = snapshot ? snapshot : m_InputImage.GetPointer();
 
-  // Append the start index to the checksum
-  for(int d = 0; d < 3; d++)
-    {
-    long p_start = run_start[d], p_end = run_end[d];
-    current_meshinfo->CheckSum =
-        adler32(current_meshinfo->CheckSum,
-                (unsigned char *) &p_start,
-                sizeof(itk::Index<3>::IndexValueType));
-
-    current_meshinfo->CheckSum =
-        adler32(current_meshinfo->CheckSum,
-                (unsigned char *) &p_end,
-                sizeof(itk::Index<3>::IndexValueType));
-    }
+  // A mesh is stored under the voxel count and checksum of its label, so it
+  // is only stored if these were computed from the image that is meshed
+  m_UpdateWritesCache = m_MeshCacheWriteEnabled
+      && m_MeshCacheDirectory.size() && (snapshot || !stats);
+
+  // The meshes of marching cubes can be updated around the edited region
+  m_UpdateRegionKnown = (modified != NULL);
+  if(modified)
+    m_UpdateRegion = *modified;
 
-  // Update the extents
-  unsigned long run_length = pos - run_start[0];
-  if(current_meshinfo->Count == 0)
+  // A request to stop a previous update does not apply to this one
     {
-    current_meshinfo->BoundingBox[0] = run_start;
-    current_meshinfo->BoundingBox[1] = run_end;
+    LockHolder holder(m_MeshInfoLock);
+    m_UpdateAborted = false;
     }
-  else
+
+  // Compute the statistics if they were not supplied
+  LabelStatisticsTable local_stats;
+  if(!stats)
     {
-    for(int d = 0; d < 3; d++)
-      {
-      if(run_start[d] < current_meshinfo->BoundingBox[0][d])
-        current_meshinfo->BoundingBox[0][d] = run_start[d];
-      if(run_end[d] > current_meshinfo->BoundingBox[1][d])
-        current_meshinfo->BoundingBox[1][d] = run_end[d];
-      }
+    local_stats.Compute(m_UpdateImage);
+    stats = &local_stats;
     }
 
-  // Add the number of pixels traversed to the index
-  current_meshinfo->Count += run_length;
-}
-
-void MultiLabelMeshPipeline::UpdateMeshes(itk::Command *progressCommand)
-{
-  // Create a temporary table of mesh info
+  // Create a temporary table of mesh info from the voxel count, extent and
+  // checksum of every label, except the clear label
   MeshInfoMap meshmap;
-
-  // Current label and current mesh map
-  LabelType current_label = 0;
-  MeshInfo *current_meshinfo = NULL;
-  itk::Index<3> run_start;
-
-  // The length of a line
-  unsigned long line_length = m_InputImage->GetLargestPossibleRegion().GetSize()[0];
-
-  // Iterate through the image updating the mesh map. This code takes advantage
-  // of the organization of label data. Rather than updating the extents after
-  // each pixel read, the code collects runs of pixels of the same label and
-  // updates once the run ends (a pixel of another label is found or the end
-  // of a line of pixels is reached). This makes for much more efficient code.
-  typedef itk::ImageRegionConstIteratorWithIndex<InputImageType> InputIterator;
-  InputIterator it(m_InputImage, m_InputImage->GetLargestPossibleRegion());
-  while( !it.IsAtEnd() )
+  const LabelStatisticsTable::EntryMap &entries = stats->GetEntries();
+  for(LabelStatisticsTable::EntryMap::const_iterator it = entries.begin();
+      it != entries.end(); ++it)
     {
-    run_start = it.GetIndex();
-    const InputIterator::RLLine &line=*(it.rlLine);
-    int t = 0;
-    // Iterate through the line
-    for (int x = 0; x < line.size(); x++)
+    if(it->first != 0)
       {
-      run_start[0] = t;
-      current_label = line[x].second;
-      t += line[x].first;
-      if (current_label != 0)
-        {
-        current_meshinfo = &meshmap[current_label];
-        // Update the current mesh info
-        UpdateMeshInfoHelper(current_meshinfo, run_start, it, t);
-        current_meshinfo = &meshmap[current_label];
-        }
+      MeshInfo &mi = meshmap[it->first];
+      mi.Count = it->second.Count;
+      mi.CheckSum = it->second.CheckSum;
+      mi.BoundingBox[0] = it->second.BoundingBox[0];
+      mi.BoundingBox[1] = it->second.BoundingBox[1];
       }
-    ++(it.bi);
-    it.rlLine = &it.bi.Value();
     }
 
   // At this point, meshmap has the number of voxels for every label, as well
@@ -249,12 +251,22 @@ void MultiLabelMeshPipeline::UpdateMeshes(itk::Command *progressCommand)
 
   // First we go through the stored mesh map and delete all meshes that are no
   // longer present in the image
-  for(MeshInfoMap::iterator it = m_MeshInfo.begin(); it != m_MeshInfo.end();)
+  bool removed = false;
     {
-    if(meshmap.find(it->first) == meshmap.end())
-      m_MeshInfo.erase(it++);
-    else
-      it++;
+    LockHolder holder(m_MeshInfoLock);
+    for(MeshInfoMap::iterator it = m_MeshInfo.begin(); it != m_MeshInfo.end();)
+      {
+      if(meshmap.find(it->first) == meshmap.end())
+        {
+        m_MeshInfo.erase(it++);
+        removed = true;
+        }
+      else
+        it++;
+      }
+
+    if(removed)
+      m_MeshCollectionTime.Modified();
     }
 
 
@@ -262,62 +274,97 @@ void MultiLabelMeshPipeline::UpdateMeshes(itk::Command *progressCommand)
   SmartPtr<AllPurposeProgressAccumulator> progress = AllPurposeProgressAccumulator::New();
   progress->AddObserver(itk::ProgressEvent(), progressCommand);
 
-  // Next we check which meshes are new or updated and mark them as needing to
-  // be recomputed
+  // Next we check which meshes are new or updated. The new meshes are built
+  // separately, and the old ones remain available for display until they are
+  // replaced by PublishMesh()
+  MeshInfoMap pending;
+  std::vector<LabelType> dirty;
   for(MeshInfoMap::const_iterator it = meshmap.begin(); it != meshmap.end(); ++it)
     {
     // Get the cached mesh info for this label
-    MeshInfo &info = m_MeshInfo[it->first];
+    MeshInfoMap::const_iterator itm = m_MeshInfo.find(it->first);
 
     // Compare the values
-    if(info.Count != it->second.Count || info.CheckSum != it->second.CheckSum)
+    if(itm == m_MeshInfo.end()
+       || itm->second.Count != it->second.Count
+       || itm->second.CheckSum != it->second.CheckSum)
       {
-      // Cache the current information
-      info.CheckSum = it->second.CheckSum;
-      info.Count = it->second.Count;
-      info.BoundingBox[0] = it->second.BoundingBox[0];
-      info.BoundingBox[1] = it->second.BoundingBox[1];
-      info.Mesh = NULL;
-
-      // Capture progress from this mesh
-      progress->RegisterSource(m_VTKPipeline->GetProgressAccumulator(), info.Count);
+      MeshInfo &info = pending[it->first];
+      info = it->second;
+      info.Mesh = vtkSmartPointer<vtkPolyData>::New();
+      dirty.push_back(it->first);
       }
     }
 
-  // Now compute the meshes
-  for(MeshInfoMap::iterator it = m_MeshInfo.begin(); it != m_MeshInfo.end(); it++)
+  // The meshes computed with marching cubes may already be in the cache.
+  // The ones that are found are published right away
+  if(m_MeshCacheDirectory.size()
+     && m_MeshOptions->GetMeshingMethod() == MeshOptions::MESH_MARCHING_CUBES)
     {
-    if(it->second.Mesh == NULL)
+    std::vector<LabelType> missing;
+    for(size_t i = 0; i < dirty.size(); i++)
       {
-      // Create the mesh
-      MeshInfo &mi = it->second;
-      mi.Mesh = vtkSmartPointer<vtkPolyData>::New();
+      MeshInfo &mi = pending[dirty[i]];
+      if(this->ReadCachedMesh(mi))
+        this->PublishMesh(dirty[i], mi);
+      else
+        missing.push_back(dirty[i]);
+      }
+    dirty.swap(missing);
+    }
 
-      // TODO: make this more elegant
-      InputImageType::RegionType bbWiderRegion;
-      for(int d = 0; d < 3; d++)
-        {
-        unsigned long len =
-            (unsigned long) (1 + mi.BoundingBox[1][d] - mi.BoundingBox[0][d]);
-        bbWiderRegion.SetIndex(d, mi.BoundingBox[0][d]);
-        bbWiderRegion.SetSize(d, len);
-        }
-      bbWiderRegion.PadByRadius(5);
-      bbWiderRegion.Crop(m_InputImage->GetLargestPossibleRegion());
+  if(m_MeshOptions->GetMeshingMethod() == MeshOptions::MESH_MULTILABEL_SINGLE_PASS)
+    {
+    // The cached surfaces must also be updated when a label is erased
+    if(dirty.size() || removed)
+      this->ComputeMeshesSinglePass(progress, meshmap, dirty, modified);
+    }
+  else if(m_NumberOfThreads > 1 && dirty.size() > 1)
+    {
+    this->ComputeMeshesInParallel(pending, dirty, progress);
+    }
+  else
+    {
+    // Capture progress from each mesh
+    for(size_t i = 0; i < dirty.size(); i++)
+      progress->RegisterSource(m_VTKPipeline->GetProgressAccumulator(),
+                               pending[dirty[i]].Count);
+
+    // Now compute the meshes
+    for(size_t i = 0; i < dirty.size() && !this->IsUpdateAborted(); i++)
+      {
+      MeshInfo &mi = pending[dirty[i]];
+
+      // If the label was only edited in part of its bounding box, only that
+      // part is meshed again
+      InputImageType::RegionType region = this->GetMeshRegion(mi), cells;
+      vtkSmartPointer<vtkPolyData> base;
+      bool partial = this->GetPartialMeshRegion(dirty[i], region, cells, base);
 
       // Pass the region to the ROI filter and propagate the filter
-      m_ROIFilter->SetInput(m_InputImage);
-      m_ROIFilter->SetRegionOfInterest(bbWiderRegion);
+      m_ROIFilter->SetInput(m_UpdateImage);
+      m_ROIFilter->SetRegionOfInterest(region);
       m_ROIFilter->Update();
 
       // Set the parameters for the thresholding filter
-      m_ThrehsoldFilter->SetLowerThreshold(it->first);
-      m_ThrehsoldFilter->SetUpperThreshold(it->first);
+      m_ThrehsoldFilter->SetLowerThreshold(dirty[i]);
+      m_ThrehsoldFilter->SetUpperThreshold(dirty[i]);
       m_ThrehsoldFilter->UpdateLargestPossibleRegion();
 
       // Graft the polydata to the last filter in the pipeline
       m_VTKPipeline->SetImage(m_ThrehsoldFilter->GetOutput());
-      m_VTKPipeline->ComputeMesh(it->second.Mesh);
+      if(partial)
+        {
+        vtkSmartPointer<vtkPolyData> part = vtkSmartPointer<vtkPolyData>::New();
+        m_VTKPipeline->ComputeMesh(part);
+        this->MergePartialMesh(base, part, cells, mi.Mesh);
+        }
+      else
+        {
+        m_VTKPipeline->ComputeMesh(mi.Mesh);
+        }
+      this->PublishMesh(dirty[i], mi);
+      this->WriteCachedMesh(mi);
 
       // Update progress
       progress->StartNextRun(m_VTKPipeline->GetProgressAccumulator());
@@ -327,8 +374,675 @@ void MultiLabelMeshPipeline::UpdateMeshes(itk::Command *progressCommand)
   // Clean up the progress
   progress->UnregisterAllSources();
 
-  // Set the modified flag, so we can use the pipeline's MTime
-  this->Modified();
+  // Keep the cache within its size if meshes were added to it
+  if(m_UpdateWritesCache && dirty.size()
+     && m_MeshOptions->GetMeshingMethod() == MeshOptions::MESH_MARCHING_CUBES)
+    this->PruneMeshCache();
+  m_UpdateWritesCache = false;
+  m_UpdateRegionKnown = false;
+
+  // Release the snapshot, which the ROI filter no longer needs either
+  m_ROIFilter->SetInput(m_InputImage);
+  m_UpdateImage = NULL;
+
+  // If the update was stopped early, some of the meshes are still out of
+  // date, and the pipeline is left looking older than the image
+  if(!this->IsUpdateAborted())
+    {
+    // The meshes now describe the image as it was when the statistics were
+    // captured
+    m_MeshImageMTime = imageMTime ? imageMTime : m_InputImage->GetMTime();
+
+    // Set the modified flag, so we can use the pipeline's MTime
+    this->Modified();
+    }
+}
+
+void
+MultiLabelMeshPipeline
+::PublishMesh(LabelType label, const MeshInfo &info)
+{
+  itk::MutexLockHolder<itk::SimpleFastMutexLock> holder(m_MeshInfoLock);
+  m_MeshInfo[label] = info;
+  m_MeshCollectionTime.Modified();
+}
+
+void
+MultiLabelMeshPipeline
+::AbortUpdate()
+{
+  itk::MutexLockHolder<itk::SimpleFastMutexLock> holder(m_MeshInfoLock);
+  m_UpdateAborted = true;
+}
+
+bool
+MultiLabelMeshPipeline
+::IsUpdateAborted() const
+{
+  itk::MutexLockHolder<itk::SimpleFastMutexLock> holder(m_MeshInfoLock);
+  return m_UpdateAborted;
+}
+
+itk::ModifiedTimeType
+MultiLabelMeshPipeline
+::GetMeshCollectionMTime() const
+{
+  itk::MutexLockHolder<itk::SimpleFastMutexLock> holder(m_MeshInfoLock);
+  return m_MeshCollectionTime.GetMTime();
+}
+
+// Get the MD5 hash of a string, in hexadecimal
+static std::string MeshCacheHash(const std::string &text)
+{
+  char hex_code[33];
+  hex_code[32] = 0;
+  itksysMD5 *md5 = itksysMD5_New();
+  itksysMD5_Initialize(md5);
+  itksysMD5_Append(md5, (unsigned char *) text.c_str(), text.size());
+  itksysMD5_FinalizeHex(md5, hex_code);
+  itksysMD5_Delete(md5);
+  return std::string(hex_code);
+}
+
+void
+MultiLabelMeshPipeline
+::UpdateMeshOptionsHash()
+{
+  // Hash all the options as they are written to the registry
+  Registry folder;
+  m_MeshOptions->WriteToRegistry(folder);
+
+  Registry::StringListType keys;
+  folder.CollectKeys(keys);
+
+  std::ostringstream oss;
+  for(Registry::StringListType::iterator it = keys.begin(); it != keys.end(); ++it)
+    oss << *it << "=" << folder[*it].GetInternalString() << ";";
+  m_MeshOptionsHash = MeshCacheHash(oss.str());
+}
+
+std::string
+MultiLabelMeshPipeline
+::GetMeshCacheFileName(const MeshInfo &mi) const
+{
+  // The mesh of a label depends only on the positions of its voxels, which
+  // are identified by the voxel count and checksum, on the geometry of the
+  // image, and on the mesh options. The bounding box is not part of the key,
+  // since it is not always tight, and the label itself is not either, so the
+  // meshes are reused when a structure is relabeled
+  std::ostringstream oss;
+  oss << std::setprecision(17) << m_MeshOptionsHash << ";"
+      << m_UpdateImage->GetLargestPossibleRegion().GetSize() << ";"
+      << m_UpdateImage->GetOrigin() << ";"
+      << m_UpdateImage->GetSpacing() << ";"
+      << m_UpdateImage->GetDirection() << ";"
+      << mi.Count << ";" << mi.CheckSum;
+  return m_MeshCacheDirectory + "/mesh_" + MeshCacheHash(oss.str()) + ".vtp";
+}
+
+bool
+MultiLabelMeshPipeline
+::ReadCachedMesh(MeshInfo &mi) const
+{
+  if(m_MeshCacheDirectory.empty())
+    return false;
+
+  std::string fn = this->GetMeshCacheFileName(mi);
+  if(!itksys::SystemTools::FileExists(fn.c_str(), true))
+    return false;
+
+  // A file that cannot be read is treated as a miss, and is replaced when
+  // the mesh is computed
+  vtkSmartPointer<vtkXMLPolyDataReader> reader = vtkSmartPointer<vtkXMLPolyDataReader>::New();
+  reader->SetFileName(fn.c_str());
+  reader->Update();
+  if(reader->GetErrorCode() != vtkErrorCode::NoError
+     || reader->GetOutput()->GetNumberOfPoints() == 0)
+    return false;
+
+  mi.Mesh->ShallowCopy(reader->GetOutput());
+
+  // The modification time of the files orders them by last use, so that the
+  // meshes that were used recently are kept when the cache is pruned
+  itksys::SystemTools::Touch(fn, false);
+  return true;
+}
+
+void
+MultiLabelMeshPipeline
+::WriteCachedMesh(const MeshInfo &mi) const
+{
+  if(!m_UpdateWritesCache
+     || !itksys::SystemTools::MakeDirectory(m_MeshCacheDirectory.c_str()))
+    return;
+
+  // The mesh is written to a temporary file that is then renamed, so that
+  // an incomplete file is never found in the cache. The appended binary data
+  // is compressed with zlib by the writer
+  std::string fn = this->GetMeshCacheFileName(mi);
+  std::string fn_temp = fn + ".tmp";
+
+  vtkSmartPointer<vtkXMLPolyDataWriter> writer = vtkSmartPointer<vtkXMLPolyDataWriter>::New();
+  writer->SetInputData(mi.Mesh);
+  writer->SetFileName(fn_temp.c_str());
+  writer->SetDataModeToAppended();
+  writer->EncodeAppendedDataOff();
+
+  if(writer->Write())
+    itksys::SystemTools::RenameFile(fn_temp.c_str(), fn.c_str());
+  else
+    itksys::SystemTools::RemoveFile(fn_temp.c_str());
+}
+
+// A file in the mesh cache
+struct MultiLabelMeshCacheFile
+{
+  long Time;
+  unsigned long Size;
+  std::string Path;
+
+  bool operator < (const MultiLabelMeshCacheFile &other) const
+    { return Time < other.Time; }
+};
+
+void
+MultiLabelMeshPipeline
+::PruneMeshCache() const
+{
+  itksys::Directory dir;
+  if(!dir.Load(m_MeshCacheDirectory.c_str()))
+    return;
+
+  // Find the cached meshes and their total size
+  std::vector<MultiLabelMeshCacheFile> files;
+  unsigned long long total = 0;
+  for(unsigned long i = 0; i < dir.GetNumberOfFiles(); i++)
+    {
+    std::string name = dir.GetFile(i);
+    if(name.compare(0, 5, "mesh_") != 0
+       || itksys::SystemTools::GetFilenameLastExtension(name) != ".vtp")
+      continue;
+
+    MultiLabelMeshCacheFile file;
+    file.Path = m_MeshCacheDirectory + "/" + name;
+    file.Time = itksys::SystemTools::ModifiedTime(file.Path.c_str());
+    file.Size = itksys::SystemTools::FileLength(file.Path.c_str());
+    files.push_back(file);
+    total += file.Size;
+    }
+
+  // Remove the least recently used meshes first
+  unsigned long long limit = ((unsigned long long) m_MeshCacheSizeInMB) << 20;
+  std::sort(files.begin(), files.end());
+  for(size_t i = 0; i < files.size() && total > limit; i++)
+    {
+    if(itksys::SystemTools::RemoveFile(files[i].Path.c_str()))
+      total -= files[i].Size;
+    }
+}
+
+MultiLabelMeshPipeline::InputImageType::RegionType
+MultiLabelMeshPipeline
+::GetMeshRegion(const MeshInfo &mi) const
+{
+  // TODO: make this more elegant
+  InputImageType::RegionType bbWiderRegion;
+  for(int d = 0; d < 3; d++)
+    {
+    unsigned long len =
+        (unsigned long) (1 + mi.BoundingBox[1][d] - mi.BoundingBox[0][d]);
+    bbWiderRegion.SetIndex(d, mi.BoundingBox[0][d]);
+    bbWiderRegion.SetSize(d, len);
+    }
+  bbWiderRegion.PadByRadius(5);
+  bbWiderRegion.Crop(m_UpdateImage->GetLargestPossibleRegion());
+  return bbWiderRegion;
+}
+
+bool
+MultiLabelMeshPipeline
+::GetPartialMeshRegion(LabelType label,
+                       InputImageType::RegionType &region,
+                       InputImageType::RegionType &cells,
+                       vtkSmartPointer<vtkPolyData> &base) const
+{
+  // Decimation and mesh smoothing move vertices across the whole mesh, so
+  // the triangles away from the edit would not match the previous mesh
+  if(!m_UpdateRegionKnown
+     || m_MeshOptions->GetUseDecimation()
+     || m_MeshOptions->GetUseMeshSmoothing())
+    return false;
+
+  // The previous mesh must be up to date with the current options
+    {
+    itk::MutexLockHolder<itk::SimpleFastMutexLock> holder(m_MeshInfoLock);
+    MeshInfoMap::const_iterator it = m_MeshInfo.find(label);
+    if(it == m_MeshInfo.end() || it->second.Count == 0 || !it->second.Mesh)
+      return false;
+    base = it->second.Mesh;
+    }
+
+  // The edit changes the smoothed image up to the radius of the Gaussian
+  // kernel, and the cells of marching cubes reach one voxel further. The
+  // radius of the VTK kernel is given in voxels
+  int reach = 1;
+  if(m_MeshOptions->GetUseGaussianSmoothing())
+    reach += (int) ceil(1.5 * m_MeshOptions->GetGaussianStandardDeviation());
+
+  cells = m_UpdateRegion;
+  cells.PadByRadius(reach);
+
+  // The smoothed image and its gradient, from which the normals are computed,
+  // must be the same in these cells as in the whole bounding box
+  InputImageType::RegionType part = cells;
+  part.PadByRadius(reach + 1);
+  if(!part.Crop(region))
+    return false;
+
+  // Meshing a large part of the box again is not worth the merge
+  if(2 * part.GetNumberOfPixels() > region.GetNumberOfPixels())
+    return false;
+
+  region = part;
+  return true;
+}
+
+void
+MultiLabelMeshPipeline
+::MergePartialMesh(vtkPolyData *base, vtkPolyData *part,
+                   const InputImageType::RegionType &cells,
+                   vtkPolyData *out) const
+{
+  // The vertices are in NIFTI/RAS space, and the triangles are assigned to
+  // the cells in voxel coordinates. A triangle lies in the cell that holds
+  // its centroid, and cell k spans the voxels k to k+1
+  vnl_matrix_fixed<double, 4, 4> nii2vox = vnl_inverse(
+    ImageWrapperBase::ConstructNiftiSform(
+      m_UpdateImage->GetDirection().GetVnlMatrix(),
+      m_UpdateImage->GetOrigin().GetVnlVector(),
+      m_UpdateImage->GetSpacing().GetVnlVector()));
+
+  double lo[3], hi[3], spacing = m_UpdateImage->GetSpacing()[0];
+  for(int d = 0; d < 3; d++)
+    {
+    lo[d] = cells.GetIndex(d);
+    hi[d] = cells.GetIndex(d) + (double) cells.GetSize(d);
+    spacing = std::min(spacing, (double) m_UpdateImage->GetSpacing()[d]);
+    }
+
+  // Take the triangles outside of the cells from the previous mesh, and the
+  // ones inside from the new mesh
+  vtkSmartPointer<vtkAppendPolyData> append = vtkSmartPointer<vtkAppendPolyData>::New();
+  vtkPolyData *meshes[] = { base, part };
+  for(int m = 0; m < 2; m++)
+    {
+    // The meshes are made of triangle strips
+    vtkSmartPointer<vtkTriangleFilter> triangles = vtkSmartPointer<vtkTriangleFilter>::New();
+    triangles->SetInputData(meshes[m]);
+    triangles->PassVertsOff();
+    triangles->PassLinesOff();
+    triangles->Update();
+    vtkPolyData *mesh = triangles->GetOutput();
+
+    vtkSmartPointer<vtkCellArray> polys = vtkSmartPointer<vtkCellArray>::New();
+    vtkSmartPointer<vtkIdList> ids = vtkSmartPointer<vtkIdList>::New();
+    for(vtkIdType c = 0; c < mesh->GetNumberOfCells(); c++)
+      {
+      mesh->GetCellPoints(c, ids);
+      vnl_vector_fixed<double, 4> x(0.0, 0.0, 0.0, 1.0);
+      for(vtkIdType j = 0; j < ids->GetNumberOfIds(); j++)
+        {
+        double p[3];
+        mesh->GetPoint(ids->GetId(j), p);
+        for(int d = 0; d < 3; d++)
+          x[d] += p[d] / ids->GetNumberOfIds();
+        }
+
+      vnl_vector_fixed<double, 4> y = nii2vox * x;
+      bool inside = true;
+      for(int d = 0; d < 3; d++)
+        inside = inside && y[d] >= lo[d] && y[d] < hi[d];
+
+      if(inside == (m == 1))
+        polys->InsertNextCell(ids);
+      }
+
+    vtkSmartPointer<vtkPolyData> piece = vtkSmartPointer<vtkPolyData>::New();
+    piece->SetPoints(mesh->GetPoints());
+    piece->GetPointData()->PassData(mesh->GetPointData());
+    piece->SetPolys(polys);
+    append->AddInputData(piece);
+    }
+
+  // The cells on either side of the boundary share the vertices on their
+  // common faces, which only differ by rounding between the two meshes
+  vtkSmartPointer<vtkCleanPolyData> clean = vtkSmartPointer<vtkCleanPolyData>::New();
+  clean->SetInputConnection(append->GetOutputPort());
+  clean->PointMergingOn();
+  clean->ToleranceIsAbsoluteOn();
+  clean->SetAbsoluteTolerance(1.0e-3 * spacing);
+  clean->ConvertPolysToLinesOff();
+  clean->ConvertLinesToPointsOff();
+  clean->ConvertStripsToPolysOff();
+
+  // Strip the triangles, as the mesh pipeline does
+  vtkSmartPointer<vtkStripper> stripper = vtkSmartPointer<vtkStripper>::New();
+  stripper->SetInputConnection(clean->GetOutputPort());
+  stripper->Update();
+
+  out->ShallowCopy(stripper->GetOutput());
+}
+
+struct MultiLabelMeshPipeline::ParallelMeshData
+{
+  MultiLabelMeshPipeline *Pipeline;
+
+  // The new meshes being computed
+  MeshInfoMap *Pending;
+
+  // The labels to compute, and the index of the next label to hand out
+  std::vector<LabelType> Labels;
+  size_t Next;
+
+  // Aggregate progress, measured in voxels of the labels that are done
+  TrivalProgressSource::Pointer Progress;
+
+  // The first error encountered by any of the threads
+  bool Failed;
+  itk::ExceptionObject Error;
+
+  // Guards the fields above and the pipeline of the input image
+  itk::SimpleFastMutexLock Lock;
+};
+
+// Orders labels by decreasing voxel count
+struct MultiLabelMeshCountGreater
+{
+  const MultiLabelMeshPipeline::MeshInfoMap *Info;
+  bool operator() (LabelType a, LabelType b) const
+    { return Info->find(a)->second.Count > Info->find(b)->second.Count; }
+};
+
+void
+MultiLabelMeshPipeline
+::ComputeMeshesInParallel(MeshInfoMap &pending,
+                          std::vector<LabelType> &labels,
+                          AllPurposeProgressAccumulator *progress)
+{
+  // Hand out the largest labels first, so that no thread is left with a big
+  // label at the end while the others are idle
+  MultiLabelMeshCountGreater cmp;
+  cmp.Info = &pending;
+  std::sort(labels.begin(), labels.end(), cmp);
+
+  ParallelMeshData td;
+  td.Pipeline = this;
+  td.Pending = &pending;
+  td.Labels = labels;
+  td.Next = 0;
+  td.Failed = false;
+
+  // Progress is reported as the labels are completed, weighted by the voxel
+  // counts, since the threads cannot share the accumulator of a VTK pipeline
+  unsigned long total = 0;
+  for(size_t i = 0; i < labels.size(); i++)
+    total += pending[labels[i]].Count;
+
+  td.Progress = TrivalProgressSource::New();
+  progress->RegisterSource(td.Progress, 1.0);
+  td.Progress->StartProgress(total);
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetNumberOfThreads(std::min(m_NumberOfThreads, (int) labels.size()));
+  threader->SetSingleMethod(&MultiLabelMeshPipeline::ParallelMeshCallback, &td);
+  threader->SingleMethodExecute();
+
+  td.Progress->EndProgress();
+
+  // The labels that were not computed keep their old meshes
+  if(td.Failed)
+    throw td.Error;
+}
+
+ITK_THREAD_RETURN_TYPE
+MultiLabelMeshPipeline
+::ParallelMeshCallback(void *arg)
+{
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfo;
+  typedef itk::MutexLockHolder<itk::SimpleFastMutexLock> LockHolder;
+  ThreadInfo *info = static_cast<ThreadInfo *>(arg);
+  ParallelMeshData *td = static_cast<ParallelMeshData *>(info->UserData);
+  MultiLabelMeshPipeline *self = td->Pipeline;
+
+  // Each thread has its own threshold filter and VTK pipeline. The threads
+  // already occupy the cores, so the filters themselves run single-threaded
+  ThresholdFilterPointer threshold = ThresholdFilter::New();
+  threshold->SetInsideValue(1.0f);
+  threshold->SetOutsideValue(-1.0f);
+  threshold->SetNumberOfThreads(1);
+
+  VTKMeshPipeline vtkPipeline;
+  vtkPipeline.SetMeshOptions(self->m_MeshOptions);
+
+  while(true)
+    {
+    try
+      {
+      LabelType label;
+      MeshInfo *mi;
+      InputImagePointer box;
+      InputImageType::RegionType cells;
+      vtkSmartPointer<vtkPolyData> base;
+      bool partial;
+
+      // Take the next label and extract its bounding box. Updating the
+      // pipeline of the shared input image is not thread-safe, so this
+      // happens while holding the lock
+        {
+        LockHolder holder(td->Lock);
+        if(td->Failed || td->Next >= td->Labels.size() || self->IsUpdateAborted())
+          break;
+
+        label = td->Labels[td->Next++];
+        mi = &(*td->Pending)[label];
+
+        InputImageType::RegionType region = self->GetMeshRegion(*mi);
+        partial = self->GetPartialMeshRegion(label, region, cells, base);
+
+        ROIFilterPointer roi = ROIFilter::New();
+        roi->SetInput(self->m_UpdateImage);
+        roi->SetRegionOfInterest(region);
+        roi->Update();
+
+        box = roi->GetOutput();
+        box->DisconnectPipeline();
+        }
+
+      threshold->SetInput(box);
+      threshold->SetLowerThreshold(label);
+      threshold->SetUpperThreshold(label);
+      threshold->UpdateLargestPossibleRegion();
+
+      vtkPipeline.SetImage(threshold->GetOutput());
+      if(partial)
+        {
+        vtkSmartPointer<vtkPolyData> part = vtkSmartPointer<vtkPolyData>::New();
+        vtkPipeline.ComputeMesh(part);
+        self->MergePartialMesh(base, part, cells, mi->Mesh);
+        }
+      else
+        {
+        vtkPipeline.ComputeMesh(mi->Mesh);
+        }
+      self->PublishMesh(label, *mi);
+      self->WriteCachedMesh(*mi);
+
+      LockHolder holder(td->Lock);
+      td->Progress->AddProgress(mi->Count);
+      }
+    catch(itk::ExceptionObject &exc)
+      {
+      LockHolder holder(td->Lock);
+      td->Failed = true;
+      td->Error = exc;
+      break;
+      }
+    catch(std::exception &exc)
+      {
+      LockHolder holder(td->Lock);
+      td->Failed = true;
+      td->Error = itk::ExceptionObject(__FILE__, __LINE__, exc.what());
+      break;
+      }
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+void
+MultiLabelMeshPipeline
+::ComputeMeshesSinglePass(AllPurposeProgressAccumulator *progress,
+                          const MeshInfoMap &meshmap,
+                          const std::vector<LabelType> &dirty,
+                          const itk::ImageRegion<3> *modified)
+{
+  // The extractor reports the fraction of bricks processed
+  void *source = progress->RegisterGenericSource(1, 1.0);
+  MultiLabelSurfaceExtractor *extractor = m_SurfaceExtractor;
+  extractor->SetProgressCallback(
+        &AllPurposeProgressAccumulator::GenericProgressCallback, source);
+
+  // If the edited region is known, only the bricks around it are extracted
+  bool partial = modified && extractor->HasBricks();
+  if(partial)
+    extractor->Update(m_UpdateImage, *modified);
+  else
+    extractor->Extract(m_UpdateImage);
+
+  if(this->IsUpdateAborted())
+    return;
+
+  // Smoothing moves the vertices of all the surfaces, so they must all be
+  // rebuilt in that case
+  if(m_MeshOptions->GetUseMeshSmoothing())
+    {
+    extractor->Smooth(m_MeshOptions->GetMeshSmoothingIterations());
+    partial = false;
+    }
+
+  // The labels whose meshes are rebuilt
+  MultiLabelSurfaceExtractor::LabelSet rebuild = extractor->GetModifiedLabels();
+  rebuild.insert(dirty.begin(), dirty.end());
+
+  // The vertices are in voxel coordinates, map them to NIFTI/RAS space
+  vnl_matrix_fixed<double, 4, 4> vox2nii =
+    ImageWrapperBase::ConstructNiftiSform(
+      m_UpdateImage->GetDirection().GetVnlMatrix(),
+      m_UpdateImage->GetOrigin().GetVnlVector(),
+      m_UpdateImage->GetSpacing().GetVnlVector());
+
+  // If the transform flips orientation, so must the triangles, to keep them
+  // facing outwards
+  double det =
+      vox2nii(0,0) * (vox2nii(1,1) * vox2nii(2,2) - vox2nii(1,2) * vox2nii(2,1))
+    - vox2nii(0,1) * (vox2nii(1,0) * vox2nii(2,2) - vox2nii(1,2) * vox2nii(2,0))
+    + vox2nii(0,2) * (vox2nii(1,0) * vox2nii(2,1) - vox2nii(1,1) * vox2nii(2,0));
+  bool flip = det < 0;
+
+  const std::vector<float> &points = extractor->GetPoints();
+  const MultiLabelSurfaceExtractor::TriangleMap &triangles = extractor->GetTriangles();
+
+  // Index of each shared vertex in the mesh being built, or -1
+  std::vector<vtkIdType> local(points.size() / 3, -1);
+  std::vector<unsigned int> used;
+
+  for(MeshInfoMap::const_iterator it = meshmap.begin();
+      it != meshmap.end() && !this->IsUpdateAborted(); ++it)
+    {
+    // Labels whose surfaces did not change keep their meshes
+    if(partial && rebuild.find(it->first) == rebuild.end())
+      continue;
+
+    MeshInfo info = it->second;
+    info.Mesh = vtkSmartPointer<vtkPolyData>::New();
+
+    MultiLabelSurfaceExtractor::TriangleMap::const_iterator itt = triangles.find(it->first);
+    if(itt == triangles.end())
+      {
+      this->PublishMesh(it->first, info);
+      continue;
+      }
+
+    vtkSmartPointer<vtkPoints> meshPoints = vtkSmartPointer<vtkPoints>::New();
+    vtkSmartPointer<vtkCellArray> meshPolys = vtkSmartPointer<vtkCellArray>::New();
+    const MultiLabelSurfaceExtractor::TriangleList &tri = itt->second;
+    for(size_t t = 0; t < tri.size(); t += 3)
+      {
+      vtkIdType ids[3];
+      for(int k = 0; k < 3; k++)
+        {
+        unsigned int v = tri[t + k];
+        if(local[v] < 0)
+          {
+          vnl_vector_fixed<double, 4> x(points[3 * v], points[3 * v + 1], points[3 * v + 2], 1.0);
+          vnl_vector_fixed<double, 4> y = vox2nii * x;
+          local[v] = meshPoints->InsertNextPoint(y[0], y[1], y[2]);
+          used.push_back(v);
+          }
+        ids[k] = local[v];
+        }
+
+      if(flip)
+        std::swap(ids[1], ids[2]);
+      meshPolys->InsertNextCell(3, ids);
+      }
+
+    for(size_t i = 0; i < used.size(); i++)
+      local[used[i]] = -1;
+    used.clear();
+
+    vtkSmartPointer<vtkPolyData> mesh = vtkSmartPointer<vtkPolyData>::New();
+    mesh->SetPoints(meshPoints);
+    mesh->SetPolys(meshPolys);
+
+    // Compute the normals for rendering
+    vtkSmartPointer<vtkPolyDataNormals> normals = vtkSmartPointer<vtkPolyDataNormals>::New();
+    normals->SetInputData(mesh);
+    normals->SplittingOff();
+    normals->ConsistencyOff();
+    normals->Update();
+
+    info.Mesh->ShallowCopy(normals->GetOutput());
+    this->PublishMesh(it->first, info);
+    }
+}
+
+bool
+MultiLabelMeshPipeline
+::IsOutOfDate(const LabelStatisticsTable &stats) const
+{
+  itk::MutexLockHolder<itk::SimpleFastMutexLock> holder(m_MeshInfoLock);
+
+  // Every non-clear label in the table must have an up to date mesh
+  size_t n_labels = 0;
+  const LabelStatisticsTable::EntryMap &entries = stats.GetEntries();
+  for(LabelStatisticsTable::EntryMap::const_iterator it = entries.begin();
+      it != entries.end(); ++it)
+    {
+    if(it->first == 0)
+      continue;
+
+    MeshInfoMap::const_iterator itm = m_MeshInfo.find(it->first);
+    if(itm == m_MeshInfo.end()
+       || itm->second.Count != it->second.Count
+       || itm->second.CheckSum != it->second.CheckSum)
+      return true;
+
+    n_labels++;
+    }
+
+  // And there must be no meshes for labels that are gone
+  return n_labels != m_MeshInfo.size();
 }
 
 void 
@@ -337,8 +1051,12 @@ MultiLabelMeshPipeline
 {
   if(m_InputImage != image)
     {
+    itk::MutexLockHolder<itk::SimpleFastMutexLock> holder(m_MeshInfoLock);
     m_InputImage = image;
     m_MeshInfo.clear();
+    m_MeshCollectionTime.Modified();
+    m_SurfaceExtractor->Clear();
+    m_MeshImageMTime = 0;
     }
 }
 
@@ -347,7 +1065,7 @@ MultiLabelMeshPipeline::MeshInfo::MeshInfo()
 {
   this->Mesh = NULL;
   this->Count = 0;
-  this->CheckSum = adler32(0L, NULL, 0);
+  this->CheckSum = 0;
 }
 
 MultiLabelMeshPipeline::MeshInfo::~MeshInfo()
@@ -357,6 +1075,7 @@ MultiLabelMeshPipeline::MeshInfo::~MeshInfo()
 
 std::map<LabelType, vtkSmartPointer<vtkPolyData> > MultiLabelMeshPipeline::GetMeshCollection()
 {
+  itk::MutexLockHolder<itk::SimpleFastMutexLock> holder(m_MeshInfoLock);
   std::map<LabelType, vtkSmartPointer<vtkPolyData> > meshes;
   for(MeshInfoMap::iterator it = m_MeshInfo.begin(); it != m_MeshInfo.end(); ++it)
     meshes[it->first] = it->second.Mesh;
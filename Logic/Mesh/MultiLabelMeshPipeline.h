@@ -41,9 +41,13 @@
 #include "vtkSmartPointer.h"
 #include "itksys/MD5.h"
 #include "itkObjectFactory.h"
+#include "itkMultiThreader.h"
+#include "itkSimpleFastMutexLock.h"
+#include "itkTimeStamp.h"
 #include "ImageWrapperTraits.h"
 #include "RLERegionOfInterestImageFilter.h"
 #include "RLEImageScanlineIterator.h"
+#include "LabelStatisticsTable.h"
 
 
 // Forward reference to itk classes
@@ -59,6 +63,7 @@ class MeshOptions;
 class VTKMeshPipeline;
 class vtkPolyData;
 class AllPurposeProgressAccumulator;
+class MultiLabelSurfaceExtractor;
 
 
 /**
@@ -70,6 +75,33 @@ class AllPurposeProgressAccumulator;
  * whether it has been updated relative to the corresponding mesh. This makes
  * it possible for selective mesh recomputation, leading to fast mesh computation
  * even for big segmentations.
+ *
+ * Depending on the mesh options, the meshes are either computed for each
+ * label separately with marching cubes, or for all labels at once in a single
+ * pass over the image. In the latter case, the surfaces are cached in bricks
+ * of the image, and when the region of the image edited since the last update
+ * is known, only the bricks in that region are extracted again. The meshes of
+ * the labels whose surfaces changed in these bricks are then rebuilt, unless
+ * mesh smoothing is on, in which case all the meshes are rebuilt from the
+ * cached surfaces. With marching cubes, which is the default method, the
+ * mesh of an edited label is computed again only in a box around the edited
+ * region, padded by the reach of the Gaussian smoothing, and the triangles
+ * of the box replace those of the previous mesh. Decimation and mesh
+ * smoothing move the vertices of the whole mesh, so when either is on, the
+ * meshes of the edited labels are computed again over their bounding box.
+ *
+ * The update can run in a background thread, reading a copy of the
+ * segmentation made when the update was prepared. The new meshes are built
+ * separately from the old ones, and each is published in the collection as
+ * soon as it is complete, so the collection can be displayed while it is
+ * being updated, and always holds complete meshes.
+ *
+ * The meshes computed with marching cubes can also be stored in a cache
+ * directory on disk, as compressed VTK XML files. A mesh is found in the
+ * cache by the voxel count and checksum of its label, the geometry of the
+ * image and a hash of the mesh options, so a segmentation that is opened
+ * again does not need to be meshed again. The least recently used meshes
+ * are removed when the cache grows beyond its size limit.
  */
 class MultiLabelMeshPipeline : public itk::Object
 {
@@ -82,7 +114,7 @@ public:
     vtkSmartPointer<vtkPolyData> Mesh;
 
     // The checksum for the mesh
-    unsigned long CheckSum;
+    unsigned long long CheckSum;
 
     // The extents of the bounding box
     Vector3i BoundingBox[2];
@@ -128,12 +160,82 @@ public:
    * the color label is not present in the image */
   bool ComputeMesh(LabelType label, vtkPolyData *outData);
 
-  /** Update the meshes */
-  void UpdateMeshes(itk::Command *progressCommand);
-
-  /** Get the collection of computed meshes */
+  /**
+   * Update the meshes. The per-label statistics of the image are used to
+   * decide which meshes are out of date. If they are not supplied, they are
+   * computed by scanning the image. The region of the image changed since
+   * the image had the MTime returned by GetMeshImageMTime() can be supplied
+   * if it is known, e.g., from the undo deltas of the edits. If the
+   * statistics and the region were captured earlier, e.g., before starting
+   * the update in another thread, the MTime of the image at that point is
+   * given as imageMTime, so that later edits are found by the next update.
+   * In that case, a copy of the image made at the same time must be given
+   * as snapshot. The update then reads only the copy, and never the input
+   * image, which may be edited while the update runs.
+   */
+  void UpdateMeshes(itk::Command *progressCommand,
+                    const LabelStatisticsTable *stats = NULL,
+                    const itk::ImageRegion<3> *modified = NULL,
+                    itk::ModifiedTimeType imageMTime = 0,
+                    const InputImageType *snapshot = NULL);
+
+  /** MTime of the input image when the meshes were last updated */
+  itk::ModifiedTimeType GetMeshImageMTime() const
+    { return m_MeshImageMTime; }
+
+  /** Check whether the meshes differ from the labels described by the
+   * statistics table, i.e., whether UpdateMeshes() would change anything */
+  bool IsOutOfDate(const LabelStatisticsTable &stats) const;
+
+  /** Get the collection of computed meshes. This can be called while the
+   * meshes are being updated in another thread */
   std::map<LabelType, vtkSmartPointer<vtkPolyData> > GetMeshCollection();
 
+  /** Time when a mesh in the collection was last added, replaced or removed */
+  itk::ModifiedTimeType GetMeshCollectionMTime() const;
+
+  /**
+   * Ask an update running in another thread to stop as soon as possible,
+   * i.e., after the meshes being computed are done. The labels that were not
+   * done keep their old meshes, and remain out of date.
+   */
+  void AbortUpdate();
+
+  /** Whether the current or last update was asked to stop */
+  bool IsUpdateAborted() const;
+
+  /**
+   * Number of threads used by UpdateMeshes() to compute the meshes of
+   * different labels in parallel, each with its own threshold filter and VTK
+   * pipeline. With one thread, the meshes are computed one after another.
+   * The default is ITK's global default number of threads.
+   */
+  irisGetSetMacro(NumberOfThreads, int)
+
+  /**
+   * Directory where the meshes computed with marching cubes are cached, and
+   * looked up before they are computed. The directory is created when the
+   * first mesh is stored. The default, an empty string, disables the cache.
+   */
+  irisGetSetMacro(MeshCacheDirectory, const std::string &)
+
+  /**
+   * Size of the mesh cache, in megabytes. When an update stores meshes in the
+   * cache, the least recently used meshes are then removed from it until it
+   * is no larger than this. The default is 512.
+   */
+  irisGetSetMacro(MeshCacheSizeInMB, int)
+
+  /**
+   * Whether the meshes computed by the next updates are stored in the cache.
+   * This can be turned off during continuous update, when most meshes are of
+   * intermediate states of an edit that will not be seen again. The cache is
+   * still read. The meshes are only stored if the statistics of the update
+   * describe the image that was meshed, i.e., if a snapshot was passed to
+   * UpdateMeshes() with the statistics, or if there were no statistics.
+   */
+  irisGetSetMacro(MeshCacheWriteEnabled, bool)
+
   
   /** Get the progress accumulator from the VTK mesh pipeline */
   AllPurposeProgressAccumulator *GetProgressAccumulator();
@@ -158,6 +260,65 @@ private:
   typedef itk::BinaryThresholdImageFilter<
     InputImageType,InternalImageType>                ThresholdFilter;
   typedef itk::SmartPointer<ThresholdFilter>         ThresholdFilterPointer;
+
+  // Shared state of the threads computing meshes in parallel
+  struct ParallelMeshData;
+
+  // Get the bounding box of a label, padded and cropped to the image
+  InputImageType::RegionType GetMeshRegion(const MeshInfo &mi) const;
+
+  // Find out if the mesh of a label can be updated by meshing only the part
+  // of its bounding box around the region edited since the last update. If
+  // so, region is reduced from the bounding box to that part, cells is set
+  // to the marching cubes cells whose triangles are replaced, and base to
+  // the previous mesh of the label
+  bool GetPartialMeshRegion(LabelType label,
+                            InputImageType::RegionType &region,
+                            InputImageType::RegionType &cells,
+                            vtkSmartPointer<vtkPolyData> &base) const;
+
+  // Combine the triangles of the previous mesh outside of the cells with
+  // the triangles of the partial mesh inside of them
+  void MergePartialMesh(vtkPolyData *base, vtkPolyData *part,
+                        const InputImageType::RegionType &cells,
+                        vtkPolyData *out) const;
+
+  // Replace the mesh of a label in the collection by a newly computed one
+  void PublishMesh(LabelType label, const MeshInfo &info);
+
+  // Compute the pending meshes of the given labels on a pool of threads
+  void ComputeMeshesInParallel(MeshInfoMap &pending,
+                               std::vector<LabelType> &labels,
+                               AllPurposeProgressAccumulator *progress);
+
+  // Callback executed by each of the threads
+  static ITK_THREAD_RETURN_TYPE ParallelMeshCallback(void *arg);
+
+  // Compute a hash of the current mesh options, used in the cache keys
+  void UpdateMeshOptionsHash();
+
+  // Get the file in the cache directory that holds the mesh of a label with
+  // the given voxel count and checksum
+  std::string GetMeshCacheFileName(const MeshInfo &mi) const;
+
+  // Read the mesh of a label from the cache, if it is there
+  bool ReadCachedMesh(MeshInfo &mi) const;
+
+  // Store the mesh of a label in the cache, if the running update may do so.
+  // Failures are ignored, since the mesh can always be computed again
+  void WriteCachedMesh(const MeshInfo &mi) const;
+
+  // Remove the least recently used meshes until the cache fits its size
+  void PruneMeshCache() const;
+
+  // Compute the meshes of all labels in one pass over the image, using
+  // MultiLabelSurfaceExtractor, given the current statistics of all labels.
+  // If the modified region is given, only the meshes of the labels with
+  // surfaces in that region and the dirty labels are rebuilt
+  void ComputeMeshesSinglePass(AllPurposeProgressAccumulator *progress,
+                               const MeshInfoMap &meshmap,
+                               const std::vector<LabelType> &dirty,
+                               const itk::ImageRegion<3> *modified);
   
   // Current set of mesh options
   SmartPtr<MeshOptions>       m_MeshOptions;
@@ -165,6 +326,10 @@ private:
   // The input image
   InputImagePointer           m_InputImage;
 
+  // The image read by the running update, i.e., the snapshot passed to
+  // UpdateMeshes(), or the input image if there is none
+  itk::SmartPointer<const InputImageType> m_UpdateImage;
+
   // The ROI extraction filter used for constructing a bounding box
   ROIFilterPointer            m_ROIFilter;
 
@@ -183,12 +348,41 @@ private:
   // The VTK pipeline
   VTKMeshPipeline *           m_VTKPipeline;
 
-  // Helper routine for the update command
-  void UpdateMeshInfoHelper(
-      MeshInfo *current_meshinfo,
-      const itk::Index<3> &run_start,
-      itk::ImageRegionConstIteratorWithIndex<InputImageType> &it,
-      unsigned long pos);
+  // Number of threads used to compute meshes of different labels
+  int                         m_NumberOfThreads;
+
+  // The single-pass surface extractor, which caches the surfaces in bricks
+  MultiLabelSurfaceExtractor *m_SurfaceExtractor;
+
+  // Directory of the mesh cache, or empty if there is none
+  std::string                 m_MeshCacheDirectory;
+
+  // Size limit of the mesh cache and whether updates may write to it
+  int                         m_MeshCacheSizeInMB;
+  bool                        m_MeshCacheWriteEnabled;
+
+  // Whether the running update stores its meshes in the cache
+  bool                        m_UpdateWritesCache;
+
+  // The region edited since the last update, if the running update knows it
+  itk::ImageRegion<3>         m_UpdateRegion;
+  bool                        m_UpdateRegionKnown;
+
+  // Hash of the mesh options that affect the marching cubes meshes
+  std::string                 m_MeshOptionsHash;
+
+  // MTime of the input image at the last update
+  itk::ModifiedTimeType       m_MeshImageMTime;
+
+  // Guards the mesh info, which is read by other threads during an update,
+  // and the abort flag
+  mutable itk::SimpleFastMutexLock m_MeshInfoLock;
+
+  // Time of the last change to the collection of meshes
+  itk::TimeStamp              m_MeshCollectionTime;
+
+  // Set when the running update should stop
+  bool                        m_UpdateAborted;
 };
 
 #endif
@@ -0,0 +1,454 @@
+#include "MultiLabelSurfaceExtractor.h"
+#include <algorithm>
+#include <utility>
+
+// Marks a corner that has no vertex yet
+static const unsigned int NO_VERTEX = static_cast<unsigned int>(-1);
+
+MultiLabelSurfaceExtractor::MultiLabelSurfaceExtractor()
+{
+  m_Size[0] = m_Size[1] = m_Size[2] = 0;
+  m_BrickCount[0] = m_BrickCount[1] = m_BrickCount[2] = 0;
+  m_BrickSize = 32;
+  m_Brick = NULL;
+  m_ProgressCallback = NULL;
+  m_ProgressSource = NULL;
+}
+
+void MultiLabelSurfaceExtractor
+::SetProgressCallback(ProgressCallback callback, void *source)
+{
+  m_ProgressCallback = callback;
+  m_ProgressSource = source;
+}
+
+void MultiLabelSurfaceExtractor::SetBrickSize(unsigned int size)
+{
+  if(size > 0 && size != m_BrickSize)
+    {
+    m_BrickSize = size;
+    this->Clear();
+    }
+}
+
+void MultiLabelSurfaceExtractor::Clear()
+{
+  m_Bricks.clear();
+  m_Points.clear();
+  m_Triangles.clear();
+  m_ModifiedLabels.clear();
+  m_Size[0] = m_Size[1] = m_Size[2] = 0;
+}
+
+void MultiLabelSurfaceExtractor::Extract(const ImageType *image)
+{
+  this->Clear();
+
+  for(int d = 0; d < 3; d++)
+    {
+    m_Size[d] = image->GetBufferedRegion().GetSize(d);
+    m_BrickCount[d] = (m_Size[d] + m_BrickSize - 1) / m_BrickSize;
+    }
+  m_Bricks.resize(m_BrickCount[0] * m_BrickCount[1] * m_BrickCount[2]);
+
+  for(size_t b = 0; b < m_Bricks.size(); b++)
+    {
+    this->ExtractBrick(image, b);
+
+    if(m_ProgressCallback)
+      m_ProgressCallback(m_ProgressSource, (b + 1.0) / m_Bricks.size());
+    }
+
+  // All the labels are new
+  for(size_t b = 0; b < m_Bricks.size(); b++)
+    for(TriangleMap::const_iterator it = m_Bricks[b].Triangles.begin();
+        it != m_Bricks[b].Triangles.end(); ++it)
+      m_ModifiedLabels.insert(it->first);
+
+  this->Stitch();
+}
+
+void MultiLabelSurfaceExtractor
+::Update(const ImageType *image, const RegionType &region)
+{
+  for(int d = 0; d < 3; d++)
+    {
+    if(m_Bricks.empty() || m_Size[d] != image->GetBufferedRegion().GetSize(d))
+      {
+      this->Extract(image);
+      return;
+      }
+    }
+
+  m_ModifiedLabels.clear();
+
+  // A change to a voxel affects the faces on its lower sides, which are in
+  // its brick, and those on its upper sides, which may be in the next brick
+  size_t b0[3], b1[3];
+  bool empty = false;
+  for(int d = 0; d < 3; d++)
+    {
+    long lo = std::max((long) region.GetIndex(d), 0L);
+    long hi = std::min((long) region.GetIndex(d) + (long) region.GetSize(d) + 1,
+                       (long) m_Size[d]);
+    if(lo >= hi)
+      {
+      empty = true;
+      break;
+      }
+    b0[d] = lo / m_BrickSize;
+    b1[d] = (hi - 1) / m_BrickSize + 1;
+    }
+
+  if(!empty)
+    {
+    size_t n_bricks = (b1[0] - b0[0]) * (b1[1] - b0[1]) * (b1[2] - b0[2]), done = 0;
+    for(size_t bz = b0[2]; bz < b1[2]; bz++)
+      {
+      for(size_t by = b0[1]; by < b1[1]; by++)
+        {
+        for(size_t bx = b0[0]; bx < b1[0]; bx++)
+          {
+          size_t b = bx + m_BrickCount[0] * (by + m_BrickCount[1] * bz);
+
+          // Keep the old faces for comparison
+          Brick old;
+          old.Corners.swap(m_Bricks[b].Corners);
+          old.Triangles.swap(m_Bricks[b].Triangles);
+
+          this->ExtractBrick(image, b);
+          this->CompareBricks(old, m_Bricks[b]);
+
+          if(m_ProgressCallback)
+            m_ProgressCallback(m_ProgressSource, (++done) / (double) n_bricks);
+          }
+        }
+      }
+    }
+
+  // The vertices are always rebuilt, since they may have been smoothed
+  this->Stitch();
+}
+
+void MultiLabelSurfaceExtractor
+::GetBrickRange(size_t brick, size_t start[3], size_t end[3]) const
+{
+  size_t pos[3];
+  pos[0] = brick % m_BrickCount[0];
+  pos[1] = (brick / m_BrickCount[0]) % m_BrickCount[1];
+  pos[2] = brick / (m_BrickCount[0] * m_BrickCount[1]);
+  for(int d = 0; d < 3; d++)
+    {
+    start[d] = pos[d] * m_BrickSize;
+    end[d] = std::min(start[d] + m_BrickSize, m_Size[d]);
+    }
+}
+
+void MultiLabelSurfaceExtractor::ExtractBrick(const ImageType *image, size_t brick)
+{
+  m_Brick = &m_Bricks[brick];
+  m_Brick->Corners.clear();
+  m_Brick->Triangles.clear();
+  this->GetBrickRange(brick, m_BrickStart, m_BrickEnd);
+
+  size_t plane_size =
+      (m_BrickEnd[0] - m_BrickStart[0] + 1) * (m_BrickEnd[1] - m_BrickStart[1] + 1);
+  for(int i = 0; i < 2; i++)
+    {
+    m_PlaneVertex[i].assign(plane_size, NO_VERTEX);
+    m_PlaneUsed[i].clear();
+    }
+
+  // The lines are stored in y, then z order
+  size_t nx = m_Size[0], ny = m_Size[1], nz = m_Size[2];
+  const RLLine *lines = image->GetBuffer()->GetBufferPointer();
+
+  // A line of background, for the neighbors outside of the image
+  RLLine outside;
+  ImageType::AppendRun(outside, nx, 0);
+
+  // The faces on the upper sides of the image belong to the last bricks
+  size_t y0 = m_BrickStart[1], y1 = m_BrickEnd[1];
+  size_t y_last = (y1 == ny) ? ny : y1 - 1;
+
+  for(size_t z = m_BrickStart[2]; z < m_BrickEnd[2]; z++)
+    {
+    const RLLine *slice = lines + z * ny;
+
+    // Faces between this slice and the one below
+    for(size_t y = y0; y < y1; y++)
+      this->CompareLines(z > 0 ? slice[y - ny] : outside, slice[y], 2, y, z);
+
+    // Faces between voxels in the same line, and between adjacent lines
+    for(size_t y = y0; y < y1; y++)
+      this->AddLineFaces(slice[y], y, z);
+
+    for(size_t y = y0; y <= y_last; y++)
+      this->CompareLines(y > 0 ? slice[y - 1] : outside,
+                         y < ny ? slice[y] : outside, 1, y, z);
+
+    // Faces above the last slice
+    if(z + 1 == nz)
+      for(size_t y = y0; y < y1; y++)
+        this->CompareLines(slice[y], outside, 2, y, nz);
+
+    // The corners below this slice are not used again
+    this->ClearPlane(z & 1);
+    }
+
+  this->ClearPlane(m_BrickEnd[2] & 1);
+  m_Brick = NULL;
+}
+
+void MultiLabelSurfaceExtractor::CompareBricks(const Brick &a, const Brick &b)
+{
+  // The vertices are numbered in the order they are found, so the triangles
+  // of a label are unchanged if they have the same corners in the same order
+  TriangleMap::const_iterator ita = a.Triangles.begin(), itb = b.Triangles.begin();
+  while(ita != a.Triangles.end() || itb != b.Triangles.end())
+    {
+    if(itb == b.Triangles.end() || (ita != a.Triangles.end() && ita->first < itb->first))
+      {
+      m_ModifiedLabels.insert((ita++)->first);
+      }
+    else if(ita == a.Triangles.end() || itb->first < ita->first)
+      {
+      m_ModifiedLabels.insert((itb++)->first);
+      }
+    else
+      {
+      const TriangleList &ta = ita->second, &tb = itb->second;
+      bool same = ta.size() == tb.size();
+      for(size_t i = 0; same && i < ta.size(); i++)
+        same = a.Corners[ta[i]] == b.Corners[tb[i]];
+      if(!same)
+        m_ModifiedLabels.insert(ita->first);
+      ++ita;
+      ++itb;
+      }
+    }
+}
+
+void MultiLabelSurfaceExtractor::Stitch()
+{
+  m_Points.clear();
+  m_Triangles.clear();
+
+  // Vertices on the sides of a brick may be shared with the neighboring
+  // bricks, and are looked up by their corner. The others are unique
+  std::map<unsigned long long, unsigned int> shared;
+  std::vector<unsigned int> index;
+  unsigned long long cnx = m_Size[0] + 1, cny = m_Size[1] + 1;
+
+  for(size_t b = 0; b < m_Bricks.size(); b++)
+    {
+    const Brick &brick = m_Bricks[b];
+    size_t start[3], end[3];
+    this->GetBrickRange(b, start, end);
+
+    index.resize(brick.Corners.size());
+    for(size_t i = 0; i < brick.Corners.size(); i++)
+      {
+      unsigned long long key = brick.Corners[i];
+      size_t c[3];
+      c[0] = (size_t) (key % cnx);
+      c[1] = (size_t) ((key / cnx) % cny);
+      c[2] = (size_t) (key / (cnx * cny));
+
+      bool on_side = false;
+      for(int d = 0; d < 3; d++)
+        if(c[d] == start[d] || c[d] == end[d])
+          on_side = true;
+
+      unsigned int vertex = (unsigned int) (m_Points.size() / 3);
+      if(on_side)
+        {
+        std::pair<std::map<unsigned long long, unsigned int>::iterator, bool> ins =
+            shared.insert(std::make_pair(key, vertex));
+        if(!ins.second)
+          {
+          index[i] = ins.first->second;
+          continue;
+          }
+        }
+
+      // The corner is half a voxel away from the voxel centers
+      index[i] = vertex;
+      m_Points.push_back(c[0] - 0.5f);
+      m_Points.push_back(c[1] - 0.5f);
+      m_Points.push_back(c[2] - 0.5f);
+      }
+
+    for(TriangleMap::const_iterator it = brick.Triangles.begin();
+        it != brick.Triangles.end(); ++it)
+      {
+      TriangleList &tri = m_Triangles[it->first];
+      for(size_t i = 0; i < it->second.size(); i++)
+        tri.push_back(index[it->second[i]]);
+      }
+    }
+}
+
+void MultiLabelSurfaceExtractor
+::CompareLines(const RLLine &lower, const RLLine &upper,
+               int axis, size_t y, size_t z)
+{
+  // Walk both lines, over the intervals in which neither label changes
+  size_t x0 = m_BrickStart[0], x1 = m_BrickEnd[0];
+  size_t il = 0, iu = 0, x = 0;
+  size_t el = lower[0].first, eu = upper[0].first;
+  while(x < x1)
+    {
+    size_t xe = std::min(el, eu);
+    LabelType ll = lower[il].second, lu = upper[iu].second;
+    if(ll != lu)
+      for(size_t xf = std::max(x, x0); xf < std::min(xe, x1); xf++)
+        this->AddFace(axis, xf, y, z, ll, lu);
+
+    x = xe;
+    if(x == el && ++il < lower.size())
+      el += lower[il].first;
+    if(x == eu && ++iu < upper.size())
+      eu += upper[iu].first;
+    }
+}
+
+void MultiLabelSurfaceExtractor
+::AddLineFaces(const RLLine &line, size_t y, size_t z)
+{
+  size_t x0 = m_BrickStart[0], x1 = m_BrickEnd[0];
+  LabelType prev = 0;
+  size_t x = 0;
+  for(size_t i = 0; i < line.size() && x < x1; i++)
+    {
+    // Segments of the same label split by the maximum run length are skipped
+    if(line[i].second != prev && x >= x0)
+      this->AddFace(0, x, y, z, prev, line[i].second);
+    prev = line[i].second;
+    x += line[i].first;
+    }
+
+  // The face at the end of the line belongs to the last brick
+  if(x == m_Size[0] && x1 == m_Size[0] && prev != 0)
+    this->AddFace(0, x, y, z, prev, 0);
+}
+
+void MultiLabelSurfaceExtractor
+::AddFace(int axis, size_t cx, size_t cy, size_t cz,
+          LabelType lower, LabelType upper)
+{
+  // The corners of the face, in counterclockwise order around the axis
+  int u = (axis + 1) % 3, v = (axis + 2) % 3;
+  size_t c[3] = { cx, cy, cz };
+  unsigned int p[4];
+  p[0] = this->GetVertex(c[0], c[1], c[2]);
+  c[u]++;
+  p[1] = this->GetVertex(c[0], c[1], c[2]);
+  c[v]++;
+  p[2] = this->GetVertex(c[0], c[1], c[2]);
+  c[u]--;
+  p[3] = this->GetVertex(c[0], c[1], c[2]);
+
+  // The face points along the axis for the label on the lower side, and the
+  // other way for the label on the upper side
+  if(lower != 0)
+    {
+    TriangleList &tri = m_Brick->Triangles[lower];
+    unsigned int t[6] = { p[0], p[1], p[2], p[0], p[2], p[3] };
+    tri.insert(tri.end(), t, t + 6);
+    }
+
+  if(upper != 0)
+    {
+    TriangleList &tri = m_Brick->Triangles[upper];
+    unsigned int t[6] = { p[0], p[2], p[1], p[0], p[3], p[2] };
+    tri.insert(tri.end(), t, t + 6);
+    }
+}
+
+unsigned int MultiLabelSurfaceExtractor
+::GetVertex(size_t cx, size_t cy, size_t cz)
+{
+  int slot = cz & 1;
+  size_t pos = (cy - m_BrickStart[1]) * (m_BrickEnd[0] - m_BrickStart[0] + 1)
+      + (cx - m_BrickStart[0]);
+  unsigned int &vertex = m_PlaneVertex[slot][pos];
+  if(vertex == NO_VERTEX)
+    {
+    vertex = (unsigned int) m_Brick->Corners.size();
+    m_Brick->Corners.push_back(
+          cx + (m_Size[0] + 1) * (cy + (m_Size[1] + 1) * (unsigned long long) cz));
+    m_PlaneUsed[slot].push_back(pos);
+    }
+  return vertex;
+}
+
+void MultiLabelSurfaceExtractor::ClearPlane(int slot)
+{
+  for(size_t i = 0; i < m_PlaneUsed[slot].size(); i++)
+    m_PlaneVertex[slot][m_PlaneUsed[slot][i]] = NO_VERTEX;
+  m_PlaneUsed[slot].clear();
+}
+
+void MultiLabelSurfaceExtractor
+::Smooth(unsigned int iterations, double lambda, double mu)
+{
+  if(iterations == 0 || m_Points.empty())
+    return;
+
+  // Collect the edges of all the meshes in both directions. Edges shared by
+  // the meshes of different labels are only counted once
+  std::vector<std::pair<unsigned int, unsigned int> > edges;
+  for(TriangleMap::const_iterator it = m_Triangles.begin(); it != m_Triangles.end(); ++it)
+    {
+    const TriangleList &tri = it->second;
+    for(size_t t = 0; t < tri.size(); t += 3)
+      {
+      for(int k = 0; k < 3; k++)
+        {
+        unsigned int a = tri[t + k], b = tri[t + (k + 1) % 3];
+        edges.push_back(std::make_pair(a, b));
+        edges.push_back(std::make_pair(b, a));
+        }
+      }
+    }
+  std::sort(edges.begin(), edges.end());
+  edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+  // Store the neighbors of each vertex contiguously
+  size_t n_points = m_Points.size() / 3;
+  std::vector<unsigned int> offsets(n_points + 1, 0), neighbors(edges.size());
+  for(size_t i = 0; i < edges.size(); i++)
+    {
+    offsets[edges[i].first + 1]++;
+    neighbors[i] = edges[i].second;
+    }
+  for(size_t i = 0; i < n_points; i++)
+    offsets[i + 1] += offsets[i];
+
+  for(unsigned int i = 0; i < iterations; i++)
+    {
+    this->SmoothStep(offsets, neighbors, lambda);
+    this->SmoothStep(offsets, neighbors, mu);
+    }
+}
+
+void MultiLabelSurfaceExtractor
+::SmoothStep(const std::vector<unsigned int> &offsets,
+             const std::vector<unsigned int> &neighbors, double factor)
+{
+  size_t n_points = m_Points.size() / 3;
+  std::vector<float> result(m_Points.size());
+  for(size_t i = 0; i < n_points; i++)
+    {
+    unsigned int n0 = offsets[i], n1 = offsets[i + 1];
+    for(int d = 0; d < 3; d++)
+      {
+      double p = m_Points[3 * i + d], avg = 0.0;
+      for(unsigned int j = n0; j < n1; j++)
+        avg += m_Points[3 * neighbors[j] + d];
+      result[3 * i + d] = (n1 > n0) ? (float) (p + factor * (avg / (n1 - n0) - p)) : (float) p;
+      }
+    }
+  m_Points.swap(result);
+}
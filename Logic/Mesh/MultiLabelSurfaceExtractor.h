@@ -0,0 +1,169 @@
+#ifndef MULTILABELSURFACEEXTRACTOR_H
+#define MULTILABELSURFACEEXTRACTOR_H
+
+#include "SNAPCommon.h"
+#include "RLEImage.h"
+#include <map>
+#include <set>
+#include <vector>
+
+/**
+ * \class MultiLabelSurfaceExtractor
+ * \brief Extracts the boundary surfaces of all labels in a segmentation in a
+ * single pass over the image.
+ *
+ * Wherever two face-adjacent voxels have different labels, the square face
+ * between them is added, as two triangles, to the meshes of both labels with
+ * opposite orientations, so that the triangles face away from each label.
+ * A vertex is created once for each voxel corner on a boundary and is shared
+ * by all the labels that meet at that corner, so neighboring meshes fit
+ * together without gaps or overlaps. Label 0 is the background and gets no
+ * mesh, and the outside of the image is treated as background.
+ *
+ * The boundaries are found by comparing the runs of each line of the
+ * RLEImage with the runs of the same line and of its neighbors in y and z,
+ * so the cost is proportional to the number of runs and boundary faces, not
+ * to the number of voxels.
+ *
+ * The image is partitioned into bricks of a fixed size, and the faces in
+ * each brick are cached separately. Each face belongs to the brick of the
+ * voxel on its upper side, or of the voxel on its lower side at the upper
+ * edges of the image. After the image is edited, Update() extracts only the
+ * bricks around the edited region again, and the meshes are stitched back
+ * together from the bricks by merging the vertices on the brick boundaries.
+ * The result is the same as extracting the whole image.
+ *
+ * The staircase surfaces can be smoothed with Taubin's lambda/mu method,
+ * which alternately moves each vertex towards and away from the average of
+ * its neighbors, removing the steps without shrinking the surfaces. Since
+ * the vertices are shared, the meshes stay watertight after smoothing.
+ */
+class MultiLabelSurfaceExtractor
+{
+public:
+  typedef RLEImage<LabelType> ImageType;
+  typedef itk::ImageRegion<3> RegionType;
+
+  /** Triangles of a mesh, as three indices into the vertex list each */
+  typedef std::vector<unsigned int> TriangleList;
+  typedef std::map<LabelType, TriangleList> TriangleMap;
+  typedef std::set<LabelType> LabelSet;
+
+  /** Progress callback, compatible with AllPurposeProgressAccumulator */
+  typedef void (*ProgressCallback)(void *source, double progress);
+
+  MultiLabelSurfaceExtractor();
+
+  /** Set a function to be called with the fraction of bricks processed */
+  void SetProgressCallback(ProgressCallback callback, void *source);
+
+  /** Set the size of the bricks along each axis, in voxels. Default is 32 */
+  void SetBrickSize(unsigned int size);
+  unsigned int GetBrickSize() const { return m_BrickSize; }
+
+  /** Extract the surfaces of all labels in the image */
+  void Extract(const ImageType *image);
+
+  /**
+   * Update the surfaces after the voxels in the given region of the image
+   * have changed, extracting only the bricks next to the region again. If
+   * the image does not have the size of the last one extracted, the whole
+   * image is extracted.
+   */
+  void Update(const ImageType *image, const RegionType &region);
+
+  /** Whether the bricks of an image are cached, so that Update() can be used */
+  bool HasBricks() const { return !m_Bricks.empty(); }
+
+  /** Discard the cached bricks and surfaces */
+  void Clear();
+
+  /** Smooth the vertices with the given number of lambda/mu iterations */
+  void Smooth(unsigned int iterations, double lambda = 0.5, double mu = -0.53);
+
+  /** The vertices, three coordinates each, in voxel index units */
+  const std::vector<float> &GetPoints() const { return m_Points; }
+
+  /** The triangles of each label present in the image */
+  const TriangleMap &GetTriangles() const { return m_Triangles; }
+
+  /** The labels whose triangles were changed by the last Extract() or Update() */
+  const LabelSet &GetModifiedLabels() const { return m_ModifiedLabels; }
+
+private:
+  typedef ImageType::RLLine RLLine;
+
+  // The faces in a brick. The vertices are given by the index of their voxel
+  // corner in the whole image, and the triangles by indices into these
+  struct Brick
+  {
+    std::vector<unsigned long long> Corners;
+    TriangleMap Triangles;
+  };
+
+  // Get the range of voxels [start, end) covered by a brick
+  void GetBrickRange(size_t brick, size_t start[3], size_t end[3]) const;
+
+  // Extract the faces that belong to a brick
+  void ExtractBrick(const ImageType *image, size_t brick);
+
+  // Add the labels whose triangles differ between two versions of a brick
+  // to the set of modified labels
+  void CompareBricks(const Brick &a, const Brick &b);
+
+  // Merge the bricks into a single list of vertices and triangles
+  void Stitch();
+
+  // Add the faces between two lines that are adjacent along the y or z axis,
+  // over the x range of the current brick. The coordinates (y, z) are those
+  // of the upper line
+  void CompareLines(const RLLine &lower, const RLLine &upper,
+                    int axis, size_t y, size_t z);
+
+  // Add the faces between the runs of a line, and at its ends, over the x
+  // range of the current brick
+  void AddLineFaces(const RLLine &line, size_t y, size_t z);
+
+  // Add the face whose corner with the lowest coordinates is (cx, cy, cz)
+  // and whose normal is the axis, between labels on its lower and upper side
+  void AddFace(int axis, size_t cx, size_t cy, size_t cz,
+               LabelType lower, LabelType upper);
+
+  // Get the vertex at a voxel corner, creating it if needed
+  unsigned int GetVertex(size_t cx, size_t cy, size_t cz);
+
+  // Forget the vertices of a plane of corners that is no longer needed
+  void ClearPlane(int slot);
+
+  // Move each vertex by a fraction of the offset to its neighbors' average
+  void SmoothStep(const std::vector<unsigned int> &offsets,
+                  const std::vector<unsigned int> &neighbors, double factor);
+
+  std::vector<float> m_Points;
+  TriangleMap m_Triangles;
+  LabelSet m_ModifiedLabels;
+
+  // Dimensions of the image being processed
+  size_t m_Size[3];
+
+  // The cached bricks, in x, then y, then z order, and their number
+  // along each axis
+  std::vector<Brick> m_Bricks;
+  size_t m_BrickCount[3];
+  unsigned int m_BrickSize;
+
+  // The brick being extracted and its range of voxels
+  Brick *m_Brick;
+  size_t m_BrickStart[3], m_BrickEnd[3];
+
+  // Vertex indices for the corners of the brick in two consecutive planes
+  // of corners, indexed by the z coordinate of the plane modulo 2, and the
+  // positions in each plane that have been assigned a vertex
+  std::vector<unsigned int> m_PlaneVertex[2];
+  std::vector<size_t> m_PlaneUsed[2];
+
+  ProgressCallback m_ProgressCallback;
+  void *m_ProgressSource;
+};
+
+#endif // MULTILABELSURFACEEXTRACTOR_H
@@ -3,8 +3,12 @@
 
 #include <utility> //std::pair
 #include <vector>
+#include <limits>
 #include <itkImageBase.h>
 #include <itkImage.h>
+#include <itkTimeStamp.h>
+#include <itkSimpleFastMutexLock.h>
+#include <itkMutexLockHolder.h>
 
 /** Run-Length Encoded image.
 * It saves memory for label images at the expense of processing times.
@@ -16,6 +20,22 @@
 * It is best if pixel type and counter type have the same byte size
 * (for memory alignment purposes).
 *
+* Lines may be longer than CounterType can count. Runs that are longer
+* than the maximum value of CounterType are stored as several consecutive
+* segments with the same value, so any counter type works for any image.
+*
+* Optionally, a skip index holding the prefix sums of segment lengths of
+* each line is maintained. It is built on demand by UpdateLineIndex() and
+* lets GetPixel and slicing across lines find a segment by binary search
+* instead of a linear scan. It becomes stale when the image is modified.
+* A rebuild creates a new index and swaps it in under a lock, so readers on
+* other threads keep using the index they obtained from GetLineIndexImage().
+*
+* Each line is a separate std::vector, so that lines can be edited in place.
+* Full-volume scans should walk the segments of the lines in GetBuffer()
+* rather than the pixels, and Compact() trims the per-line allocations
+* after heavy editing.
+*
 * Copied and adapted from itk::Image.
 */
 template< typename TPixel, unsigned int VImageDimension = 3, typename CounterType = unsigned short >
@@ -50,6 +70,10 @@ public:
     /** A Run-Length encoded line of pixels. */
     typedef std::vector<RLSegment> RLLine;
 
+    /** Prefix sums of segment lengths of a RLLine. Element i is the
+    * position (relative to line start) one past the end of segment i. */
+    typedef std::vector<unsigned int> RLLineIndex;
+
     /** Internal Pixel representation. Used to maintain a uniform API
     * with Image Adaptors and allow to keep a particular internal
     * representation of data while showing a different external
@@ -107,6 +131,7 @@ public:
         Superclass::Initialize();
         m_OnTheFlyCleanup = true;
         myBuffer = BufferType::New();
+        ReleaseLineIndex();
     }
 
     /** Fill the image buffer with a value.  Be sure to call Allocate()
@@ -144,6 +169,17 @@ public:
     * This method is used by iterators directly. */
     int SetPixel(RLLine & line, IndexValueType & segmentRemainder, IndexValueType & realIndex, const TPixel & value);
 
+    /** The longest run that fits into a single segment. */
+    static SizeValueType MaxSegmentLength()
+    {
+        return static_cast<SizeValueType>(std::numeric_limits<CounterType>::max());
+    }
+
+    /** Appends a run of pixels with the given value to a line. The run is
+    * merged into the last segment when possible, and split into several
+    * segments if it is longer than MaxSegmentLength(). */
+    static void AppendRun(RLLine & line, SizeValueType length, const TPixel & value);
+
     /** \brief Get a pixel. SLOW! Better use iterators for pixel access. */
     const TPixel & GetPixel(const IndexType & index) const;
 
@@ -180,6 +216,50 @@ public:
     /** We need to allow itk-style const iterators to be constructed. */
     typename BufferType::Pointer GetBuffer() const { return myBuffer; }
 
+    /** Typedef for the per-line skip index. */
+    typedef typename itk::Image<RLLineIndex, VImageDimension - 1> LineIndexType;
+
+    /** Returns the skip index, or NULL if the index is not up to date. The
+    * returned index is never changed, so it can be read by several threads
+    * while the image is not edited, even if another thread rebuilds the index. */
+    typename LineIndexType::ConstPointer GetLineIndexImage() const;
+
+    /** Returns the index of the segment of a line that contains pixel x
+    * (relative to line start) and sets segmentEnd to one past its last pixel.
+    * Uses binary search if the skip index is up to date. */
+    IndexValueType FindSegment(const typename BufferType::IndexType & bi,
+        IndexValueType x, IndexValueType & segmentEnd) const;
+
+    /** Rebuilds the per-line skip index if it is out of date and enabled.
+    * Safe to call from several threads, e.g. by slicers in different views,
+    * as long as none of them edits the image. */
+    void UpdateLineIndex() const;
+
+    /** Whether the per-line skip index exists and reflects current contents. */
+    bool IsLineIndexValid() const
+    {
+        return GetLineIndexImage().IsNotNull();
+    }
+
+    /** Should the per-line skip index be used? Disabling releases its memory. */
+    bool GetUseLineIndex() const { return m_UseLineIndex; }
+
+    /** Should the per-line skip index be used? Disabling releases its memory. */
+    void SetUseLineIndex(bool value)
+    {
+        m_UseLineIndex = value;
+        if (!m_UseLineIndex)
+            ReleaseLineIndex();
+    }
+
+    /** Returns the total number of segments in all buffered lines. */
+    SizeValueType GetNumberOfSegments() const;
+
+    /** Reallocates every line to exactly fit its segments, in buffer order,
+    * and releases the skip index. Editing leaves spare capacity in lines,
+    * so this reduces memory use after large edits. */
+    void Compact();
+
     /** Returns N-1-dimensional index, the remainder after 0-index is removed. */
     static inline typename BufferType::IndexType
         truncateIndex(const IndexType & index);
@@ -217,6 +297,8 @@ protected:
     {
         m_OnTheFlyCleanup = true;
         myBuffer = BufferType::New();
+        m_UseLineIndex = true;
+        m_LineIndexValid = false;
     }
     void PrintSelf(std::ostream & os, itk::Indent indent) const ITK_OVERRIDE;
 
@@ -235,6 +317,22 @@ protected:
     /** Merges adjacent segments with duplicate values in a single line. */
     void CleanUpLine(RLLine & line) const;
 
+    /** Marks the skip index as stale. */
+    void InvalidateDerivedData() const
+    {
+        itk::MutexLockHolder<itk::SimpleFastMutexLock> lock(m_LineIndexLock);
+        m_LineIndexValid = false;
+    }
+
+    /** Marks the skip index as stale and releases its memory. Readers that
+    * hold the index keep it alive until they are done. */
+    void ReleaseLineIndex() const
+    {
+        itk::MutexLockHolder<itk::SimpleFastMutexLock> lock(m_LineIndexLock);
+        m_LineIndexValid = false;
+        m_LineIndex = ITK_NULLPTR;
+    }
+
 private:
     bool m_OnTheFlyCleanup; //should same-valued segments be merged on the fly
 
@@ -243,9 +341,30 @@ private:
 
     /** Memory for the current buffer. */
     mutable typename BufferType::Pointer myBuffer;
+
+    /** Per-line skip index and its validity. Writes through SetPixel
+    * invalidate the index, as does calling Modified() on the image.
+    * Code that edits lines directly through GetBuffer() must call Modified().
+    * The first lock guards these members, the second one makes concurrent
+    * calls to UpdateLineIndex() build the index only once. */
+    bool m_UseLineIndex;
+    mutable bool m_LineIndexValid;
+    mutable itk::TimeStamp m_LineIndexTime;
+    mutable typename LineIndexType::ConstPointer m_LineIndex;
+    mutable itk::SimpleFastMutexLock m_LineIndexLock;
+    mutable itk::SimpleFastMutexLock m_LineIndexBuildLock;
 };
 
 
+/** Copies an RLE image into an RLE image with another counter type, e.g. to
+* trade memory for segment count. Buffered region, geometry and pixel values
+* are preserved; runs are re-split as needed for the output counter type. */
+template< typename TPixel, unsigned int VImageDimension,
+    typename TInputCounter, typename TOutputCounter >
+void ConvertRLEImageCounterType(
+    const RLEImage<TPixel, VImageDimension, TInputCounter> *input,
+    RLEImage<TPixel, VImageDimension, TOutputCounter> *output);
+
 #ifndef ITK_MANUAL_INSTANTIATION
 #include "RLEImage.txx"
 #endif
@@ -3,6 +3,8 @@
 
 #include "RLEImage.h"
 #include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIterator.h"
+#include <algorithm>
 
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
 inline typename RLEImage<TPixel, VImageDimension, CounterType>::BufferType::IndexType
@@ -43,17 +45,14 @@ void RLEImage<TPixel, VImageDimension, CounterType>::Allocate(bool initialize)
     itkAssertOrThrowMacro(this->GetBufferedRegion().GetSize(0)
         == this->GetLargestPossibleRegion().GetSize(0),
         "BufferedRegion must contain complete run-length lines!");
-    itkAssertOrThrowMacro(this->GetLargestPossibleRegion().GetSize(0)
-        <= std::numeric_limits<CounterType>::max(),
-        "CounterType is not large enough to support image's X dimension!");
     this->ComputeOffsetTable();
     //SizeValueType num = static_cast<SizeValueType>(this->GetOffsetTable()[VImageDimension]);
     myBuffer->Allocate(false);
+    InvalidateDerivedData();
     //if (initialize) //there is assumption that the image is fully formed after a call to allocate
     {
-        RLSegment segment(CounterType(this->GetBufferedRegion().GetSize(0)), TPixel());
-        RLLine line(1);
-        line[0] = segment;
+        RLLine line;
+        AppendRun(line, this->GetBufferedRegion().GetSize(0), TPixel());
         myBuffer->FillBuffer(line);
     }
 }
@@ -62,25 +61,26 @@ template< typename TPixel, unsigned int VImageDimension, typename CounterType >
 void RLEImage<TPixel, VImageDimension, CounterType>
 ::FillBuffer(const TPixel & value)
 {
-    RLSegment segment(CounterType(this->GetBufferedRegion().GetSize(0)), value);
-    RLLine line(1);
-    line[0] = segment;
+    RLLine line;
+    AppendRun(line, this->GetBufferedRegion().GetSize(0), value);
     myBuffer->FillBuffer(line);
+    InvalidateDerivedData();
 }
 
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
 void RLEImage<TPixel, VImageDimension, CounterType>::CleanUpLine(RLLine & line) const
 {
-    CounterType x = 0;
+    SizeValueType x = 0;
     RLLine out;
-    out.reserve(this->GetLargestPossibleRegion().GetSize(0));
+    out.reserve(line.size());
     do
     {
         out.push_back(line[x]);
-        while (++x < line.size() && line[x].second == line[x - 1].second)
+        while (++x < line.size() && line[x].second == out.back().second
+            && SizeValueType(out.back().first) + line[x].first <= MaxSegmentLength())
             out.back().first += line[x].first;
     } while (x < line.size());
-    out.swap(line);
+    RLLine(out).swap(line); //copy, so that capacity matches size
 }
 
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
@@ -89,12 +89,60 @@ void RLEImage<TPixel, VImageDimension, CounterType>::CleanUp() const
     assert(!myBuffer.empty());
     if (this->GetLargestPossibleRegion().GetSize(0) == 0)
         return;
+    InvalidateDerivedData();
 #pragma omp parallel for
     for (CounterType z = 0; z < myBuffer.size(); z++)
         for (CounterType y = 0; y < myBuffer[0].size(); y++)
             CleanUpLine(myBuffer[z][y]);
 }
 
+template< typename TPixel, unsigned int VImageDimension, typename CounterType >
+void RLEImage<TPixel, VImageDimension, CounterType>
+::AppendRun(RLLine & line, SizeValueType length, const TPixel & value)
+{
+    //top up the last segment if it has the same value
+    if (!line.empty() && line.back().second == value)
+    {
+        SizeValueType n = std::min(MaxSegmentLength() - line.back().first, length);
+        line.back().first += n;
+        length -= n;
+    }
+    //runs longer than CounterType can hold are split into several segments
+    while (length > 0)
+    {
+        SizeValueType n = std::min(MaxSegmentLength(), length);
+        line.push_back(RLSegment(CounterType(n), value));
+        length -= n;
+    }
+}
+
+template< typename TPixel, unsigned int VImageDimension, typename CounterType >
+void RLEImage<TPixel, VImageDimension, CounterType>::Compact()
+{
+    //lines are reallocated in buffer order, with no spare capacity
+    itk::ImageRegionIterator<BufferType> it(myBuffer, myBuffer->GetBufferedRegion());
+    for (; !it.IsAtEnd(); ++it)
+    {
+        RLLine & line = it.Value();
+        if (line.capacity() > line.size())
+            RLLine(line).swap(line);
+    }
+
+    //the skip index can be rebuilt on demand
+    ReleaseLineIndex();
+}
+
+template< typename TPixel, unsigned int VImageDimension, typename CounterType >
+typename RLEImage<TPixel, VImageDimension, CounterType>::SizeValueType
+RLEImage<TPixel, VImageDimension, CounterType>::GetNumberOfSegments() const
+{
+    SizeValueType n = 0;
+    itk::ImageRegionConstIterator<BufferType> it(myBuffer, myBuffer->GetBufferedRegion());
+    for (; !it.IsAtEnd(); ++it)
+        n += it.Value().size();
+    return n;
+}
+
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
 int RLEImage<TPixel, VImageDimension, CounterType>::
 SetPixel(RLLine & line, IndexValueType & segmentRemainder, IndexValueType & realIndex, const TPixel & value)
@@ -105,13 +153,20 @@ SetPixel(RLLine & line, IndexValueType & segmentRemainder, IndexValueType & real
         "BufferedRegion must contain complete run-length lines!");
     if (line[realIndex].second == value) //already correct value
         return 0;
-    else if (line[realIndex].first == 1) //single pixel segment
+    InvalidateDerivedData(); //segment boundaries are about to change
+    //segments which are full cannot grow, the run continues in the next one
+    const SizeValueType maxLength = MaxSegmentLength();
+    if (line[realIndex].first == 1) //single pixel segment
     {
         line[realIndex].second = value;
         if (m_OnTheFlyCleanup)//now see if we can merge it into adjacent segments
         {
-            if (realIndex>0 && realIndex < line.size() - 1 &&
-                line[realIndex + 1].second == value && line[realIndex - 1].second == value)
+            bool mergePrev = realIndex > 0 && line[realIndex - 1].second == value
+                && line[realIndex - 1].first < maxLength;
+            bool mergeNext = realIndex < line.size() - 1 && line[realIndex + 1].second == value
+                && line[realIndex + 1].first < maxLength;
+            if (mergePrev && mergeNext &&
+                SizeValueType(line[realIndex - 1].first) + 1 + line[realIndex + 1].first <= maxLength)
             {
                 //merge these 3 segments
                 line[realIndex - 1].first += 1 + line[realIndex + 1].first;
@@ -120,7 +175,7 @@ SetPixel(RLLine & line, IndexValueType & segmentRemainder, IndexValueType & real
                 realIndex--;
                 return -2;
             }
-            if (realIndex>0 && line[realIndex - 1].second == value)
+            if (mergePrev)
             {
                 //merge into previous
                 line[realIndex - 1].first++;
@@ -128,7 +183,7 @@ SetPixel(RLLine & line, IndexValueType & segmentRemainder, IndexValueType & real
                 realIndex--; assert(segmentRemainder == 1);
                 return -1;
             }
-            else if (realIndex < line.size() - 1 && line[realIndex + 1].second == value)
+            else if (mergeNext)
             {
                 //merge into next
                 segmentRemainder = ++(line[realIndex + 1].first);
@@ -138,7 +193,8 @@ SetPixel(RLLine & line, IndexValueType & segmentRemainder, IndexValueType & real
         }
         return 0;
     }
-    else if (segmentRemainder==1 && realIndex < line.size() - 1 && line[realIndex + 1].second == value)
+    else if (segmentRemainder==1 && realIndex < line.size() - 1 && line[realIndex + 1].second == value
+        && line[realIndex + 1].first < maxLength)
     {
         //shift this pixel to next segment
         line[realIndex].first--;
@@ -146,7 +202,8 @@ SetPixel(RLLine & line, IndexValueType & segmentRemainder, IndexValueType & real
         realIndex++;
         return 0;
     }
-    else if (realIndex>0 && segmentRemainder == line[realIndex].first && line[realIndex - 1].second == value)
+    else if (realIndex>0 && segmentRemainder == line[realIndex].first && line[realIndex - 1].second == value
+        && line[realIndex - 1].first < maxLength)
     {
         //shift this pixel to previous segment
         line[realIndex].first--;
@@ -195,18 +252,10 @@ SetPixel(const IndexType & index, const TPixel & value)
     IndexValueType bri0 = this->GetBufferedRegion().GetIndex(0);
     typename BufferType::IndexType bi = truncateIndex(index);
     RLLine & line = myBuffer->GetPixel(bi);
-    IndexValueType t = 0;
-    for (IndexValueType x = 0; x < line.size(); x++)
-    {
-        t += line[x].first;
-        if (t > index[0] - bri0)
-        {
-            t -= index[0] - bri0; //we need to supply a reference
-            SetPixel(line, t, x, value);
-            return;
-        }
-    }
-    throw itk::ExceptionObject(__FILE__, __LINE__, "Reached past the end of Run-Length line!", __FUNCTION__);
+    IndexValueType t;
+    IndexValueType x = FindSegment(bi, index[0] - bri0, t);
+    t -= index[0] - bri0; //we need to supply a reference
+    SetPixel(line, t, x, value);
 }
 
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
@@ -220,16 +269,90 @@ GetPixel(const IndexType & index) const
     IndexValueType bri0 = this->GetBufferedRegion().GetIndex(0);
     typename BufferType::IndexType bi = truncateIndex(index);
     RLLine & line = myBuffer->GetPixel(bi);
-    IndexValueType t = 0;
-    for (IndexValueType x = 0; x < line.size(); x++)
+    IndexValueType t;
+    return line[FindSegment(bi, index[0] - bri0, t)].second;
+}
+
+template< typename TPixel, unsigned int VImageDimension, typename CounterType >
+typename RLEImage<TPixel, VImageDimension, CounterType>::IndexValueType
+RLEImage<TPixel, VImageDimension, CounterType>::
+FindSegment(const typename BufferType::IndexType & bi, IndexValueType x, IndexValueType & segmentEnd) const
+{
+    typename LineIndexType::ConstPointer lineIndex = GetLineIndexImage();
+    if (lineIndex)
+    {
+        const RLLineIndex & li = lineIndex->GetPixel(bi);
+        typename RLLineIndex::const_iterator it = std::upper_bound(li.begin(), li.end(), x);
+        if (it != li.end())
+        {
+            segmentEnd = *it;
+            return it - li.begin();
+        }
+    }
+    else
     {
-        t += line[x].first;
-        if (t > index[0] - bri0)
-            return line[x].second;
+        const RLLine & line = myBuffer->GetPixel(bi);
+        IndexValueType t = 0;
+        for (IndexValueType s = 0; s < line.size(); s++)
+        {
+            t += line[s].first;
+            if (t > x)
+            {
+                segmentEnd = t;
+                return s;
+            }
+        }
     }
     throw itk::ExceptionObject(__FILE__, __LINE__, "Reached past the end of Run-Length line!", __FUNCTION__);
 }
 
+template< typename TPixel, unsigned int VImageDimension, typename CounterType >
+typename RLEImage<TPixel, VImageDimension, CounterType>::LineIndexType::ConstPointer
+RLEImage<TPixel, VImageDimension, CounterType>::GetLineIndexImage() const
+{
+    itk::MutexLockHolder<itk::SimpleFastMutexLock> lock(m_LineIndexLock);
+    if (m_UseLineIndex && m_LineIndexValid && m_LineIndex
+        && m_LineIndexTime.GetMTime() > this->GetMTime())
+        return m_LineIndex;
+    return ITK_NULLPTR;
+}
+
+template< typename TPixel, unsigned int VImageDimension, typename CounterType >
+void RLEImage<TPixel, VImageDimension, CounterType>::UpdateLineIndex() const
+{
+    //threads that ask for the index while it is being built wait for it,
+    //readers of the previous index are not blocked
+    itk::MutexLockHolder<itk::SimpleFastMutexLock> buildLock(m_LineIndexBuildLock);
+    if (!m_UseLineIndex || IsLineIndexValid())
+        return;
+
+    //the index is built aside, the old one may still be in use
+    typename LineIndexType::Pointer lineIndex = LineIndexType::New();
+    lineIndex->SetLargestPossibleRegion(myBuffer->GetLargestPossibleRegion());
+    lineIndex->SetBufferedRegion(myBuffer->GetBufferedRegion());
+    lineIndex->Allocate();
+
+    itk::ImageRegionConstIterator<BufferType> it(myBuffer, myBuffer->GetBufferedRegion());
+    itk::ImageRegionIterator<LineIndexType> iit(lineIndex, myBuffer->GetBufferedRegion());
+    for (; !it.IsAtEnd(); ++it, ++iit)
+    {
+        const RLLine & line = it.Value();
+        RLLineIndex & li = iit.Value();
+        li.resize(line.size());
+        typename RLLineIndex::value_type t = 0;
+        for (SizeValueType s = 0; s < line.size(); s++)
+        {
+            t += line[s].first;
+            li[s] = t;
+        }
+    }
+
+    itk::MutexLockHolder<itk::SimpleFastMutexLock> lock(m_LineIndexLock);
+    m_LineIndex = lineIndex.GetPointer();
+    m_LineIndexValid = true;
+    m_LineIndexTime.Modified();
+}
+
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
 void RLEImage<TPixel, VImageDimension, CounterType>
 ::PrintSelf(std::ostream & os, itk::Indent indent) const
@@ -257,4 +380,35 @@ void RLEImage<TPixel, VImageDimension, CounterType>
     os.precision(prec);
 }
 
+template< typename TPixel, unsigned int VImageDimension,
+    typename TInputCounter, typename TOutputCounter >
+void ConvertRLEImageCounterType(
+    const RLEImage<TPixel, VImageDimension, TInputCounter> *input,
+    RLEImage<TPixel, VImageDimension, TOutputCounter> *output)
+{
+    typedef RLEImage<TPixel, VImageDimension, TInputCounter> InputImageType;
+    typedef RLEImage<TPixel, VImageDimension, TOutputCounter> OutputImageType;
+
+    output->CopyInformation(input);
+    output->SetBufferedRegion(input->GetBufferedRegion());
+    output->SetRequestedRegion(input->GetBufferedRegion());
+    output->Allocate();
+
+    typedef typename InputImageType::BufferType InputBufferType;
+    typedef typename OutputImageType::BufferType OutputBufferType;
+    itk::ImageRegionConstIterator<InputBufferType> iIt(
+        input->GetBuffer(), input->GetBuffer()->GetBufferedRegion());
+    itk::ImageRegionIterator<OutputBufferType> oIt(
+        output->GetBuffer(), output->GetBuffer()->GetBufferedRegion());
+    for (; !iIt.IsAtEnd(); ++iIt, ++oIt)
+    {
+        const typename InputImageType::RLLine & iLine = iIt.Value();
+        typename OutputImageType::RLLine & oLine = oIt.Value();
+        oLine.clear();
+        for (itk::SizeValueType x = 0; x < iLine.size(); x++)
+            OutputImageType::AppendRun(oLine, iLine[x].first, iLine[x].second);
+    }
+    output->Modified();
+}
+
 #endif //RLEImage_txx
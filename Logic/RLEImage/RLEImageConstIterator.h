@@ -304,7 +304,7 @@ protected: //made protected so other iterators can access
       m_Index0 = ind0;
       rlLine = &bi.Value();
 
-      CounterType t = 0;
+      IndexValueType t = 0;
       SizeValueType x = 0;
 
       for (; x < (*rlLine).size(); x++)
@@ -148,7 +148,7 @@ void RegionOfInterestImageFilter<RLEImage<TPixel, VImageDimension, CounterType>,
             typename RLEImageType::RLLine &oLine = oIt.Value();
             oLine.clear();
             const typename RLEImageType::RLLine &iLine = iIt.Value();
-            CounterType t = 0;
+            IndexValueType t = 0;
             SizeValueType x = 0;
             //find start
             for (; x < iLine.size(); x++)
@@ -334,7 +334,8 @@ void RegionOfInterestImageFilter<Image<TPixel, VImageDimension>,
         while (x < size0)
         {
             typename RLEImageType::RLSegment s(0, iIt.Value());
-            while (x < size0 && iIt.Value() == s.second)
+            while (x < size0 && iIt.Value() == s.second
+                && s.first < RLEImageType::MaxSegmentLength())
             {
                 x++;
                 s.first++;
@@ -479,7 +480,7 @@ void RegionOfInterestImageFilter<RLEImage<TPixel, VImageDimension, CounterType>,
   while (!iIt.IsAtEnd())
   {
     const typename RLEImageType::RLLine &iLine = iIt.Value();
-    CounterType t = 0;
+    IndexValueType t = 0;
     SizeValueType x = 0;
     //find start
     for (; x < iLine.size(); x++)
@@ -316,33 +316,58 @@ protected:
   virtual void CallCopyOutputRegionToInputRegion(InputImageRegionType &destRegion,
                                                  const OutputImageRegionType &srcRegion) ITK_OVERRIDE;
 
-  void GenerateData() ITK_OVERRIDE;
-  //void ThreadedGenerateData(const OutputImageRegionType &outputRegionForThread,
-  //    itk::ThreadIdType threadId);
+  /** Selects between the main and the preview input */
+  void BeforeThreadedGenerateData() ITK_OVERRIDE;
 
-  /** Uncompresses a RLE line into a buffer pointed by out.
+  /**
+    * The output slice is split into bands of lines, and each thread decodes
+    * the part of every RLLine that falls into its band. Use
+    * SetNumberOfThreads(1) to get the single-threaded behavior.
+    */
+  void ThreadedGenerateData(const OutputImageRegionType &outputRegionForThread,
+                            itk::ThreadIdType threadId) ITK_OVERRIDE;
+
+  /** Releases the skip index used by the update */
+  void AfterThreadedGenerateData() ITK_OVERRIDE;
+
+  /** Uncompresses pixels [x0, x0+nx) of a RLE line into a buffer pointed by out.
     * After each pixel is written, adds stride to the pointer.
-    * The buffer needs to have enough room.
+    * If the line's skip index is given, the first segment is found by
+    * binary search. The buffer needs to have enough room.
     * No error checking is conducted. */
-  inline void uncompressLine(const typename InputImageType::RLLine & line, TPixel *out, long stride)
+  inline void uncompressLine(const typename InputImageType::RLLine & line,
+                             const typename InputImageType::RLLineIndex *index,
+                             long x0, long nx, TPixel *out, long stride)
   {
-    //complete Run-Length Lines have to be buffered
-    itkAssertOrThrowMacro(this->GetInput()->GetBufferedRegion().GetSize(0)
-                          == this->GetInput()->GetLargestPossibleRegion().GetSize(0),
-                          "BufferedRegion must contain complete run-length lines!");
-#ifdef _DEBUG
-    int debugCount = 0;
-#endif
-    for (int x = 0; x < line.size(); x++)
-      for (CounterType r = 0; r < line[x].first; r++)
+    // Skip the segments that lie completely before x0
+    size_t s = 0;
+    long t;
+    if (index && x0 > 0)
+      {
+      s = std::upper_bound(index->begin(), index->end(), x0) - index->begin();
+      t = (*index)[s];
+      }
+    else
+      {
+      t = line[0].first;
+      while (t <= x0)
+        t += line[++s].first;
+      }
+
+    // Copy the segments that overlap [x0, x0+nx)
+    long x = x0, xEnd = x0 + nx;
+    while (x < xEnd)
+      {
+      long segEnd = std::min(t, xEnd);
+      const TPixel &value = line[s].second;
+      for (; x < segEnd; x++)
         {
-#ifdef _DEBUG
-        debugCount++;
-        assert(debugCount <= this->GetInput()->GetLargestPossibleRegion().GetSize(0));
-#endif
-        *out = line[x].second;
+        *out = value;
         out += stride;
         }
+      if (++s < line.size())
+        t += line[s].first;
+      }
   }
 
 private:
@@ -370,6 +395,12 @@ private:
   // Whether the main input should always be bypassed
   bool m_BypassMainInput;
 
+  // The input (main or preview) from which the current slice is extracted
+  const InputImageType *m_SourceImage;
+
+  // Skip index of the source image, held for the duration of the update so
+  // that a rebuild by another thread does not release it
+  typename InputImageType::LineIndexType::ConstPointer m_SourceLineIndex;
 };
 
 #ifndef ITK_MANUAL_INSTANTIATION
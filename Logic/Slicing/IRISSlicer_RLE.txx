@@ -65,6 +65,8 @@ IRISSlicer<RLEImage<TPixel, 3, CounterType>, TOutputImage, TPreviewImage>
 
   // Initialize to a zero slice index
   m_SliceIndex = 0;
+
+  m_SourceImage = NULL;
 }
 
 template< typename TPixel, typename CounterType, class TOutputImage, class TPreviewImage>
@@ -197,131 +199,103 @@ void IRISSlicer<RLEImage<TPixel, 3, CounterType>, TOutputImage, TPreviewImage>
 
 #include "RLEImageRegionConstIterator.h"
 
-#define sign(forward) (forward ? 1 : -1)
-
 template< typename TPixel, typename CounterType, class TOutputImage, class TPreviewImage>
 void IRISSlicer<RLEImage<TPixel, 3, CounterType>, TOutputImage, TPreviewImage>
-::GenerateData()
+::BeforeThreadedGenerateData()
 {
-  // Here's the input and output
-  const InputImageType *inputPtr = this->GetInput();
-  OutputImageType *outputPtr = this->GetOutput();
-
   // Decide if we want to use the preview input instead
+  m_SourceImage = this->GetInput();
   const InputImageType *preview =
       (InputImageType *) this->GetInputs()[1].GetPointer();
 
-  if (preview && preview->GetMTime() > inputPtr->GetMTime())
+  if (preview && preview->GetMTime() > m_SourceImage->GetMTime())
+    {
+    m_SourceImage = preview;
+    }
+
+  //complete Run-Length Lines have to be buffered
+  itkAssertOrThrowMacro(m_SourceImage->GetBufferedRegion().GetSize(0)
+                        == m_SourceImage->GetLargestPossibleRegion().GetSize(0),
+                        "BufferedRegion must contain complete run-length lines!");
+
+  // Slices along x cut across every line. Build the skip index, so that the
+  // segment at the slice position is found by binary search. The index is
+  // reused by subsequent slices until the image is modified. Slicers of
+  // other views may use the same index concurrently.
+  m_SourceLineIndex = NULL;
+  if (m_SliceDirectionImageAxis == 0)
     {
-    inputPtr = preview;
+    m_SourceImage->UpdateLineIndex();
+    m_SourceLineIndex = m_SourceImage->GetLineIndexImage();
     }
+}
+
+template< typename TPixel, typename CounterType, class TOutputImage, class TPreviewImage>
+void IRISSlicer<RLEImage<TPixel, 3, CounterType>, TOutputImage, TPreviewImage>
+::ThreadedGenerateData(const OutputImageRegionType &outputRegionForThread,
+                       itk::ThreadIdType itkNotUsed(threadId))
+{
+  // Here's the input and output
+  const InputImageType *inputPtr = m_SourceImage;
+  OutputImageType *outputPtr = this->GetOutput();
 
-  this->AllocateOutputs();
+  if (outputRegionForThread.GetNumberOfPixels() == 0)
+    return;
+
+  // The block of the input volume that maps onto this thread's part of the slice
+  InputImageRegionType inRegion;
+  this->CallCopyOutputRegionToInputRegion(inRegion, outputRegionForThread);
 
   // Important: the size needs to be cast to long to avoid problems with
   // pointer arithmetic on some MSVC versions!
-  long szVol[3];
-  szVol[0] = inputPtr->GetBufferedRegion().GetSize(0);
-  szVol[1] = inputPtr->GetBufferedRegion().GetSize(1);
-  szVol[2] = inputPtr->GetBufferedRegion().GetSize(2);
-
-  // Also cast the output size to long
   long szSlice[2];
   szSlice[0] = outputPtr->GetBufferedRegion().GetSize(0);
   szSlice[1] = outputPtr->GetBufferedRegion().GetSize(1);
 
-  // The sign of the line and pixel traversal directions
-  int s_line = (m_LineTraverseForward) ? 1 : -1;
-  int s_pixel = (m_PixelTraverseForward) ? 1 : -1;
+  // Steps in the output buffer that correspond to unit steps along each
+  // image axis. There is no step along the slicing axis.
+  long stride[3];
+  stride[m_SliceDirectionImageAxis] = 0;
+  stride[m_PixelDirectionImageAxis] = (m_PixelTraverseForward) ? 1 : -1;
+  stride[m_LineDirectionImageAxis] = ((m_LineTraverseForward) ? 1 : -1) * szSlice[0];
 
-  typename TOutputImage::IndexType oStartInd;
-  oStartInd[1] = (m_LineTraverseForward) ? 0 : szSlice[1] - 1;
-  oStartInd[0] = (m_PixelTraverseForward) ? 0 : szSlice[0] - 1;
+  // Output pixel that corresponds to the image origin
+  typename TOutputImage::IndexType oStartInd = outputPtr->GetBufferedRegion().GetIndex();
+  oStartInd[1] += (m_LineTraverseForward) ? 0 : szSlice[1] - 1;
+  oStartInd[0] += (m_PixelTraverseForward) ? 0 : szSlice[0] - 1;
 
   typename OutputImageType::PixelType *outSlice = &outputPtr->GetPixel(oStartInd);
 
-  if (m_SliceDirectionImageAxis == 2) //slicing along z
-    {
-#pragma omp parallel for
-    for (int y = 0; y < szVol[1]; y++)
-      {
-      typename InputImageType::BufferType::IndexType lineIndex = { { y, (int) m_SliceIndex } };
-      const typename InputImageType::RLLine & line = inputPtr->GetBuffer()->GetPixel(lineIndex);
-      if (m_LineDirectionImageAxis == 1) //y is line coordinate
-        {
-        assert(m_PixelDirectionImageAxis == 0); //x is pixel coordinate
-        uncompressLine(line, outSlice + s_line*y*szVol[0], s_pixel * 1);
-        }
-      else if (m_LineDirectionImageAxis == 0) //x is line coordinate
-        {
-        assert(m_PixelDirectionImageAxis == 1); //y is pixel coordinate
-        uncompressLine(line, outSlice + s_pixel*y, s_line*szVol[1]);
-        }
-      else
-        throw itk::ExceptionObject(__FILE__, __LINE__, "SliceDirectionImageAxis and SliceDirectionImageAxis cannot both have a value of 2!", __FUNCTION__);
-      }
-    }
-  else if (m_SliceDirectionImageAxis == 1) //slicing along y
+  // The part of each RLLine that we need. When slicing along x, this is a
+  // single pixel; otherwise it is the x-range assigned to this thread
+  long x0 = inRegion.GetIndex(0) - inputPtr->GetBufferedRegion().GetIndex(0);
+  long nx = inRegion.GetSize(0);
+
+  long y0 = inRegion.GetIndex(1), y1 = y0 + (long) inRegion.GetSize(1);
+  long z0 = inRegion.GetIndex(2), z1 = z0 + (long) inRegion.GetSize(2);
+
+  const typename InputImageType::BufferType *buffer = inputPtr->GetBuffer();
+  const typename InputImageType::LineIndexType *index = m_SourceLineIndex;
+  for (long z = z0; z < z1; z++)
     {
-#pragma omp parallel for
-    for (int z = 0; z < szVol[2]; z++)
+    for (long y = y0; y < y1; y++)
       {
-      typename InputImageType::BufferType::IndexType lineIndex = { { (int) m_SliceIndex, z } };
-      const typename InputImageType::RLLine & line = inputPtr->GetBuffer()->GetPixel(lineIndex);
-      if (m_LineDirectionImageAxis == 2) //z is line coordinate
-        {
-        assert(m_PixelDirectionImageAxis == 0); //x is pixel coordinate
-        uncompressLine(line, outSlice + s_line*z*szVol[0], s_pixel * 1);
-        }
-      else if (m_LineDirectionImageAxis == 0) //x is line coordinate
-        {
-        assert(m_PixelDirectionImageAxis == 2); //z is pixel coordinate
-        uncompressLine(line, outSlice + s_pixel*z, s_line*szVol[2]);
-        }
-      else
-        throw itk::ExceptionObject(__FILE__, __LINE__, "SliceDirectionImageAxis and SliceDirectionImageAxis cannot both have a value of 1!", __FUNCTION__);
+      typename InputImageType::BufferType::IndexType lineIndex = { { y, z } };
+      const typename InputImageType::RLLine & line = buffer->GetPixel(lineIndex);
+      uncompressLine(line, index ? &index->GetPixel(lineIndex) : NULL, x0, nx,
+                     outSlice + x0 * stride[0] + y * stride[1] + z * stride[2],
+                     stride[0]);
       }
     }
-  else //slicing along x, the low-preformance case
-    {
-    assert(m_SliceDirectionImageAxis == 0);
-#pragma omp parallel for
-    for (int z = 0; z < szVol[2]; z++)
-      for (int y = 0; y < szVol[1]; y++)
-        {
-        typename InputImageType::BufferType::IndexType lineIndex = { { y, z } };
-        const typename InputImageType::RLLine & line = inputPtr->GetBuffer()->GetPixel(lineIndex);
-        int t = 0;
-        for (int x = 0; x < line.size(); x++)
-          {
-          t += line[x].first;
-          if (t > m_SliceIndex)
-            {
-            if (m_LineDirectionImageAxis == 2) //z is line coordinate
-              {
-              assert(m_PixelDirectionImageAxis == 1); //y is pixel coordinate
-              *(outSlice + s_line*z*szVol[1] + s_pixel *y) = line[x].second;;
-              }
-            else if (m_LineDirectionImageAxis == 1) //y is line coordinate
-              {
-              assert(m_PixelDirectionImageAxis == 2); //z is pixel coordinate
-              *(outSlice + s_pixel*z + s_line *y*szVol[2]) = line[x].second;
-              }
-            else
-              throw itk::ExceptionObject(__FILE__, __LINE__, "SliceDirectionImageAxis and SliceDirectionImageAxis cannot both have a value of 0!", __FUNCTION__);
-            break;
-            }
-          }
-        }
-    }
 }
 
-//template< typename TPixel, typename CounterType, class TOutputImage, class TPreviewImage>
-//void IRISSlicer<RLEImage<TPixel, 3, CounterType>, TOutputImage, TPreviewImage>
-//::AfterThreadedGenerateData()
-//{
-//
-//}
+template< typename TPixel, typename CounterType, class TOutputImage, class TPreviewImage>
+void IRISSlicer<RLEImage<TPixel, 3, CounterType>, TOutputImage, TPreviewImage>
+::AfterThreadedGenerateData()
+{
+  // Do not keep a replaced skip index alive between updates
+  m_SourceLineIndex = NULL;
+}
 
 template< typename TPixel, typename CounterType, class TOutputImage, class TPreviewImage>
 void IRISSlicer<RLEImage<TPixel, 3, CounterType>, TOutputImage, TPreviewImage>
@@ -46,6 +46,7 @@
 #include "itkImageToImageFilter.h"
 #include "itkTransform.h"
 #include "itkDataObjectDecorator.h"
+#include "NonOrthogonalSlicerLineKernel.h"
 
 using itk::DataObjectDecorator;
 using itk::ProcessObject;
@@ -74,6 +75,14 @@ public:
 
   inline void ProcessVoxel(double *cix, bool use_nn, OutputComponentType **out_ptr);
 
+  /**
+   * Process n voxels along a line starting at cix and advancing by step. The
+   * position cix is updated. The default implementation processes blocks of
+   * voxels using the vectorized line kernel.
+   */
+  inline void ProcessLine(double *cix, const double *step, int n, bool use_nn,
+                          OutputComponentType **out_ptr);
+
   inline void SkipVoxels(int n, OutputComponentType **out_ptr);
 
 protected:
@@ -82,6 +91,12 @@ protected:
   typedef FastLinearInterpolator<TInputImage, double, TInputImage::ImageDimension> Interpolator;
   Interpolator m_Interpolator;
 
+  // The kernel that samples several voxels along a line at once
+  typedef NonOrthogonalSlicerLineKernel<
+    typename TInputImage::InternalPixelType, OutputComponentType,
+    TInputImage::ImageDimension> LineKernel;
+  LineKernel m_LineKernel;
+
   // Number of components
   int m_NumComponents;
 
@@ -196,6 +211,12 @@ public:
     assert(0);
   }
 
+  inline void ProcessLine(double *cix, const double *step, int n, bool use_nn,
+                          OutputComponentType **out_ptr)
+  {
+    assert(0);
+  }
+
   inline void SkipVoxels(int n, OutputComponentType **out_ptr) {}
 };
 
@@ -217,6 +238,8 @@ public:
   ~NonOrthogonalSlicerPixelAccessTraitsWorker();
 
   inline void ProcessVoxel(double *cix, bool use_nn, OutputComponentType **out_ptr);
+  inline void ProcessLine(double *cix, const double *step, int n, bool use_nn,
+                          OutputComponentType **out_ptr);
   inline void SkipVoxels(int n, OutputComponentType **out_ptr);
 
 protected:
@@ -258,6 +281,8 @@ public:
   ~NonOrthogonalSlicerPixelAccessTraitsWorker();
 
   inline void ProcessVoxel(double *cix, bool use_nn, OutputComponentType **out_ptr);
+  inline void ProcessLine(double *cix, const double *step, int n, bool use_nn,
+                          OutputComponentType **out_ptr);
   inline void SkipVoxels(int n, OutputComponentType **out_ptr);
 
 protected:
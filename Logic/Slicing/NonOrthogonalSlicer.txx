@@ -243,14 +243,8 @@ NonOrthogonalSlicer<TInputImage, TOutputImage>
         }
 
       // Process the voxels that cross the image cube
-      for(int i = kStart; i <= kEnd; i++)
-        {
-        worker.ProcessVoxel(cixSample.GetDataPointer(), use_nn, &outPixelPtr);
-
-        // Update the sample location
-        for(int d = 0; d < InputImageDimension; d++)
-          cixSample[d] += cixStep[d];
-        }
+      worker.ProcessLine(cixSample.GetDataPointer(), cixStep.GetDataPointer(),
+                         kEnd - kStart + 1, use_nn, &outPixelPtr);
 
       // Process the rest
       if(kEnd < line_len - 1)
@@ -264,7 +258,9 @@ NonOrthogonalSlicer<TInputImage, TOutputImage>
 template <class TInputImage, class TOutputImage>
 NonOrthogonalSlicerPixelAccessTraitsWorker<TInputImage, TOutputImage>
 ::NonOrthogonalSlicerPixelAccessTraitsWorker(TInputImage *image)
-  : m_Interpolator(image)
+  : m_Interpolator(image),
+    m_LineKernel(image->GetBufferPointer(), m_Interpolator.GetPointerIncrement(),
+                 image->GetLargestPossibleRegion().GetSize())
 {
   m_NumComponents = m_Interpolator.GetPointerIncrement();
   m_Buffer = new double[m_NumComponents];
@@ -301,6 +297,60 @@ NonOrthogonalSlicerPixelAccessTraitsWorker<TInputImage, TOutputImage>
     }
 }
 
+template <class TInputImage, class TOutputImage>
+void
+NonOrthogonalSlicerPixelAccessTraitsWorker<TInputImage, TOutputImage>
+::ProcessLine(double *cix, const double *step, int n, bool use_nn,
+              OutputComponentType **out_ptr)
+{
+  const unsigned int VDim = TInputImage::ImageDimension;
+
+  // Positions of the voxels in a block, all x coordinates first, etc.
+  double pos[VDim * 4], cix_voxel[VDim];
+
+  int i = 0;
+  for(; i + 4 <= n; i += 4)
+    {
+    // The positions are accumulated one step at a time, exactly as when
+    // processing voxel by voxel, so that both paths sample the same points
+    for(int j = 0; j < 4; j++)
+      {
+      for(unsigned int d = 0; d < VDim; d++)
+        {
+        pos[d * 4 + j] = cix[d];
+        cix[d] += step[d];
+        }
+      }
+
+    bool done = use_nn
+        ? m_LineKernel.NearestNeighborBlock(pos, *out_ptr)
+        : m_LineKernel.InterpolateBlock(pos, *out_ptr);
+
+    if(done)
+      {
+      *out_ptr += 4 * m_NumComponents;
+      }
+    else
+      {
+      // Some of the voxels are on the border, sample them one at a time
+      for(int j = 0; j < 4; j++)
+        {
+        for(unsigned int d = 0; d < VDim; d++)
+          cix_voxel[d] = pos[d * 4 + j];
+        this->ProcessVoxel(cix_voxel, use_nn, out_ptr);
+        }
+      }
+    }
+
+  // Process the remaining voxels
+  for(; i < n; i++)
+    {
+    this->ProcessVoxel(cix, use_nn, out_ptr);
+    for(unsigned int d = 0; d < VDim; d++)
+      cix[d] += step[d];
+    }
+}
+
 template <class TInputImage, class TOutputImage>
 void
 NonOrthogonalSlicerPixelAccessTraitsWorker<TInputImage, TOutputImage>
@@ -356,6 +406,20 @@ NonOrthogonalSlicerPixelAccessTraitsWorker<itk::VectorImageToImageAdaptor<TPixel
     }
 }
 
+template <typename TPixelType, unsigned int Dimension, typename TOutputImage>
+void
+NonOrthogonalSlicerPixelAccessTraitsWorker<itk::VectorImageToImageAdaptor<TPixelType, Dimension>, TOutputImage>
+::ProcessLine(double *cix, const double *step, int n, bool use_nn,
+              OutputComponentType **out_ptr)
+{
+  for(int i = 0; i < n; i++)
+    {
+    this->ProcessVoxel(cix, use_nn, out_ptr);
+    for(unsigned int d = 0; d < Dimension; d++)
+      cix[d] += step[d];
+    }
+}
+
 template <typename TPixelType, unsigned int Dimension, typename TOutputImage>
 void
 NonOrthogonalSlicerPixelAccessTraitsWorker<itk::VectorImageToImageAdaptor<TPixelType, Dimension>, TOutputImage>
@@ -420,6 +484,21 @@ NonOrthogonalSlicerPixelAccessTraitsWorker<
 }
 
 
+template <typename TPixelType, unsigned int Dimension, typename TAccessor, typename TOutputImage>
+void
+NonOrthogonalSlicerPixelAccessTraitsWorker<
+  itk::ImageAdaptor<itk::VectorImage<TPixelType, Dimension>, TAccessor>, TOutputImage>
+::ProcessLine(double *cix, const double *step, int n, bool use_nn,
+              OutputComponentType **out_ptr)
+{
+  for(int i = 0; i < n; i++)
+    {
+    this->ProcessVoxel(cix, use_nn, out_ptr);
+    for(unsigned int d = 0; d < Dimension; d++)
+      cix[d] += step[d];
+    }
+}
+
 template <typename TPixelType, unsigned int Dimension, typename TAccessor, typename TOutputImage>
 void
 NonOrthogonalSlicerPixelAccessTraitsWorker<
@@ -0,0 +1,298 @@
+#ifndef NONORTHOGONALSLICERLINEKERNEL_H
+#define NONORTHOGONALSLICERLINEKERNEL_H
+
+#include <cmath>
+#include <cstddef>
+#include "itkSize.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SNAP_SLICER_SIMD_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#if defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+#define SNAP_SLICER_SIMD_SSE2
+#endif
+
+/**
+ * A minimal set of operations on a vector of four doubles, used by the line
+ * kernel of the NonOrthogonalSlicer. Depending on the instruction set that
+ * the compiler targets, the vector maps onto a single AVX register, onto a
+ * pair of SSE2 registers, or onto a plain array.
+ */
+namespace slicer_simd
+{
+
+#if defined(SNAP_SLICER_SIMD_AVX)
+
+struct Vec4d { __m256d v; };
+
+inline const char *GetInstructionSet() { return "AVX"; }
+inline Vec4d load(const double *p) { Vec4d r; r.v = _mm256_loadu_pd(p); return r; }
+inline void store(double *p, const Vec4d &a) { _mm256_storeu_pd(p, a.v); }
+inline Vec4d set1(double x) { Vec4d r; r.v = _mm256_set1_pd(x); return r; }
+inline Vec4d add(const Vec4d &a, const Vec4d &b) { Vec4d r; r.v = _mm256_add_pd(a.v, b.v); return r; }
+inline Vec4d sub(const Vec4d &a, const Vec4d &b) { Vec4d r; r.v = _mm256_sub_pd(a.v, b.v); return r; }
+inline Vec4d mul(const Vec4d &a, const Vec4d &b) { Vec4d r; r.v = _mm256_mul_pd(a.v, b.v); return r; }
+inline Vec4d vmin(const Vec4d &a, const Vec4d &b) { Vec4d r; r.v = _mm256_min_pd(a.v, b.v); return r; }
+inline Vec4d vmax(const Vec4d &a, const Vec4d &b) { Vec4d r; r.v = _mm256_max_pd(a.v, b.v); return r; }
+inline Vec4d vfloor(const Vec4d &a) { Vec4d r; r.v = _mm256_floor_pd(a.v); return r; }
+
+// Bit j of the result is set if lo <= a[j] <= hi
+inline int in_range(const Vec4d &a, const Vec4d &lo, const Vec4d &hi)
+{
+  return _mm256_movemask_pd(_mm256_and_pd(_mm256_cmp_pd(a.v, lo.v, _CMP_GE_OQ),
+                                          _mm256_cmp_pd(a.v, hi.v, _CMP_LE_OQ)));
+}
+
+#elif defined(SNAP_SLICER_SIMD_SSE2)
+
+struct Vec4d { __m128d lo, hi; };
+
+inline const char *GetInstructionSet() { return "SSE2"; }
+inline Vec4d load(const double *p)
+  { Vec4d r; r.lo = _mm_loadu_pd(p); r.hi = _mm_loadu_pd(p+2); return r; }
+inline void store(double *p, const Vec4d &a)
+  { _mm_storeu_pd(p, a.lo); _mm_storeu_pd(p+2, a.hi); }
+inline Vec4d set1(double x)
+  { Vec4d r; r.lo = r.hi = _mm_set1_pd(x); return r; }
+inline Vec4d add(const Vec4d &a, const Vec4d &b)
+  { Vec4d r; r.lo = _mm_add_pd(a.lo, b.lo); r.hi = _mm_add_pd(a.hi, b.hi); return r; }
+inline Vec4d sub(const Vec4d &a, const Vec4d &b)
+  { Vec4d r; r.lo = _mm_sub_pd(a.lo, b.lo); r.hi = _mm_sub_pd(a.hi, b.hi); return r; }
+inline Vec4d mul(const Vec4d &a, const Vec4d &b)
+  { Vec4d r; r.lo = _mm_mul_pd(a.lo, b.lo); r.hi = _mm_mul_pd(a.hi, b.hi); return r; }
+inline Vec4d vmin(const Vec4d &a, const Vec4d &b)
+  { Vec4d r; r.lo = _mm_min_pd(a.lo, b.lo); r.hi = _mm_min_pd(a.hi, b.hi); return r; }
+inline Vec4d vmax(const Vec4d &a, const Vec4d &b)
+  { Vec4d r; r.lo = _mm_max_pd(a.lo, b.lo); r.hi = _mm_max_pd(a.hi, b.hi); return r; }
+
+#if defined(__SSE4_1__)
+inline __m128d floor2(__m128d a) { return _mm_floor_pd(a); }
+#else
+// Truncate and correct negative non-integers. Only valid for arguments that
+// fit into an int, which the kernel guarantees by clamping its coordinates
+inline __m128d floor2(__m128d a)
+{
+  __m128d t = _mm_cvtepi32_pd(_mm_cvttpd_epi32(a));
+  return _mm_sub_pd(t, _mm_and_pd(_mm_cmpgt_pd(t, a), _mm_set1_pd(1.0)));
+}
+#endif
+
+inline Vec4d vfloor(const Vec4d &a)
+  { Vec4d r; r.lo = floor2(a.lo); r.hi = floor2(a.hi); return r; }
+
+inline int in_range(const Vec4d &a, const Vec4d &lo, const Vec4d &hi)
+{
+  int m_lo = _mm_movemask_pd(_mm_and_pd(_mm_cmpge_pd(a.lo, lo.lo), _mm_cmple_pd(a.lo, hi.lo)));
+  int m_hi = _mm_movemask_pd(_mm_and_pd(_mm_cmpge_pd(a.hi, lo.hi), _mm_cmple_pd(a.hi, hi.hi)));
+  return m_lo | (m_hi << 2);
+}
+
+#else
+
+struct Vec4d { double v[4]; };
+
+inline const char *GetInstructionSet() { return "scalar"; }
+inline Vec4d load(const double *p)
+  { Vec4d r; for(int j = 0; j < 4; j++) r.v[j] = p[j]; return r; }
+inline void store(double *p, const Vec4d &a)
+  { for(int j = 0; j < 4; j++) p[j] = a.v[j]; }
+inline Vec4d set1(double x)
+  { Vec4d r; for(int j = 0; j < 4; j++) r.v[j] = x; return r; }
+inline Vec4d add(const Vec4d &a, const Vec4d &b)
+  { Vec4d r; for(int j = 0; j < 4; j++) r.v[j] = a.v[j] + b.v[j]; return r; }
+inline Vec4d sub(const Vec4d &a, const Vec4d &b)
+  { Vec4d r; for(int j = 0; j < 4; j++) r.v[j] = a.v[j] - b.v[j]; return r; }
+inline Vec4d mul(const Vec4d &a, const Vec4d &b)
+  { Vec4d r; for(int j = 0; j < 4; j++) r.v[j] = a.v[j] * b.v[j]; return r; }
+inline Vec4d vmin(const Vec4d &a, const Vec4d &b)
+  { Vec4d r; for(int j = 0; j < 4; j++) r.v[j] = b.v[j] < a.v[j] ? b.v[j] : a.v[j]; return r; }
+inline Vec4d vmax(const Vec4d &a, const Vec4d &b)
+  { Vec4d r; for(int j = 0; j < 4; j++) r.v[j] = a.v[j] < b.v[j] ? b.v[j] : a.v[j]; return r; }
+inline Vec4d vfloor(const Vec4d &a)
+  { Vec4d r; for(int j = 0; j < 4; j++) r.v[j] = std::floor(a.v[j]); return r; }
+
+inline int in_range(const Vec4d &a, const Vec4d &lo, const Vec4d &hi)
+{
+  int mask = 0;
+  for(int j = 0; j < 4; j++)
+    if(a.v[j] >= lo.v[j] && a.v[j] <= hi.v[j])
+      mask |= (1 << j);
+  return mask;
+}
+
+#endif
+
+} // namespace slicer_simd
+
+
+/**
+ * This kernel samples blocks of four consecutive points along a line of the
+ * NonOrthogonalSlicer output. The positions of the four points are passed in
+ * as a structure of arrays (all x coordinates, then all y coordinates, etc.)
+ * and the samples are written interleaved, with all components of the first
+ * sample followed by all components of the second sample, and so on.
+ *
+ * The index arithmetic, the interpolation weights and the linear blend are
+ * computed for all four samples at once. The corner values are fetched with
+ * scalar loads, since the component type of the input image varies.
+ *
+ * The arithmetic follows FastLinearInterpolator operation by operation, so
+ * that the output matches the per-voxel path. Blocks in which any sample
+ * falls on the border of the image are rejected by InterpolateBlock() and
+ * must be sampled one voxel at a time by the caller.
+ *
+ * The generic version of the kernel handles nothing; only 3D images are
+ * supported by the specialization below.
+ */
+template <class TInputComponent, class TOutputComponent, unsigned int VDim>
+class NonOrthogonalSlicerLineKernel
+{
+public:
+  NonOrthogonalSlicerLineKernel(const TInputComponent *, int, const itk::Size<VDim> &) {}
+
+  bool InterpolateBlock(const double *, TOutputComponent *) { return false; }
+  bool NearestNeighborBlock(const double *, TOutputComponent *) { return false; }
+};
+
+
+template <class TInputComponent, class TOutputComponent>
+class NonOrthogonalSlicerLineKernel<TInputComponent, TOutputComponent, 3>
+{
+public:
+
+  NonOrthogonalSlicerLineKernel(const TInputComponent *buffer, int n_comp,
+                                const itk::Size<3> &size)
+    : m_Buffer(buffer), m_NumComponents(n_comp)
+  {
+    for(int d = 0; d < 3; d++)
+      m_Size[d] = (int) size[d];
+
+    m_StrideY = (std::ptrdiff_t) m_Size[0] * n_comp;
+    m_StrideZ = (std::ptrdiff_t) m_Size[1] * m_StrideY;
+  }
+
+  /**
+   * Trilinear interpolation of four samples. Returns false, without writing
+   * any output, unless all eight corners of every sample are in the image.
+   */
+  bool InterpolateBlock(const double *pos, TOutputComponent *out)
+  {
+    using namespace slicer_simd;
+
+    // The coordinates are clamped to just outside of the image, which does
+    // not change which samples are inside, but keeps the arithmetic bounded
+    Vec4d cix[3], c0[3], f[3];
+    int mask = 0xF;
+    for(int d = 0; d < 3; d++)
+      {
+      cix[d] = vmin(vmax(load(pos + 4 * d), set1(-2.0)), set1(m_Size[d] + 1.0));
+      c0[d] = vfloor(cix[d]);
+      mask &= in_range(c0[d], set1(0.0), set1(m_Size[d] - 2.0));
+      }
+
+    if(mask != 0xF)
+      return false;
+
+    for(int d = 0; d < 3; d++)
+      f[d] = sub(cix[d], c0[d]);
+
+    // Offsets of the first corner of each sample
+    double x0[4], y0[4], z0[4];
+    store(x0, c0[0]); store(y0, c0[1]); store(z0, c0[2]);
+
+    const TInputComponent *dp[4];
+    for(int j = 0; j < 4; j++)
+      {
+      dp[j] = m_Buffer
+          + (std::ptrdiff_t) x0[j] * m_NumComponents
+          + (std::ptrdiff_t) y0[j] * m_StrideY
+          + (std::ptrdiff_t) z0[j] * m_StrideZ;
+      }
+
+    // Interpolate each component
+    double l00[4], l01[4], l10[4], l11[4];
+    double h00[4], h01[4], h10[4], h11[4];
+    double res[4];
+    std::ptrdiff_t dx = m_NumComponents, dy = m_StrideY, dz = m_StrideZ;
+    for(int k = 0; k < m_NumComponents; k++)
+      {
+      // Fetch the corners. The differences along x are taken in the input
+      // type, as in FastLinearInterpolatorBase::lerp
+      for(int j = 0; j < 4; j++)
+        {
+        const TInputComponent *p = dp[j] + k;
+        l00[j] = p[0];       h00[j] = p[dx] - p[0];
+        l10[j] = p[dy];      h10[j] = p[dy + dx] - p[dy];
+        l01[j] = p[dz];      h01[j] = p[dz + dx] - p[dz];
+        l11[j] = p[dz + dy]; h11[j] = p[dz + dy + dx] - p[dz + dy];
+        }
+
+      Vec4d dx00 = add(load(l00), mul(load(h00), f[0]));
+      Vec4d dx01 = add(load(l01), mul(load(h01), f[0]));
+      Vec4d dx10 = add(load(l10), mul(load(h10), f[0]));
+      Vec4d dx11 = add(load(l11), mul(load(h11), f[0]));
+      Vec4d dxy0 = add(dx00, mul(sub(dx10, dx00), f[1]));
+      Vec4d dxy1 = add(dx01, mul(sub(dx11, dx01), f[1]));
+      store(res, add(dxy0, mul(sub(dxy1, dxy0), f[2])));
+
+      for(int j = 0; j < 4; j++)
+        out[j * m_NumComponents + k] = static_cast<TOutputComponent>(res[j]);
+      }
+
+    return true;
+  }
+
+  /**
+   * Nearest neighbor sampling of four samples. Samples outside of the image
+   * are set to zero, so the block is always processed.
+   */
+  bool NearestNeighborBlock(const double *pos, TOutputComponent *out)
+  {
+    using namespace slicer_simd;
+
+    Vec4d c0[3];
+    int mask = 0xF;
+    for(int d = 0; d < 3; d++)
+      {
+      Vec4d cix = vmin(vmax(load(pos + 4 * d), set1(-2.0)), set1(m_Size[d] + 1.0));
+      c0[d] = vfloor(add(cix, set1(0.5)));
+      mask &= in_range(c0[d], set1(0.0), set1(m_Size[d] - 1.0));
+      }
+
+    double x0[4], y0[4], z0[4];
+    store(x0, c0[0]); store(y0, c0[1]); store(z0, c0[2]);
+
+    for(int j = 0; j < 4; j++, out += m_NumComponents)
+      {
+      if(mask & (1 << j))
+        {
+        const TInputComponent *p = m_Buffer
+            + (std::ptrdiff_t) x0[j] * m_NumComponents
+            + (std::ptrdiff_t) y0[j] * m_StrideY
+            + (std::ptrdiff_t) z0[j] * m_StrideZ;
+        for(int k = 0; k < m_NumComponents; k++)
+          out[k] = static_cast<TOutputComponent>(p[k]);
+        }
+      else
+        {
+        for(int k = 0; k < m_NumComponents; k++)
+          out[k] = 0;
+        }
+      }
+
+    return true;
+  }
+
+protected:
+
+  const TInputComponent *m_Buffer;
+  int m_NumComponents;
+  int m_Size[3];
+  std::ptrdiff_t m_StrideY, m_StrideZ;
+};
+
+#endif // NONORTHOGONALSLICERLINEKERNEL_H
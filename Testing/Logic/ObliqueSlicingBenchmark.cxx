@@ -0,0 +1,139 @@
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+
+#include <itkImage.h>
+#include <itkImageFileReader.h>
+#include <itkTimeProbe.h>
+#include "FastLinearInterpolator.h"
+#include "NonOrthogonalSlicer.h"
+
+typedef itk::Image<short, 3> Image3DType;
+typedef itk::Image<short, 2> Image2DType;
+typedef itk::ImageFileReader<Image3DType> ReaderType;
+typedef NonOrthogonalSlicerPixelAccessTraitsWorker<Image3DType, Image2DType> WorkerType;
+
+// An oblique line through the volume, in voxel coordinates
+struct ObliqueLine
+{
+  double start[3], step[3];
+};
+
+// Generate the lines of a square slice through the center of the volume, tilted
+// by the given angles about the x and y axes
+vector<ObliqueLine> makeSliceLines(const Image3DType::SizeType &size, int n, double ax, double ay)
+{
+  double cx = cos(ax), sx = sin(ax), cy = cos(ay), sy = sin(ay);
+
+  // Rotated in-plane directions
+  double u[3] = { cy, 0.0, -sy };
+  double v[3] = { sx * sy, cx, sx * cy };
+
+  vector<ObliqueLine> lines(n);
+  for(int j = 0; j < n; j++)
+    {
+    double b = j - 0.5 * n;
+    for(int d = 0; d < 3; d++)
+      {
+      lines[j].start[d] = 0.5 * size[d] - 0.5 * n * u[d] + b * v[d];
+      lines[j].step[d] = u[d];
+      }
+    }
+  return lines;
+}
+
+// Sample all lines voxel by voxel, the way the slicer used to
+void sliceVoxelByVoxel(WorkerType &worker, const vector<ObliqueLine> &lines, int n,
+                       bool use_nn, short *out)
+{
+  for(size_t j = 0; j < lines.size(); j++)
+    {
+    double cix[3] = { lines[j].start[0], lines[j].start[1], lines[j].start[2] };
+    for(int i = 0; i < n; i++)
+      {
+      worker.ProcessVoxel(cix, use_nn, &out);
+      for(int d = 0; d < 3; d++)
+        cix[d] += lines[j].step[d];
+      }
+    }
+}
+
+// Sample all lines using the line kernel
+void sliceByLine(WorkerType &worker, const vector<ObliqueLine> &lines, int n,
+                 bool use_nn, short *out)
+{
+  for(size_t j = 0; j < lines.size(); j++)
+    {
+    double cix[3] = { lines[j].start[0], lines[j].start[1], lines[j].start[2] };
+    worker.ProcessLine(cix, lines[j].step, n, use_nn, &out);
+    }
+}
+
+// Compare the per-voxel and line sampling paths, return the number of mismatches
+int runComparison(Image3DType *image, int n, int repeats, bool use_nn)
+{
+  vector<ObliqueLine> lines =
+      makeSliceLines(image->GetLargestPossibleRegion().GetSize(), n, 0.3, 0.5);
+
+  vector<short> outVoxel(n * n), outLine(n * n);
+  WorkerType worker(image);
+
+  itk::TimeProbe tpVoxel, tpLine;
+  for(int r = 0; r < repeats; r++)
+    {
+    tpVoxel.Start();
+    sliceVoxelByVoxel(worker, lines, n, use_nn, &outVoxel[0]);
+    tpVoxel.Stop();
+
+    tpLine.Start();
+    sliceByLine(worker, lines, n, use_nn, &outLine[0]);
+    tpLine.Stop();
+    }
+
+  int mismatch = 0;
+  for(int i = 0; i < n * n; i++)
+    if(outVoxel[i] != outLine[i])
+      mismatch++;
+
+  cout << (use_nn ? "Nearest neighbor" : "Linear") << " oblique slicing ("
+       << slicer_simd::GetInstructionSet() << "): "
+       << "per-voxel " << tpVoxel.GetMean() * 1000 << " ms, "
+       << "line kernel " << tpLine.GetMean() * 1000 << " ms, "
+       << "speedup " << tpVoxel.GetMean() / tpLine.GetMean() << endl;
+
+  if(mismatch)
+    cout << "Per-voxel and line kernel slices differ in " << mismatch << " pixels!" << endl;
+
+  return mismatch;
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc < 2)
+    {
+    cout << "Usage:\n" << argv[0] << " InputImage3D.ext [SliceSize] [Repeats]" << endl;
+    return 1;
+    }
+
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName(argv[1]);
+  reader->Update();
+  Image3DType::Pointer image = reader->GetOutput();
+
+  // By default, the slice covers the diagonal of the volume
+  Image3DType::SizeType size = image->GetLargestPossibleRegion().GetSize();
+  int n = (int) sqrt((double)(size[0] * size[0] + size[1] * size[1] + size[2] * size[2]));
+  if(argc > 2)
+    n = atoi(argv[2]);
+
+  int repeats = argc > 3 ? atoi(argv[3]) : 20;
+
+  int mismatch = 0;
+  mismatch += runComparison(image, n, repeats, false);
+  mismatch += runComparison(image, n, repeats, true);
+
+  return mismatch ? 1 : 0;
+}
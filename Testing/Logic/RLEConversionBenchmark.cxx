@@ -0,0 +1,221 @@
+#include <iostream>
+#include <cstdlib>
+
+using namespace std;
+
+#include <itkImage.h>
+#include <itkImageFileReader.h>
+#include <itkImageRegionConstIterator.h>
+#include <itkMultiThreader.h>
+#include <itkTimeProbe.h>
+#include "RLEImageRegionIterator.h"
+#include "RLERegionOfInterestImageFilter.h"
+#include "RLESegmentationImageIO.h"
+#include "GuidedNativeImageIO.h"
+#include "Registry.h"
+#include <itkVectorImage.h>
+
+typedef itk::Image<short, 3> Seg3DImageType;
+typedef RLEImage<short> ShortRLEImage;
+typedef itk::ImageFileReader<Seg3DImageType> ReaderType;
+typedef itk::RegionOfInterestImageFilter<Seg3DImageType, ShortRLEImage> InConverterType;
+typedef itk::RegionOfInterestImageFilter<ShortRLEImage, Seg3DImageType> OutConverterType;
+
+typedef itk::Image<LabelType, 3> LabelImageType;
+typedef RLESegmentationImageIO::RLEImageType LabelRLEImage;
+typedef itk::VectorImage<LabelType, 3> NativeImageType;
+
+// Result of converting in both directions with a given number of threads
+struct ConversionResult
+{
+  double encode_time, decode_time;
+  Seg3DImageType::Pointer decoded;
+};
+
+// Time the conversion to RLE and back. Both filters split the output region
+// along z, so each thread converts a slab of slices
+ConversionResult runConversion(Seg3DImageType *image, int threads, int repeats)
+{
+  ConversionResult result;
+  itk::TimeProbe tpEncode, tpDecode;
+  for(int r = 0; r < repeats; r++)
+    {
+    InConverterType::Pointer inConv = InConverterType::New();
+    inConv->SetInput(image);
+    inConv->SetRegionOfInterest(image->GetLargestPossibleRegion());
+    if(threads > 0)
+      inConv->SetNumberOfThreads(threads);
+
+    tpEncode.Start();
+    inConv->Update();
+    tpEncode.Stop();
+
+    OutConverterType::Pointer outConv = OutConverterType::New();
+    outConv->SetInput(inConv->GetOutput());
+    outConv->SetRegionOfInterest(inConv->GetOutput()->GetLargestPossibleRegion());
+    if(threads > 0)
+      outConv->SetNumberOfThreads(threads);
+
+    tpDecode.Start();
+    outConv->Update();
+    tpDecode.Stop();
+
+    result.decoded = outConv->GetOutput();
+    }
+
+  result.encode_time = tpEncode.GetMean();
+  result.decode_time = tpDecode.GetMean();
+  return result;
+}
+
+// Count the voxels that differ between two images
+int countMismatches(Seg3DImageType *a, Seg3DImageType *b)
+{
+  int mismatch = 0;
+  itk::ImageRegionConstIterator<Seg3DImageType> itA(a, a->GetBufferedRegion());
+  itk::ImageRegionConstIterator<Seg3DImageType> itB(b, b->GetBufferedRegion());
+  for(; !itA.IsAtEnd(); ++itA, ++itB)
+    if(itA.Get() != itB.Get())
+      mismatch++;
+  return mismatch;
+}
+
+// Result of writing and reading the RLE segmentation format
+struct FileResult
+{
+  double write_time, read_time, expand_time;
+  int mismatch;
+};
+
+// Time the threaded chunk encoding (WriteRLEImage), the threaded chunk
+// decoding (ReadRLEImage) and the expansion of the runs into a voxel buffer
+// by GuidedNativeImageIO (ExpandNativeRLEImage). The chunk threads are
+// created by the IO classes, so the thread count is set globally
+FileResult runFileConversion(LabelImageType *image, LabelRLEImage *rle,
+                             const std::string &fname, int threads, int repeats)
+{
+  int saved_threads = itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+  if(threads > 0)
+    itk::MultiThreader::SetGlobalDefaultNumberOfThreads(threads);
+
+  FileResult result;
+  result.mismatch = 0;
+  itk::TimeProbe tpWrite, tpRead, tpExpand;
+  for(int r = 0; r < repeats; r++)
+    {
+    RLESegmentationImageIO::Pointer writer = RLESegmentationImageIO::New();
+    writer->SetFileName(fname);
+
+    tpWrite.Start();
+    writer->WriteRLEImage(rle);
+    tpWrite.Stop();
+
+    RLESegmentationImageIO::Pointer reader = RLESegmentationImageIO::New();
+    reader->SetFileName(fname);
+
+    tpRead.Start();
+    reader->ReadImageInformation();
+    LabelRLEImage::Pointer rle_read = reader->ReadRLEImage();
+    tpRead.Stop();
+
+    // The native image is replaced by its expansion, so it is read each time
+    SmartPtr<GuidedNativeImageIO> gio = GuidedNativeImageIO::New();
+    Registry reg;
+    GuidedNativeImageIO::SetFileFormat(reg, GuidedNativeImageIO::FORMAT_SNAP_RLE);
+    gio->ReadNativeImage(fname.c_str(), reg);
+
+    tpExpand.Start();
+    gio->ExpandNativeRLEImage();
+    tpExpand.Stop();
+
+    // Check the expanded voxels on the last repeat
+    if(r == repeats - 1)
+      {
+      NativeImageType *native = dynamic_cast<NativeImageType *>(gio->GetNativeImage());
+      if(!native)
+        {
+        result.mismatch = 1;
+        }
+      else
+        {
+        itk::ImageRegionConstIterator<LabelImageType> itA(image, image->GetBufferedRegion());
+        itk::ImageRegionConstIterator<NativeImageType> itB(native, native->GetBufferedRegion());
+        for(; !itA.IsAtEnd(); ++itA, ++itB)
+          if(itA.Get() != itB.Get()[0])
+            result.mismatch++;
+        }
+      }
+    }
+
+  itk::MultiThreader::SetGlobalDefaultNumberOfThreads(saved_threads);
+
+  result.write_time = tpWrite.GetMean();
+  result.read_time = tpRead.GetMean();
+  result.expand_time = tpExpand.GetMean();
+  return result;
+}
+
+void printSpeed(const char *name, double nvox, double serial, double threaded)
+{
+  cout << name << ": "
+       << "1 thread " << nvox / serial << " voxels/s, "
+       << itk::MultiThreader::GetGlobalDefaultNumberOfThreads() << " threads "
+       << nvox / threaded << " voxels/s, "
+       << "speedup " << serial / threaded << endl;
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc < 2)
+    {
+    cout << "Usage:\n" << argv[0] << " Segmentation3D.ext [Repeats] [Temporary.rle]" << endl;
+    return 1;
+    }
+
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName(argv[1]);
+  reader->Update();
+  Seg3DImageType::Pointer image = reader->GetOutput();
+
+  int repeats = argc > 2 ? atoi(argv[2]) : 10;
+  double nvox = (double) image->GetBufferedRegion().GetNumberOfPixels();
+
+  ConversionResult serial = runConversion(image, 1, repeats);
+  ConversionResult threaded = runConversion(image, 0, repeats);
+
+  printSpeed("itk->RLE conversion", nvox, serial.encode_time, threaded.encode_time);
+  printSpeed("RLE->itk conversion", nvox, serial.decode_time, threaded.decode_time);
+
+  int mismatch = countMismatches(image, serial.decoded)
+      + countMismatches(image, threaded.decoded);
+  if(mismatch)
+    cout << "Round trip through RLE changes " << mismatch << " voxels!" << endl;
+
+  // The RLE segmentation format stores labels
+  typedef itk::ImageFileReader<LabelImageType> LabelReaderType;
+  LabelReaderType::Pointer labelReader = LabelReaderType::New();
+  labelReader->SetFileName(argv[1]);
+  labelReader->Update();
+  LabelImageType::Pointer labels = labelReader->GetOutput();
+
+  typedef itk::RegionOfInterestImageFilter<LabelImageType, LabelRLEImage> LabelConverterType;
+  LabelConverterType::Pointer labelConv = LabelConverterType::New();
+  labelConv->SetInput(labels);
+  labelConv->SetRegionOfInterest(labels->GetLargestPossibleRegion());
+  labelConv->Update();
+
+  std::string fname = argc > 3 ? argv[3] : "RLEConversionBenchmark.rle";
+  FileResult fserial = runFileConversion(labels, labelConv->GetOutput(), fname, 1, repeats);
+  FileResult fthreaded = runFileConversion(labels, labelConv->GetOutput(), fname, 0, repeats);
+
+  printSpeed(".rle chunk encoding", nvox, fserial.write_time, fthreaded.write_time);
+  printSpeed(".rle chunk decoding", nvox, fserial.read_time, fthreaded.read_time);
+  printSpeed("ExpandNativeRLEImage", nvox, fserial.expand_time, fthreaded.expand_time);
+
+  int fmismatch = fserial.mismatch + fthreaded.mismatch;
+  if(fmismatch)
+    cout << "Round trip through the .rle format changes " << fmismatch << " voxels!" << endl;
+  mismatch += fmismatch;
+
+  return mismatch ? 1 : 0;
+}
@@ -0,0 +1,366 @@
+#include "RLESegmentationImageIO.h"
+#include "GuidedNativeImageIO.h"
+#include "Registry.h"
+#include <itkImage.h>
+#include <itkVectorImage.h>
+#include <itkImageFileReader.h>
+#include <itkImageRegionConstIteratorWithIndex.h>
+#include <itkImageRegionIteratorWithIndex.h>
+#include <itksys/SystemTools.hxx>
+#include <iostream>
+#include <cstdio>
+#include <cmath>
+#include <vector>
+
+using namespace std;
+
+typedef itk::Image<LabelType, 3> LabelImageType;
+typedef itk::VectorImage<LabelType, 3> NativeImageType;
+typedef RLESegmentationImageIO::RLEImageType RLEImageType;
+
+// Label patterns used to fill the test volumes
+enum TestPattern { PATTERN_EMPTY, PATTERN_SINGLE_RUN, PATTERN_MIXED };
+
+LabelType patternValue(TestPattern pattern, long x, long y, long z)
+{
+  switch(pattern)
+    {
+    case PATTERN_EMPTY:
+      return 0;
+    case PATTERN_SINGLE_RUN:
+      // Every line is a single run, with a different label on each line
+      return (LabelType) ((7 * y + 3 * z + 1000) % 11);
+    default:
+      // Runs of varying length, including the largest label
+      if(x == y)
+        return 65535;
+      return ((x / 3 + y + 2 * z) % 4 == 0) ? (LabelType) ((x + y + 1000) % 6) : 0;
+    }
+}
+
+// Create a label image whose region starts at the given index
+LabelImageType::Pointer createImage(TestPattern pattern,
+                                    const LabelImageType::IndexType &start,
+                                    const LabelImageType::SizeType &size)
+{
+  LabelImageType::Pointer image = LabelImageType::New();
+  image->SetRegions(LabelImageType::RegionType(start, size));
+
+  LabelImageType::SpacingType spacing;
+  LabelImageType::PointType origin;
+  for(int i = 0; i < 3; i++)
+    {
+    spacing[i] = 0.5 * (i + 1);
+    origin[i] = 10.0 - 15.0 * i;
+    }
+
+  // Rotation by 90 degrees about z
+  LabelImageType::DirectionType dir;
+  dir.Fill(0.0);
+  dir(0, 1) = -1.0; dir(1, 0) = 1.0; dir(2, 2) = 1.0;
+
+  image->SetSpacing(spacing);
+  image->SetOrigin(origin);
+  image->SetDirection(dir);
+  image->Allocate();
+
+  itk::ImageRegionIteratorWithIndex<LabelImageType> it(image, image->GetBufferedRegion());
+  for(; !it.IsAtEnd(); ++it)
+    {
+    LabelImageType::IndexType idx = it.GetIndex();
+    it.Set(patternValue(pattern, idx[0], idx[1], idx[2]));
+    }
+  return image;
+}
+
+// Encode an image into an RLE image with the same region and geometry
+RLEImageType::Pointer createRLEImage(LabelImageType *image)
+{
+  RLEImageType::Pointer rle = RLEImageType::New();
+  rle->CopyInformation(image);
+  rle->SetRegions(image->GetBufferedRegion());
+  rle->Allocate();
+
+  LabelImageType::RegionType region = image->GetBufferedRegion();
+  LabelImageType::IndexType idx = region.GetIndex();
+  for(idx[2] = region.GetIndex(2); idx[2] < region.GetUpperIndex()[2] + 1; idx[2]++)
+    {
+    for(idx[1] = region.GetIndex(1); idx[1] < region.GetUpperIndex()[1] + 1; idx[1]++)
+      {
+      // Lines are addressed by their absolute (y,z) index
+      RLEImageType::RLLine &line = rle->GetBuffer()->GetPixel(RLEImageType::truncateIndex(idx));
+      line.clear();
+      for(idx[0] = region.GetIndex(0); idx[0] < region.GetUpperIndex()[0] + 1; idx[0]++)
+        RLEImageType::AppendRun(line, 1, image->GetPixel(idx));
+      }
+    }
+
+  rle->Modified();
+  return rle;
+}
+
+// Check that an image read from a file has the geometry of the image written,
+// which is stored relative to the first voxel
+int checkGeometry(const char *path, LabelImageType *image, itk::ImageBase<3> *read)
+{
+  LabelImageType::RegionType region = image->GetBufferedRegion();
+  LabelImageType::PointType start;
+  image->TransformIndexToPhysicalPoint(region.GetIndex(), start);
+
+  bool ok = read->GetBufferedRegion().GetSize() == region.GetSize();
+  for(int i = 0; i < 3; i++)
+    {
+    ok = ok && read->GetBufferedRegion().GetIndex(i) == 0;
+    ok = ok && fabs(read->GetOrigin()[i] - start[i]) < 1e-6;
+    ok = ok && fabs(read->GetSpacing()[i] - image->GetSpacing()[i]) < 1e-6;
+    for(int j = 0; j < 3; j++)
+      ok = ok && fabs(read->GetDirection()(i, j) - image->GetDirection()(i, j)) < 1e-6;
+    }
+
+  if(!ok)
+    cout << "  " << path << ": geometry does not match the image written" << endl;
+  return ok ? 0 : 1;
+}
+
+// Compare the voxels of an image with those read back, using an accessor
+// for the image type read
+template <class TReadImage, class TGetter>
+int countMismatches(LabelImageType *image, TReadImage *read, TGetter get)
+{
+  LabelImageType::RegionType region = image->GetBufferedRegion();
+  int mismatch = 0;
+  itk::ImageRegionConstIteratorWithIndex<LabelImageType> it(image, region);
+  for(; !it.IsAtEnd(); ++it)
+    {
+    typename TReadImage::IndexType ridx;
+    for(int i = 0; i < 3; i++)
+      ridx[i] = it.GetIndex()[i] - region.GetIndex(i);
+    if(get(read, ridx) != it.Get())
+      mismatch++;
+    }
+  return mismatch;
+}
+
+LabelType getRLE(RLEImageType *image, const RLEImageType::IndexType &idx)
+{
+  return image->GetPixel(idx);
+}
+
+LabelType getLabel(LabelImageType *image, const LabelImageType::IndexType &idx)
+{
+  return image->GetPixel(idx);
+}
+
+LabelType getNative(NativeImageType *image, const NativeImageType::IndexType &idx)
+{
+  return image->GetPixel(idx)[0];
+}
+
+// Write an image in the RLE format and read it back through each of the
+// read paths: the runs directly, the expansion of the native RLE image by
+// GuidedNativeImageIO, and the uncompressed buffer of a regular ITK reader
+int testRoundTrip(const char *name, LabelImageType *image, const string &fname)
+{
+  cout << name << ": " << flush;
+  int failed = 0;
+
+  RLEImageType::Pointer rle = createRLEImage(image);
+  RLESegmentationImageIO::Pointer writer = RLESegmentationImageIO::New();
+  writer->SetFileName(fname);
+  writer->WriteRLEImage(rle);
+
+  // Runs read directly
+  RLESegmentationImageIO::Pointer rio = RLESegmentationImageIO::New();
+  rio->SetFileName(fname);
+  rio->ReadImageInformation();
+  RLEImageType::Pointer rle_read = rio->ReadRLEImage();
+  failed += checkGeometry("ReadRLEImage", image, rle_read);
+  int mismatch = countMismatches(image, rle_read.GetPointer(), &getRLE);
+
+  // Native RLE image expanded by GuidedNativeImageIO
+  SmartPtr<GuidedNativeImageIO> gio = GuidedNativeImageIO::New();
+  Registry reg;
+  GuidedNativeImageIO::SetFileFormat(reg, GuidedNativeImageIO::FORMAT_SNAP_RLE);
+  gio->ReadNativeImage(fname.c_str(), reg);
+  if(!gio->GetNativeRLEImage())
+    {
+    cout << "  GuidedNativeImageIO did not read the runs directly" << endl;
+    failed++;
+    }
+  gio->ExpandNativeRLEImage();
+  NativeImageType *native = dynamic_cast<NativeImageType *>(gio->GetNativeImage());
+  if(native)
+    {
+    failed += checkGeometry("ExpandNativeRLEImage", image, native);
+    mismatch += countMismatches(image, native, &getNative);
+    }
+  else
+    {
+    cout << "  ExpandNativeRLEImage did not produce a vector image" << endl;
+    failed++;
+    }
+
+  // Uncompressed buffer read by ITK
+  typedef itk::ImageFileReader<LabelImageType> ReaderType;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetImageIO(RLESegmentationImageIO::New());
+  reader->SetFileName(fname);
+  reader->Update();
+  failed += checkGeometry("ImageFileReader", image, reader->GetOutput());
+  mismatch += countMismatches(image, reader->GetOutput(), &getLabel);
+
+  if(mismatch)
+    cout << "  Round trip changes " << mismatch << " voxels" << endl;
+
+  failed += mismatch ? 1 : 0;
+  cout << (failed ? "FAILED" : "passed") << endl;
+  return failed;
+}
+
+bool readFile(const string &fname, vector<char> &data)
+{
+  FILE *f = fopen(fname.c_str(), "rb");
+  if(!f)
+    return false;
+  fseek(f, 0, SEEK_END);
+  data.resize(ftell(f));
+  fseek(f, 0, SEEK_SET);
+  bool ok = fread(&data[0], 1, data.size(), f) == data.size();
+  fclose(f);
+  return ok;
+}
+
+bool writeFile(const string &fname, const vector<char> &data, size_t n_bytes)
+{
+  FILE *f = fopen(fname.c_str(), "wb");
+  if(!f)
+    return false;
+  bool ok = fwrite(&data[0], 1, n_bytes, f) == n_bytes;
+  return (fclose(f) == 0) && ok;
+}
+
+// Every read path must throw on a damaged file, rather than return an image
+int expectReadFailure(const char *name, const string &fname)
+{
+  cout << name << ": " << flush;
+  int accepted = 0;
+
+  try
+    {
+    RLESegmentationImageIO::Pointer rio = RLESegmentationImageIO::New();
+    rio->SetFileName(fname);
+    rio->ReadImageInformation();
+    rio->ReadRLEImage();
+    cout << "  ReadRLEImage accepted the file" << endl;
+    accepted++;
+    }
+  catch(itk::ExceptionObject &) {}
+
+  try
+    {
+    SmartPtr<GuidedNativeImageIO> gio = GuidedNativeImageIO::New();
+    Registry reg;
+    GuidedNativeImageIO::SetFileFormat(reg, GuidedNativeImageIO::FORMAT_SNAP_RLE);
+    gio->ReadNativeImage(fname.c_str(), reg);
+    gio->ExpandNativeRLEImage();
+    cout << "  GuidedNativeImageIO accepted the file" << endl;
+    accepted++;
+    }
+  catch(std::exception &) {}
+
+  try
+    {
+    typedef itk::ImageFileReader<LabelImageType> ReaderType;
+    ReaderType::Pointer reader = ReaderType::New();
+    reader->SetImageIO(RLESegmentationImageIO::New());
+    reader->SetFileName(fname);
+    reader->Update();
+    cout << "  ImageFileReader accepted the file" << endl;
+    accepted++;
+    }
+  catch(itk::ExceptionObject &) {}
+
+  cout << (accepted ? "FAILED" : "passed") << endl;
+  return accepted;
+}
+
+int testDamagedFiles(LabelImageType *image, const string &dir)
+{
+  string fname = dir + "/rle_valid.rle";
+  RLEImageType::Pointer rle = createRLEImage(image);
+  RLESegmentationImageIO::Pointer writer = RLESegmentationImageIO::New();
+  writer->SetFileName(fname);
+  writer->WriteRLEImage(rle);
+
+  vector<char> data;
+  if(!readFile(fname, data))
+    {
+    cout << "Unable to read back " << fname << endl;
+    return 1;
+    }
+
+  int failed = 0;
+
+  // The last chunk ends early
+  string fn_trunc = dir + "/rle_truncated_chunk.rle";
+  writeFile(fn_trunc, data, data.size() - 16);
+  failed += expectReadFailure("Truncated chunk", fn_trunc);
+
+  // The file ends inside the header
+  string fn_header = dir + "/rle_truncated_header.rle";
+  writeFile(fn_header, data, 100);
+  failed += expectReadFailure("Truncated header", fn_header);
+
+  // The zlib stream of a chunk ends with the checksum of its data, so
+  // flipping its last bytes makes the chunk fail to decompress
+  vector<char> corrupt = data;
+  for(size_t i = corrupt.size() - 4; i < corrupt.size(); i++)
+    corrupt[i] = (char) ~corrupt[i];
+  string fn_corrupt = dir + "/rle_corrupt_chunk.rle";
+  writeFile(fn_corrupt, corrupt, corrupt.size());
+  failed += expectReadFailure("Corrupt chunk", fn_corrupt);
+
+  return failed;
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc < 2)
+    {
+    cout << "Usage:\n" << argv[0] << " TemporaryDirectory" << endl;
+    return 1;
+    }
+
+  string dir = argv[1];
+  itksys::SystemTools::MakeDirectory(dir.c_str());
+
+  LabelImageType::IndexType zero = {{ 0, 0, 0 }};
+  LabelImageType::IndexType offset = {{ -4, 7, 3 }};
+
+  // The sizes along z are not multiples of the number of slices in a chunk
+  LabelImageType::SizeType sz_empty = {{ 13, 11, 9 }};
+  LabelImageType::SizeType sz_single = {{ 17, 5, 19 }};
+  LabelImageType::SizeType sz_mixed = {{ 23, 9, 12 }};
+
+  int failed = 0;
+  try
+    {
+    failed += testRoundTrip("Empty label volume",
+                            createImage(PATTERN_EMPTY, zero, sz_empty),
+                            dir + "/rle_empty.rle");
+    failed += testRoundTrip("Single run per line",
+                            createImage(PATTERN_SINGLE_RUN, zero, sz_single),
+                            dir + "/rle_single_run.rle");
+    failed += testRoundTrip("Region with non-zero index",
+                            createImage(PATTERN_MIXED, offset, sz_mixed),
+                            dir + "/rle_offset.rle");
+    failed += testDamagedFiles(createImage(PATTERN_MIXED, zero, sz_mixed), dir);
+    }
+  catch(std::exception &exc)
+    {
+    cout << "Exception: " << exc.what() << endl;
+    return 1;
+    }
+
+  return failed ? 1 : 0;
+}
@@ -160,11 +160,13 @@ Seg2DImageType::Pointer cropIRIS(Seg3DImageType::Pointer image)
     return roi->GetOutput();
 }
 
-Seg2DImageType::Pointer cropRLEiris(RLEImage3D::Pointer image)
+Seg2DImageType::Pointer cropRLEiris(RLEImage3D::Pointer image, int numberOfThreads = 0)
 {
     typedef IRISSlicer<RLEImage3D, Seg2DImageType, RLEImage3D> roiType;
     roiType::Pointer roi = roiType::New();
     roi->SetInput(image);
+    if (numberOfThreads > 0)
+        roi->SetNumberOfThreads(numberOfThreads);
     roi->SetSliceIndex(sliceIndex);
     roi->SetSliceDirectionImageAxis(axis);
     if (axis == 0) //x
@@ -280,6 +282,16 @@ int main(int argc, char *argv[])
         getchar();
     }
 
+    //reference result and timing of the single-threaded RLE slicing path
+    Seg2DImageType::Pointer singleThreaded2D;
+    itk::TimeProbe tpSingle;
+    if (irisRLE)
+    {
+        tpSingle.Start();
+        singleThreaded2D = cropRLEiris(rleImage, 1);
+        tpSingle.Stop();
+    }
+
     itk::TimeProbe tp;
     tp.Start();
     if (rle)
@@ -307,6 +319,25 @@ int main(int argc, char *argv[])
 
     cout << " slicing took: " << tp.GetMean() * 1000 << " ms " << endl;
 
+    if (irisRLE)
+    {
+        cout << "Single-threaded irisRLE slicing took: " << tpSingle.GetMean() * 1000 << " ms " << endl;
+        cout << "Multi-threaded speedup: " << tpSingle.GetMean() / tp.GetMean() << endl;
+
+        //both paths must produce identical slices
+        typedef itk::Testing::ComparisonImageFilter<Seg2DImageType, Seg2DImageType> cmpType;
+        cmpType::Pointer cmp = cmpType::New();
+        cmp->SetValidInput(singleThreaded2D);
+        cmp->SetTestInput(cropped2D);
+        cmp->Update();
+        if (cmp->GetNumberOfPixelsWithDifferences() > 0)
+        {
+            cout << "Single- and multi-threaded slices differ in "
+                 << cmp->GetNumberOfPixelsWithDifferences() << " pixels!" << endl;
+            return 1;
+        }
+    }
+
 
     if (!iris && !rli && !irisRLE)
     {
@@ -0,0 +1,159 @@
+#include "SNAPCommon.h"
+#include "UndoDataManager.h"
+#include <itksys/SystemTools.hxx>
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+
+using namespace std;
+
+typedef UndoDataManager<LabelType> ManagerType;
+typedef ManagerType::Delta DeltaType;
+
+// Undo manager whose spill files can be made read-only, so that spilling
+// more commits to them fails
+class FailingSpillUndoDataManager : public ManagerType
+{
+public:
+  FailingSpillUndoDataManager(const string &dir)
+    : ManagerType(1, 1, 1 << 20), m_Directory(dir), m_File(NULL), m_Count(0) {}
+
+  // Reopen the current spill file for reading only. The commits already
+  // spilled to it can still be restored
+  bool BreakSpillFile()
+  {
+    return m_File && freopen(m_FileName.c_str(), "rb", m_File) != NULL;
+  }
+
+protected:
+  virtual FILE *CreateSpillFile()
+  {
+    ostringstream oss;
+    oss << m_Directory << "/undo_spill_" << m_Count++ << ".dat";
+    m_FileName = oss.str();
+    m_File = fopen(m_FileName.c_str(), "w+b");
+    return m_File;
+  }
+
+  string m_Directory, m_FileName;
+  FILE *m_File;
+  int m_Count;
+};
+
+// Commit a delta whose runs all hold the given value. The runs are long
+// enough for the encoded data to exceed the memory budget of the manager
+void commitValue(ManagerType &undo, LabelType value)
+{
+  DeltaType *delta = new DeltaType();
+  delta->SetRegion(itk::ImageRegion<3>());
+  for(int i = 0; i < 16; i++)
+    {
+    delta->Encode(value, 10 + i);
+    delta->Encode(0, 1);
+    }
+  delta->FinishEncoding();
+  undo.AddDeltaToStaging(delta);
+  undo.CommitStaging("test");
+}
+
+// Get the value stored in the first run of a commit
+LabelType getCommitValue(const ManagerType::Commit &commit)
+{
+  DeltaType::RLEIterator it(commit.GetDeltas().front());
+  return it.GetValue();
+}
+
+// Undo every commit, checking that their values count down from first
+int testUndoSequence(ManagerType &undo, LabelType first, LabelType last)
+{
+  for(LabelType value = first; value >= last; value--)
+    {
+    if(!undo.IsUndoPossible())
+      {
+      cout << "  Cannot undo commit " << value << endl;
+      return 1;
+      }
+    LabelType found = getCommitValue(undo.GetCommitForUndo());
+    if(found != value)
+      {
+      cout << "  Undo returned commit " << found << " instead of " << value << endl;
+      return 1;
+      }
+    }
+
+  if(undo.IsUndoPossible())
+    {
+    cout << "  Undo goes past commit " << last << endl;
+    return 1;
+    }
+
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc < 2)
+    {
+    cout << "Usage:\n" << argv[0] << " TemporaryDirectory" << endl;
+    return 1;
+    }
+
+  string dir = argv[1];
+  itksys::SystemTools::MakeDirectory(dir.c_str());
+
+  int failed = 0;
+  try
+    {
+    FailingSpillUndoDataManager undo(dir);
+
+    // Only the newest commits are kept in memory, the others are spilled
+    for(LabelType value = 1; value <= 4; value++)
+      commitValue(undo, value);
+
+    cout << "Undo through spilled commits" << endl;
+    if(undo.GetNumberOfSpilledCommits() != 2)
+      {
+      cout << "  Expected 2 spilled commits, found "
+           << undo.GetNumberOfSpilledCommits() << endl;
+      failed++;
+      }
+    failed += testUndoSequence(undo, 4, 1);
+
+    // Redo everything, so that the next commit evicts another one
+    while(undo.IsRedoPossible())
+      undo.GetCommitForRedo();
+
+    // Commit 3 cannot be spilled, so it is lost, and so are commits 1 and
+    // 2, which could otherwise be undone after commit 4, skipping 3
+    cout << "Undo after failing to spill a commit" << endl;
+    if(!undo.BreakSpillFile())
+      {
+      cout << "  Could not reopen the spill file" << endl;
+      return 1;
+      }
+    commitValue(undo, 5);
+
+    if(undo.GetNumberOfSpilledCommits() != 0 || undo.GetNumberOfCommits() != 2)
+      {
+      cout << "  Expected 2 commits in memory, found " << undo.GetNumberOfCommits()
+           << " commits, " << undo.GetNumberOfSpilledCommits() << " spilled" << endl;
+      failed++;
+      }
+    failed += testUndoSequence(undo, 5, 4);
+
+    // Spilling works again with a new file
+    cout << "Spill after a failure" << endl;
+    while(undo.IsRedoPossible())
+      undo.GetCommitForRedo();
+    commitValue(undo, 6);
+    commitValue(undo, 7);
+    failed += testUndoSequence(undo, 7, 4);
+    }
+  catch(std::exception &exc)
+    {
+    cout << "Exception: " << exc.what() << endl;
+    return 1;
+    }
+
+  return failed ? 1 : 0;
+}
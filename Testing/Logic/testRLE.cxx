@@ -57,8 +57,8 @@ inline char axisToLetter(unsigned axis)
         return '?';
 }
 
-//invokes IRISSlicer<itk> and IRISSlicer<rle> and compares results
-void testIRISSlicer(shortRLEImage::Pointer rleImage, Seg3DImageType::Pointer itkImage,
+//invokes IRISSlicer<itk> and IRISSlicer<rle>, returns the number of differences
+unsigned long testIRISSlicer(shortRLEImage::Pointer rleImage, Seg3DImageType::Pointer itkImage,
     unsigned sliceIndex, unsigned sliceAxis, unsigned lineAxis, unsigned pixelAxis,
     bool lineForward, bool pixelForward)
 {
@@ -104,16 +104,91 @@ void testIRISSlicer(shortRLEImage::Pointer rleImage, Seg3DImageType::Pointer itk
     diff->UpdateLargestPossibleRegion();
     std::cout << "Number of pixels with difference: " << 
         diff->GetNumberOfPixelsWithDifferences() << std::endl << std::endl;
+    return diff->GetNumberOfPixelsWithDifferences();
 }
 
 //test all 4 combinations of bool parameters (lineForward and pixelForward)
-void test4bools(shortRLEImage::Pointer rleImage, Seg3DImageType::Pointer itkImage,
+unsigned long test4bools(shortRLEImage::Pointer rleImage, Seg3DImageType::Pointer itkImage,
     unsigned sliceIndex, unsigned sliceAxis, unsigned lineAxis, unsigned pixelAxis)
 {
-    testIRISSlicer(rleImage, itkImage, sliceIndex, sliceAxis, lineAxis, pixelAxis, true, true);
-    testIRISSlicer(rleImage, itkImage, sliceIndex, sliceAxis, lineAxis, pixelAxis, true, false);
-    testIRISSlicer(rleImage, itkImage, sliceIndex, sliceAxis, lineAxis, pixelAxis, false, true);
-    testIRISSlicer(rleImage, itkImage, sliceIndex, sliceAxis, lineAxis, pixelAxis, false, false);
+    return testIRISSlicer(rleImage, itkImage, sliceIndex, sliceAxis, lineAxis, pixelAxis, true, true)
+        + testIRISSlicer(rleImage, itkImage, sliceIndex, sliceAxis, lineAxis, pixelAxis, true, false)
+        + testIRISSlicer(rleImage, itkImage, sliceIndex, sliceAxis, lineAxis, pixelAxis, false, true)
+        + testIRISSlicer(rleImage, itkImage, sliceIndex, sliceAxis, lineAxis, pixelAxis, false, false);
+}
+
+//random access through GetPixel, with and without the per-line skip index,
+//returns the number of mismatches
+unsigned long benchmarkLineIndex(shortRLEImage::Pointer rleImage, Seg3DImageType::Pointer itkImage,
+    unsigned count = 1000000)
+{
+    itk::TimeProbe tp;
+    shortRLEImage::RegionType reg = rleImage->GetLargestPossibleRegion();
+    std::vector<shortRLEImage::IndexType> indices(count);
+    srand(0);
+    for (unsigned i = 0; i < count; i++)
+        for (unsigned d = 0; d < 3; d++)
+            indices[i][d] = reg.GetIndex(d) + rand() % reg.GetSize(d);
+
+    long sumLinear = 0, sumIndexed = 0;
+
+    std::cout << "GetPixel, linear scan: "; tp.Start();
+    rleImage->SetUseLineIndex(false);
+    for (unsigned i = 0; i < count; i++)
+        sumLinear += rleImage->GetPixel(indices[i]);
+    tp.Stop(); std::cout << tp.GetMean() * 1000 << " ms " << std::endl; tp.Reset();
+
+    std::cout << "Building skip index: "; tp.Start();
+    rleImage->SetUseLineIndex(true);
+    rleImage->UpdateLineIndex();
+    tp.Stop(); std::cout << tp.GetMean() * 1000 << " ms " << std::endl; tp.Reset();
+
+    std::cout << "GetPixel, skip index: "; tp.Start();
+    for (unsigned i = 0; i < count; i++)
+        sumIndexed += rleImage->GetPixel(indices[i]);
+    tp.Stop(); std::cout << tp.GetMean() * 1000 << " ms " << std::endl; tp.Reset();
+
+    unsigned mismatches = 0;
+    for (unsigned i = 0; i < count; i += 97)
+        if (rleImage->GetPixel(indices[i]) != itkImage->GetPixel(indices[i]))
+            mismatches++;
+    std::cout << "Checksums (linear/indexed): " << sumLinear << '/' << sumIndexed
+        << ".  Mismatches against itk image: " << mismatches << std::endl << std::endl;
+    if (sumLinear != sumIndexed)
+        mismatches++;
+    return mismatches;
+}
+
+//converts to 8-bit counters, which splits runs longer than 255, and compares,
+//returns the number of differences
+unsigned long testCounterConversion(shortRLEImage::Pointer rleImage, Seg3DImageType::Pointer itkImage)
+{
+    typedef RLEImage<short, 3, unsigned char> narrowRLEImage;
+    itk::TimeProbe tp;
+
+    std::cout << "Conversion to 8-bit counters: "; tp.Start();
+    narrowRLEImage::Pointer narrow = narrowRLEImage::New();
+    ConvertRLEImageCounterType(rleImage.GetPointer(), narrow.GetPointer());
+    tp.Stop(); std::cout << tp.GetMean() * 1000 << " ms " << std::endl; tp.Reset();
+
+    std::cout << "Segments (16-bit/8-bit counters): "
+        << rleImage->GetNumberOfSegments() << '/'
+        << narrow->GetNumberOfSegments() << std::endl;
+
+    typedef itk::RegionOfInterestImageFilter<narrowRLEImage, Seg3DImageType> outConverterType;
+    outConverterType::Pointer outConv = outConverterType::New();
+    outConv->SetInput(narrow);
+    outConv->SetRegionOfInterest(narrow->GetLargestPossibleRegion());
+    outConv->Update();
+
+    typedef itk::Testing::ComparisonImageFilter< Seg3DImageType, Seg3DImageType > DiffType;
+    DiffType::Pointer diff = DiffType::New();
+    diff->SetValidInput(itkImage);
+    diff->SetTestInput(outConv->GetOutput());
+    diff->UpdateLargestPossibleRegion();
+    std::cout << "Number of pixels with difference: " <<
+        diff->GetNumberOfPixelsWithDifferences() << std::endl << std::endl;
+    return diff->GetNumberOfPixelsWithDifferences();
 }
 
 int main(int argc, char* argv[])
@@ -133,13 +208,18 @@ int main(int argc, char* argv[])
     test = inConv->GetOutput();
     tp.Stop(); std::cout << tp.GetMean() * 1000 << " ms " << std::endl; tp.Reset();
 
+    unsigned long failures = 0;
+    failures += benchmarkLineIndex(test, inImage);
+    failures += testCounterConversion(test, inImage);
+
     //Test all 6 permutations of axes
-    test4bools(test, inImage, inImage->GetBufferedRegion().GetSize(2) / 2, 2, 1, 0);
-    test4bools(test, inImage, inImage->GetBufferedRegion().GetSize(2) / 2, 2, 0, 1);
-    test4bools(test, inImage, inImage->GetBufferedRegion().GetSize(1) / 2, 1, 2, 0);
-    test4bools(test, inImage, inImage->GetBufferedRegion().GetSize(1) / 2, 1, 0, 2);
-    test4bools(test, inImage, inImage->GetBufferedRegion().GetSize(0) / 2, 0, 2, 1);
-    test4bools(test, inImage, inImage->GetBufferedRegion().GetSize(0) / 2, 0, 1, 2);
-    std::cout << "All tests finished!";
+    failures += test4bools(test, inImage, inImage->GetBufferedRegion().GetSize(2) / 2, 2, 1, 0);
+    failures += test4bools(test, inImage, inImage->GetBufferedRegion().GetSize(2) / 2, 2, 0, 1);
+    failures += test4bools(test, inImage, inImage->GetBufferedRegion().GetSize(1) / 2, 1, 2, 0);
+    failures += test4bools(test, inImage, inImage->GetBufferedRegion().GetSize(1) / 2, 1, 0, 2);
+    failures += test4bools(test, inImage, inImage->GetBufferedRegion().GetSize(0) / 2, 0, 2, 1);
+    failures += test4bools(test, inImage, inImage->GetBufferedRegion().GetSize(0) / 2, 0, 1, 2);
+    std::cout << "All tests finished! Mismatches: " << failures << std::endl;
     getchar();
+    return failures ? 1 : 0;
 }